@@ -98,6 +98,7 @@ find_package(FlatBuffers REQUIRED)
 find_package(fmt REQUIRED)
 find_package(hiredis REQUIRED)
 find_package(nng REQUIRED)
+find_package(OpenSSL REQUIRED)
 find_package(Protobuf 3.20.0 REQUIRED)
 find_package(RapidJSON REQUIRED)
 find_package(readerwriterqueue REQUIRED)
@@ -192,6 +193,7 @@ target_link_libraries(faabric_common_dependencies INTERFACE
     flatbuffers::flatbuffers
     hiredis::hiredis
     nng::nng
+    OpenSSL::Crypto
     protobuf::libprotobuf
     RapidJSON::RapidJSON
     readerwriterqueue::readerwriterqueue
@@ -11,5 +11,6 @@ enum FunctionCalls
     PendingMigrations = 5,
     DirectResult = 6,
     NdpDeltaRequest = 7,
+    FunctionUpdated = 8,
 };
 }
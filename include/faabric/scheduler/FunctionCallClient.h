@@ -29,6 +29,8 @@ getPendingMigrationsRequests();
 std::vector<std::pair<std::string, faabric::UnregisterRequest>>
 getUnregisterRequests();
 
+std::vector<std::pair<std::string, faabric::Message>> getFunctionUpdatedCalls();
+
 void queueResourceResponse(const std::string& host,
                            faabric::HostResources& res);
 
@@ -54,6 +56,11 @@ class FunctionCallClient : public faabric::transport::MessageEndpointClient
 
     void unregister(faabric::UnregisterRequest& req);
 
+    void sendFunctionUpdated(const faabric::Message& msg);
+
     faabric::NdpDelta requestNdpDelta(int msgId);
+
+  protected:
+    bool isPriorityCall(int header) override;
 };
 }
@@ -42,6 +42,8 @@ class FunctionCallServer final
 
     void recvUnregister(std::span<const uint8_t> buffer);
 
+    void recvFunctionUpdated(std::span<const uint8_t> buffer);
+
     void recvDirectResult(std::span<const uint8_t> buffer);
 };
 }
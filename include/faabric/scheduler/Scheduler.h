@@ -15,6 +15,7 @@
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
 #include <faabric/util/memory.h>
+#include <faabric/util/memory_pressure.h>
 #include <faabric/util/queue.h>
 #include <faabric/util/scheduling.h>
 #include <faabric/util/snapshot.h>
@@ -25,15 +26,22 @@
 #include <cstdint>
 #include <functional>
 #include <future>
+#include <map>
 #include <optional>
 #include <semaphore>
 #include <shared_mutex>
+#include <unordered_set>
 
 #define AVAILABLE_HOST_SET "available_hosts"
 #define MIGRATED_FUNCTION_RETURN_VALUE -99
 #define AVAILABLE_STORAGE_HOST_SET "available_storage_hosts"
 #define ALL_STORAGE_HOST_SET "all_storage_hosts"
 
+// Weight of the latest interval in each function's arrival rate estimate
+#define PREWARM_RATE_WEIGHT 0.5
+// Functions expecting fewer arrivals per interval than this aren't pre-warmed
+#define PREWARM_MIN_ARRIVALS 0.5
+
 namespace faabric::scheduler {
 
 typedef std::pair<std::shared_ptr<BatchExecuteRequest>,
@@ -100,6 +108,27 @@ class Executor
 
     void releaseClaim();
 
+    bool isClaimed() { return claimed.load(); }
+
+    // Starts the first pool thread, which initialises the executor for its
+    // bound message, so that the first task executed doesn't wait for it
+    void prewarm();
+
+    /**
+     * Initialises the executor for its bound message. With zygote snapshots
+     * enabled, the function's zygote is mapped copy-on-write if there is one
+     * for the current version of the function, otherwise the executor is reset
+     * and its memory captured as the zygote. Returns whether the executor was
+     * initialised from a zygote.
+     */
+    bool initialise();
+
+    // Identifies the function's binary, so that zygotes taken from older
+    // binaries aren't used. The default is the same for every binary, so
+    // executors that don't override it rely on the scheduler being told of
+    // updates with broadcastFunctionUpdated, or on a flush.
+    virtual std::string getZygoteVersion();
+
     std::shared_ptr<faabric::util::SnapshotData> getMainThreadSnapshot(
       faabric::Message& msg,
       bool createIfNotExists = false);
@@ -110,6 +139,10 @@ class Executor
 
     virtual void restore(const std::string& snapshotKey);
 
+    // Returns how many pages of memory have been written since it was last
+    // restored, i.e. those that no longer share the snapshot's pages
+    size_t getRestoredDirtyPageCount();
+
     faabric::Message& getBoundMessage();
 
     bool isExecuting();
@@ -118,9 +151,27 @@ class Executor
 
     int32_t getQueueLength();
 
+    // NUMA node the executor's threads and memory are placed on, or -1 if it
+    // isn't placed. Only affects pool threads started after it's set.
+    int getNumaNode() { return numaNode.load(); }
+
+    void setNumaNode(int nodeId) { numaNode.store(nodeId); }
+
+    // Index of the CPU, among those on its NUMA node, that the executor's
+    // first pool thread is pinned to with core pinning. Later pool threads
+    // are pinned to the CPUs after it.
+    int getCoreIdx() { return coreIdx.load(); }
+
+    void setCoreIdx(int idx) { coreIdx.store(idx); }
+
   protected:
     virtual void setMemorySize(size_t newSize);
 
+    // Restores the executor's memory from the zygote in place of resetting
+    // it. Executors with state outside their memory need to restore it here.
+    virtual void resetFromZygote(faabric::Message& msg,
+                                 faabric::util::SnapshotData& zygote);
+
     virtual void softShutdown();
 
     virtual size_t getMaxMemorySize();
@@ -140,14 +191,21 @@ class Executor
     std::atomic<bool> claimed = false;
     std::atomic<bool> _isShutdown = false;
     std::atomic<int> batchCounter = 0;
+    std::atomic<int> numaNode = -1;
+    std::atomic<int> coreIdx = 0;
     faabric::util::TimePoint lastExec;
 
     // ---- Application threads ----
     std::shared_mutex threadExecutionMutex;
-    std::vector<char> dirtyRegions;
-    std::vector<std::vector<char>> threadLocalDirtyRegions;
+    faabric::util::DirtyPages dirtyRegions;
     void deleteMainThreadSnapshot(const faabric::Message& msg);
 
+    // ---- Snapshot restore ----
+    // Restoring the committed version leaves out changes that other batches
+    // are still making to the snapshot
+    void restoreFromSnapshot(faabric::util::SnapshotData& snap,
+                             bool committedOnly = false);
+
     // ---- Function execution thread pool ----
     std::mutex threadsMutex;
     std::vector<std::shared_ptr<std::jthread>> threadPoolThreads;
@@ -161,6 +219,10 @@ class Executor
     std::vector<faabric::util::Queue<ExecutorTask>> threadTaskQueues;
 
     void threadPoolThread(std::stop_token st, int threadPoolIdx);
+
+    // Moves the calling pool thread and the memory it allocates to the
+    // executor's NUMA node, and pins it as configured
+    void placePoolThread(int threadPoolIdx);
 };
 
 /**
@@ -211,7 +273,8 @@ class MessageLocalResult final
 /**
  * Background thread that periodically checks to see if any executors have
  * become stale (i.e. not handled any requests in a given timeout). If any are
- * found, they are removed.
+ * found, they are removed. It also evicts idle executors and snapshots when
+ * the host is under memory pressure.
  */
 class SchedulerReaperThread : public faabric::util::PeriodicBackgroundThread
 {
@@ -219,6 +282,36 @@ class SchedulerReaperThread : public faabric::util::PeriodicBackgroundThread
     void doWork() override;
 };
 
+/**
+ * Background thread that creates executors ahead of demand for functions being
+ * called on this host, so that calls don't wait for them to be created and
+ * reset.
+ */
+class ExecutorPrewarmThread : public faabric::util::PeriodicBackgroundThread
+{
+  public:
+    void doWork() override;
+};
+
+/**
+ * Memory held by executors and snapshots on this host, along with the last
+ * memory pressure seen and what has been evicted to relieve it.
+ */
+struct MemoryStats
+{
+    size_t executorBytes = 0;
+    size_t snapshotBytes = 0;
+
+    int nExecutors = 0;
+    int nSnapshots = 0;
+
+    faabric::util::MemoryPressure pressure;
+
+    int evictedExecutors = 0;
+    int evictedSnapshots = 0;
+    size_t evictedBytes = 0;
+};
+
 class Scheduler
 {
   public:
@@ -255,11 +348,66 @@ class Scheduler
 
     bool isShutdown() { return _isShutdown; }
 
+    // Hosts the snapshot was pushed to lazily fetch pages from it here, so
+    // this waits for them to drop their copies before returning
     void broadcastSnapshotDelete(const faabric::Message& msg,
                                  const std::string& snapshotKey);
 
     int reapStaleExecutors();
 
+    // ----------------------------------
+    // Memory pressure
+    // ----------------------------------
+
+    /**
+     * Evicts idle executors and unpinned snapshots, least recently used first,
+     * until memory usage is back under the configured percentage of the limit.
+     * If only memory stalls are over the configured threshold, just the least
+     * recently used is evicted, leaving the next pass to evict more if the
+     * stalls persist. Returns the number evicted.
+     */
+    int evictForMemoryPressure(const faabric::util::MemoryPressure& pressure);
+
+    // Reads this host's memory pressure and evicts for it, if enabled
+    int evictUnderMemoryPressure();
+
+    MemoryStats getMemoryStats();
+
+    // ----------------------------------
+    // Executor pre-warming
+    // ----------------------------------
+
+    /**
+     * Updates each function's arrival rate, an exponentially weighted moving
+     * average of the calls per second, then creates enough idle executors to
+     * handle the calls expected in the next interval. Executors are created
+     * without holding the scheduler lock, and reset in their first pool
+     * thread. Returns the number created.
+     */
+    int prewarmExecutors();
+
+    double getArrivalRate(const faabric::Message& msg);
+
+    // Number of idle executors kept ready for the function
+    int getPrewarmTarget(const faabric::Message& msg);
+
+    // ----------------------------------
+    // Zygotes
+    // ----------------------------------
+
+    // Returns the function's zygote, or null if there isn't one for the given
+    // version of the function
+    std::shared_ptr<faabric::util::SnapshotData> getZygote(
+      const faabric::Message& msg,
+      const std::string& version);
+
+    void registerZygote(const faabric::Message& msg,
+                        const std::string& version,
+                        std::shared_ptr<faabric::util::SnapshotData> zygote);
+
+    // Deletes the function's zygote, e.g. when its binary has been replaced
+    void invalidateZygote(const faabric::Message& msg);
+
     long getFunctionExecutorCount(const faabric::Message& msg);
 
     int getFunctionRegisteredHostCount(const faabric::Message& msg);
@@ -273,6 +421,10 @@ class Scheduler
 
     void flushLocally();
 
+    // Tells every host that the function's binary has been replaced, so that
+    // zygotes taken from the old one are no longer used
+    void broadcastFunctionUpdated(const faabric::Message& msg);
+
     void setFunctionResult(std::unique_ptr<faabric::Message> msg);
 
     inline void setFunctionResult(const faabric::Message& msg)
@@ -421,6 +573,47 @@ class Scheduler
       executors;
     std::unordered_map<std::string, std::atomic_int> suspendedExecutors;
 
+    // Returns true if no executors remain for the function
+    bool removeExecutors(
+      std::vector<std::shared_ptr<Executor>>& execs,
+      const std::vector<std::shared_ptr<Executor>>& toRemove);
+
+    // ---- Executor pre-warming ----
+    struct PrewarmState
+    {
+        // Copy of a called message, which pre-warmed executors are bound to
+        std::shared_ptr<faabric::Message> boundMessage;
+        int arrivals = 0;
+        double arrivalRate = 0;
+        int target = 0;
+    };
+
+    std::unordered_map<std::string, PrewarmState> prewarmStates;
+
+    // Functions that have spawned threads, which aren't pre-warmed as their
+    // threads run on the main thread's executor
+    std::unordered_set<std::string> threadedFunctions;
+
+    faabric::util::TimePoint lastPrewarmUpdate;
+
+    ExecutorPrewarmThread prewarmThread;
+
+    void recordArrival(const std::string& funcStr, const faabric::Message& msg);
+
+    // ---- Zygotes ----
+    // Version of the function each zygote was taken from, by snapshot key.
+    // Zygotes are registered as unpinned snapshots, so can be evicted.
+    std::mutex zygotesMx;
+    std::unordered_map<std::string, std::string> zygoteVersions;
+
+    // ---- Memory pressure ----
+    faabric::util::MemoryPressure lastMemoryPressure;
+    std::atomic<size_t> monitorExecutorBytes = 0;
+    std::atomic<size_t> monitorSnapshotBytes = 0;
+    std::atomic<int> monitorEvictedExecutors = 0;
+    std::atomic<int> monitorEvictedSnapshots = 0;
+    std::atomic<size_t> monitorEvictedBytes = 0;
+
     // ---- Threads ----
     faabric::snapshot::SnapshotRegistry& reg;
 
@@ -431,7 +624,12 @@ class Scheduler
     std::unordered_map<uint32_t, std::shared_ptr<MessageLocalResult>>
       localResults;
 
-    std::unordered_map<std::string, std::set<std::string>> pushedSnapshotsMap;
+    // The version of each snapshot held by each host it's been pushed to
+    std::unordered_map<std::string, std::map<std::string, uint64_t>>
+      pushedSnapshotsMap;
+
+    // Hosts each snapshot has been pushed to lazily
+    std::unordered_map<std::string, std::set<std::string>> lazySnapshotHosts;
 
     std::mutex localResultsMutex;
 
@@ -462,7 +660,24 @@ class Scheduler
       faabric::util::SchedulingTopologyHint topologyHint,
       std::shared_ptr<void> extraData);
 
-    std::shared_ptr<Executor> claimExecutor(const faabric::MessageInBatch& msg);
+    // Claims an executor for the message, preferring one on the given NUMA
+    // node, and placing any new executor on it
+    std::shared_ptr<Executor> claimExecutor(const faabric::MessageInBatch& msg,
+                                            int numaNode = -1);
+
+    // Returns the NUMA node to place a batch of tasks on, i.e. the least busy
+    // one that has free CPUs for all of them, or the least busy if none does.
+    // Returns -1 if NUMA placement is off. Must be called holding the lock.
+    int pickNumaNode(int nTasks);
+
+    // Returns the core index for the first of n new executors on the NUMA
+    // node, the rest taking the cores after it. Executors on a node take
+    // turns, so that those with core pinning are spread across its cores.
+    // Must be called holding the lock.
+    int reserveCores(int numaNode, int n);
+
+    // Core index for the next executor placed on each NUMA node
+    std::unordered_map<int, int> nextCoreIdxs;
 
     std::vector<std::string> getUnregisteredHosts(const std::string& user,
                                                   const std::string& function,
@@ -8,5 +8,12 @@ enum SnapshotCalls
     PushSnapshotUpdate = 2,
     DeleteSnapshot = 3,
     ThreadResult = 4,
+    GetMissingPages = 5,
+    CompressedCall = 6,
+    PushSnapshotBegin = 7,
+    PushSnapshotChunk = 8,
+    PushSnapshotCommit = 9,
+    PushLazySnapshot = 10,
+    GetSnapshotPages = 11,
 };
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <faabric/flat/faabric_generated.h>
+#include <faabric/proto/faabric.pb.h>
 #include <faabric/snapshot/SnapshotApi.h>
+#include <faabric/transport/FlatBufferMessageBuilder.h>
 #include <faabric/transport/MessageEndpoint.h>
 #include <faabric/transport/MessageEndpointClient.h>
 #include <faabric/util/snapshot.h>
@@ -24,6 +26,10 @@ std::vector<
   std::pair<std::string, std::shared_ptr<faabric::util::SnapshotData>>>
 getSnapshotPushes();
 
+std::vector<
+  std::pair<std::string, std::shared_ptr<faabric::util::SnapshotData>>>
+getLazySnapshotPushes();
+
 std::vector<std::pair<std::string, std::vector<faabric::util::SnapshotDiff>>>
 getSnapshotDiffPushes();
 
@@ -33,29 +39,90 @@ std::vector<std::pair<std::string, MockThreadResult>> getThreadResults();
 
 void clearMockSnapshotRequests();
 
+// -----------------------------------
+// Link throughput
+// -----------------------------------
+
+// Moving average of the bytes per second measured sending snapshot data to the
+// host, or zero if nothing has been measured yet
+double getSnapshotLinkThroughput(const std::string& host);
+
+void clearSnapshotLinkThroughputs();
+
 // -----------------------------------
 // Client
 // -----------------------------------
 
+struct PageContents;
+
 class SnapshotClient final : public faabric::transport::MessageEndpointClient
 {
   public:
     explicit SnapshotClient(const std::string& hostIn);
 
+    // Only the pages of the snapshot that the host doesn't already hold are
+    // sent, pages are matched on the hash of their contents. If there are
+    // more than fit in one chunk, they're streamed to the host in chunks.
     void pushSnapshot(const std::string& key,
                       std::shared_ptr<faabric::util::SnapshotData> data);
 
+    // Only the snapshot's size and merge regions are sent, the host fetches
+    // its pages from this host as they're needed
+    void pushLazySnapshot(const std::string& key,
+                          std::shared_ptr<faabric::util::SnapshotData> data);
+
+    // Fetches part of the host's copy of the snapshot into the buffer
+    void getSnapshotPages(const std::string& key,
+                          uint32_t offset,
+                          std::span<uint8_t> buffer);
+
     void pushSnapshotUpdate(
       std::string snapshotKey,
       const std::shared_ptr<faabric::util::SnapshotData>& data,
       const std::vector<faabric::util::SnapshotDiff>& diffs);
 
-    void deleteSnapshot(const std::string& key);
+    // If waiting, returns once the host has deleted its copy
+    void deleteSnapshot(const std::string& key, bool wait = false);
 
     void pushThreadResult(
       uint32_t messageId,
       int returnValue,
       const std::string& key,
       const std::vector<faabric::util::SnapshotDiff>& diffs);
+
+  private:
+    std::vector<int> getMissingPages(
+      const std::vector<faabric::util::SnapshotPageHash>& hashes);
+
+    faabric::SnapshotPagesResponse pushSnapshotPages(
+      const std::string& key,
+      std::shared_ptr<faabric::util::SnapshotData> data,
+      const std::vector<faabric::util::SnapshotPageHash>& hashes,
+      const std::vector<int>& pages);
+
+    faabric::SnapshotPagesResponse streamSnapshotPages(
+      const std::string& key,
+      std::shared_ptr<faabric::util::SnapshotData> data,
+      const std::vector<faabric::util::SnapshotPageHash>& hashes,
+      const std::vector<uint32_t>& sentPages);
+
+    PageContents getPageContents(faabric::util::SnapshotData& data,
+                                 std::span<const uint32_t> pages);
+
+    int getCompressionLevel(size_t payloadSize);
+
+    flatbuffers::Offset<
+      flatbuffers::Vector<flatbuffers::Offset<SnapshotDiffRequest>>>
+    createDiffs(faabric::transport::FlatBufferMessageBuilder& mb,
+                const std::vector<faabric::util::SnapshotDiff>& diffs);
+
+    // Sends a finished request holding diffs, compressing the whole request if
+    // configured to do so
+    void sendDiffsRequest(int call,
+                          faabric::transport::FlatBufferMessageBuilder& mb);
+
+    void timedSyncSend(int call,
+                       faabric::transport::Message&& msg,
+                       google::protobuf::Message* response);
 };
 }
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/util/locks.h>
@@ -18,6 +20,10 @@ class SnapshotRegistry
     std::shared_ptr<faabric::util::SnapshotData> getSnapshot(
       const std::string& key);
 
+    // Returns null if the snapshot doesn't exist, e.g. as it's been evicted
+    std::shared_ptr<faabric::util::SnapshotData> tryGetSnapshot(
+      const std::string& key);
+
     bool snapshotExists(const std::string& key);
 
     void registerSnapshot(const std::string& key,
@@ -29,6 +35,72 @@ class SnapshotRegistry
 
     void clear();
 
+    // -----------------------------------
+    // Page store
+    // -----------------------------------
+
+    /**
+     * Adds the pages of a registered snapshot to the content-addressed page
+     * store, so that other snapshots with the same pages can be built from
+     * them rather than transferring them again. Pages are not copied into the
+     * store, it refers to them in place, and counts how many snapshot pages
+     * share each hash. They are removed when the snapshot is deleted or
+     * replaced.
+     */
+    void registerSnapshotPages(
+      const std::string& key,
+      const std::vector<faabric::util::SnapshotPageHash>& hashes);
+
+    // Returns the indices of the given pages not held by any snapshot
+    std::vector<int> getMissingPages(
+      const std::vector<faabric::util::SnapshotPageHash>& hashes);
+
+    /**
+     * Copies a page with the given hash from the store into the target
+     * snapshot. As snapshots may have been modified since their pages were
+     * stored, the copy is checked against the hash, and false is returned if
+     * no matching page is found.
+     */
+    bool copyStoredPage(const faabric::util::SnapshotPageHash& hash,
+                        faabric::util::SnapshotData& target,
+                        uint32_t offset,
+                        size_t length);
+
+    size_t getStoredPageCount();
+
+    int getStoredPageRefCount(const faabric::util::SnapshotPageHash& hash);
+
+    // -----------------------------------
+    // Eviction
+    // -----------------------------------
+
+    /**
+     * Pinned snapshots are never evicted under memory pressure, e.g. those
+     * other hosts are sending diffs against. Pins are counted, and dropped
+     * along with the snapshot when it's deleted.
+     */
+    void pinSnapshot(const std::string& key);
+
+    void unpinSnapshot(const std::string& key);
+
+    bool isSnapshotPinned(const std::string& key);
+
+    struct EvictableSnapshot
+    {
+        std::string key;
+        size_t sizeBytes;
+        long idleMillis;
+    };
+
+    // Returns the unpinned snapshots, least recently used first
+    std::vector<EvictableSnapshot> getEvictableSnapshots();
+
+    // Deletes the snapshot unless it has been pinned in the meantime,
+    // returning whether it was deleted
+    bool evictSnapshot(const std::string& key);
+
+    size_t getTotalSnapshotBytes();
+
   private:
     std::unordered_map<std::string,
                        std::shared_ptr<faabric::util::SnapshotData>>
@@ -36,6 +108,35 @@ class SnapshotRegistry
 
     std::shared_mutex snapshotsMx;
 
+    // Snapshots are marked as used under the shared lock, so the time they
+    // were last used is atomic
+    struct SnapshotUsage
+    {
+        int pins = 0;
+        std::atomic<long> lastUsedMillis = 0;
+    };
+
+    std::unordered_map<std::string, SnapshotUsage> snapshotUsage;
+
+    struct StoredPage
+    {
+        std::shared_ptr<faabric::util::SnapshotData> snapshot;
+        uint32_t offset;
+    };
+
+    // Every snapshot page with a given hash, the reference count being the
+    // number of entries
+    std::unordered_map<faabric::util::SnapshotPageHash,
+                       std::vector<StoredPage>,
+                       faabric::util::SnapshotPageHashHasher>
+      pageStore;
+
+    std::unordered_map<std::string,
+                       std::vector<faabric::util::SnapshotPageHash>>
+      snapshotPageHashes;
+
+    void removeSnapshotPages(const std::string& key);
+
     int writeSnapshotToFd(const std::string& key,
                           faabric::util::SnapshotData& data);
 };
@@ -1,28 +1,81 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <faabric/flat/faabric_generated.h>
+#include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotApi.h>
 #include <faabric/transport/MessageEndpointServer.h>
 #include <faabric/transport/PointToPointBroker.h>
+#include <faabric/util/snapshot.h>
+#include <faabric/util/timing.h>
 
 namespace faabric::snapshot {
+
+// A snapshot being received, which may be pushed over several requests
+struct PendingSnapshotPush
+{
+    std::string key;
+
+    std::shared_ptr<faabric::util::SnapshotData> snap;
+
+    std::vector<faabric::util::SnapshotPageHash> hashes;
+
+    std::vector<bool> filledPages;
+
+    // Where the first page with each hash was written
+    std::unordered_map<faabric::util::SnapshotPageHash,
+                       uint32_t,
+                       faabric::util::SnapshotPageHashHasher>
+      sentPageOffsets;
+
+    std::vector<faabric::util::SnapshotMergeRegion> mergeRegions;
+
+    // When the push last received a request, to drop abandoned pushes
+    faabric::util::TimePoint lastUsed;
+};
+
 class SnapshotServer final : public faabric::transport::MessageEndpointServer
 {
   public:
     SnapshotServer();
 
+    // Pushes that have begun but not yet been committed or expired
+    size_t getPendingPushCount();
+
   protected:
     void doAsyncRecv(transport::Message& message) override;
 
     std::unique_ptr<google::protobuf::Message> doSyncRecv(
       transport::Message& message) override;
 
+    std::unique_ptr<google::protobuf::Message> recvGetMissingPages(
+      std::span<const uint8_t> buffer);
+
     std::unique_ptr<google::protobuf::Message> recvPushSnapshot(
       std::span<const uint8_t> buffer);
 
+    std::unique_ptr<google::protobuf::Message> recvPushSnapshotBegin(
+      std::span<const uint8_t> buffer);
+
+    std::unique_ptr<google::protobuf::Message> recvPushSnapshotChunk(
+      std::span<const uint8_t> buffer);
+
+    std::unique_ptr<google::protobuf::Message> recvPushSnapshotCommit(
+      std::span<const uint8_t> buffer);
+
+    std::unique_ptr<google::protobuf::Message> recvPushLazySnapshot(
+      std::span<const uint8_t> buffer);
+
+    std::unique_ptr<google::protobuf::Message> recvGetSnapshotPages(
+      std::span<const uint8_t> buffer);
+
     std::unique_ptr<google::protobuf::Message> recvPushSnapshotUpdate(
       std::span<const uint8_t> buffer);
 
@@ -31,8 +84,24 @@ class SnapshotServer final : public faabric::transport::MessageEndpointServer
     std::unique_ptr<google::protobuf::Message> recvThreadResult(
       faabric::transport::Message& message);
 
+    std::unique_ptr<google::protobuf::Message> recvCompressedRequest(
+      faabric::transport::Message& message);
+
   private:
     faabric::transport::PointToPointBroker& broker;
     faabric::snapshot::SnapshotRegistry& reg;
+
+    std::mutex pendingPushesMx;
+    std::unordered_map<uint64_t, std::shared_ptr<PendingSnapshotPush>>
+      pendingPushes;
+
+    std::shared_ptr<PendingSnapshotPush> getPendingPush(uint64_t pushId,
+                                                        bool remove);
+
+    // Must hold pendingPushesMx
+    void expirePendingPushes();
+
+    std::unique_ptr<faabric::SnapshotPagesResponse> finishSnapshotPush(
+      PendingSnapshotPush& push);
 };
 }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <faabric/transport/Message.h>
+
+#include <flatbuffers/flatbuffers.h>
+
+namespace faabric::transport {
+
+/**
+ * Flatbuffers builder whose backing buffer lives inside an nng message, with
+ * space for the transport header reserved in front of it. Once the buffer has
+ * been finished it can be released as a transport message and sent as-is,
+ * rather than being copied from the builder into a newly allocated message.
+ */
+class FlatBufferMessageBuilder final : public flatbuffers::FlatBufferBuilder
+{
+  public:
+    explicit FlatBufferMessageBuilder(size_t initialSize = 1024);
+
+    /**
+     * Hands the finished buffer over as a transport message. The builder must
+     * have been finished, and is left empty afterwards.
+     */
+    Message releaseMessage();
+};
+}
@@ -7,6 +7,10 @@
 
 #include <faabric/util/bytes.h>
 
+namespace google::protobuf {
+class Message;
+}
+
 // The header structure is:
 // 1 byte - Message code (uint8_t)
 // 8 bytes - Message body size (uint64_t)
@@ -46,9 +50,25 @@ enum class MessageResponseCode
  */
 class Message final
 {
+    friend class MessageEndpoint;
+
   public:
     Message(size_t bufferSize);
 
+    /**
+     * Allocates a message with room for the transport header followed by
+     * dataSize bytes of payload. The payload is left for the caller to fill in
+     * through udata(), so data can be serialised straight into the buffer that
+     * is handed to the socket.
+     */
+    static Message allocate(size_t dataSize);
+
+    /**
+     * Serialises a protobuf message directly into the payload of a newly
+     * allocated message, without going through an intermediate string.
+     */
+    static Message fromProtobuf(const google::protobuf::Message& msg);
+
     Message(nng_msg* nngMsg);
 
     Message(MessageResponseCode responseCodeIn);
@@ -128,6 +148,18 @@ class Message final
   private:
     nng_msg* nngMsg = nullptr;
 
+    // Fills in the header in front of the payload, called by the endpoint just
+    // before the message is sent
+    void writeHeader(uint8_t header, int sequenceNum);
+
+    // Hands ownership of the underlying nng message over to the caller
+    nng_msg* release()
+    {
+        nng_msg* released = nngMsg;
+        nngMsg = nullptr;
+        return released;
+    }
+
     MessageResponseCode responseCode = MessageResponseCode::SUCCESS;
 
     uint8_t _header = 0;
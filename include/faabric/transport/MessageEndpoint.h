@@ -4,6 +4,11 @@
 #include <faabric/util/exception.h>
 
 #include <array>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <nng/nng.h>
 #include <optional>
 #include <string>
@@ -23,8 +28,24 @@
 // things haven't yet completed (usually only when there's an error).
 #define LINGER_MS 25
 
+// Number of idle aio handles each endpoint keeps around for reuse by blocking
+// sends and receives
+#define AIO_POOL_SIZE 8
+
+// Maximum number of asynchronous operations in flight on a single endpoint,
+// starting any more blocks until one of them completes
+#define MAX_ASYNC_OPS_IN_FLIGHT 256
+
 namespace faabric::transport {
 
+// Called once an asynchronous send has completed, with zero on success or the
+// nng error code on failure
+using SendCallback = std::function<void(int)>;
+
+// Called once an asynchronous receive has completed. If the receive failed the
+// message carries no data, only the response code.
+using RecvCallback = std::function<void(Message&&)>;
+
 enum MessageEndpointConnectType
 {
     BIND = 0,
@@ -70,6 +91,32 @@ class MessageContext final
     nng_ctx context = NNG_CTX_INITIALIZER;
 };
 
+// Pool of reusable nng_aio handles, so that blocking sends and receives don't
+// allocate and free one on every call. Handles are only pooled while idle, and
+// the pool holds at most maxPooled of them.
+class AioPool final
+{
+  public:
+    explicit AioPool(size_t maxPooledIn = AIO_POOL_SIZE);
+
+    AioPool(const AioPool&) = delete;
+
+    AioPool& operator=(const AioPool&) = delete;
+
+    ~AioPool();
+
+    nng_aio* acquire();
+
+    void release(nng_aio* aio);
+
+  private:
+    const size_t maxPooled;
+
+    std::mutex mx;
+
+    std::vector<nng_aio*> freeAios;
+};
+
 // Note: In a given communication group, one socket may bind, and all the rest
 // must connect. The bound socket should be created before the connecting
 // sockets, otherwise the first sendMessage call will block, waiting for the
@@ -110,12 +157,59 @@ class MessageEndpoint
                      int sequenceNumber = NO_SEQUENCE_NUM,
                      std::optional<nng_ctx> context = std::nullopt);
 
+    // Sends a message whose payload has already been written in place, e.g.
+    // one created with Message::allocate, avoiding a copy of the payload.
+    void sendMessage(uint8_t header,
+                     Message&& msg,
+                     int sequenceNumber = NO_SEQUENCE_NUM,
+                     std::optional<nng_ctx> context = std::nullopt);
+
+    // The receive timeout defaults to the socket's, but can be overridden for
+    // a single call
     Message recvMessage(bool async,
-                        std::optional<nng_ctx> context = std::nullopt);
+                        std::optional<nng_ctx> context = std::nullopt,
+                        std::optional<int> recvTimeoutMs = std::nullopt);
+
+    // Starts sending the message and returns without waiting for it to be
+    // accepted by the socket. The callback is invoked from an nng thread.
+    void sendMessageAsync(uint8_t header,
+                          Message&& msg,
+                          int sequenceNumber,
+                          SendCallback callback);
+
+    // Starts a receive on the socket, the callback is invoked from an nng
+    // thread once a message arrives or the receive fails
+    void recvMessageAsync(RecvCallback callback);
+
+    // Blocks until all asynchronous operations on this endpoint have completed
+    void awaitAsyncOps();
 
     MessageContext createContext();
 
     void close();
+
+  private:
+    AioPool aioPool;
+
+    struct AsyncOp;
+
+    std::mutex asyncOpsMx;
+
+    std::condition_variable asyncOpsCv;
+
+    std::vector<std::unique_ptr<AsyncOp>> asyncOps;
+
+    std::vector<AsyncOp*> freeAsyncOps;
+
+    int asyncOpsInFlight = 0;
+
+    AsyncOp* acquireAsyncOp();
+
+    void releaseAsyncOp(AsyncOp* op);
+
+    static void asyncOpCallback(void* arg);
+
+    Message checkReceivedMessage(int ec, nng_msg* rawMsg, bool async);
 };
 
 class AsyncSendMessageEndpoint final : public MessageEndpoint
@@ -129,6 +223,19 @@ class AsyncSendMessageEndpoint final : public MessageEndpoint
               const uint8_t* data,
               size_t dataSize,
               int sequenceNum = NO_SEQUENCE_NUM);
+
+    void send(uint8_t header,
+              Message&& msg,
+              int sequenceNum = NO_SEQUENCE_NUM);
+
+    void sendAsync(uint8_t header,
+                   Message&& msg,
+                   int sequenceNum,
+                   SendCallback callback);
+
+    std::future<void> sendAsync(uint8_t header,
+                                Message&& msg,
+                                int sequenceNum = NO_SEQUENCE_NUM);
 };
 
 class AsyncInternalSendMessageEndpoint final : public MessageEndpoint
@@ -155,6 +262,11 @@ class SyncSendMessageEndpoint final : public MessageEndpoint
     Message sendAwaitResponse(uint8_t header,
                               const uint8_t* data,
                               size_t dataSize);
+
+    Message sendAwaitResponse(uint8_t header, Message&& msg);
+
+  private:
+    Message awaitResponse(const MessageContext& ctx);
 };
 
 class RecvMessageEndpoint : public MessageEndpoint
@@ -191,13 +303,18 @@ class FanMessageEndpoint : public MessageEndpoint
 
     MessageContext attachFanOut();
 
-    Message recv(const MessageContext& ctx);
+    Message recv(const MessageContext& ctx,
+                 std::optional<int> recvTimeoutMs = std::nullopt);
 
     void sendResponse(const MessageContext& ctx,
                       uint8_t header,
                       const uint8_t* data,
                       size_t dataSize);
 
+    void sendResponse(const MessageContext& ctx,
+                      uint8_t header,
+                      Message&& msg);
+
     void stop();
 
   private:
@@ -229,6 +346,10 @@ class AsyncRecvMessageEndpoint final : public RecvMessageEndpoint
                              int timeoutMs = DEFAULT_SOCKET_TIMEOUT_MS);
 
     Message recv() override;
+
+    void recvAsync(RecvCallback callback);
+
+    std::future<Message> recvAsync();
 };
 
 class AsyncInternalRecvMessageEndpoint final : public RecvMessageEndpoint
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <future>
 #include <optional>
 
 #include <faabric/flat/faabric_generated.h>
@@ -16,6 +17,8 @@ class MessageEndpointClient
                           int syncPort,
                           int timeoutMs = DEFAULT_SOCKET_TIMEOUT_MS);
 
+    virtual ~MessageEndpointClient() = default;
+
     void asyncSend(int header,
                    google::protobuf::Message* msg,
                    int sequenceNum = NO_SEQUENCE_NUM);
@@ -25,6 +28,22 @@ class MessageEndpointClient
                    size_t bufferSize,
                    int sequenceNum = NO_SEQUENCE_NUM);
 
+    // Sends a message whose payload has been serialised in place, avoiding a
+    // copy of the payload into the transport message
+    void asyncSend(int header,
+                   Message&& msg,
+                   int sequenceNum = NO_SEQUENCE_NUM);
+
+    /**
+     * Queues the message to be sent on the async socket without waiting for
+     * the socket to accept it, so that many sends can be in flight from one
+     * thread. The future completes once the send is done, and failures are
+     * logged whether or not it is waited on.
+     */
+    std::future<void> asyncSendNoWait(int header,
+                                      google::protobuf::Message* msg,
+                                      int sequenceNum = NO_SEQUENCE_NUM);
+
     void syncSend(int header,
                   google::protobuf::Message* msg,
                   google::protobuf::Message* response);
@@ -34,6 +53,10 @@ class MessageEndpointClient
                   size_t bufferSize,
                   google::protobuf::Message* response);
 
+    void syncSend(int header,
+                  Message&& msg,
+                  google::protobuf::Message* response);
+
   protected:
     const std::string host;
 
@@ -41,9 +64,35 @@ class MessageEndpointClient
 
     const int syncPort;
 
+    const int timeoutMs;
+
     // Optional: nullopt in mock mode, to avoid connecting to invalid hosts
     std::optional<faabric::transport::AsyncSendMessageEndpoint> asyncEndpoint;
 
     std::optional<faabric::transport::SyncSendMessageEndpoint> syncEndpoint;
+
+    // Only set if the server has a priority lane, see addPriorityLane
+    std::optional<faabric::transport::AsyncSendMessageEndpoint>
+      priorityAsyncEndpoint;
+
+    std::optional<faabric::transport::SyncSendMessageEndpoint>
+      prioritySyncEndpoint;
+
+    /**
+     * Connects to the server's priority lane. Calls for which isPriorityCall
+     * returns true are then sent on the priority sockets, rather than queueing
+     * behind other traffic on the main ones.
+     */
+    void addPriorityLane(int priorityAsyncPort, int prioritySyncPort);
+
+    virtual bool isPriorityCall(int header);
+
+  private:
+    std::optional<AsyncSendMessageEndpoint>& asyncEndpointFor(int header);
+
+    std::optional<SyncSendMessageEndpoint>& syncEndpointFor(int header);
+
+    void parseResponse(const Message& responseMsg,
+                       google::protobuf::Message* response);
 };
 }
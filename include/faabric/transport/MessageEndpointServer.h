@@ -5,7 +5,11 @@
 #include <faabric/transport/MessageEndpoint.h>
 #include <faabric/util/latch.h>
 
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #define DEFAULT_MESSAGE_SERVER_THREADS 4
 
@@ -15,29 +19,79 @@ namespace faabric::transport {
 // one for asynchronous. Each is run inside its own background thread.
 class MessageEndpointServer;
 
+/**
+ * Load metrics for one of a server's handlers. nng doesn't expose how many
+ * messages are queued on a socket, so the closest measure is how often a
+ * message was picked up while every worker was already busy.
+ */
+struct MessageEndpointServerStats
+{
+    int nWorkers = 0;
+    int nBusyWorkers = 0;
+    int peakWorkers = 0;
+
+    uint64_t nMessages = 0;
+
+    // Messages received while all other workers were busy, i.e. ones that
+    // were likely to have queued on the socket
+    uint64_t nSaturated = 0;
+
+    uint64_t totalHandlingUs = 0;
+    uint64_t maxHandlingUs = 0;
+};
+
 class MessageEndpointServerHandler
 {
   public:
     MessageEndpointServerHandler(MessageEndpointServer* serverIn,
                                  bool asyncIn,
                                  const std::string& inprocLabelIn,
+                                 int portIn,
                                  int nThreadsIn);
 
     void start(int timeoutMs = DEFAULT_SOCKET_TIMEOUT_MS);
 
     void join();
 
+    MessageEndpointServerStats getStats();
+
   private:
     MessageEndpointServer* server;
     bool async = false;
     const std::string inprocLabel;
+    const int port;
+
+    // The handler always keeps nThreads workers, and adds more up to
+    // maxThreads when they are all busy. Extra workers are retired once they
+    // have been idle for idleTimeoutMs.
     int nThreads;
+    int maxThreads;
+    int idleTimeoutMs;
+    int recvTimeoutMs;
 
     std::jthread receiverThread;
 
-    std::vector<std::jthread> workerThreads;
+    std::mutex workersMx;
+    std::map<int, std::jthread> workerThreads;
+    std::vector<int> retiredWorkers;
+    int nextWorkerId = 0;
+    bool stopping = false;
+
+    MessageEndpointServerStats stats;
 
     std::shared_ptr<FanMessageEndpoint> fan = nullptr;
+
+    // Must be called with the workers mutex held
+    void spawnWorker(std::shared_ptr<faabric::util::Latch> startupLatch);
+
+    void runWorker(int workerId,
+                   std::shared_ptr<faabric::util::Latch> startupLatch);
+
+    void onMessageStart();
+
+    void onMessageEnd(uint64_t handlingUs);
+
+    bool tryRetireWorker(int workerId);
 };
 
 class MessageEndpointServer
@@ -54,18 +108,38 @@ class MessageEndpointServer
 
     virtual void onWorkerStop();
 
+    // Called when a worker added under load is retired after being idle,
+    // while the server itself keeps running
+    virtual void onWorkerRetired();
+
     void setRequestLatch();
 
     void awaitRequestLatch();
 
     int getNThreads();
 
+    MessageEndpointServerStats getAsyncStats(bool priorityLane = false);
+
+    MessageEndpointServerStats getSyncStats(bool priorityLane = false);
+
+    bool hasPriorityLane();
+
   protected:
     virtual void doAsyncRecv(transport::Message& message) = 0;
 
     virtual std::unique_ptr<google::protobuf::Message> doSyncRecv(
       transport::Message& message) = 0;
 
+    /**
+     * Adds a second pair of sockets with their own workers, for calls that
+     * mustn't queue behind bulk traffic on the main sockets. Messages on
+     * either lane go to the same handlers. Must be called before the server
+     * is started.
+     */
+    void addPriorityLane(int priorityAsyncPort,
+                         int prioritySyncPort,
+                         int priorityThreads);
+
   private:
     friend class MessageEndpointServerHandler;
 
@@ -77,6 +151,9 @@ class MessageEndpointServer
     MessageEndpointServerHandler asyncHandler;
     MessageEndpointServerHandler syncHandler;
 
+    std::unique_ptr<MessageEndpointServerHandler> priorityAsyncHandler;
+    std::unique_ptr<MessageEndpointServerHandler> prioritySyncHandler;
+
     std::shared_ptr<faabric::util::Latch> requestLatch;
 
     bool started = false;
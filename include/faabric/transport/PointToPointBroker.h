@@ -1,5 +1,6 @@
 #pragma once
 
+#include <faabric/proto/faabric.pb.h>
 #include <faabric/transport/PointToPointClient.h>
 #include <faabric/util/config.h>
 #include <faabric/util/locks.h>
@@ -7,6 +8,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <map>
 #include <queue>
 #include <set>
 #include <shared_mutex>
@@ -98,12 +100,21 @@ class PointToPointBroker
     void setAndSendMappingsFromSchedulingDecision(
       const faabric::util::SchedulingDecision& decision);
 
+    faabric::PointToPointMappings setUpLocalAndGetRemoteMappings(
+      const faabric::util::SchedulingDecision& decision);
+
+    void setUpLocalMappingsFromPiggyback(
+      const faabric::PointToPointMappings& mappings);
+
     void waitForMappingsOnThisHost(int groupId);
 
     std::set<int> getIdxsRegisteredForGroup(int groupId);
 
     void updateHostForIdx(int groupId, int groupIdx, std::string newHost);
 
+    void updateHostsForIdxs(int groupId,
+                            const std::map<int, std::string>& newHosts);
+
     void sendMessage(int groupId,
                      int sendIdx,
                      int recvIdx,
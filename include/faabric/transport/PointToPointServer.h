@@ -20,6 +20,8 @@ class PointToPointServer final : public MessageEndpointServer
 
     void onWorkerStop() override;
 
+    void onWorkerRetired() override;
+
     std::unique_ptr<google::protobuf::Message> doRecvMappings(
       std::span<const uint8_t> buffer);
 
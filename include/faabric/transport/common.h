@@ -12,6 +12,11 @@
 #define FUNCTION_CALL_SYNC_PORT 8006
 #define FUNCTION_INPROC_LABEL "function"
 
+// Separate sockets for small control-plane function calls, so they don't queue
+// behind bulk traffic such as batch execute requests
+#define FUNCTION_CALL_PRIORITY_ASYNC_PORT 8011
+#define FUNCTION_CALL_PRIORITY_SYNC_PORT 8012
+
 #define SNAPSHOT_ASYNC_PORT 8007
 #define SNAPSHOT_SYNC_PORT 8008
 #define SNAPSHOT_INPROC_LABEL "snapshot"
@@ -6,17 +6,15 @@
         throw std::runtime_error("Error deserialising message");               \
     }
 
+// Both expect a finished faabric::transport::FlatBufferMessageBuilder, whose
+// buffer is sent without being copied
 #define SEND_FB_MSG(T, _mb)                                                    \
     {                                                                          \
-        const uint8_t* _buffer = _mb.GetBufferPointer();                       \
-        int _size = _mb.GetSize();                                             \
         faabric::EmptyResponse _response;                                      \
-        syncSend(T, _buffer, _size, &_response);                               \
+        syncSend(T, _mb.releaseMessage(), &_response);                         \
     }
 
 #define SEND_FB_MSG_ASYNC(T, _mb)                                              \
     {                                                                          \
-        const uint8_t* _buffer = _mb.GetBufferPointer();                       \
-        int _size = _mb.GetSize();                                             \
-        asyncSend(T, _buffer, _size);                                          \
+        asyncSend(T, _mb.releaseMessage());                                    \
     }
@@ -25,6 +25,13 @@ class PeriodicBackgroundThread
      */
     void stop();
 
+    /**
+     * Do the work now rather than waiting for the rest of the interval. Doesn't
+     * wait for the work, so can be called while holding locks the work needs.
+     * If the work is already being done, it's done again straight after.
+     */
+    void wakeUp();
+
     virtual void doWork() = 0;
 
     virtual void tidyUp();
@@ -40,5 +47,8 @@ class PeriodicBackgroundThread
     std::mutex mx;
 
     std::condition_variable_any timeoutCv;
+
+    // Guarded by mx
+    bool wakeUpRequested = false;
 };
 }
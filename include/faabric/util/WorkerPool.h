@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace faabric::util {
+
+/**
+ * Long-lived worker threads that help callers split up short pieces of work,
+ * so that starting threads doesn't cost more than the work saves.
+ *
+ * The work passed to run() is executed on several threads at once, including
+ * the caller's. It must claim its own tasks, e.g. from a shared atomic
+ * counter, so that it's done once any copy returns. Copies that haven't
+ * started on a worker by then are dropped.
+ */
+class WorkerPool
+{
+  public:
+    WorkerPool() = default;
+
+    WorkerPool(const WorkerPool&) = delete;
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool();
+
+    /**
+     * Runs the work on up to nThreads threads, including the calling one, and
+     * waits for every copy that started to finish. Workers are added as
+     * needed and kept for later calls. The first exception thrown by any copy
+     * is rethrown here.
+     */
+    void run(int nThreads, const std::function<void()>& work);
+
+    int getThreadCount();
+
+  private:
+    struct Job
+    {
+        const std::function<void()>* work = nullptr;
+        int nRunning = 0;
+        std::exception_ptr error = nullptr;
+    };
+
+    std::mutex mx;
+
+    std::condition_variable workCv;
+
+    std::condition_variable doneCv;
+
+    // One entry per copy of a job yet to be picked up by a worker
+    std::deque<std::shared_ptr<Job>> pending;
+
+    std::vector<std::jthread> workers;
+
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+/**
+ * Pool shared by snapshot diffing and diff writing.
+ */
+WorkerPool& getSnapshotWorkerPool();
+}
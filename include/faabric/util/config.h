@@ -31,12 +31,20 @@ class SystemConfig
     std::string noTopologyHints;
     bool isStorageNode;
     int noSingleHostOptimisations;
+    int numaPlacement;
+    std::string threadPinning;
 
     // Worker-related timeouts
     int globalMessageTimeout;
     int boundTimeout;
     int reaperIntervalSeconds;
 
+    // Executor pre-warming
+    int prewarmMinExecutors;
+    int prewarmMaxExecutors;
+    int prewarmIntervalSeconds;
+    int zygoteSnapshots;
+
     // MPI
     int defaultMpiWorldSize;
     int mpiBasePort;
@@ -52,13 +60,35 @@ class SystemConfig
 
     // Transport
     int functionServerThreads;
+    int functionServerPriorityThreads;
     int stateServerThreads;
     int snapshotServerThreads;
     int pointToPointServerThreads;
+    int serverMaxThreads;
+    int serverIdleThreadTimeoutMs;
 
     // Dirty tracking
     std::string dirtyTrackingMode;
     std::string diffingMode;
+    int diffMergeGap;
+    int diffThreads;
+    int uffdHandlerThreads;
+    int uffdFaultAroundPages;
+
+    // Memory
+    std::string hugePagesMode;
+    std::string memoryCgroupDir;
+    int memoryEvictionUsagePercent;
+    int memoryEvictionStallPercent;
+
+    // Snapshot transfers
+    std::string snapshotCompression;
+    int snapshotCompressionMinSize;
+    int snapshotCompressionLevel;
+    int snapshotPushChunkSize;
+    int snapshotPushTimeoutMs;
+    std::string snapshotRestoreMode;
+    int snapshotPrefetchPages;
 
     SystemConfig();
 
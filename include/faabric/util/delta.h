@@ -5,6 +5,7 @@
 #include <span>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace faabric::util {
 
@@ -50,4 +51,34 @@ void applyDelta(std::span<const uint8_t> delta,
                 std::function<void(uint32_t)> setDataSize,
                 std::function<uint8_t*()> getDataPointer);
 
+// Payloads at least this big are compressed at a low level whatever the link
+// speed, as the sender blocks while compressing them
+#define ZSTD_LARGE_PAYLOAD_SIZE (64 * 1024 * 1024)
+
+// Worst-case size of srcSize bytes once compressed
+size_t zstdCompressBound(size_t srcSize);
+
+// Compresses the concatenation of the source buffers into a single zstd frame
+// written to dest, returning the compressed size. The destination must be at
+// least zstdCompressBound of the total source size.
+size_t zstdCompress(std::span<const std::span<const uint8_t>> srcs,
+                    std::span<uint8_t> dest,
+                    int level);
+
+size_t zstdCompress(std::span<const uint8_t> src,
+                    std::span<uint8_t> dest,
+                    int level);
+
+// Decompresses a single zstd frame, filling each of the destination buffers in
+// turn. Throws unless the frame holds exactly the total size of the buffers.
+void zstdDecompress(std::span<const uint8_t> src,
+                    std::span<const std::span<uint8_t>> dests);
+
+void zstdDecompress(std::span<const uint8_t> src, std::span<uint8_t> dest);
+
+// Picks a zstd level for the payload so that compressing it is unlikely to
+// take longer than sending it over a link with the given throughput in bytes
+// per second. Zero throughput means the link speed is unknown.
+int zstdAdaptiveLevel(size_t payloadSize, double linkBytesPerSecond);
+
 }
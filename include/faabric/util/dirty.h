@@ -1,20 +1,70 @@
 #pragma once
 
+#include <linux/types.h>
+#include <map>
+#include <mutex>
 #include <signal.h>
 #include <span>
 #include <string>
+#include <sys/ioctl.h>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include <faabric/util/config.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 
 #define CLEAR_REFS "/proc/self/clear_refs"
-#define PAGEMAP "/proc/self/pagemap"
 
-#define PAGEMAP_ENTRY_BYTES sizeof(uint64_t)
 #define PAGEMAP_SOFT_DIRTY (1Ull << 55)
 
+// The PAGEMAP_SCAN ioctl is only in kernel headers from 6.7
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WPALLOWED (1 << 0)
+#define PAGE_IS_WRITTEN (1 << 1)
+#define PAGE_IS_FILE (1 << 2)
+#define PAGE_IS_PRESENT (1 << 3)
+#define PAGE_IS_SWAPPED (1 << 4)
+#define PAGE_IS_PFNZERO (1 << 5)
+#define PAGE_IS_HUGE (1 << 6)
+#define PAGE_IS_SOFT_DIRTY (1 << 7)
+
+struct page_region
+{
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+#define PM_SCAN_WP_MATCHING (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+
+struct pm_scan_arg
+{
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
+
+// Number of dirty ranges returned by each PAGEMAP_SCAN call
+#define PAGEMAP_SCAN_BATCH_SIZE 512
+
+// Maximum number of userfaultfd events read in one go by an event thread
+#define UFFD_EVENT_BATCH_SIZE 64
+
 namespace faabric::util {
 
 /*
@@ -36,16 +86,19 @@ class DirtyTracker
 
     virtual void stopTracking(std::span<uint8_t> region) = 0;
 
-    virtual std::vector<char> getDirtyPages(std::span<uint8_t> region) = 0;
+    virtual DirtyPages getDirtyPages(std::span<uint8_t> region) = 0;
 
     virtual void startThreadLocalTracking(std::span<uint8_t> region) = 0;
 
     virtual void stopThreadLocalTracking(std::span<uint8_t> region) = 0;
 
-    virtual std::vector<char> getThreadLocalDirtyPages(
-      std::span<uint8_t> region) = 0;
+    virtual DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) = 0;
+
+    virtual DirtyPages getBothDirtyPages(std::span<uint8_t> region) = 0;
 
-    virtual std::vector<char> getBothDirtyPages(std::span<uint8_t> region) = 0;
+    // Trackers using userfaultfd own the tracked memory's registration, so it
+    // can't be filled lazily by another userfaultfd
+    virtual bool usesUserfaultfd() { return false; }
 
   protected:
     const std::string mode;
@@ -70,16 +123,15 @@ class SoftPTEDirtyTracker final : public DirtyTracker
 
     void stopTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getDirtyPages(std::span<uint8_t> region) override;
 
     void startThreadLocalTracking(std::span<uint8_t> region) override;
 
     void stopThreadLocalTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getThreadLocalDirtyPages(
-      std::span<uint8_t> region) override;
+    DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) override;
 
-    std::vector<char> getBothDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getBothDirtyPages(std::span<uint8_t> region) override;
 
   private:
     FILE* clearRefsFile = nullptr;
@@ -89,6 +141,65 @@ class SoftPTEDirtyTracker final : public DirtyTracker
     void resetPTEs();
 };
 
+/*
+ * Dirty tracking implementation using the PAGEMAP_SCAN ioctl on memory that's
+ * registered for asynchronous write-protection with userfaultfd. Writes don't
+ * need to be handled in userspace, and each tracked region is scanned and
+ * reset on its own, rather than resetting the whole process as soft-dirty
+ * PTEs do. Needs Linux 6.7 or later.
+ * https://docs.kernel.org/admin-guide/mm/pagemap.html
+ */
+class PagemapScanDirtyTracker final : public DirtyTracker
+{
+  public:
+    PagemapScanDirtyTracker(const std::string& modeIn);
+
+    ~PagemapScanDirtyTracker();
+
+    // Whether the kernel supports this tracker, i.e. is Linux 6.7 or later
+    static bool isSupported();
+
+    void clearAll() override;
+
+    std::string getType() override { return "pagemap-scan"; }
+
+    void startTracking(std::span<uint8_t> region) override;
+
+    void stopTracking(std::span<uint8_t> region) override;
+
+    DirtyPages getDirtyPages(std::span<uint8_t> region) override;
+
+    void startThreadLocalTracking(std::span<uint8_t> region) override;
+
+    void stopThreadLocalTracking(std::span<uint8_t> region) override;
+
+    DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) override;
+
+    DirtyPages getBothDirtyPages(std::span<uint8_t> region) override;
+
+    bool usesUserfaultfd() override { return true; }
+
+    // Returns the pages written in the region as ranges of offsets, merging
+    // neighbouring pages. If reset is set, the pages are write-protected again
+    // in the same call, so no writes can be missed in between.
+    std::vector<std::pair<size_t, size_t>> getDirtyRanges(
+      std::span<uint8_t> region,
+      bool reset = false);
+
+  private:
+    UserfaultFd uffd;
+
+    int pagemapFd = -1;
+
+    // Regions registered with the userfaultfd, by start address
+    std::mutex regionsMx;
+    std::map<uintptr_t, size_t> regions;
+
+    void scanRegion(std::span<uint8_t> region,
+                    bool reset,
+                    std::vector<std::pair<size_t, size_t>>* ranges);
+};
+
 /*
  * Dirty tracking implementation using mprotect to make pages read-only and
  * use segfaults resulting from writes to mark them as dirty.
@@ -106,16 +217,15 @@ class SegfaultDirtyTracker final : public DirtyTracker
 
     void stopTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getDirtyPages(std::span<uint8_t> region) override;
 
     void startThreadLocalTracking(std::span<uint8_t> region) override;
 
     void stopThreadLocalTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getThreadLocalDirtyPages(
-      std::span<uint8_t> region) override;
+    DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) override;
 
-    std::vector<char> getBothDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getBothDirtyPages(std::span<uint8_t> region) override;
 
     // Signal handler for the resulting segfaults
     static void handler(int sig, siginfo_t* info, void* ucontext) noexcept;
@@ -133,7 +243,11 @@ class SegfaultDirtyTracker final : public DirtyTracker
  *   subsequent writes to write-protected pages.
  * - uffd-thread - same as `uffd`, but using a background event thread to handle
  *   events. This has the benefit of distinguishing between read and write
- *   missing page events.
+ *   missing page events. Events carry the id of the faulting thread, so
+ *   writes are attributed to threads doing thread-local tracking. Events are
+ *   read in batches, and the pages they fault on resolved with one ioctl per
+ *   run of pages. The number of event threads and how many pages are
+ *   resolved ahead of sequential writers are set in the system config.
  * - uffd-thread-wp - same as `uffd-thread`, but adds write-protected events.
  *
  * See the docs for more info on these different approaches:
@@ -154,16 +268,21 @@ class UffdDirtyTracker final : public DirtyTracker
 
     void stopTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getDirtyPages(std::span<uint8_t> region) override;
 
     void startThreadLocalTracking(std::span<uint8_t> region) override;
 
     void stopThreadLocalTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getThreadLocalDirtyPages(
-      std::span<uint8_t> region) override;
+    DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) override;
+
+    DirtyPages getBothDirtyPages(std::span<uint8_t> region) override;
+
+    bool usesUserfaultfd() override { return true; }
 
-    std::vector<char> getBothDirtyPages(std::span<uint8_t> region) override;
+    // Number of fault events handled by the event threads since the tracker
+    // was created
+    static size_t getHandledFaultCount();
 
     static void sigbusHandler(int sig,
                               siginfo_t* info,
@@ -209,19 +328,18 @@ class NoneDirtyTracker final : public DirtyTracker
 
     void stopTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getDirtyPages(std::span<uint8_t> region) override;
 
     void startThreadLocalTracking(std::span<uint8_t> region) override;
 
     void stopThreadLocalTracking(std::span<uint8_t> region) override;
 
-    std::vector<char> getThreadLocalDirtyPages(
-      std::span<uint8_t> region) override;
+    DirtyPages getThreadLocalDirtyPages(std::span<uint8_t> region) override;
 
-    std::vector<char> getBothDirtyPages(std::span<uint8_t> region) override;
+    DirtyPages getBothDirtyPages(std::span<uint8_t> region) override;
 
   private:
-    std::vector<char> dirtyPages;
+    DirtyPages dirtyPages;
 };
 
 /**
@@ -2,9 +2,18 @@
 
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/util/exception.h>
+#include <google/protobuf/arena.h>
+#include <memory>
 #include <string>
 #include <vector>
 
+// Size of the block each pooled request arena starts with, requests that fit
+// in it are built without allocating once the arena has been used
+#define REQUEST_ARENA_BLOCK_SIZE (16 * 1024)
+
+// Maximum number of idle request arenas kept for reuse
+#define REQUEST_ARENA_POOL_SIZE 64
+
 namespace faabric::util {
 
 class FunctionMigratedException : public faabric::util::FaabricException
@@ -31,6 +40,20 @@ std::shared_ptr<faabric::Message> messageFactoryShared(
 faabric::Message messageFactory(const std::string& user,
                                 const std::string& function);
 
+/*
+ * Returns an arena from the pool, which is reset and returned to the pool when
+ * the last reference to it is dropped. Everything allocated on the arena is
+ * freed in one go at that point.
+ */
+std::shared_ptr<google::protobuf::Arena> getRequestArena();
+
+/*
+ * Creates an empty request on a pooled arena, which is freed along with
+ * everything in the request when the last reference to the request is
+ * dropped. Messages moved into the request are copied onto the arena.
+ */
+std::shared_ptr<faabric::BatchExecuteRequest> arenaBatchExecRequest();
+
 std::shared_ptr<faabric::BatchExecuteRequest> batchExecFactory();
 
 std::shared_ptr<faabric::BatchExecuteRequest> batchExecFactory(faabric::Message&& msg);
@@ -54,4 +77,10 @@ std::vector<std::string> getArgvForMessage(const faabric::Message& msg);
  */
 std::string getMainThreadSnapshotKey(const faabric::Message& msg);
 
+/*
+ * Gets the key for the zygote snapshot of the given message's function, i.e.
+ * its memory just after it was first initialised on this host.
+ */
+std::string getZygoteSnapshotKey(const faabric::Message& msg);
+
 }
@@ -8,6 +8,9 @@ std::string messageToJson(const faabric::Message& msg);
 
 faabric::Message jsonToMessage(const std::string& jsonIn);
 
+// Parses into the given message, e.g. one already allocated in a request
+void jsonToMessage(const std::string& jsonIn, faabric::Message& msg);
+
 class JsonFieldNotFound : public faabric::util::FaabricException
 {
   public:
@@ -4,29 +4,104 @@
 #include <fcntl.h>
 #include <functional>
 #include "userfaultfd.h"
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
+#define PAGEMAP "/proc/self/pagemap"
+
+#define PAGEMAP_ENTRY_BYTES sizeof(uint64_t)
+#define PAGEMAP_FILE_OR_SHARED (1Ull << 61)
+#define PAGEMAP_SWAPPED (1Ull << 62)
+#define PAGEMAP_PRESENT (1Ull << 63)
+
 namespace faabric::util {
 
 /*
- * Merges all the dirty page flags from the list of vectors into the first
- * vector in place.
+ * Set of dirty pages in a region of memory, held as a bitset with one bit per
+ * host page. Merging and scanning work on whole words, so sets covering large
+ * memories with few dirty pages are cheap to merge and skip over.
+ */
+class DirtyPages
+{
+  public:
+    DirtyPages() = default;
+
+    explicit DirtyPages(size_t nPagesIn, bool dirty = false);
+
+    // Builds the set from one flag per page, non-zero flags being dirty
+    explicit DirtyPages(const std::vector<char>& flags);
+
+    size_t size() const { return nPages; }
+
+    bool empty() const { return nPages == 0; }
+
+    // Pages past the end of the set are never dirty
+    bool isDirty(size_t page) const
+    {
+        return page < nPages && (words[page / 64] >> (page % 64)) & 1;
+    }
+
+    void markDirty(size_t page) { words[page / 64] |= 1Ull << (page % 64); }
+
+    // Marks the pages in [startPage, endPage) as dirty
+    void markDirty(size_t startPage, size_t endPage);
+
+    // Pages added by growing the set are clean
+    void resize(size_t nPagesIn);
+
+    void clear();
+
+    bool any() const;
+
+    size_t count() const;
+
+    // Returns the first dirty page at or after the given page, or the size of
+    // the set if there are none
+    size_t nextDirty(size_t page) const;
+
+    // Returns the first clean page at or after the given page, or the size of
+    // the set if there are none
+    size_t nextClean(size_t page) const;
+
+    // Returns the runs of dirty pages as [start, end) page ranges
+    std::vector<std::pair<size_t, size_t>> getRanges() const;
+
+    std::vector<char> toFlags() const;
+
+    // Merges the other set's dirty pages into this one, growing it to fit
+    void merge(const DirtyPages& other);
+
+    bool operator==(const DirtyPages& other) const = default;
+
+  private:
+    size_t nPages = 0;
+
+    // Bits past the last page are always clear
+    std::vector<uint64_t> words;
+};
+
+/*
+ * Merges all the dirty pages from the list of sets into the first set in
+ * place.
  */
-void mergeManyDirtyPages(std::vector<char>& dest,
-                         const std::vector<std::vector<char>>& source);
+void mergeManyDirtyPages(DirtyPages& dest,
+                         const std::vector<DirtyPages>& source);
 
 /*
- * Merges the dirty page flags from the source into the destination.
+ * Merges the dirty pages from the source into the destination.
  */
-void mergeDirtyPages(std::vector<char>& dest, const std::vector<char>& source);
+void mergeDirtyPages(DirtyPages& dest, const DirtyPages& source);
 
 /*
  * Typedef used to enforce RAII on mmapped memory regions
@@ -59,6 +134,23 @@ size_t alignOffsetDown(size_t offset);
 
 AlignedChunk getPageAlignedChunk(long offset, long length);
 
+// -------------------------
+// Huge pages
+// -------------------------
+
+// Size of the huge pages used to back large allocations, read from the kernel
+size_t getHugePageSize();
+
+bool isHugePageAligned(const void* ptr);
+
+/*
+ * Returns the size of the pages backing the start of the region, which is the
+ * huge page size for memory allocated with huge TLB pages, and the host page
+ * size otherwise. Transparent huge pages are split by the kernel when parts of
+ * them are protected, so they count as host pages.
+ */
+size_t getBackingPageSize(std::span<const uint8_t> region);
+
 // -------------------------
 // Dirty pages
 // -------------------------
@@ -105,7 +197,9 @@ struct UserfaultFd
     // Release ownership and return the fd
     std::pair<int, uffdio_api> release();
 
-    void create(int flags = 0, bool sigbus = false);
+    // Extra features are requested on top of the defaults, and the handshake
+    // fails if the kernel doesn't support them
+    void create(int flags = 0, bool sigbus = false, uint64_t extraFeatures = 0);
 
     // Thread-safe
     inline void checkFd()
@@ -148,14 +242,90 @@ struct UserfaultFd
     void wakePages(size_t startPtr, size_t length);
 };
 
+// -------------------------
+// Lazy pages
+// -------------------------
+
+/*
+ * Provides the data for a page-aligned range of a lazily filled region,
+ * returning a pointer to it that must stay valid until the range is filled.
+ */
+using LazyPageSource =
+  std::function<const uint8_t*(size_t offset, size_t length)>;
+
+/*
+ * Fills in the pages of registered regions the first time they are accessed,
+ * rather than up front. Faults are handled on a background thread, which
+ * copies each missing page in from the region's source with userfaultfd. If a
+ * source fails, its region is removed, so its unfilled pages read as zero.
+ */
+class LazyPageHandler
+{
+  public:
+    LazyPageHandler();
+
+    LazyPageHandler(const LazyPageHandler&) = delete;
+
+    LazyPageHandler& operator=(const LazyPageHandler&) = delete;
+
+    ~LazyPageHandler();
+
+    // Replaces the region with empty memory whose pages are filled from the
+    // source on first access. On each fault, up to prefetchPages of the pages
+    // that follow are filled at the same time, if they aren't already.
+    void addRegion(std::span<uint8_t> region,
+                   LazyPageSource source,
+                   size_t prefetchPages,
+                   const void* owner);
+
+    // Stops filling the regions added by the given owner from their sources,
+    // any of their pages not yet filled will read as zero. Waits for any
+    // fetch in progress, so the sources aren't used once this returns.
+    void removeRegions(const void* owner);
+
+    size_t getRegionCount();
+
+  private:
+    struct LazyRegion;
+
+    UserfaultFd uffd;
+
+    int closeFd = -1;
+
+    std::mutex mx;
+
+    // Held while fetching from a source, which is done without holding mx
+    std::mutex fetchMx;
+
+    // Keyed on the start address of each region
+    std::map<uintptr_t, std::shared_ptr<LazyRegion>> regions;
+
+    std::jthread eventThread;
+
+    void eventLoop();
+
+    void handleFault(uintptr_t faultAddr);
+};
+
+LazyPageHandler& getLazyPageHandler();
+
 // -------------------------
 // Allocation
 // -------------------------
 
+/*
+ * Allocations of at least a huge page are backed by huge pages depending on
+ * the huge pages mode in the system config. In "transparent" mode they are
+ * aligned to the huge page size and advised to use transparent huge pages. In
+ * "explicit" mode private and shared memory is allocated with huge TLB pages,
+ * falling back to transparent huge pages if not enough are reserved. Memory
+ * backed by huge TLB pages can't be mapped onto from an fd.
+ */
 MemoryRegion allocatePrivateMemory(size_t size);
 
 MemoryRegion allocateSharedMemory(size_t size);
 
+// Virtual memory is claimed in host pages, so only uses transparent huge pages
 MemoryRegion allocateVirtualMemory(size_t size);
 
 void claimVirtualMemory(std::span<uint8_t> region);
@@ -164,6 +334,12 @@ void mapMemoryPrivate(std::span<uint8_t> target, int fd);
 
 void mapMemoryShared(std::span<uint8_t> target, int fd);
 
+/*
+ * Counts the pages in the region backed by private anonymous memory. For a
+ * private file mapping these are the pages that have been copied on write.
+ */
+size_t countPrivatePages(std::span<const uint8_t> region);
+
 void resizeFd(int fd, size_t size);
 
 void writeToFd(int fd, off_t offset, std::span<const uint8_t> data);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define PROC_SELF_CGROUP "/proc/self/cgroup"
+#define SYSTEM_MEMORY_PRESSURE "/proc/pressure/memory"
+
+namespace faabric::util {
+
+/*
+ * Memory pressure on this host. Stalls are the kernel's pressure stall
+ * information (PSI), as the percentage of the last ten seconds in which some
+ * or all tasks were waiting on memory. Usage and limit are those of this
+ * process's cgroup, or of the whole host if the cgroup has no limit.
+ */
+struct MemoryPressure
+{
+    double someStallPercent = 0;
+    double fullStallPercent = 0;
+
+    size_t usageBytes = 0;
+    size_t limitBytes = 0;
+};
+
+/*
+ * Reads the memory pressure from the cgroup v2 directory given in the system
+ * config, or the cgroup this process is in if none is given. Falls back to the
+ * system-wide values for anything the cgroup doesn't provide.
+ */
+MemoryPressure readMemoryPressure();
+
+MemoryPressure readMemoryPressure(const std::string& cgroupDir);
+
+/*
+ * Parses the contents of a PSI file, e.g. /proc/pressure/memory, setting the
+ * stalls in the given pressure.
+ */
+void parsePressureStall(const std::string& psi, MemoryPressure& pressure);
+
+/*
+ * Returns the cgroup v2 directory this process is in.
+ */
+std::string getCgroupDir();
+}
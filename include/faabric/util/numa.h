@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#define NUMA_NODES_DIR "/sys/devices/system/node"
+
+namespace faabric::util {
+
+struct NumaNode
+{
+    int id = 0;
+
+    std::vector<int> cpus;
+};
+
+/*
+ * The NUMA nodes of this host and the CPUs on each that this process may run
+ * on. Nodes without any such CPUs are left out. Hosts without NUMA are a
+ * single node zero holding all CPUs.
+ */
+struct CpuTopology
+{
+    std::vector<NumaNode> nodes;
+
+    // Returns the node with the given id, or null if there isn't one
+    const NumaNode* getNode(int nodeId) const;
+
+    std::vector<int> getCpus() const;
+};
+
+/*
+ * Parses a sysfs CPU list, e.g. "0-3,8,10-11".
+ */
+std::vector<int> parseCpuList(const std::string& cpuList);
+
+/*
+ * Returns the CPUs this process may run on.
+ */
+std::vector<int> getAffinityCpus();
+
+/*
+ * Reads the topology of this host from sysfs, restricted to the given CPUs.
+ */
+CpuTopology readCpuTopology(const std::string& nodesDir,
+                            const std::vector<int>& usableCpus);
+
+/*
+ * Returns the topology of this host, read on first use.
+ */
+const CpuTopology& getCpuTopology();
+
+/*
+ * Restricts the calling thread to run on the given CPUs.
+ */
+void pinThreadToCpus(const std::vector<int>& cpus);
+
+/*
+ * Makes memory first touched by the calling thread prefer the given node.
+ */
+void setThreadNumaNode(int nodeId);
+
+/*
+ * Makes the whole pages in the region prefer the given node, moving any
+ * already allocated elsewhere. Pages of shared memory are bound for all their
+ * mappings. Failures are logged and ignored, as binding is only an
+ * optimisation.
+ */
+void bindToNumaNode(std::span<uint8_t> region, int nodeId);
+}
@@ -14,7 +14,7 @@ class SchedulingDecision
 {
   public:
     static SchedulingDecision fromPointToPointMappings(
-      faabric::PointToPointMappings& mappings);
+      const faabric::PointToPointMappings& mappings);
 
     SchedulingDecision(uint32_t appIdIn, int32_t groupIdIn);
 
@@ -43,6 +43,8 @@ class SchedulingDecision
      */
     bool isSingleHost();
 
+    faabric::PointToPointMappings toPointToPointMappings() const;
+
     void addMessage(const std::string& host, const faabric::Message& msg);
 
     void addMessage(const std::string& host, int32_t messageId, int32_t appIdx);
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <faabric/util/dirty.h>
@@ -16,10 +22,20 @@
 namespace faabric::util {
 
 // This paramter controls the step size in the array comparison function. The
-// function will normally be comparing 4kB pages, and when it detects a change
-// within a chunk, it will byte-wise compare that chunk
+// function will normally be comparing 4kB pages, and skips over unchanged
+// chunks of this size before looking for changes within a chunk
 #define ARRAY_COMP_CHUNK_SIZE 128
 
+// Diffing is only split across threads when at least this many pages are
+// dirty, below this the cost of starting the threads outweighs the gain. Work
+// is handed out to threads in tasks of up to DIFF_TASK_PAGES pages.
+#define DIFF_PARALLEL_MIN_DIRTY_PAGES 256
+#define DIFF_TASK_PAGES 64
+
+// Queued diffs are only written on multiple threads when there are at least
+// this many of them
+#define WRITE_DIFFS_PARALLEL_MIN_DIFFS 1024
+
 /**
  * Defines the permitted datatypes for snapshot diffs. Each has a predefined
  * length, except for the raw option which is used for generic streams of bytes.
@@ -93,19 +109,22 @@ class SnapshotDiff
  * arrays.
  *
  * The function compares chunks of bytes at a time, if there are no differences,
- * it skips to the next chunk. If one or more differences are detected in a
- * chunk, it does a byte-wise comparison on that chunk.
+ * it skips to the next chunk. Within a chunk that has changed, it compares a
+ * vector register's worth of bytes at a time (depending on the instruction set
+ * the code is built for), and uses the resulting bitmask to find where runs of
+ * changed bytes start and end.
  *
- * The performance of this will vary depending on how sparse the diffs are, and
- * on the chunk size itself. A larger chunk size is optimal for very sparse
- * changes, but it makes the byte-wise comparision more intensive (as we're
- * byte-wise comparing more bytes).
+ * Runs separated by at most mergeGap unchanged bytes are merged into a single
+ * diff, which includes the unchanged bytes in between. This cuts down on the
+ * number of diffs, but is only safe when nothing else may write to the gap in
+ * the meantime, as the diff will overwrite it with its old value.
  */
 void diffArrayRegions(std::vector<SnapshotDiff>& diffs,
                       uint32_t startOffset,
                       uint32_t endOffset,
                       std::span<const uint8_t> a,
-                      std::span<const uint8_t> b);
+                      std::span<const uint8_t> b,
+                      uint32_t mergeGap = 0);
 
 /**
  * Defines how diffs in the given snapshot region should be interpreted wrt the
@@ -134,10 +153,20 @@ class SnapshotMergeRegion
                         SnapshotDataType dataTypeIn,
                         SnapshotMergeOperation operationIn);
 
+    // Diffs can be restricted to the pages in [fromPage, toPage) of a bytewise,
+    // XOR or typed array region, so that a large region can be split up and
+    // diffed in parallel. Values in a typed array belong to the page they
+    // start on. Single-value regions are always diffed as a whole.
     void addDiffs(std::vector<SnapshotDiff>& diffs,
                   std::span<const uint8_t> originalData,
                   std::span<uint8_t> updatedData,
-                  const std::vector<char>& dirtyRegions);
+                  const DirtyPages& dirtyRegions,
+                  size_t fromPage = 0,
+                  size_t toPage = std::numeric_limits<size_t>::max());
+
+    // Typed regions spanning more than one value of their type are arrays,
+    // which get one diff per run of changed values
+    bool isTypedArray() const;
 
     /**
      * This allows us to sort the merge regions which is important for diffing
@@ -209,6 +238,48 @@ inline bool calculateDiffValue(const uint8_t* original,
     return true;
 }
 
+/*
+ * Calculates the diff values of a run of consecutive changed values in place,
+ * as calculateDiffValue does for a single value. The operation is only
+ * checked once, so that each loop can be vectorised.
+ */
+template<typename T>
+inline void calculateDiffValues(const uint8_t* original,
+                                uint8_t* updated,
+                                size_t nValues,
+                                SnapshotMergeOperation operation)
+{
+    auto transformValues = [&](auto op) {
+        for (size_t i = 0; i < nValues; i++) {
+            T result = op(unalignedRead<T>(original + i * sizeof(T)),
+                          unalignedRead<T>(updated + i * sizeof(T)));
+            unalignedWrite<T>(result, updated + i * sizeof(T));
+        }
+    };
+
+    switch (operation) {
+        case (SnapshotMergeOperation::Sum): {
+            transformValues([](T orig, T upd) { return upd - orig; });
+            break;
+        }
+        case (SnapshotMergeOperation::Subtract): {
+            transformValues([](T orig, T upd) { return orig - upd; });
+            break;
+        }
+        case (SnapshotMergeOperation::Product): {
+            transformValues([](T orig, T upd) { return upd / orig; });
+            break;
+        }
+        case (SnapshotMergeOperation::Max):
+        case (SnapshotMergeOperation::Min):
+            break;
+        default: {
+            SPDLOG_ERROR("Can't calculate diff for operation: {}", operation);
+            throw std::runtime_error("Can't calculate diff");
+        }
+    }
+}
+
 /*
  * Applies a diff value to the master copy of a snapshot, where the diff has
  * been calculated based on a change made to another copy of the same snapshot.
@@ -245,6 +316,33 @@ inline T applyDiffValue(const uint8_t* original,
     }
 }
 
+/*
+ * Pages of snapshot data are identified by the SHA-256 hash of their contents,
+ * so that hosts can tell which pages they already hold without transferring
+ * them. The final page of a snapshot may be shorter than a full page.
+ */
+using SnapshotPageHash = std::array<uint8_t, 32>;
+
+SnapshotPageHash hashSnapshotPage(std::span<const uint8_t> page);
+
+// The hash is already uniformly distributed, so any part of it will do
+struct SnapshotPageHashHasher
+{
+    size_t operator()(const SnapshotPageHash& hash) const
+    {
+        size_t result;
+        std::memcpy(&result, hash.data(), sizeof(result));
+        return result;
+    }
+};
+
+/*
+ * Fetches part of a snapshot held elsewhere into the buffer. The part starts
+ * on a page boundary, and is a whole number of pages unless it's at the end.
+ */
+using SnapshotPageFetcher =
+  std::function<void(uint32_t offset, std::span<uint8_t> buffer)>;
+
 class SnapshotData
 {
   public:
@@ -266,14 +364,41 @@ class SnapshotData
 
     void copyInData(std::span<const uint8_t> buffer, uint32_t offset = 0);
 
+    // Decompresses a zstd frame straight into the given regions of the
+    // snapshot, filling them in order. Regions are offsets and lengths.
+    void copyInCompressedData(
+      std::span<const uint8_t> compressed,
+      const std::vector<std::pair<uint32_t, size_t>>& regions);
+
+    // Note that this doesn't fetch any missing pages of a lazy snapshot
     const uint8_t* getDataPtr(uint32_t offset = 0);
 
     std::vector<uint8_t> getDataCopy();
 
     std::vector<uint8_t> getDataCopy(uint32_t offset, size_t dataSize);
 
+    // Maps the snapshot onto the target copy-on-write, so restoring takes the
+    // same time whatever the snapshot size, and only pages that are written
+    // to get copied
     void mapToMemory(std::span<uint8_t> target);
 
+    // Maps the snapshot onto the target like mapToMemory, but each page is
+    // only filled in when first accessed, fetching it first if it's missing.
+    // With committedOnly, pages are filled in as of the latest committed
+    // version when mapped, or the oldest one kept once that's been pruned.
+    void mapToMemoryLazily(std::span<uint8_t> target,
+                           size_t prefetchPages,
+                           bool committedOnly = false);
+
+    // Marks all pages of the snapshot as missing, to be fetched the first time
+    // they're read or written
+    void setLazyPageFetcher(SnapshotPageFetcher fetcherIn);
+
+    size_t getMissingPageCount() const { return nMissingPages; }
+
+    // Fetches any missing pages overlapping the given range
+    void fetchMissingPages(uint32_t offset, size_t length);
+
     void addMergeRegion(uint32_t offset,
                         size_t length,
                         SnapshotDataType dataType,
@@ -301,6 +426,10 @@ class SnapshotData
 
     int getFd() const { return fd; }
 
+    // Returns the hashes of each page of the snapshot, which are cached until
+    // the snapshot is next modified.
+    std::vector<SnapshotPageHash> getPageHashes();
+
     // Returns a list of changes that have been made to the snapshot since the
     // last time the list was cleared.
     std::vector<SnapshotDiff> getTrackedChanges();
@@ -308,12 +437,43 @@ class SnapshotData
     // Clears the list of tracked changes.
     void clearTrackedChanges();
 
+    // Commits the changes tracked since the last version as a new version,
+    // clearing the tracked changes. Returns the latest version, which is
+    // unchanged if there was nothing to commit. From the first commit on,
+    // pages are copied before they're first changed in each version, so that
+    // committed versions stay readable while the next one is built.
+    uint64_t commitVersion();
+
+    uint64_t getVersion();
+
+    // Returns the changes committed in all versions after the given one, with
+    // overlapping changes merged. Data is as of the latest committed version,
+    // leaving out changes yet to be committed. Throws if the version has been
+    // pruned.
+    std::vector<SnapshotDiff> getChangesSinceVersion(uint64_t sinceVersion);
+
+    // Returns a copy of the data as of the given committed version. Throws if
+    // the version has been pruned.
+    std::vector<uint8_t> getVersionDataCopy(uint64_t atVersion);
+
+    // Maps the given committed version onto the target like mapToMemory, then
+    // copies in the pages that have changed since
+    void mapVersionToMemory(std::span<uint8_t> target, uint64_t atVersion);
+
+    // Maps the latest committed version, which can't be pruned in between
+    void mapCommittedToMemory(std::span<uint8_t> target);
+
+    // Drops the change logs and page copies of versions up to and including
+    // the given one, once no host needs to be brought up to date from before
+    // it. The given version stays readable.
+    void pruneVersions(uint64_t upToVersion);
+
     // Returns the list of changes in the given dirty regions versus their
     // original value in the snapshot, based on the merge regions set on this
     // snapshot.
     std::vector<faabric::util::SnapshotDiff> diffWithDirtyRegions(
       std::span<uint8_t> updated,
-      const std::vector<char>& dirtyRegions);
+      const DirtyPages& dirtyRegions);
 
   private:
     size_t size = 0;
@@ -329,8 +489,39 @@ class SnapshotData
 
     std::vector<std::pair<uint32_t, uint32_t>> trackedChanges;
 
+    // Committed versions, each with the merged changes made in that version.
+    // Logs of versions up to prunedVersion have been dropped.
+    uint64_t version = 0;
+    uint64_t prunedVersion = 0;
+    std::map<uint64_t, std::vector<std::pair<uint32_t, uint32_t>>>
+      versionChanges;
+
+    // Copies of pages taken before their first change in each version, keyed
+    // on that version, with version + 1 holding those yet to be committed. A
+    // page's contents in a version are those of its first copy in any later
+    // version, or the live data if there is none.
+    bool versioned = false;
+    std::map<uint64_t, std::unordered_map<size_t, std::vector<uint8_t>>>
+      versionPages;
+
     std::vector<SnapshotMergeRegion> mergeRegions;
 
+    // Incremented on every write, to tell when cached page hashes are stale
+    uint64_t writeCount = 0;
+
+    std::mutex pageHashesMx;
+    std::vector<SnapshotPageHash> pageHashes;
+    uint64_t pageHashesWriteCount = 0;
+
+    // Pages of a lazy snapshot that have yet to be fetched
+    std::mutex missingPagesMx;
+    SnapshotPageFetcher pageFetcher;
+    std::vector<bool> missingPages;
+    size_t lazySize = 0;
+    std::atomic<size_t> nMissingPages = 0;
+
+    std::atomic<bool> mappedLazily = false;
+
     uint8_t* validatedOffsetPtr(uint32_t offset);
 
     void mapToMemory(uint8_t* target, bool shared);
@@ -339,7 +530,25 @@ class SnapshotData
 
     void xorData(std::span<const uint8_t> buffer, uint32_t offset = 0);
 
-    void checkWriteExtension(std::span<const uint8_t> buffer, uint32_t offset);
+    void checkWriteExtension(size_t regionEnd);
+
+    void doMapToMemory(std::span<uint8_t> target);
+
+    void doMapVersionToMemory(std::span<uint8_t> target, uint64_t atVersion);
+
+    void preserveVersionPages(uint32_t offset, size_t length);
+
+    void checkVersionReadable(uint64_t atVersion);
+
+    const uint8_t* getVersionPagePtr(uint64_t atVersion, size_t page);
+
+    void writeDiffs(const std::vector<SnapshotDiff>& diffs);
+
+    void diffRegionsInParallel(std::vector<SnapshotDiff>& diffs,
+                               std::span<const uint8_t> original,
+                               std::span<uint8_t> updated,
+                               const DirtyPages& dirtyRegions,
+                               int nThreads);
 };
 
 std::string snapshotDataTypeStr(SnapshotDataType dt);
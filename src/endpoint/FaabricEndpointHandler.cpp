@@ -56,7 +56,7 @@ void FaabricEndpointHandler::onRequest(
     } else {
         auto req = faabric::util::batchExecFactory();
         req->set_type(req->FUNCTIONS);
-        *req->add_messages() = faabric::util::jsonToMessage(requestStr);
+        faabric::util::jsonToMessage(requestStr, *req->add_messages());
         faabric::MessageInBatch msg(req, 0);
         faabric::scheduler::Scheduler& sched =
           faabric::scheduler::getScheduler();
@@ -16,6 +16,7 @@
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/memory.h>
+#include <faabric/util/numa.h>
 #include <faabric/util/queue.h>
 #include <faabric/util/scheduling.h>
 #include <faabric/util/snapshot.h>
@@ -147,7 +148,8 @@ std::vector<std::pair<uint32_t, int32_t>> Executor::executeThreads(
         tracker->stopThreadLocalTracking(memView);
 
         // If this is the first batch, these dirty regions will be empty
-        std::vector<char> dirtyRegions = tracker->getBothDirtyPages(memView);
+        faabric::util::DirtyPages dirtyRegions =
+          tracker->getBothDirtyPages(memView);
 
         // Apply changes to snapshot
         snap->fillGapsWithBytewiseRegions();
@@ -188,14 +190,12 @@ std::vector<std::pair<uint32_t, int32_t>> Executor::executeThreads(
         int nWritten = snap->writeQueuedDiffs();
 
         // Remap memory to snapshot if it's been updated
-        std::span<uint8_t> memView = getMemoryView();
         if (nWritten > 0) {
-            setMemorySize(snap->getSize());
-            snap->mapToMemory(memView);
+            restoreFromSnapshot(*snap);
         }
 
         // Start tracking again
-        memView = getMemoryView();
+        std::span<uint8_t> memView = getMemoryView();
         tracker->startTracking(memView);
         tracker->startThreadLocalTracking(memView);
     }
@@ -260,9 +260,6 @@ void Executor::executeTasks(std::vector<int> msgIdxs,
         // Get updated memory view and start global tracking of memory
         memView = getMemoryView();
         tracker->startTracking(memView);
-
-        // Prepare list of lists for dirty pages from each thread
-        threadLocalDirtyRegions.resize(req->messages_size());
     } else if (!isThreads && !firstMsg.snapshotkey().empty()) {
         // Restore from snapshot if provided
         std::string snapshotKey = firstMsg.snapshotkey();
@@ -373,6 +370,10 @@ std::shared_ptr<faabric::util::SnapshotData> Executor::getMainThreadSnapshot(
               std::make_shared<faabric::util::SnapshotData>(getMemoryView(),
                                                             getMaxMemorySize());
             reg.registerSnapshot(snapshotKey, snap);
+
+            // Threads are merged into the main thread snapshot until it's
+            // deleted, so it can't be evicted
+            reg.pinSnapshot(snapshotKey);
         } else {
             return reg.getSnapshot(snapshotKey);
         }
@@ -414,6 +415,8 @@ void Executor::threadPoolThread(std::stop_token st, int threadPoolIdx)
 
     const auto& conf = faabric::util::getSystemConfig();
 
+    placePoolThread(threadPoolIdx);
+
     bool failedTasks = false;
     auto failAllTasks = [&]() {
         failedTasks = true;
@@ -435,7 +438,7 @@ void Executor::threadPoolThread(std::stop_token st, int threadPoolIdx)
     if (threadPoolIdx == 0) {
         std::unique_lock<std::shared_mutex> _lock(resetMutex);
         try {
-            reset(boundMessage);
+            initialise();
         } catch (...) {
             SPDLOG_ERROR("Caught exception when initialising module for {}",
                          boundName);
@@ -566,11 +569,13 @@ void Executor::threadPoolThread(std::stop_token st, int threadPoolIdx)
             tracker->stopThreadLocalTracking(memView);
 
             // Add this thread's changes to executor-wide list of dirty regions
-            auto thisThreadDirtyRegions =
+            // as it finishes, so the last thread doesn't merge them all
+            faabric::util::DirtyPages thisThreadDirtyRegions =
               tracker->getThreadLocalDirtyPages(memView);
 
-            // Record this thread's dirty regions
-            threadLocalDirtyRegions[task.messageIndex] = thisThreadDirtyRegions;
+            faabric::util::FullLock lock(threadExecutionMutex);
+            faabric::util::mergeDirtyPages(dirtyRegions,
+                                           thisThreadDirtyRegions);
         }
 
         // Set the return value
@@ -602,19 +607,12 @@ void Executor::threadPoolThread(std::stop_token st, int threadPoolIdx)
                 std::span<uint8_t> memView = getMemoryView();
                 tracker->stopTracking(memView);
 
-                // Merge all dirty regions
+                // Each thread has already merged its own dirty regions
                 {
                     faabric::util::FullLock lock(threadExecutionMutex);
 
-                    // Merge together regions from all threads
-                    faabric::util::mergeManyDirtyPages(dirtyRegions,
-                                                       threadLocalDirtyRegions);
-
-                    // Clear thread-local dirty regions, no longer needed
-                    threadLocalDirtyRegions.clear();
-
                     // Merge the globally tracked regions
-                    std::vector<char> globalDirtyRegions =
+                    faabric::util::DirtyPages globalDirtyRegions =
                       tracker->getDirtyPages(memView);
                     faabric::util::mergeDirtyPages(dirtyRegions,
                                                    globalDirtyRegions);
@@ -727,6 +725,101 @@ void Executor::releaseClaim()
     claimed.store(false);
 }
 
+bool Executor::initialise()
+{
+    // Memory allocated before the executor was placed, e.g. when it was
+    // constructed, is moved to its node. Memory mapped from a zygote is left,
+    // so as not to move the zygote's own pages.
+    auto resetOnNode = [this]() {
+        reset(boundMessage);
+
+        int nodeId = numaNode.load();
+        if (nodeId >= 0) {
+            faabric::util::bindToNumaNode(getMemoryView(), nodeId);
+        }
+    };
+
+    if (faabric::util::getSystemConfig().zygoteSnapshots == 0) {
+        resetOnNode();
+        return false;
+    }
+
+    std::string version = getZygoteVersion();
+    std::shared_ptr<faabric::util::SnapshotData> zygote =
+      sch.getZygote(boundMessage, version);
+    if (zygote != nullptr) {
+        SPDLOG_DEBUG("Initialising {} from zygote", id);
+        resetFromZygote(boundMessage, *zygote);
+        return true;
+    }
+
+    resetOnNode();
+
+    // Capture the newly initialised memory for later executors
+    std::span<uint8_t> memView = getMemoryView();
+    if (!memView.empty()) {
+        sch.registerZygote(
+          boundMessage,
+          version,
+          std::make_shared<faabric::util::SnapshotData>(memView));
+    }
+
+    return false;
+}
+
+void Executor::placePoolThread(int threadPoolIdx)
+{
+    const auto& conf = faabric::util::getSystemConfig();
+    const faabric::util::CpuTopology& topology =
+      faabric::util::getCpuTopology();
+    const faabric::util::NumaNode* node = topology.getNode(numaNode.load());
+
+    // Memory first touched by this thread, including that of the executor
+    // when reset and of the snapshots it takes, goes on the node
+    if (node != nullptr) {
+        faabric::util::setThreadNumaNode(node->id);
+    }
+
+    if (conf.threadPinning != "core" && conf.threadPinning != "node") {
+        return;
+    }
+
+    std::vector<int> cpus = node != nullptr ? node->cpus : topology.getCpus();
+    if (conf.threadPinning == "core") {
+        cpus = { cpus.at((coreIdx.load() + threadPoolIdx) % cpus.size()) };
+    }
+
+    try {
+        faabric::util::pinThreadToCpus(cpus);
+    } catch (std::runtime_error&) {
+        SPDLOG_WARN("Could not pin thread {}:{}, leaving it unpinned",
+                    id,
+                    threadPoolIdx);
+    }
+}
+
+std::string Executor::getZygoteVersion()
+{
+    return "";
+}
+
+void Executor::resetFromZygote(faabric::Message& msg,
+                               faabric::util::SnapshotData& zygote)
+{
+    restoreFromSnapshot(zygote);
+}
+
+void Executor::prewarm()
+{
+    faabric::util::UniqueLock lock(threadsMutex);
+
+    if (threadPoolThreads.at(0) == nullptr) {
+        SPDLOG_DEBUG("Pre-warming executor {}", id);
+        threadPoolThreads.at(0) = std::make_shared<std::jthread>(
+          std::bind_front(&Executor::threadPoolThread, this), 0);
+    }
+}
+
 void Executor::softShutdown() {}
 
 int32_t Executor::getQueueLength()
@@ -789,11 +882,37 @@ void Executor::restore(const std::string& snapshotKey)
         throw std::runtime_error("No memory to restore executor");
     }
 
-    // Expand memory if necessary
+    SPDLOG_DEBUG("Restoring {} from {}", id, snapshotKey);
     auto snap = reg.getSnapshot(snapshotKey);
-    setMemorySize(snap->getSize());
+    restoreFromSnapshot(*snap, true);
+}
+
+size_t Executor::getRestoredDirtyPageCount()
+{
+    return faabric::util::countPrivatePages(getMemoryView());
+}
 
-    // Map the memory onto the snapshot
-    snap->mapToMemory({ memView.data(), snap->getSize() });
+void Executor::restoreFromSnapshot(faabric::util::SnapshotData& snap,
+                                   bool committedOnly)
+{
+    // Expand memory if necessary
+    setMemorySize(snap.getSize());
+    std::span<uint8_t> memView = getMemoryView();
+
+    // Snapshots pushed lazily have their pages filled in as the memory is
+    // accessed. Userfaultfd dirty tracking needs the memory for itself, so in
+    // that case the whole snapshot is fetched up front instead.
+    std::span<uint8_t> target(memView.data(), snap.getSize());
+    if (snap.getMissingPageCount() > 0 && !tracker->usesUserfaultfd()) {
+        SPDLOG_DEBUG("Restoring {} lazily", id);
+        snap.mapToMemoryLazily(
+          target,
+          faabric::util::getSystemConfig().snapshotPrefetchPages,
+          committedOnly);
+    } else if (committedOnly) {
+        snap.mapCommittedToMemory(target);
+    } else {
+        snap.mapToMemory(target);
+    }
 }
 }
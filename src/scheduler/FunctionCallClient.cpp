@@ -37,6 +37,9 @@ static std::vector<
 static std::vector<std::pair<std::string, faabric::UnregisterRequest>>
   unregisterRequests;
 
+static std::vector<std::pair<std::string, faabric::Message>>
+  functionUpdatedCalls;
+
 std::vector<std::pair<std::string, faabric::Message>> getFunctionCalls()
 {
     faabric::util::UniqueLock lock(mockMutex);
@@ -77,6 +80,12 @@ getUnregisterRequests()
     return unregisterRequests;
 }
 
+std::vector<std::pair<std::string, faabric::Message>> getFunctionUpdatedCalls()
+{
+    faabric::util::UniqueLock lock(mockMutex);
+    return functionUpdatedCalls;
+}
+
 void queueResourceResponse(const std::string& host, faabric::HostResources& res)
 {
     faabric::util::UniqueLock lock(mockMutex);
@@ -91,6 +100,7 @@ void clearMockRequests()
     resourceRequests.clear();
     pendingMigrationsRequests.clear();
     unregisterRequests.clear();
+    functionUpdatedCalls.clear();
 
     for (auto& p : queuedResourceResponses) {
         p.second.reset();
@@ -106,6 +116,20 @@ FunctionCallClient::FunctionCallClient(const std::string& hostIn)
                                               FUNCTION_CALL_ASYNC_PORT,
                                               FUNCTION_CALL_SYNC_PORT)
 {
+    addPriorityLane(FUNCTION_CALL_PRIORITY_ASYNC_PORT,
+                    FUNCTION_CALL_PRIORITY_SYNC_PORT);
+}
+
+bool FunctionCallClient::isPriorityCall(int header)
+{
+    // Only the bulk calls stay on the main sockets
+    switch (header) {
+        case faabric::scheduler::FunctionCalls::ExecuteFunctions:
+        case faabric::scheduler::FunctionCalls::NdpDeltaRequest:
+            return false;
+        default:
+            return true;
+    }
 }
 
 void FunctionCallClient::sendFlush()
@@ -171,8 +195,8 @@ void FunctionCallClient::executeFunctions(
         faabric::util::UniqueLock lock(mockMutex);
         batchMessages.emplace_back(host, req);
     } else {
-        asyncSend(faabric::scheduler::FunctionCalls::ExecuteFunctions,
-                  req.get());
+        asyncSendNoWait(faabric::scheduler::FunctionCalls::ExecuteFunctions,
+                        req.get());
     }
 }
 
@@ -181,7 +205,7 @@ void FunctionCallClient::sendDirectResult(faabric::Message msg)
     ZoneScopedNS("FunctionCallClient::sendDirectResult", 6);
     faabric::DirectResultTransmission drt;
     drt.mutable_result()->CopyFrom(msg);
-    asyncSend(faabric::scheduler::FunctionCalls::DirectResult, &drt);
+    asyncSendNoWait(faabric::scheduler::FunctionCalls::DirectResult, &drt);
 }
 
 void FunctionCallClient::unregister(faabric::UnregisterRequest& req)
@@ -194,6 +218,17 @@ void FunctionCallClient::unregister(faabric::UnregisterRequest& req)
     }
 }
 
+void FunctionCallClient::sendFunctionUpdated(const faabric::Message& msg)
+{
+    if (faabric::util::isMockMode()) {
+        faabric::util::UniqueLock lock(mockMutex);
+        functionUpdatedCalls.emplace_back(host, msg);
+    } else {
+        faabric::Message req = msg;
+        asyncSend(faabric::scheduler::FunctionCalls::FunctionUpdated, &req);
+    }
+}
+
 faabric::NdpDelta FunctionCallClient::requestNdpDelta(int msgId)
 {
     faabric::GetNdpDelta gnd;
@@ -2,6 +2,7 @@
 #include <faabric/scheduler/FunctionCallServer.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/state/State.h>
+#include <faabric/transport/PointToPointBroker.h>
 #include <faabric/transport/common.h>
 #include <faabric/transport/macros.h>
 #include <faabric/util/concurrent_map.h>
@@ -19,6 +20,12 @@ FunctionCallServer::FunctionCallServer()
       faabric::util::getSystemConfig().functionServerThreads)
   , scheduler(getScheduler())
 {
+    // Results, resource queries and other control messages get their own
+    // workers, so they aren't held up by large batches or NDP deltas
+    addPriorityLane(
+      FUNCTION_CALL_PRIORITY_ASYNC_PORT,
+      FUNCTION_CALL_PRIORITY_SYNC_PORT,
+      faabric::util::getSystemConfig().functionServerPriorityThreads);
 }
 
 static faabric::util::ConcurrentMap<int, std::function<std::vector<uint8_t>()>>
@@ -48,6 +55,10 @@ void FunctionCallServer::doAsyncRecv(transport::Message& message)
             recvUnregister(message.udata());
             break;
         }
+        case faabric::scheduler::FunctionCalls::FunctionUpdated: {
+            recvFunctionUpdated(message.udata());
+            break;
+        }
         case faabric::scheduler::FunctionCalls::DirectResult: {
             recvDirectResult(message.udata());
             break;
@@ -98,13 +109,25 @@ std::unique_ptr<google::protobuf::Message> FunctionCallServer::recvFlush(
 void FunctionCallServer::recvExecuteFunctions(std::span<const uint8_t> buffer)
 {
     ZoneScopedNS("FunctionCallServer::recvExecuteFunctions", 6);
-    PARSE_MSG(faabric::BatchExecuteRequest, buffer.data(), buffer.size())
+
+    // Parse straight onto a pooled arena, which is freed in one go once the
+    // request is done with
+    auto req = faabric::util::arenaBatchExecRequest();
+    if (!req->ParseFromArray(buffer.data(), buffer.size())) {
+        throw std::runtime_error("Error deserialising message");
+    }
+
+    // Set up any point-to-point mappings piggybacked on the request before
+    // the functions start executing
+    if (req->has_mappings()) {
+        faabric::transport::getPointToPointBroker()
+          .setUpLocalMappingsFromPiggyback(req->mappings());
+        req->clear_mappings();
+    }
 
     // This host has now been told to execute these functions no matter what
-    // TODO - avoid this copy
-    parsedMsg.mutable_messages()->at(0).set_topologyhint("FORCE_LOCAL");
-    scheduler.callFunctions(
-      std::make_shared<faabric::BatchExecuteRequest>(std::move(parsedMsg)));
+    req->mutable_messages()->at(0).set_topologyhint("FORCE_LOCAL");
+    scheduler.callFunctions(std::move(req));
 }
 
 void FunctionCallServer::recvUnregister(std::span<const uint8_t> buffer)
@@ -121,6 +144,17 @@ void FunctionCallServer::recvUnregister(std::span<const uint8_t> buffer)
       parsedMsg.host(), parsedMsg.user(), parsedMsg.function());
 }
 
+void FunctionCallServer::recvFunctionUpdated(std::span<const uint8_t> buffer)
+{
+    PARSE_MSG(faabric::Message, buffer.data(), buffer.size())
+
+    SPDLOG_DEBUG("Function {}/{} updated",
+                 parsedMsg.user(),
+                 parsedMsg.function());
+
+    scheduler.invalidateZygote(parsedMsg);
+}
+
 std::unique_ptr<google::protobuf::Message> FunctionCallServer::recvGetResources(
   std::span<const uint8_t> buffer)
 {
@@ -1589,6 +1589,7 @@ void MpiWorld::prepareMigration(
 
     // Update local records
     if (thisRank == localLeader) {
+        std::map<int, std::string> migratedHosts;
         for (int i = 0; i < pendingMigrations->migrations_size(); i++) {
             auto m = pendingMigrations->mutable_migrations()->at(i);
             assert(hostForRank.at(m.msg().mpirank()) == m.srchost());
@@ -1622,11 +1623,12 @@ void MpiWorld::prepareMigration(
                 ranksForHost.erase(m.srchost());
             }
 
-            // This could be made more efficient as the broker method acquires
-            // a full lock every time
-            broker.updateHostForIdx(id, m.msg().mpirank(), m.dsthost());
+            migratedHosts[m.msg().mpirank()] = m.dsthost();
         }
 
+        // Apply the point-to-point mapping delta in one go
+        broker.updateHostsForIdxs(id, migratedHosts);
+
         // Set the migration flag
         hasBeenMigrated = true;
 
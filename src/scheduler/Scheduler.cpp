@@ -12,7 +12,9 @@
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
+#include <faabric/util/memory_pressure.h>
 #include <faabric/util/network.h>
+#include <faabric/util/numa.h>
 #include <faabric/util/random.h>
 #include <faabric/util/scheduling.h>
 #include <faabric/util/snapshot.h>
@@ -25,6 +27,8 @@
 #include <sys/syscall.h>
 
 #include <chrono>
+#include <cmath>
+#include <tuple>
 #include <unordered_set>
 
 #define FLUSH_TIMEOUT_MS 10000
@@ -83,6 +87,12 @@ Scheduler::Scheduler()
     // Start the reaper thread
     reaperThread.start(conf.reaperIntervalSeconds);
 
+    // Start pre-warming executors if enabled
+    lastPrewarmUpdate = faabric::util::startTimer();
+    if (conf.prewarmMaxExecutors > 0) {
+        prewarmThread.start(conf.prewarmIntervalSeconds);
+    }
+
     if (this->conf.isStorageNode) {
         redis::Redis& redis = redis::Redis::getQueue();
         redis.sadd(ALL_STORAGE_HOST_SET, this->thisHost);
@@ -168,6 +178,9 @@ void Scheduler::reset()
     // Stop the reaper thread
     reaperThread.stop();
 
+    // Stop the pre-warming thread
+    prewarmThread.stop();
+
     // Shut down, then clear executors
     for (auto& ep : executors) {
         for (auto& e : ep.second) {
@@ -195,6 +208,31 @@ void Scheduler::reset()
     threadResultMessages.clear();
 
     pushedSnapshotsMap.clear();
+    lazySnapshotHosts.clear();
+
+    nextCoreIdxs.clear();
+
+    // Reset executor pre-warming
+    prewarmStates.clear();
+    threadedFunctions.clear();
+    lastPrewarmUpdate = faabric::util::startTimer();
+
+    // Delete zygotes
+    {
+        faabric::util::UniqueLock zygotesLock(zygotesMx);
+        for (const auto& [key, version] : zygoteVersions) {
+            reg.deleteSnapshot(key);
+        }
+        zygoteVersions.clear();
+    }
+
+    // Reset memory accounting
+    lastMemoryPressure = faabric::util::MemoryPressure();
+    monitorExecutorBytes = 0;
+    monitorSnapshotBytes = 0;
+    monitorEvictedExecutors = 0;
+    monitorEvictedSnapshots = 0;
+    monitorEvictedBytes = 0;
 
     // Reset function migration tracking
     inFlightRequests.clear();
@@ -207,6 +245,11 @@ void Scheduler::reset()
 
     // Restart reaper thread
     reaperThread.start(conf.reaperIntervalSeconds);
+
+    // Restart pre-warming thread
+    if (conf.prewarmMaxExecutors > 0) {
+        prewarmThread.start(conf.prewarmIntervalSeconds);
+    }
 }
 
 void Scheduler::shutdown()
@@ -214,6 +257,7 @@ void Scheduler::shutdown()
     reset();
 
     reaperThread.stop();
+    prewarmThread.stop();
 
     removeHostFromGlobalSet(thisHost);
 
@@ -226,7 +270,9 @@ void Scheduler::shutdown()
 
 void SchedulerReaperThread::doWork()
 {
-    getScheduler().reapStaleExecutors();
+    Scheduler& sch = getScheduler();
+    sch.reapStaleExecutors();
+    sch.evictUnderMemoryPressure();
 }
 
 int Scheduler::reapStaleExecutors()
@@ -253,10 +299,12 @@ int Scheduler::reapStaleExecutors()
         SPDLOG_TRACE(
           "Checking {} executors for {} for reaping", execs.size(), key);
 
-        faabric::Message& firstMsg = execs.back()->getBoundMessage();
-        std::string user = firstMsg.user();
-        std::string function = firstMsg.function();
-        std::string masterHost = firstMsg.masterhost();
+        // Keep the executors pre-warmed for this function
+        int nToKeep = 0;
+        auto prewarmIt = prewarmStates.find(key);
+        if (prewarmIt != prewarmStates.end()) {
+            nToKeep = prewarmIt->second.target;
+        }
 
         for (auto exec : execs) {
             long millisSinceLastExec = exec->getMillisSinceLastExec();
@@ -275,6 +323,12 @@ int Scheduler::reapStaleExecutors()
                 continue;
             }
 
+            if (nToKeep > 0) {
+                SPDLOG_TRACE("Not reaping {}, kept pre-warmed", exec->id);
+                nToKeep--;
+                continue;
+            }
+
             SPDLOG_TRACE("Reaping {}, last exec {}ms ago (limit {}ms)",
                          exec->id,
                          millisSinceLastExec,
@@ -284,31 +338,8 @@ int Scheduler::reapStaleExecutors()
             nReaped++;
         }
 
-        // Remove those that need to be removed
-        for (auto exec : toRemove) {
-            // Shut down the executor
-            exec->shutdown();
-
-            // Remove and erase
-            auto removed = std::remove(execs.begin(), execs.end(), exec);
-            execs.erase(removed, execs.end());
-        }
-
-        // Unregister this host if no more executors remain on this host, and
-        // it's not the master
-        if (execs.empty()) {
+        if (removeExecutors(execs, toRemove)) {
             SPDLOG_TRACE("No remaining executors for {}", key);
-
-            bool isMaster = thisHost == masterHost;
-            if (!isMaster) {
-                faabric::UnregisterRequest req;
-                req.set_host(thisHost);
-                req.set_user(user);
-                req.set_function(function);
-
-                getFunctionCallClient(masterHost)->unregister(req);
-            }
-
             keysToRemove.emplace_back(key);
         }
     }
@@ -323,6 +354,415 @@ int Scheduler::reapStaleExecutors()
     return nReaped;
 }
 
+bool Scheduler::removeExecutors(
+  std::vector<std::shared_ptr<Executor>>& execs,
+  const std::vector<std::shared_ptr<Executor>>& toRemove)
+{
+    if (execs.empty()) {
+        return true;
+    }
+
+    faabric::Message& firstMsg = execs.back()->getBoundMessage();
+    std::string user = firstMsg.user();
+    std::string function = firstMsg.function();
+    std::string masterHost = firstMsg.masterhost();
+
+    for (auto exec : toRemove) {
+        // Shut down the executor
+        exec->shutdown();
+
+        // Remove and erase
+        auto removed = std::remove(execs.begin(), execs.end(), exec);
+        execs.erase(removed, execs.end());
+    }
+
+    if (!execs.empty()) {
+        return false;
+    }
+
+    // Unregister this host if no more executors remain on this host, and
+    // it's not the master
+    bool isMaster = thisHost == masterHost;
+    if (!isMaster) {
+        faabric::UnregisterRequest req;
+        req.set_host(thisHost);
+        req.set_user(user);
+        req.set_function(function);
+
+        getFunctionCallClient(masterHost)->unregister(req);
+    }
+
+    return true;
+}
+
+void ExecutorPrewarmThread::doWork()
+{
+    getScheduler().prewarmExecutors();
+}
+
+void Scheduler::recordArrival(const std::string& funcStr,
+                              const faabric::Message& msg)
+{
+    if (conf.prewarmMaxExecutors <= 0 || threadedFunctions.contains(funcStr)) {
+        return;
+    }
+
+    PrewarmState& state = prewarmStates[funcStr];
+    if (state.boundMessage == nullptr) {
+        state.boundMessage = std::make_shared<faabric::Message>(msg);
+        state.boundMessage->clear_inputdata();
+        state.boundMessage->clear_outputdata();
+    }
+
+    state.arrivals++;
+}
+
+int Scheduler::prewarmExecutors()
+{
+    if (conf.prewarmMaxExecutors <= 0) {
+        return 0;
+    }
+
+    // Message to bind to, number to create, NUMA node to place them on and
+    // core index of the first
+    std::vector<std::tuple<std::shared_ptr<faabric::Message>, int, int, int>>
+      toCreate;
+    {
+        faabric::util::FullLock lock(mx);
+
+        double intervalSeconds = std::max(conf.prewarmIntervalSeconds, 1);
+        double elapsedSeconds =
+          std::max(faabric::util::getTimeDiffMillis(lastPrewarmUpdate), 1.0) /
+          1000.0;
+        lastPrewarmUpdate = faabric::util::startTimer();
+
+        // Early wake-ups cover less than an interval, so their arrivals are
+        // weighted less
+        double weight = 1 - std::pow(1 - PREWARM_RATE_WEIGHT,
+                                     elapsedSeconds / intervalSeconds);
+
+        for (auto it = prewarmStates.begin(); it != prewarmStates.end();) {
+            const std::string& funcStr = it->first;
+            PrewarmState& state = it->second;
+
+            double rate = state.arrivals / elapsedSeconds;
+            state.arrivalRate =
+              weight * rate + (1 - weight) * state.arrivalRate;
+            state.arrivals = 0;
+
+            double expected = state.arrivalRate * intervalSeconds;
+            if (expected < PREWARM_MIN_ARRIVALS) {
+                state.target = 0;
+
+                // Forget functions that are no longer being called
+                if (expected < PREWARM_MIN_ARRIVALS / 100) {
+                    SPDLOG_TRACE("No longer pre-warming {}", funcStr);
+                    it = prewarmStates.erase(it);
+                } else {
+                    it++;
+                }
+
+                continue;
+            }
+
+            state.target = std::min(
+              std::max((int)std::ceil(expected), conf.prewarmMinExecutors),
+              conf.prewarmMaxExecutors);
+
+            int nIdle = 0;
+            auto execIt = executors.find(funcStr);
+            if (execIt != executors.end()) {
+                for (const auto& e : execIt->second) {
+                    if (!e->isClaimed()) {
+                        nIdle++;
+                    }
+                }
+            }
+
+            if (nIdle < state.target) {
+                SPDLOG_DEBUG("Pre-warming {} from {} -> {} idle executors "
+                             "({:.2f} calls/s)",
+                             funcStr,
+                             nIdle,
+                             state.target,
+                             state.arrivalRate);
+                int nToCreate = state.target - nIdle;
+                int numaNode = pickNumaNode(nToCreate);
+                toCreate.emplace_back(state.boundMessage,
+                                      nToCreate,
+                                      numaNode,
+                                      reserveCores(numaNode, nToCreate));
+            }
+
+            it++;
+        }
+    }
+
+    // Create and reset the executors without holding the lock, so calls
+    // aren't held up by it
+    int nCreated = 0;
+    for (auto& [msg, n, numaNode, coreIdx] : toCreate) {
+        std::shared_ptr<faabric::scheduler::ExecutorFactory> factory =
+          getExecutorFactory();
+
+        std::vector<std::shared_ptr<Executor>> created;
+        for (int i = 0; i < n; i++) {
+            faabric::Message boundMsg = *msg;
+            auto executor =
+              factory->createExecutor(faabric::MessageInBatch(boundMsg));
+            executor->setNumaNode(numaNode);
+            executor->setCoreIdx(coreIdx + i);
+            executor->prewarm();
+            created.push_back(std::move(executor));
+        }
+
+        std::string funcStr = faabric::util::funcToString(*msg, false);
+
+        faabric::util::FullLock lock(mx);
+        std::vector<std::shared_ptr<Executor>>& thisExecutors =
+          executors[funcStr];
+        if (thisExecutors.empty()) {
+            suspendedExecutors[funcStr] = 0;
+        }
+
+        thisExecutors.insert(
+          thisExecutors.end(), created.begin(), created.end());
+        nCreated += n;
+    }
+
+    return nCreated;
+}
+
+double Scheduler::getArrivalRate(const faabric::Message& msg)
+{
+    faabric::util::SharedLock lock(mx);
+
+    auto it = prewarmStates.find(faabric::util::funcToString(msg, false));
+    if (it == prewarmStates.end()) {
+        return 0;
+    }
+
+    return it->second.arrivalRate;
+}
+
+int Scheduler::getPrewarmTarget(const faabric::Message& msg)
+{
+    faabric::util::SharedLock lock(mx);
+
+    auto it = prewarmStates.find(faabric::util::funcToString(msg, false));
+    if (it == prewarmStates.end()) {
+        return 0;
+    }
+
+    return it->second.target;
+}
+
+std::shared_ptr<faabric::util::SnapshotData> Scheduler::getZygote(
+  const faabric::Message& msg,
+  const std::string& version)
+{
+    std::string key = faabric::util::getZygoteSnapshotKey(msg);
+
+    faabric::util::UniqueLock lock(zygotesMx);
+    auto it = zygoteVersions.find(key);
+    if (it == zygoteVersions.end()) {
+        return nullptr;
+    }
+
+    // Zygotes of other versions of the function are no use
+    if (it->second != version) {
+        SPDLOG_DEBUG("Invalidating zygote {} of version {}, now {}",
+                     key,
+                     it->second,
+                     version);
+        reg.deleteSnapshot(key);
+        zygoteVersions.erase(it);
+        return nullptr;
+    }
+
+    // May have been evicted under memory pressure
+    auto zygote = reg.tryGetSnapshot(key);
+    if (zygote == nullptr) {
+        zygoteVersions.erase(it);
+    }
+
+    return zygote;
+}
+
+void Scheduler::registerZygote(
+  const faabric::Message& msg,
+  const std::string& version,
+  std::shared_ptr<faabric::util::SnapshotData> zygote)
+{
+    std::string key = faabric::util::getZygoteSnapshotKey(msg);
+    SPDLOG_DEBUG("Registering zygote {} of version {} ({} bytes)",
+                 key,
+                 version,
+                 zygote->getSize());
+
+    faabric::util::UniqueLock lock(zygotesMx);
+    reg.registerSnapshot(key, std::move(zygote));
+    zygoteVersions[key] = version;
+}
+
+void Scheduler::invalidateZygote(const faabric::Message& msg)
+{
+    std::string key = faabric::util::getZygoteSnapshotKey(msg);
+
+    faabric::util::UniqueLock lock(zygotesMx);
+    if (zygoteVersions.erase(key) > 0) {
+        SPDLOG_DEBUG("Invalidating zygote {}", key);
+        reg.deleteSnapshot(key);
+    }
+}
+
+int Scheduler::evictUnderMemoryPressure()
+{
+    if (conf.memoryEvictionUsagePercent <= 0 &&
+        conf.memoryEvictionStallPercent <= 0) {
+        return 0;
+    }
+
+    return evictForMemoryPressure(faabric::util::readMemoryPressure());
+}
+
+int Scheduler::evictForMemoryPressure(
+  const faabric::util::MemoryPressure& pressure)
+{
+    faabric::util::FullLock lock(mx);
+
+    lastMemoryPressure = pressure;
+
+    // Work out how much memory to free, if any
+    size_t bytesToFree = 0;
+    if (conf.memoryEvictionUsagePercent > 0 && pressure.limitBytes > 0) {
+        size_t maxBytes =
+          pressure.limitBytes / 100 * conf.memoryEvictionUsagePercent;
+        if (pressure.usageBytes > maxBytes) {
+            bytesToFree = pressure.usageBytes - maxBytes;
+        }
+    }
+
+    bool stalled = conf.memoryEvictionStallPercent > 0 &&
+                   pressure.someStallPercent >= conf.memoryEvictionStallPercent;
+
+    // Executors and snapshots are put in one list, least recently used first
+    struct EvictionCandidate
+    {
+        long idleMillis;
+        size_t bytes;
+        std::string key;
+        std::shared_ptr<Executor> exec;
+    };
+
+    std::vector<EvictionCandidate> candidates;
+    size_t executorBytes = 0;
+    for (auto& [key, execs] : executors) {
+        for (auto& exec : execs) {
+            size_t bytes = exec->getMemoryView().size();
+            executorBytes += bytes;
+
+            // Executors stay claimed after their last task finishes, until
+            // they've been reset, so being claimed is what marks them in use
+            if (!exec->isClaimed()) {
+                candidates.push_back(
+                  { exec->getMillisSinceLastExec(), bytes, key, exec });
+            }
+        }
+    }
+
+    monitorExecutorBytes = executorBytes;
+    monitorSnapshotBytes = reg.getTotalSnapshotBytes();
+
+    if (bytesToFree == 0 && !stalled) {
+        return 0;
+    }
+
+    SPDLOG_DEBUG("Memory pressure: {}/{} bytes used, {}% stalled, freeing {}",
+                 pressure.usageBytes,
+                 pressure.limitBytes,
+                 pressure.someStallPercent,
+                 bytesToFree);
+
+    for (const auto& snap : reg.getEvictableSnapshots()) {
+        candidates.push_back(
+          { snap.idleMillis, snap.sizeBytes, snap.key, nullptr });
+    }
+
+    std::stable_sort(
+      candidates.begin(),
+      candidates.end(),
+      [](const EvictionCandidate& a, const EvictionCandidate& b) {
+          return a.idleMillis > b.idleMillis;
+      });
+
+    // Stop as soon as enough has been freed, which with only stalls is after
+    // the first
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Executor>>>
+      execsToRemove;
+    size_t bytesFreed = 0;
+    int nEvicted = 0;
+    for (const auto& candidate : candidates) {
+        if (candidate.exec != nullptr) {
+            SPDLOG_DEBUG("Evicting executor {}, idle for {}ms",
+                         candidate.exec->id,
+                         candidate.idleMillis);
+            execsToRemove[candidate.key].push_back(candidate.exec);
+            monitorEvictedExecutors++;
+        } else if (reg.evictSnapshot(candidate.key)) {
+            monitorEvictedSnapshots++;
+        } else {
+            // Pinned since the candidates were listed
+            continue;
+        }
+
+        bytesFreed += candidate.bytes;
+        nEvicted++;
+
+        if (bytesFreed >= bytesToFree) {
+            break;
+        }
+    }
+
+    for (auto& [key, toRemove] : execsToRemove) {
+        if (removeExecutors(executors[key], toRemove)) {
+            SPDLOG_TRACE("Removing scheduler record for {}, no more executors",
+                         key);
+            executors.erase(key);
+        }
+    }
+
+    monitorEvictedBytes += bytesFreed;
+    monitorSnapshotBytes = reg.getTotalSnapshotBytes();
+
+    lock.unlock();
+    updateMonitoring();
+
+    return nEvicted;
+}
+
+MemoryStats Scheduler::getMemoryStats()
+{
+    faabric::util::SharedLock lock(mx);
+
+    MemoryStats stats;
+    for (auto& [key, execs] : executors) {
+        for (auto& exec : execs) {
+            stats.executorBytes += exec->getMemoryView().size();
+            stats.nExecutors++;
+        }
+    }
+
+    stats.snapshotBytes = reg.getTotalSnapshotBytes();
+    stats.nSnapshots = reg.getSnapshotCount();
+    stats.pressure = lastMemoryPressure;
+    stats.evictedExecutors = monitorEvictedExecutors;
+    stats.evictedSnapshots = monitorEvictedSnapshots;
+    stats.evictedBytes = monitorEvictedBytes;
+
+    return stats;
+}
+
 long Scheduler::getFunctionExecutorCount(const faabric::Message& msg)
 {
     faabric::util::SharedLock lock(mx);
@@ -729,11 +1169,13 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
         throw std::runtime_error("Message with no master host");
     }
 
-    // Send out point-to-point mappings if necessary (unless being forced to
+    // Set up point-to-point mappings if necessary (unless being forced to
     // execute locally, in which case they will be transmitted from the
-    // master)
+    // master). Remote hosts receive the mappings piggybacked on their batch
+    // request below, rather than in a separate round trip.
     bool isForceLocal =
       topologyHint == faabric::util::SchedulingTopologyHint::FORCE_LOCAL;
+    std::optional<faabric::PointToPointMappings> ptpMappings;
     if (!isForceLocal && !isMigration && (firstMsg.groupid() > 0)) {
         if (firstMsg.ismpi()) {
             // If we are scheduling an MPI message, we want rank 0 to be in the
@@ -745,9 +1187,9 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
             auto msgCopy = firstMsg;
             msgCopy.set_groupidx(0);
             decisionCopy.addMessage(thisHost, msgCopy);
-            broker.setAndSendMappingsFromSchedulingDecision(decisionCopy);
+            ptpMappings = broker.setUpLocalAndGetRemoteMappings(decisionCopy);
         } else {
-            broker.setAndSendMappingsFromSchedulingDecision(decision);
+            ptpMappings = broker.setUpLocalAndGetRemoteMappings(decision);
         }
     }
 
@@ -827,33 +1269,57 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
         ZoneScopedN("Push snapshot diffs");
         auto snap = reg.getSnapshot(snapshotKey);
 
-        for (const auto& host : getFunctionRegisteredHosts(
-               firstMsg.user(), firstMsg.function(), false)) {
+        // Changes made so far make up a new version, each host is sent
+        // whatever it's missing since the version it holds
+        uint64_t version = snap->commitVersion();
+        auto& hostVersions = pushedSnapshotsMap[snapshotKey];
+        const std::set<std::string>& registeredHosts =
+          getFunctionRegisteredHosts(
+            firstMsg.user(), firstMsg.function(), false);
+
+        // Hosts that have been unregistered no longer hold the snapshot, and
+        // get it in full if they come back
+        std::erase_if(hostVersions, [&registeredHosts](const auto& hv) {
+            return !registeredHosts.contains(hv.first);
+        });
+
+        for (const auto& host : registeredHosts) {
             std::shared_ptr<SnapshotClient> c = getSnapshotClient(host);
 
             // See if we've already pushed this snapshot to the given host,
-            // if so, just push the diffs that have occurred in this main thread
-            if (pushedSnapshotsMap[snapshotKey].contains(host)) {
+            // if so, just push the diffs since the version it holds
+            auto it = hostVersions.find(host);
+            if (it != hostVersions.end()) {
                 std::vector<faabric::util::SnapshotDiff> snapshotDiffs =
-                  snap->getTrackedChanges();
+                  snap->getChangesSinceVersion(it->second);
 
                 c->pushSnapshotUpdate(snapshotKey, snap, snapshotDiffs);
+            } else if (isThreads && conf.snapshotRestoreMode == "lazy") {
+                // Threads' snapshots are held here while they run, so the
+                // host can fetch pages from here as the threads need them
+                c->pushLazySnapshot(snapshotKey, snap);
+                lazySnapshotHosts[snapshotKey].insert(host);
             } else {
                 c->pushSnapshot(snapshotKey, snap);
-                pushedSnapshotsMap[snapshotKey].insert(host);
             }
+
+            hostVersions[host] = version;
         }
 
-        // Now reset the tracking on the snapshot before we start executing
-        snap->clearTrackedChanges();
+        // Change logs are only needed for versions some host doesn't hold
+        uint64_t oldestHeld = version;
+        for (const auto& [host, hostVersion] : hostVersions) {
+            oldestHeld = std::min(oldestHeld, hostVersion);
+        }
+        snap->pruneVersions(oldestHeld);
     } else if (!snapshotKey.empty() && isMigration && isForceLocal) {
         // If we are executing a migrated function, we don't need to distribute
         // the snapshot to other hosts, as this snapshot is specific to the
         // to-be-restored function
         auto snap = reg.getSnapshot(snapshotKey);
 
-        // Now reset the tracking on the snapshot before we start executing
-        snap->clearTrackedChanges();
+        // Commit the changes so far before we start executing
+        snap->commitVersion();
     }
 
     // -------------------------------------------
@@ -908,15 +1374,29 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
                 std::vector<std::shared_ptr<Executor>>& thisExecutors =
                   executors[funcStr];
 
+                // Threaded functions aren't pre-warmed, and any executors
+                // already pre-warmed are left idle
+                threadedFunctions.insert(funcStr);
+                prewarmStates.erase(funcStr);
+                std::vector<std::shared_ptr<Executor>> claimedExecutors;
+                std::copy_if(thisExecutors.begin(),
+                             thisExecutors.end(),
+                             std::back_inserter(claimedExecutors),
+                             [](const auto& e) { return e->isClaimed(); });
+
                 std::shared_ptr<Executor> e = nullptr;
                 if (thisExecutors.empty()) {
                     ZoneScopedN(
                       "Scheduler::callFunctions claiming new executor");
                     // Create executor if not exists
-                    e = claimExecutor(faabric::MessageInBatch(req, 0));
+                    e = claimExecutor(faabric::MessageInBatch(req, 0),
+                                      pickNumaNode(thisHostIdxs.size()));
                 } else if (thisExecutors.size() == 1) {
                     // Use existing executor if exists
                     e = thisExecutors.back();
+                } else if (claimedExecutors.size() == 1) {
+                    // Use the executor running the main thread
+                    e = claimedExecutors.back();
                 } else {
                     SPDLOG_ERROR("Found {} executors for threaded function {}",
                                  thisExecutors.size(),
@@ -930,7 +1410,9 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
                 // Execute the tasks
                 e->executeTasks(thisHostIdxs, req, extraData);
             } else {
-                // Non-threads require one executor per task
+                // Non-threads require one executor per task, kept on one
+                // NUMA node where possible
+                int numaNode = pickNumaNode(thisHostIdxs.size());
                 for (auto i : thisHostIdxs) {
                     auto localMsg = faabric::MessageInBatch(req, i);
 
@@ -946,8 +1428,10 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
                             std::make_shared<MessageLocalResult>() });
                     }
 
+                    recordArrival(funcStr, *localMsg);
+
                     std::shared_ptr<Executor> e =
-                      claimExecutor(std::move(localMsg));
+                      claimExecutor(std::move(localMsg), numaNode);
                     e->executeTasks({ i }, req, extraData);
                 }
             }
@@ -969,6 +1453,10 @@ faabric::util::SchedulingDecision Scheduler::doCallFunctions(
             hostRequest->set_subtype(req->subtype());
             hostRequest->set_contextdata(req->contextdata());
 
+            if (ptpMappings.has_value()) {
+                *hostRequest->mutable_mappings() = *ptpMappings;
+            }
+
             // Add messages
             for (auto msgIdx : thisHostIdxs) {
                 auto* newMsg = hostRequest->add_messages();
@@ -1042,8 +1530,27 @@ void Scheduler::broadcastSnapshotDelete(const faabric::Message& msg,
     const std::set<std::string>& thisRegisteredHosts =
       getFunctionRegisteredHosts(msg.user(), msg.function(), false);
 
+    std::set<std::string> lazyHosts;
+    {
+        faabric::util::FullLock lock(mx);
+        auto it = lazySnapshotHosts.find(snapshotKey);
+        if (it != lazySnapshotHosts.end()) {
+            lazyHosts = std::move(it->second);
+            lazySnapshotHosts.erase(it);
+        }
+    }
+
     for (auto host : thisRegisteredHosts) {
-        getSnapshotClient(host)->deleteSnapshot(snapshotKey);
+        if (!lazyHosts.contains(host)) {
+            getSnapshotClient(host)->deleteSnapshot(snapshotKey);
+        }
+    }
+
+    // Lazy hosts may have stopped being registered for the function, but
+    // still hold the snapshot. Waiting for them means the caller can delete
+    // its own copy without them fetching from it afterwards.
+    for (const auto& host : lazyHosts) {
+        getSnapshotClient(host)->deleteSnapshot(snapshotKey, true);
     }
 }
 
@@ -1118,7 +1625,8 @@ Scheduler::getRecordedMessagesShared()
 }
 
 std::shared_ptr<Executor> Scheduler::claimExecutor(
-  const faabric::MessageInBatch& msg)
+  const faabric::MessageInBatch& msg,
+  int numaNode)
 {
     std::string funcStr = faabric::util::funcToString(msg, false);
 
@@ -1128,13 +1636,21 @@ std::shared_ptr<Executor> Scheduler::claimExecutor(
         suspendedExecutors[funcStr] = 0;
     }
 
+    // Warm executors on the node are tried first
     std::shared_ptr<Executor> claimed = nullptr;
-    for (auto& e : thisExecutors) {
-        if (e->tryClaim()) {
-            claimed = e;
-            SPDLOG_DEBUG(
-              "Reusing warm executor {} for {}", claimed->id, funcStr);
-            break;
+    for (int pass = (numaNode >= 0 ? 0 : 1); pass < 2 && claimed == nullptr;
+         pass++) {
+        for (auto& e : thisExecutors) {
+            if (pass == 0 && e->getNumaNode() != numaNode) {
+                continue;
+            }
+
+            if (e->tryClaim()) {
+                claimed = e;
+                SPDLOG_DEBUG(
+                  "Reusing warm executor {} for {}", claimed->id, funcStr);
+                break;
+            }
         }
     }
 
@@ -1169,11 +1685,20 @@ std::shared_ptr<Executor> Scheduler::claimExecutor(
             std::shared_ptr<faabric::scheduler::ExecutorFactory> factory =
               getExecutorFactory();
             auto executor = factory->createExecutor(msg);
+            executor->setNumaNode(numaNode);
+            executor->setCoreIdx(reserveCores(numaNode, 1));
             thisExecutors.push_back(std::move(executor));
             claimed = thisExecutors.back();
 
             // Claim it
             claimed->tryClaim();
+
+            // Pre-warm ahead of further calls rather than waiting for the
+            // next interval
+            if (conf.prewarmMaxExecutors > 0 &&
+                !threadedFunctions.contains(funcStr)) {
+                prewarmThread.wakeUp();
+            }
         }
     }
 
@@ -1181,6 +1706,64 @@ std::shared_ptr<Executor> Scheduler::claimExecutor(
     return claimed;
 }
 
+int Scheduler::pickNumaNode(int nTasks)
+{
+    if (conf.numaPlacement == 0) {
+        return -1;
+    }
+
+    const faabric::util::CpuTopology& topology =
+      faabric::util::getCpuTopology();
+    if (topology.nodes.size() == 1) {
+        return topology.nodes.at(0).id;
+    }
+
+    // Claimed executors are busy, and idle ones break ties so that executors
+    // are spread across nodes
+    std::map<int, std::pair<int, int>> nodeExecutors;
+    for (const auto& [funcStr, execs] : executors) {
+        for (const auto& e : execs) {
+            auto& [nBusy, nIdle] = nodeExecutors[e->getNumaNode()];
+            if (e->isClaimed()) {
+                nBusy++;
+            } else {
+                nIdle++;
+            }
+        }
+    }
+
+    int bestNode = -1;
+    bool bestFits = false;
+    std::pair<int, int> bestLoad;
+    for (const auto& node : topology.nodes) {
+        std::pair<int, int> load = nodeExecutors[node.id];
+        bool fits = (int)node.cpus.size() - load.first >= nTasks;
+        if (bestNode < 0 || (fits && !bestFits) ||
+            (fits == bestFits && load < bestLoad)) {
+            bestNode = node.id;
+            bestFits = fits;
+            bestLoad = load;
+        }
+    }
+
+    SPDLOG_TRACE("Placing {} tasks on NUMA node {}", nTasks, bestNode);
+    return bestNode;
+}
+
+int Scheduler::reserveCores(int numaNode, int n)
+{
+    const faabric::util::CpuTopology& topology =
+      faabric::util::getCpuTopology();
+    const faabric::util::NumaNode* node = topology.getNode(numaNode);
+    int nCpus = node != nullptr ? node->cpus.size() : topology.getCpus().size();
+
+    int& nextCoreIdx = nextCoreIdxs[numaNode];
+    int coreIdx = nextCoreIdx;
+    nextCoreIdx = (nextCoreIdx + n) % std::max(nCpus, 1);
+
+    return coreIdx;
+}
+
 std::string Scheduler::getThisHost()
 {
     faabric::util::SharedLock lock(mx);
@@ -1208,6 +1791,22 @@ void Scheduler::broadcastFlush()
     flushLocally();
 }
 
+void Scheduler::broadcastFunctionUpdated(const faabric::Message& msg)
+{
+    faabric::util::FullLock lock(mx);
+    redis::Redis& redis = redis::Redis::getQueue();
+    std::set<std::string> allHosts =
+      redis.smembers(AVAILABLE_HOST_SET, HOST_CACHE_TIME);
+    allHosts.erase(thisHost);
+
+    for (auto& otherHost : allHosts) {
+        getFunctionCallClient(otherHost)->sendFunctionUpdated(msg);
+    }
+
+    lock.unlock();
+    invalidateZygote(msg);
+}
+
 void Scheduler::flushLocally()
 {
     SPDLOG_INFO("Flushing host {}",
@@ -1695,12 +2294,19 @@ void Scheduler::updateMonitoring()
     int32_t waiting = monitorWaitingTasks.load(ord);
     fmt::format_to(std::back_inserter(wrBuffer),
                    "local_sched,{},waiting_queued,{},started,{},"
-                   "waiting,{},active,{}\n",
+                   "waiting,{},active,{},executor_bytes,{},snapshot_bytes,{},"
+                   "evicted_executors,{},evicted_snapshots,{},"
+                   "evicted_bytes,{}\n",
                    locallySched,
                    locallySched - started,
                    started,
                    waiting,
-                   started - waiting);
+                   started - waiting,
+                   monitorExecutorBytes.load(),
+                   monitorSnapshotBytes.load(),
+                   monitorEvictedExecutors.load(),
+                   monitorEvictedSnapshots.load(),
+                   monitorEvictedBytes.load());
     const size_t size = wrBuffer.size();
     flock(monitorFd, LOCK_EX);
     ftruncate(monitorFd, size);
@@ -1,10 +1,20 @@
 #include <faabric/snapshot/SnapshotClient.h>
+#include <faabric/transport/FlatBufferMessageBuilder.h>
 #include <faabric/transport/common.h>
 #include <faabric/transport/macros.h>
 #include <faabric/util/config.h>
+#include <faabric/util/delta.h>
+#include <faabric/util/gids.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/queue.h>
 #include <faabric/util/testing.h>
+#include <faabric/util/timing.h>
+
+#include <future>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace faabric::snapshot {
 
@@ -18,6 +28,10 @@ static std::vector<
   std::pair<std::string, std::shared_ptr<faabric::util::SnapshotData>>>
   snapshotPushes;
 
+static std::vector<
+  std::pair<std::string, std::shared_ptr<faabric::util::SnapshotData>>>
+  lazySnapshotPushes;
+
 static std::vector<
   std::pair<std::string, std::vector<faabric::util::SnapshotDiff>>>
   snapshotDiffPushes;
@@ -34,6 +48,14 @@ getSnapshotPushes()
     return snapshotPushes;
 }
 
+std::vector<
+  std::pair<std::string, std::shared_ptr<faabric::util::SnapshotData>>>
+getLazySnapshotPushes()
+{
+    faabric::util::UniqueLock lock(mockMutex);
+    return lazySnapshotPushes;
+}
+
 std::vector<std::pair<std::string, std::vector<faabric::util::SnapshotDiff>>>
 getSnapshotDiffPushes()
 {
@@ -57,11 +79,117 @@ void clearMockSnapshotRequests()
 {
     faabric::util::UniqueLock lock(mockMutex);
     snapshotPushes.clear();
+    lazySnapshotPushes.clear();
     snapshotDiffPushes.clear();
     snapshotDeletes.clear();
     threadResults.clear();
 }
 
+// -----------------------------------
+// Link throughput
+// -----------------------------------
+
+// Weight given to each new measurement in the moving average
+#define LINK_THROUGHPUT_WEIGHT 0.25
+
+// Smaller transfers are dominated by latency, so say little about throughput
+#define LINK_THROUGHPUT_MIN_BYTES (64 * 1024)
+
+static std::mutex linkThroughputMx;
+
+static std::unordered_map<std::string, double> linkThroughputs;
+
+double getSnapshotLinkThroughput(const std::string& host)
+{
+    faabric::util::UniqueLock lock(linkThroughputMx);
+    auto it = linkThroughputs.find(host);
+    return it == linkThroughputs.end() ? 0 : it->second;
+}
+
+void clearSnapshotLinkThroughputs()
+{
+    faabric::util::UniqueLock lock(linkThroughputMx);
+    linkThroughputs.clear();
+}
+
+// The time measured includes the receiver handling the request, so this
+// underestimates the link itself, which errs towards compressing more
+static void recordTransfer(const std::string& host,
+                           size_t nBytes,
+                           const faabric::util::TimePoint& start)
+{
+    double seconds = faabric::util::getTimeDiffNanos(start) / 1e9;
+    if (nBytes < LINK_THROUGHPUT_MIN_BYTES || seconds <= 0) {
+        return;
+    }
+
+    double throughput = nBytes / seconds;
+
+    faabric::util::UniqueLock lock(linkThroughputMx);
+    auto [it, inserted] = linkThroughputs.try_emplace(host, throughput);
+    if (!inserted) {
+        it->second = (LINK_THROUGHPUT_WEIGHT * throughput) +
+                     ((1 - LINK_THROUGHPUT_WEIGHT) * it->second);
+    }
+}
+
+// -----------------------------------
+// Compression
+// -----------------------------------
+
+enum class SnapshotCompression
+{
+    None,
+    Diff,
+    Message,
+};
+
+static SnapshotCompression getCompressionMode()
+{
+    const std::string& mode =
+      faabric::util::getSystemConfig().snapshotCompression;
+    if (mode == "none") {
+        return SnapshotCompression::None;
+    }
+    if (mode == "diff") {
+        return SnapshotCompression::Diff;
+    }
+    if (mode == "message") {
+        return SnapshotCompression::Message;
+    }
+
+    SPDLOG_ERROR("Unrecognised snapshot compression mode: {}", mode);
+    throw std::runtime_error("Unrecognised snapshot compression mode");
+}
+
+// Holds compressed data, which is only kept if it's smaller than the input
+struct CompressedBuffer
+{
+    std::unique_ptr<uint8_t[]> data;
+    size_t size = 0;
+
+    std::span<const uint8_t> span() const { return { data.get(), size }; }
+};
+
+static CompressedBuffer compress(
+  std::span<const std::span<const uint8_t>> srcs,
+  size_t srcSize,
+  int level)
+{
+    CompressedBuffer result;
+    size_t bound = faabric::util::zstdCompressBound(srcSize);
+    result.data = std::make_unique_for_overwrite<uint8_t[]>(bound);
+    result.size =
+      faabric::util::zstdCompress(srcs, { result.data.get(), bound }, level);
+
+    if (result.size >= srcSize) {
+        result.data.reset();
+        result.size = 0;
+    }
+
+    return result;
+}
+
 // -----------------------------------
 // Snapshot client
 // -----------------------------------
@@ -89,31 +217,388 @@ void SnapshotClient::pushSnapshot(
 
         snapshotPushes.emplace_back(host, data);
     } else {
-        // Set up the main request
-        // TODO - avoid copying data here?
-        flatbuffers::FlatBufferBuilder mb;
+        // Work out which pages the host doesn't have
+        std::vector<faabric::util::SnapshotPageHash> hashes =
+          data->getPageHashes();
+        std::vector<int> missingPages = getMissingPages(hashes);
+
+        SPDLOG_DEBUG("Host {} missing {}/{} pages of snapshot {}",
+                     host,
+                     missingPages.size(),
+                     hashes.size(),
+                     key);
+
+        faabric::SnapshotPagesResponse response =
+          pushSnapshotPages(key, data, hashes, missingPages);
+
+        // Pages held by the host may have been deleted or modified in the
+        // meantime, in which case we fall back to sending all of them
+        if (response.missingpages_size() > 0) {
+            SPDLOG_DEBUG("Host {} lost {} pages of snapshot {}, resending",
+                         host,
+                         response.missingpages_size(),
+                         key);
+
+            std::vector<int> allPages(hashes.size());
+            std::iota(allPages.begin(), allPages.end(), 0);
+            response = pushSnapshotPages(key, data, hashes, allPages);
+        }
 
-        std::vector<flatbuffers::Offset<SnapshotMergeRegionRequest>>
-          mrsFbVector;
-        mrsFbVector.reserve(data->getMergeRegions().size());
-        for (const auto& m : data->getMergeRegions()) {
-            auto mr = CreateSnapshotMergeRegionRequest(
-              mb, m.offset, m.length, m.dataType, m.operation);
-            mrsFbVector.push_back(mr);
+        if (response.missingpages_size() > 0) {
+            SPDLOG_ERROR("Host {} still missing {} pages of snapshot {}",
+                         host,
+                         response.missingpages_size(),
+                         key);
+            throw std::runtime_error("Failed to push snapshot pages");
+        }
+    }
+}
+
+std::vector<int> SnapshotClient::getMissingPages(
+  const std::vector<faabric::util::SnapshotPageHash>& hashes)
+{
+    faabric::transport::FlatBufferMessageBuilder mb(
+      (hashes.size() * sizeof(faabric::util::SnapshotPageHash)) + 1024);
+
+    auto hashesOffset = mb.CreateVector<uint8_t>(
+      BYTES_CONST(hashes.data()),
+      hashes.size() * sizeof(faabric::util::SnapshotPageHash));
+    auto requestOffset = CreateSnapshotPagesRequest(mb, hashesOffset);
+    mb.Finish(requestOffset);
+
+    faabric::SnapshotPagesResponse response;
+    syncSend(SnapshotCalls::GetMissingPages, mb.releaseMessage(), &response);
+
+    return { response.missingpages().begin(), response.missingpages().end() };
+}
+
+static size_t getPageSize(const faabric::util::SnapshotData& data, uint32_t p)
+{
+    size_t pageOffset = p * faabric::util::HOST_PAGE_SIZE;
+    return std::min<size_t>(faabric::util::HOST_PAGE_SIZE,
+                            data.getSize() - pageOffset);
+}
+
+// The contents of some pages of a snapshot, which may be compressed
+struct PageContents
+{
+    std::span<const uint32_t> pages;
+    size_t size = 0;
+    CompressedBuffer compressed;
+
+    size_t sentSize() const { return compressed.data ? compressed.size : size; }
+
+    uint64_t uncompressedSize() const { return compressed.data ? size : 0; }
+};
+
+PageContents SnapshotClient::getPageContents(
+  faabric::util::SnapshotData& data,
+  std::span<const uint32_t> pages)
+{
+    PageContents contents;
+    contents.pages = pages;
+    for (uint32_t p : pages) {
+        contents.size += getPageSize(data, p);
+    }
+
+    // Pages are compressed straight from the snapshot's memory
+    size_t minSize =
+      faabric::util::getSystemConfig().snapshotCompressionMinSize;
+    if (getCompressionMode() != SnapshotCompression::None &&
+        contents.size >= minSize) {
+        std::vector<std::span<const uint8_t>> pageSpans;
+        pageSpans.reserve(pages.size());
+        for (uint32_t p : pages) {
+            pageSpans.emplace_back(
+              data.getDataPtr(p * faabric::util::HOST_PAGE_SIZE),
+              getPageSize(data, p));
         }
 
+        contents.compressed = compress(
+          pageSpans, contents.size, getCompressionLevel(contents.size));
+    }
+
+    return contents;
+}
+
+static flatbuffers::Offset<flatbuffers::Vector<uint8_t>> createPageContents(
+  faabric::transport::FlatBufferMessageBuilder& mb,
+  faabric::util::SnapshotData& data,
+  const PageContents& contents)
+{
+    if (contents.compressed.data) {
+        return mb.CreateVector<uint8_t>(contents.compressed.data.get(),
+                                        contents.compressed.size);
+    }
+
+    uint8_t* buffer = nullptr;
+    auto offset = mb.CreateUninitializedVector<uint8_t>(contents.size, &buffer);
+    for (uint32_t p : contents.pages) {
+        size_t pageSize = getPageSize(data, p);
+        std::memcpy(
+          buffer, data.getDataPtr(p * faabric::util::HOST_PAGE_SIZE), pageSize);
+        buffer += pageSize;
+    }
+
+    return offset;
+}
+
+static flatbuffers::Offset<
+  flatbuffers::Vector<flatbuffers::Offset<SnapshotMergeRegionRequest>>>
+createMergeRegions(faabric::transport::FlatBufferMessageBuilder& mb,
+                   faabric::util::SnapshotData& data)
+{
+    std::vector<faabric::util::SnapshotMergeRegion> mergeRegions =
+      data.getMergeRegions();
+
+    std::vector<flatbuffers::Offset<SnapshotMergeRegionRequest>> mrsFbVector;
+    mrsFbVector.reserve(mergeRegions.size());
+    for (const auto& m : mergeRegions) {
+        auto mr = CreateSnapshotMergeRegionRequest(
+          mb, m.offset, m.length, m.dataType, m.operation);
+        mrsFbVector.push_back(mr);
+    }
+
+    return mb.CreateVector(mrsFbVector);
+}
+
+void SnapshotClient::pushLazySnapshot(
+  const std::string& key,
+  std::shared_ptr<faabric::util::SnapshotData> data)
+{
+    if (data->getSize() == 0) {
+        SPDLOG_ERROR("Cannot push snapshot {} with size zero to {}", key, host);
+        throw std::runtime_error("Pushing snapshot with zero size");
+    }
+
+    SPDLOG_DEBUG("Pushing snapshot {} lazily to {} ({} bytes)",
+                 key,
+                 host,
+                 data->getSize());
+
+    if (faabric::util::isMockMode()) {
+        faabric::util::UniqueLock lock(mockMutex);
+        lazySnapshotPushes.emplace_back(host, data);
+    } else {
+        faabric::transport::FlatBufferMessageBuilder mb;
+
+        auto mrsOffset = createMergeRegions(mb, *data);
         auto keyOffset = mb.CreateString(key);
-        auto dataOffset =
-          mb.CreateVector<uint8_t>(data->getDataPtr(), data->getSize());
-        auto mrsOffset = mb.CreateVector(mrsFbVector);
-        auto requestOffset = CreateSnapshotPushRequest(
-          mb, keyOffset, data->getMaxSize(), dataOffset, mrsOffset);
+        auto sourceHostOffset =
+          mb.CreateString(faabric::util::getSystemConfig().endpointHost);
+        auto requestOffset = CreateSnapshotLazyPushRequest(mb,
+                                                           keyOffset,
+                                                           data->getMaxSize(),
+                                                           data->getSize(),
+                                                           mrsOffset,
+                                                           sourceHostOffset);
+        mb.Finish(requestOffset);
+
+        faabric::EmptyResponse response;
+        syncSend(
+          SnapshotCalls::PushLazySnapshot, mb.releaseMessage(), &response);
+    }
+}
+
+void SnapshotClient::getSnapshotPages(const std::string& key,
+                                      uint32_t offset,
+                                      std::span<uint8_t> buffer)
+{
+    SPDLOG_TRACE("Fetching {} bytes of snapshot {} at {} from {}",
+                 buffer.size(),
+                 key,
+                 offset,
+                 host);
+
+    faabric::transport::FlatBufferMessageBuilder mb;
+    auto keyOffset = mb.CreateString(key);
+    auto requestOffset =
+      CreateSnapshotPageContentsRequest(mb, keyOffset, offset, buffer.size());
+    mb.Finish(requestOffset);
+
+    faabric::SnapshotPageContentsResponse response;
+    syncSend(SnapshotCalls::GetSnapshotPages, mb.releaseMessage(), &response);
+
+    if (response.contents().size() != buffer.size()) {
+        SPDLOG_ERROR("Fetched {} bytes of snapshot {} from {}, expected {}",
+                     response.contents().size(),
+                     key,
+                     host,
+                     buffer.size());
+        throw std::runtime_error("Fetched wrong size of snapshot pages");
+    }
+
+    std::copy(
+      response.contents().begin(), response.contents().end(), buffer.begin());
+}
+
+faabric::SnapshotPagesResponse SnapshotClient::pushSnapshotPages(
+  const std::string& key,
+  std::shared_ptr<faabric::util::SnapshotData> data,
+  const std::vector<faabric::util::SnapshotPageHash>& hashes,
+  const std::vector<int>& pages)
+{
+    // Pages with the same contents are only sent once, the host copies them
+    // to the other places they appear
+    std::unordered_set<faabric::util::SnapshotPageHash,
+                       faabric::util::SnapshotPageHashHasher>
+      sentHashes;
+    std::vector<uint32_t> sentPages;
+    size_t sentPagesSize = 0;
+    for (int p : pages) {
+        if (sentHashes.insert(hashes.at(p)).second) {
+            sentPages.push_back(p);
+            sentPagesSize += getPageSize(*data, p);
+        }
+    }
+
+    SPDLOG_DEBUG("Sending {}/{} pages of snapshot {} to {} ({} bytes)",
+                 sentPages.size(),
+                 hashes.size(),
+                 key,
+                 host,
+                 sentPagesSize);
+
+    size_t chunkSize = faabric::util::getSystemConfig().snapshotPushChunkSize;
+    if (sentPagesSize > chunkSize) {
+        return streamSnapshotPages(key, data, hashes, sentPages);
+    }
+
+    PageContents contents = getPageContents(*data, sentPages);
+
+    // Set up the request. The page data is copied once, into the builder,
+    // which is sized up front to avoid regrowing it.
+    size_t hashesSize = hashes.size() * sizeof(faabric::util::SnapshotPageHash);
+    faabric::transport::FlatBufferMessageBuilder mb(
+      contents.sentSize() + hashesSize + (sentPages.size() * sizeof(uint32_t)) +
+      4096);
+
+    auto mrsOffset = createMergeRegions(mb, *data);
+    auto contentsOffset = createPageContents(mb, *data, contents);
+    auto keyOffset = mb.CreateString(key);
+    auto hashesOffset =
+      mb.CreateVector<uint8_t>(BYTES_CONST(hashes.data()), hashesSize);
+    auto sentPagesOffset = mb.CreateVector(sentPages);
+    auto requestOffset =
+      CreateSnapshotPushRequest(mb,
+                                keyOffset,
+                                data->getMaxSize(),
+                                contentsOffset,
+                                mrsOffset,
+                                data->getSize(),
+                                hashesOffset,
+                                sentPagesOffset,
+                                contents.uncompressedSize());
+
+    mb.Finish(requestOffset);
+
+    faabric::SnapshotPagesResponse response;
+    timedSyncSend(SnapshotCalls::PushSnapshot, mb.releaseMessage(), &response);
+
+    return response;
+}
+
+faabric::SnapshotPagesResponse SnapshotClient::streamSnapshotPages(
+  const std::string& key,
+  std::shared_ptr<faabric::util::SnapshotData> data,
+  const std::vector<faabric::util::SnapshotPageHash>& hashes,
+  const std::vector<uint32_t>& sentPages)
+{
+    uint64_t pushId = faabric::util::generateGid();
+    size_t chunkSize = faabric::util::getSystemConfig().snapshotPushChunkSize;
+
+    // Begin the push
+    {
+        size_t hashesSize =
+          hashes.size() * sizeof(faabric::util::SnapshotPageHash);
+        faabric::transport::FlatBufferMessageBuilder mb(hashesSize + 4096);
 
+        auto mrsOffset = createMergeRegions(mb, *data);
+        auto keyOffset = mb.CreateString(key);
+        auto hashesOffset =
+          mb.CreateVector<uint8_t>(BYTES_CONST(hashes.data()), hashesSize);
+        auto requestOffset = CreateSnapshotPushBeginRequest(mb,
+                                                            pushId,
+                                                            keyOffset,
+                                                            data->getMaxSize(),
+                                                            data->getSize(),
+                                                            mrsOffset,
+                                                            hashesOffset);
         mb.Finish(requestOffset);
 
-        // Send it
-        SEND_FB_MSG(SnapshotCalls::PushSnapshot, mb)
+        SEND_FB_MSG(SnapshotCalls::PushSnapshotBegin, mb);
     }
+
+    // Each chunk is sent while the next one is built, so at most two chunks
+    // are held in memory at once. Chunks are sent in order, one at a time,
+    // so the host handles them in order too.
+    std::future<void> inFlight;
+    size_t nChunks = 0;
+    size_t chunkStart = 0;
+    while (chunkStart < sentPages.size()) {
+        size_t chunkEnd = chunkStart;
+        size_t chunkBytes = 0;
+        while (chunkEnd < sentPages.size()) {
+            size_t pageSize = getPageSize(*data, sentPages.at(chunkEnd));
+            if (chunkBytes > 0 && chunkBytes + pageSize > chunkSize) {
+                break;
+            }
+
+            chunkBytes += pageSize;
+            chunkEnd++;
+        }
+
+        std::span<const uint32_t> chunkPages(sentPages.data() + chunkStart,
+                                             chunkEnd - chunkStart);
+        PageContents contents = getPageContents(*data, chunkPages);
+
+        faabric::transport::FlatBufferMessageBuilder mb(
+          contents.sentSize() + (chunkPages.size() * sizeof(uint32_t)) + 1024);
+        auto contentsOffset = createPageContents(mb, *data, contents);
+        auto pagesOffset =
+          mb.CreateVector(chunkPages.data(), chunkPages.size());
+        auto requestOffset =
+          CreateSnapshotPushChunkRequest(mb,
+                                         pushId,
+                                         pagesOffset,
+                                         contentsOffset,
+                                         contents.uncompressedSize());
+        mb.Finish(requestOffset);
+
+        faabric::transport::Message msg = mb.releaseMessage();
+        if (inFlight.valid()) {
+            inFlight.get();
+        }
+
+        inFlight = std::async(
+          std::launch::async, [this, chunkMsg = std::move(msg)]() mutable {
+              faabric::EmptyResponse response;
+              timedSyncSend(SnapshotCalls::PushSnapshotChunk,
+                            std::move(chunkMsg),
+                            &response);
+          });
+
+        nChunks++;
+        chunkStart = chunkEnd;
+    }
+
+    if (inFlight.valid()) {
+        inFlight.get();
+    }
+
+    SPDLOG_DEBUG(
+      "Sent snapshot {} to {} in {} chunks, committing", key, host, nChunks);
+
+    // Commit the push
+    faabric::transport::FlatBufferMessageBuilder mb;
+    auto requestOffset = CreateSnapshotPushCommitRequest(mb, pushId);
+    mb.Finish(requestOffset);
+
+    faabric::SnapshotPagesResponse response;
+    syncSend(
+      SnapshotCalls::PushSnapshotCommit, mb.releaseMessage(), &response);
+
+    return response;
 }
 
 void SnapshotClient::pushSnapshotUpdate(
@@ -131,20 +616,10 @@ void SnapshotClient::pushSnapshotUpdate(
         faabric::util::UniqueLock lock(mockMutex);
         snapshotDiffPushes.emplace_back(host, diffs);
     } else {
-        flatbuffers::FlatBufferBuilder mb;
+        faabric::transport::FlatBufferMessageBuilder mb;
 
         // Create objects for all the diffs
-        std::vector<flatbuffers::Offset<SnapshotDiffRequest>> diffsFbVector;
-        diffsFbVector.reserve(diffs.size());
-        for (const auto& d : diffs) {
-            std::span<const uint8_t> diffData = d.getData();
-            auto dataOffset =
-              mb.CreateVector<uint8_t>(diffData.data(), diffData.size());
-
-            auto diff = CreateSnapshotDiffRequest(
-              mb, d.getOffset(), d.getDataType(), d.getOperation(), dataOffset);
-            diffsFbVector.push_back(diff);
-        }
+        auto diffsOffset = createDiffs(mb, diffs);
 
         // Add merge regions
         std::vector<flatbuffers::Offset<SnapshotMergeRegionRequest>>
@@ -157,7 +632,6 @@ void SnapshotClient::pushSnapshotUpdate(
         }
 
         auto keyOffset = mb.CreateString(snapshotKey);
-        auto diffsOffset = mb.CreateVector(diffsFbVector);
         auto mrsOffset = mb.CreateVector(mrsFbVector);
 
         auto requestOffset =
@@ -165,11 +639,11 @@ void SnapshotClient::pushSnapshotUpdate(
 
         mb.Finish(requestOffset);
 
-        SEND_FB_MSG(SnapshotCalls::PushSnapshotUpdate, mb);
+        sendDiffsRequest(SnapshotCalls::PushSnapshotUpdate, mb);
     }
 }
 
-void SnapshotClient::deleteSnapshot(const std::string& key)
+void SnapshotClient::deleteSnapshot(const std::string& key, bool wait)
 {
     if (faabric::util::isMockMode()) {
         faabric::util::UniqueLock lock(mockMutex);
@@ -178,13 +652,16 @@ void SnapshotClient::deleteSnapshot(const std::string& key)
     } else {
         SPDLOG_DEBUG("Deleting snapshot {} from {}", key, host);
 
-        // TODO - avoid copying data here
-        flatbuffers::FlatBufferBuilder mb;
+        faabric::transport::FlatBufferMessageBuilder mb;
         auto keyOffset = mb.CreateString(key);
         auto requestOffset = CreateSnapshotDeleteRequest(mb, keyOffset);
         mb.Finish(requestOffset);
 
-        SEND_FB_MSG_ASYNC(SnapshotCalls::DeleteSnapshot, mb);
+        if (wait) {
+            SEND_FB_MSG(SnapshotCalls::DeleteSnapshot, mb);
+        } else {
+            SEND_FB_MSG_ASYNC(SnapshotCalls::DeleteSnapshot, mb);
+        }
     }
 }
 
@@ -202,7 +679,7 @@ void SnapshotClient::pushThreadResult(
         threadResults.emplace_back(std::make_pair(host, mockResult));
 
     } else {
-        flatbuffers::FlatBufferBuilder mb;
+        faabric::transport::FlatBufferMessageBuilder mb;
         flatbuffers::Offset<ThreadResultRequest> requestOffset;
 
         SPDLOG_DEBUG("Sending thread result for {} with {} diffs to {}",
@@ -213,27 +690,127 @@ void SnapshotClient::pushThreadResult(
         auto keyOffset = mb.CreateString(key);
 
         // Create objects for all the diffs
-        std::vector<flatbuffers::Offset<SnapshotDiffRequest>> diffsFbVector;
-        diffsFbVector.reserve(diffs.size());
+        auto diffsOffset = createDiffs(mb, diffs);
+
+        requestOffset = CreateThreadResultRequest(
+          mb, messageId, returnValue, keyOffset, diffsOffset);
+
+        mb.Finish(requestOffset);
+        sendDiffsRequest(SnapshotCalls::ThreadResult, mb);
+    }
+}
+
+int SnapshotClient::getCompressionLevel(size_t payloadSize)
+{
+    int level = faabric::util::getSystemConfig().snapshotCompressionLevel;
+    if (level != 0) {
+        return level;
+    }
+
+    return faabric::util::zstdAdaptiveLevel(payloadSize,
+                                            getSnapshotLinkThroughput(host));
+}
+
+flatbuffers::Offset<
+  flatbuffers::Vector<flatbuffers::Offset<SnapshotDiffRequest>>>
+SnapshotClient::createDiffs(
+  faabric::transport::FlatBufferMessageBuilder& mb,
+  const std::vector<faabric::util::SnapshotDiff>& diffs)
+{
+    size_t minSize =
+      faabric::util::getSystemConfig().snapshotCompressionMinSize;
+    bool compressDiffs = getCompressionMode() == SnapshotCompression::Diff;
+
+    // All diffs are compressed at the level suited to their total size
+    int level = 0;
+    if (compressDiffs) {
+        size_t totalSize = 0;
         for (const auto& d : diffs) {
-            std::span<const uint8_t> diffData = d.getData();
+            totalSize += d.getData().size();
+        }
+        level = getCompressionLevel(totalSize);
+    }
 
-            // Note that we're doing a copy here, but it's unavoidable
-            auto dataOffset =
-              mb.CreateVector<uint8_t>(diffData.data(), diffData.size());
+    std::vector<flatbuffers::Offset<SnapshotDiffRequest>> diffsFbVector;
+    diffsFbVector.reserve(diffs.size());
+    for (const auto& d : diffs) {
+        std::span<const uint8_t> diffData = d.getData();
 
-            auto diff = CreateSnapshotDiffRequest(
-              mb, d.getOffset(), d.getDataType(), d.getOperation(), dataOffset);
-            diffsFbVector.push_back(diff);
+        CompressedBuffer compressed;
+        if (compressDiffs && diffData.size() >= minSize) {
+            compressed =
+              compress(std::span(&diffData, 1), diffData.size(), level);
         }
 
-        auto diffsOffset = mb.CreateVector(diffsFbVector);
+        // Note that we're doing a copy here, but it's unavoidable
+        std::span<const uint8_t> sentData =
+          compressed.data ? compressed.span() : diffData;
+        auto dataOffset =
+          mb.CreateVector<uint8_t>(sentData.data(), sentData.size());
+
+        auto diff = CreateSnapshotDiffRequest(mb,
+                                              d.getOffset(),
+                                              d.getDataType(),
+                                              d.getOperation(),
+                                              dataOffset,
+                                              compressed.data ? diffData.size()
+                                                              : 0);
+        diffsFbVector.push_back(diff);
+    }
 
-        requestOffset = CreateThreadResultRequest(
-          mb, messageId, returnValue, keyOffset, diffsOffset);
+    return mb.CreateVector(diffsFbVector);
+}
 
-        mb.Finish(requestOffset);
-        SEND_FB_MSG(SnapshotCalls::ThreadResult, mb);
+void SnapshotClient::sendDiffsRequest(
+  int call,
+  faabric::transport::FlatBufferMessageBuilder& mb)
+{
+    faabric::EmptyResponse response;
+
+    size_t minSize =
+      faabric::util::getSystemConfig().snapshotCompressionMinSize;
+    size_t requestSize = mb.GetSize();
+    if (getCompressionMode() == SnapshotCompression::Message &&
+        requestSize >= minSize) {
+        std::span<const uint8_t> request(mb.GetBufferPointer(), requestSize);
+        int level = getCompressionLevel(requestSize);
+        CompressedBuffer compressed =
+          compress(std::span(&request, 1), requestSize, level);
+
+        if (compressed.data) {
+            SPDLOG_TRACE("Compressed call {} to {} from {} to {} bytes",
+                         call,
+                         host,
+                         requestSize,
+                         compressed.size);
+
+            faabric::transport::FlatBufferMessageBuilder cmb(compressed.size +
+                                                             1024);
+            auto dataOffset =
+              cmb.CreateVector<uint8_t>(compressed.data.get(), compressed.size);
+            auto requestOffset =
+              CreateCompressedRequest(cmb, call, requestSize, dataOffset);
+            cmb.Finish(requestOffset);
+
+            timedSyncSend(SnapshotCalls::CompressedCall,
+                          cmb.releaseMessage(),
+                          &response);
+            return;
+        }
     }
+
+    timedSyncSend(call, mb.releaseMessage(), &response);
+}
+
+void SnapshotClient::timedSyncSend(int call,
+                                   faabric::transport::Message&& msg,
+                                   google::protobuf::Message* response)
+{
+    size_t nBytes = msg.allData().size();
+    faabric::util::TimePoint start = faabric::util::startTimer();
+
+    syncSend(call, std::move(msg), response);
+
+    recordTransfer(host, nBytes, start);
 }
 }
@@ -1,4 +1,5 @@
 #include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/util/clock.h>
 #include <faabric/util/func.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
@@ -6,6 +7,7 @@
 #include <faabric/util/snapshot.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
 #include <sys/mman.h>
 
 namespace faabric::snapshot {
@@ -24,9 +26,28 @@ std::shared_ptr<faabric::util::SnapshotData> SnapshotRegistry::getSnapshot(
         throw std::runtime_error("Snapshot doesn't exist");
     }
 
+    snapshotUsage.at(key).lastUsedMillis =
+      faabric::util::getGlobalClock().epochMillis();
+
     return snapshotMap[key];
 }
 
+std::shared_ptr<faabric::util::SnapshotData> SnapshotRegistry::tryGetSnapshot(
+  const std::string& key)
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    auto it = snapshotMap.find(key);
+    if (it == snapshotMap.end()) {
+        return nullptr;
+    }
+
+    snapshotUsage.at(key).lastUsedMillis =
+      faabric::util::getGlobalClock().epochMillis();
+
+    return it->second;
+}
+
 bool SnapshotRegistry::snapshotExists(const std::string& key)
 {
     faabric::util::SharedLock lock(snapshotsMx);
@@ -44,14 +65,23 @@ void SnapshotRegistry::registerSnapshot(
                  data->getSize(),
                  data->getMaxSize());
 
+    // Any pages stored for a snapshot we're replacing are no longer valid
+    removeSnapshotPages(key);
+
     snapshotMap.insert_or_assign(key, std::move(data));
+
+    // Replacing a snapshot keeps its pins
+    snapshotUsage[key].lastUsedMillis =
+      faabric::util::getGlobalClock().epochMillis();
 }
 
 void SnapshotRegistry::deleteSnapshot(const std::string& key)
 {
     faabric::util::FullLock lock(snapshotsMx);
     SPDLOG_DEBUG("Deleting snapshot {}", key);
+    removeSnapshotPages(key);
     snapshotMap.erase(key);
+    snapshotUsage.erase(key);
 }
 
 size_t SnapshotRegistry::getSnapshotCount()
@@ -71,5 +101,224 @@ void SnapshotRegistry::clear()
     faabric::util::FullLock lock(snapshotsMx);
     SPDLOG_DEBUG("Deleting all snapshots");
     snapshotMap.clear();
+    snapshotUsage.clear();
+    pageStore.clear();
+    snapshotPageHashes.clear();
+}
+
+void SnapshotRegistry::registerSnapshotPages(
+  const std::string& key,
+  const std::vector<faabric::util::SnapshotPageHash>& hashes)
+{
+    faabric::util::FullLock lock(snapshotsMx);
+
+    auto it = snapshotMap.find(key);
+    if (it == snapshotMap.end()) {
+        SPDLOG_ERROR("Storing pages for snapshot {} which does not exist", key);
+        throw std::runtime_error("Storing pages for missing snapshot");
+    }
+
+    const auto& snap = it->second;
+    size_t nPages = faabric::util::getRequiredHostPages(snap->getSize());
+    if (hashes.size() != nPages) {
+        SPDLOG_ERROR("Storing {} page hashes for snapshot {} with {} pages",
+                     hashes.size(),
+                     key,
+                     nPages);
+        throw std::runtime_error("Snapshot page hashes don't match size");
+    }
+
+    removeSnapshotPages(key);
+
+    SPDLOG_DEBUG("Storing {} pages for snapshot {}", nPages, key);
+    for (size_t i = 0; i < nPages; i++) {
+        pageStore[hashes.at(i)].push_back(
+          { snap, (uint32_t)(i * faabric::util::HOST_PAGE_SIZE) });
+    }
+
+    snapshotPageHashes[key] = hashes;
+}
+
+std::vector<int> SnapshotRegistry::getMissingPages(
+  const std::vector<faabric::util::SnapshotPageHash>& hashes)
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    std::vector<int> missing;
+    for (int i = 0; i < hashes.size(); i++) {
+        if (!pageStore.contains(hashes.at(i))) {
+            missing.push_back(i);
+        }
+    }
+
+    return missing;
+}
+
+bool SnapshotRegistry::copyStoredPage(
+  const faabric::util::SnapshotPageHash& hash,
+  faabric::util::SnapshotData& target,
+  uint32_t offset,
+  size_t length)
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    auto it = pageStore.find(hash);
+    if (it == pageStore.end()) {
+        return false;
+    }
+
+    for (const auto& page : it->second) {
+        if (page.offset + length > page.snapshot->getSize()) {
+            continue;
+        }
+
+        target.copyInData({ page.snapshot->getDataPtr(page.offset), length },
+                          offset);
+
+        if (faabric::util::hashSnapshotPage(
+              { target.getDataPtr(offset), length }) == hash) {
+            return true;
+        }
+
+        SPDLOG_TRACE("Stored page at {} changed since it was stored",
+                     page.offset);
+    }
+
+    return false;
+}
+
+size_t SnapshotRegistry::getStoredPageCount()
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+    return pageStore.size();
+}
+
+int SnapshotRegistry::getStoredPageRefCount(
+  const faabric::util::SnapshotPageHash& hash)
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    auto it = pageStore.find(hash);
+    if (it == pageStore.end()) {
+        return 0;
+    }
+
+    return it->second.size();
+}
+
+void SnapshotRegistry::pinSnapshot(const std::string& key)
+{
+    faabric::util::FullLock lock(snapshotsMx);
+
+    auto it = snapshotUsage.find(key);
+    if (it == snapshotUsage.end()) {
+        SPDLOG_ERROR("Pinning snapshot {} which does not exist", key);
+        throw std::runtime_error("Pinning missing snapshot");
+    }
+
+    it->second.pins++;
+}
+
+void SnapshotRegistry::unpinSnapshot(const std::string& key)
+{
+    faabric::util::FullLock lock(snapshotsMx);
+
+    auto it = snapshotUsage.find(key);
+    if (it == snapshotUsage.end() || it->second.pins == 0) {
+        SPDLOG_ERROR("Unpinning snapshot {} which is not pinned", key);
+        throw std::runtime_error("Unpinning snapshot which is not pinned");
+    }
+
+    it->second.pins--;
+}
+
+bool SnapshotRegistry::isSnapshotPinned(const std::string& key)
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    auto it = snapshotUsage.find(key);
+    return it != snapshotUsage.end() && it->second.pins > 0;
+}
+
+std::vector<SnapshotRegistry::EvictableSnapshot>
+SnapshotRegistry::getEvictableSnapshots()
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    long nowMillis = faabric::util::getGlobalClock().epochMillis();
+
+    std::vector<EvictableSnapshot> evictable;
+    for (const auto& [key, usage] : snapshotUsage) {
+        if (usage.pins > 0) {
+            continue;
+        }
+
+        evictable.push_back({ key,
+                              snapshotMap.at(key)->getSize(),
+                              nowMillis - usage.lastUsedMillis.load() });
+    }
+
+    std::sort(evictable.begin(),
+              evictable.end(),
+              [](const EvictableSnapshot& a, const EvictableSnapshot& b) {
+                  return a.idleMillis > b.idleMillis;
+              });
+
+    return evictable;
+}
+
+bool SnapshotRegistry::evictSnapshot(const std::string& key)
+{
+    faabric::util::FullLock lock(snapshotsMx);
+
+    auto it = snapshotUsage.find(key);
+    if (it == snapshotUsage.end() || it->second.pins > 0) {
+        return false;
+    }
+
+    SPDLOG_DEBUG("Evicting snapshot {}", key);
+    removeSnapshotPages(key);
+    snapshotMap.erase(key);
+    snapshotUsage.erase(it);
+
+    return true;
+}
+
+size_t SnapshotRegistry::getTotalSnapshotBytes()
+{
+    faabric::util::SharedLock lock(snapshotsMx);
+
+    size_t total = 0;
+    for (const auto& [key, snap] : snapshotMap) {
+        total += snap->getSize();
+    }
+
+    return total;
+}
+
+void SnapshotRegistry::removeSnapshotPages(const std::string& key)
+{
+    auto hashesIt = snapshotPageHashes.find(key);
+    if (hashesIt == snapshotPageHashes.end()) {
+        return;
+    }
+
+    const auto& snap = snapshotMap.at(key);
+    for (const auto& hash : hashesIt->second) {
+        auto pageIt = pageStore.find(hash);
+        if (pageIt == pageStore.end()) {
+            continue;
+        }
+
+        std::erase_if(pageIt->second, [&snap](const StoredPage& page) {
+            return page.snapshot == snap;
+        });
+
+        if (pageIt->second.empty()) {
+            pageStore.erase(pageIt);
+        }
+    }
+
+    snapshotPageHashes.erase(hashesIt);
 }
 }
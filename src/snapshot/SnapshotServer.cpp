@@ -7,11 +7,16 @@
 #include <faabric/transport/common.h>
 #include <faabric/transport/macros.h>
 #include <faabric/util/bytes.h>
+#include <faabric/util/delta.h>
 #include <faabric/util/func.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/snapshot.h>
 
+#include <optional>
+#include <unordered_map>
+
 using namespace faabric::util;
 
 namespace faabric::snapshot {
@@ -54,6 +59,31 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::doSyncRecv(
         case faabric::snapshot::SnapshotCalls::ThreadResult: {
             return recvThreadResult(message);
         }
+        case faabric::snapshot::SnapshotCalls::GetMissingPages: {
+            return recvGetMissingPages(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::CompressedCall: {
+            return recvCompressedRequest(message);
+        }
+        case faabric::snapshot::SnapshotCalls::PushSnapshotBegin: {
+            return recvPushSnapshotBegin(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::PushSnapshotChunk: {
+            return recvPushSnapshotChunk(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::PushSnapshotCommit: {
+            return recvPushSnapshotCommit(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::PushLazySnapshot: {
+            return recvPushLazySnapshot(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::GetSnapshotPages: {
+            return recvGetSnapshotPages(message.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::DeleteSnapshot: {
+            recvDeleteSnapshot(message.udata());
+            return std::make_unique<faabric::EmptyResponse>();
+        }
         default: {
             throw std::runtime_error(
               fmt::format("Unrecognized sync call header: {}", header));
@@ -61,29 +91,453 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::doSyncRecv(
     }
 }
 
+static std::vector<SnapshotPageHash> getPageHashes(
+  const flatbuffers::Vector<uint8_t>* hashBytes)
+{
+    if (hashBytes->size() % sizeof(SnapshotPageHash) != 0) {
+        SPDLOG_ERROR("Invalid snapshot page hashes size: {}",
+                     hashBytes->size());
+        throw std::runtime_error("Invalid snapshot page hashes");
+    }
+
+    std::vector<SnapshotPageHash> hashes(hashBytes->size() /
+                                         sizeof(SnapshotPageHash));
+    std::memcpy(hashes.data(), hashBytes->data(), hashBytes->size());
+
+    return hashes;
+}
+
+using SnapshotDiffRequests =
+  flatbuffers::Vector<flatbuffers::Offset<SnapshotDiffRequest>>;
+
+// Returns the space needed to decompress the diffs, or zero if none of them
+// are compressed
+static size_t getDecompressedDiffsSize(const SnapshotDiffRequests* diffsFb)
+{
+    bool anyCompressed = false;
+    size_t totalSize = 0;
+    for (const auto* diff : *diffsFb) {
+        if (diff->uncompressed_size() > 0) {
+            anyCompressed = true;
+            totalSize += diff->uncompressed_size();
+        } else {
+            totalSize += diff->data()->size();
+        }
+    }
+
+    return anyCompressed ? totalSize : 0;
+}
+
+// Converts diffs to snapshot diff objects. If a buffer is given, all the
+// diffs' data is decompressed or copied into it, otherwise the diffs refer to
+// the data in the request.
+static std::vector<SnapshotDiff> getDiffs(const SnapshotDiffRequests* diffsFb,
+                                          std::span<uint8_t> buffer = {})
+{
+    std::vector<SnapshotDiff> diffs;
+    diffs.reserve(diffsFb->size());
+
+    size_t bufferOffset = 0;
+    for (const auto* diff : *diffsFb) {
+        std::span<const uint8_t> data(diff->data()->data(),
+                                      diff->data()->size());
+
+        if (!buffer.empty()) {
+            size_t dataSize = diff->uncompressed_size() > 0
+                                ? diff->uncompressed_size()
+                                : data.size();
+            if (bufferOffset + dataSize > buffer.size()) {
+                SPDLOG_ERROR("Diff at {} overruns decompression buffer",
+                             diff->offset());
+                throw std::runtime_error("Diff overruns decompression buffer");
+            }
+
+            std::span<uint8_t> target = buffer.subspan(bufferOffset, dataSize);
+            if (diff->uncompressed_size() > 0) {
+                zstdDecompress(data, target);
+            } else {
+                std::copy(data.begin(), data.end(), target.begin());
+            }
+
+            data = target;
+            bufferOffset += dataSize;
+        }
+
+        diffs.emplace_back(
+          static_cast<SnapshotDataType>(diff->data_type()),
+          static_cast<SnapshotMergeOperation>(diff->merge_op()),
+          diff->offset(),
+          data);
+    }
+
+    return diffs;
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvCompressedRequest(faabric::transport::Message& message)
+{
+    const CompressedRequest* r =
+      flatbuffers::GetRoot<CompressedRequest>(message.udata().data());
+
+    SPDLOG_TRACE("Decompressing call {} ({} -> {} bytes)",
+                 r->call(),
+                 r->data()->size(),
+                 r->uncompressed_size());
+
+    // Decompress into a transport message of its own, which can be cached in
+    // place of the original if the request's data must be kept around
+    faabric::transport::Message inner =
+      faabric::transport::Message::allocate(r->uncompressed_size());
+    zstdDecompress({ r->data()->data(), r->data()->size() }, inner.udata());
+
+    switch (r->call()) {
+        case faabric::snapshot::SnapshotCalls::PushSnapshotUpdate: {
+            return recvPushSnapshotUpdate(inner.udata());
+        }
+        case faabric::snapshot::SnapshotCalls::ThreadResult: {
+            return recvThreadResult(inner);
+        }
+        default: {
+            throw std::runtime_error(
+              fmt::format("Unrecognized compressed call: {}", r->call()));
+        }
+    }
+}
+
+std::unique_ptr<google::protobuf::Message> SnapshotServer::recvGetMissingPages(
+  std::span<const uint8_t> buffer)
+{
+    const SnapshotPagesRequest* r =
+      flatbuffers::GetRoot<SnapshotPagesRequest>(buffer.data());
+
+    std::vector<SnapshotPageHash> hashes = getPageHashes(r->page_hashes());
+
+    auto response = std::make_unique<faabric::SnapshotPagesResponse>();
+    for (int p : reg.getMissingPages(hashes)) {
+        response->add_missingpages(p);
+    }
+
+    return response;
+}
+
+static std::shared_ptr<PendingSnapshotPush> beginSnapshotPush(
+  const std::string& snapKey,
+  size_t snapSize,
+  size_t maxSize,
+  const flatbuffers::Vector<uint8_t>* pageHashes,
+  const flatbuffers::Vector<flatbuffers::Offset<SnapshotMergeRegionRequest>>*
+    mergeRegions)
+{
+    if (snapSize == 0) {
+        SPDLOG_ERROR("Received shapshot {} with zero size", snapKey);
+        throw std::runtime_error("Received snapshot with zero size");
+    }
+
+    auto push = std::make_shared<PendingSnapshotPush>();
+    push->key = snapKey;
+
+    size_t nPages = getRequiredHostPages(snapSize);
+    push->hashes = getPageHashes(pageHashes);
+    if (push->hashes.size() != nPages) {
+        SPDLOG_ERROR("Snapshot {} has {} pages but {} hashes",
+                     snapKey,
+                     nPages,
+                     push->hashes.size());
+        throw std::runtime_error("Snapshot page hashes don't match size");
+    }
+
+    // Set up the snapshot, whose memory is backed by its fd, so pages are
+    // written straight into the fd as they arrive
+    push->snap = std::make_shared<SnapshotData>(snapSize, maxSize);
+    push->filledPages.resize(nPages, false);
+
+    for (const auto* mr : *mergeRegions) {
+        push->mergeRegions.emplace_back(
+          mr->offset(),
+          mr->length(),
+          static_cast<SnapshotDataType>(mr->data_type()),
+          static_cast<SnapshotMergeOperation>(mr->merge_op()));
+    }
+
+    return push;
+}
+
+static void receiveSnapshotPages(PendingSnapshotPush& push,
+                                 const flatbuffers::Vector<uint32_t>* sentPages,
+                                 const flatbuffers::Vector<uint8_t>* contents,
+                                 size_t contentsUncompressedSize)
+{
+    size_t snapSize = push.snap->getSize();
+    size_t nPages = push.filledPages.size();
+
+    // Work out where each page that was sent goes
+    bool compressed = contentsUncompressedSize > 0;
+    size_t contentsSize =
+      compressed ? contentsUncompressedSize : contents->size();
+    std::vector<std::pair<uint32_t, size_t>> sentRegions;
+    sentRegions.reserve(sentPages->size());
+    size_t contentsOffset = 0;
+    for (uint32_t p : *sentPages) {
+        if (p >= nPages) {
+            SPDLOG_ERROR("Invalid page {} sent for snapshot {}", p, push.key);
+            throw std::runtime_error("Invalid snapshot page sent");
+        }
+
+        uint32_t pageOffset = p * HOST_PAGE_SIZE;
+        size_t pageSize =
+          std::min<size_t>(HOST_PAGE_SIZE, snapSize - pageOffset);
+        if (contentsOffset + pageSize > contentsSize) {
+            SPDLOG_ERROR("Invalid page {} sent for snapshot {}", p, push.key);
+            throw std::runtime_error("Invalid snapshot page sent");
+        }
+
+        sentRegions.emplace_back(pageOffset, pageSize);
+        contentsOffset += pageSize;
+
+        push.filledPages.at(p) = true;
+        push.sentPageOffsets.try_emplace(push.hashes.at(p), pageOffset);
+    }
+
+    // Compressed pages are decompressed straight into the snapshot
+    if (compressed) {
+        push.snap->copyInCompressedData({ contents->data(), contents->size() },
+                                        sentRegions);
+    } else {
+        contentsOffset = 0;
+        for (const auto& [pageOffset, pageSize] : sentRegions) {
+            push.snap->copyInData(
+              { contents->data() + contentsOffset, pageSize }, pageOffset);
+            contentsOffset += pageSize;
+        }
+    }
+}
+
+std::unique_ptr<faabric::SnapshotPagesResponse>
+SnapshotServer::finishSnapshotPush(PendingSnapshotPush& push)
+{
+    auto snap = push.snap;
+    size_t snapSize = snap->getSize();
+    size_t nPages = push.filledPages.size();
+
+    // Fill in the rest, either from pages sent with this push, or pages we
+    // already hold in other snapshots
+    auto response = std::make_unique<faabric::SnapshotPagesResponse>();
+    for (int p = 0; p < nPages; p++) {
+        if (push.filledPages.at(p)) {
+            continue;
+        }
+
+        uint32_t pageOffset = p * HOST_PAGE_SIZE;
+        size_t pageSize =
+          std::min<size_t>(HOST_PAGE_SIZE, snapSize - pageOffset);
+
+        const SnapshotPageHash& hash = push.hashes.at(p);
+        auto sentIt = push.sentPageOffsets.find(hash);
+        if (sentIt != push.sentPageOffsets.end()) {
+            snap->copyInData({ snap->getDataPtr(sentIt->second), pageSize },
+                             pageOffset);
+        } else if (!reg.copyStoredPage(hash, *snap, pageOffset, pageSize)) {
+            response->add_missingpages(p);
+        }
+    }
+
+    // If pages are missing the client will have to send them
+    if (response->missingpages_size() > 0) {
+        SPDLOG_DEBUG("Snapshot {} missing {} pages",
+                     push.key,
+                     response->missingpages_size());
+        return response;
+    }
+
+    // Add the merge regions
+    for (const auto& mr : push.mergeRegions) {
+        snap->addMergeRegion(mr.offset, mr.length, mr.dataType, mr.operation);
+    }
+
+    // Register snapshot, and its pages so that later pushes can reuse them
+    reg.registerSnapshot(push.key, snap);
+    reg.registerSnapshotPages(push.key, push.hashes);
+
+    // The host that pushed the snapshot keeps sending diffs against it until
+    // it's deleted, so it can't be evicted
+    if (!reg.isSnapshotPinned(push.key)) {
+        reg.pinSnapshot(push.key);
+    }
+
+    snap->clearTrackedChanges();
+
+    return response;
+}
+
 std::unique_ptr<google::protobuf::Message> SnapshotServer::recvPushSnapshot(
   std::span<const uint8_t> buffer)
 {
     const SnapshotPushRequest* r =
       flatbuffers::GetRoot<SnapshotPushRequest>(buffer.data());
 
-    if (r->contents()->size() == 0) {
-        SPDLOG_ERROR("Received shapshot {} with zero size", r->key()->c_str());
-        throw std::runtime_error("Received snapshot with zero size");
-    }
+    SPDLOG_DEBUG("Receiving snapshot {} (size {}, max {}, {} pages sent)",
+                 r->key()->c_str(),
+                 r->size(),
+                 r->max_size(),
+                 r->sent_pages()->size());
+
+    auto push = beginSnapshotPush(r->key()->str(),
+                                  r->size(),
+                                  r->max_size(),
+                                  r->page_hashes(),
+                                  r->merge_regions());
+
+    receiveSnapshotPages(*push,
+                         r->sent_pages(),
+                         r->contents(),
+                         r->contents_uncompressed_size());
 
-    SPDLOG_DEBUG("Receiving snapshot {} (size {}, max {})",
+    return finishSnapshotPush(*push);
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvPushSnapshotBegin(std::span<const uint8_t> buffer)
+{
+    const SnapshotPushBeginRequest* r =
+      flatbuffers::GetRoot<SnapshotPushBeginRequest>(buffer.data());
+
+    SPDLOG_DEBUG("Beginning push {} of snapshot {} (size {}, max {})",
+                 r->push_id(),
                  r->key()->c_str(),
-                 r->contents()->size(),
+                 r->size(),
                  r->max_size());
 
-    // Set up the snapshot
-    size_t snapSize = r->contents()->size();
-    std::string snapKey = r->key()->str();
-    auto snap = std::make_shared<SnapshotData>(
-      std::span((uint8_t*)r->contents()->Data(), snapSize), r->max_size());
+    auto push = beginSnapshotPush(r->key()->str(),
+                                  r->size(),
+                                  r->max_size(),
+                                  r->page_hashes(),
+                                  r->merge_regions());
+
+    push->lastUsed = faabric::util::startTimer();
+
+    faabric::util::UniqueLock lock(pendingPushesMx);
+    expirePendingPushes();
+    if (!pendingPushes.try_emplace(r->push_id(), push).second) {
+        SPDLOG_ERROR("Snapshot push {} already in progress", r->push_id());
+        throw std::runtime_error("Snapshot push already in progress");
+    }
+
+    return std::make_unique<faabric::EmptyResponse>();
+}
+
+std::shared_ptr<PendingSnapshotPush> SnapshotServer::getPendingPush(
+  uint64_t pushId,
+  bool remove)
+{
+    faabric::util::UniqueLock lock(pendingPushesMx);
+    auto it = pendingPushes.find(pushId);
+    if (it == pendingPushes.end()) {
+        SPDLOG_ERROR("No snapshot push {} in progress", pushId);
+        throw std::runtime_error("No snapshot push in progress");
+    }
+
+    std::shared_ptr<PendingSnapshotPush> push = it->second;
+    if (remove) {
+        pendingPushes.erase(it);
+    } else {
+        push->lastUsed = faabric::util::startTimer();
+    }
+
+    return push;
+}
+
+void SnapshotServer::expirePendingPushes()
+{
+    // A client that fails part way through a push never commits it, so drop
+    // pushes that have been idle for too long rather than keeping their
+    // snapshots forever
+    int timeoutMs = faabric::util::getSystemConfig().snapshotPushTimeoutMs;
+    std::erase_if(pendingPushes, [timeoutMs](const auto& entry) {
+        const auto& [pushId, push] = entry;
+        if (faabric::util::getTimeDiffMillis(push->lastUsed) < timeoutMs) {
+            return false;
+        }
+
+        SPDLOG_WARN("Dropping abandoned push {} of snapshot {}",
+                    pushId,
+                    push->key);
+        return true;
+    });
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvPushSnapshotChunk(std::span<const uint8_t> buffer)
+{
+    const SnapshotPushChunkRequest* r =
+      flatbuffers::GetRoot<SnapshotPushChunkRequest>(buffer.data());
+
+    SPDLOG_TRACE("Receiving {} pages for snapshot push {}",
+                 r->sent_pages()->size(),
+                 r->push_id());
+
+    // Chunks of a push arrive one at a time, as each is a sync request
+    auto push = getPendingPush(r->push_id(), false);
+
+    try {
+        receiveSnapshotPages(*push,
+                             r->sent_pages(),
+                             r->contents(),
+                             r->contents_uncompressed_size());
+    } catch (...) {
+        // Abandon the push, the client will get the error
+        getPendingPush(r->push_id(), true);
+        throw;
+    }
+
+    return std::make_unique<faabric::EmptyResponse>();
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvPushSnapshotCommit(std::span<const uint8_t> buffer)
+{
+    const SnapshotPushCommitRequest* r =
+      flatbuffers::GetRoot<SnapshotPushCommitRequest>(buffer.data());
+
+    SPDLOG_DEBUG("Committing snapshot push {}", r->push_id());
+
+    auto push = getPendingPush(r->push_id(), true);
+
+    return finishSnapshotPush(*push);
+}
+
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvPushLazySnapshot(std::span<const uint8_t> buffer)
+{
+    const SnapshotLazyPushRequest* r =
+      flatbuffers::GetRoot<SnapshotLazyPushRequest>(buffer.data());
+
+    std::string key = r->key()->str();
+    std::string sourceHost = r->source_host()->str();
+
+    SPDLOG_DEBUG("Receiving snapshot {} lazily from {} (size {}, max {})",
+                 key,
+                 sourceHost,
+                 r->size(),
+                 r->max_size());
+
+    if (r->size() == 0) {
+        SPDLOG_ERROR("Received shapshot {} with zero size", key);
+        throw std::runtime_error("Received snapshot with zero size");
+    }
+
+    auto snap = std::make_shared<SnapshotData>(r->size(), r->max_size());
+
+    // Pages are fetched from the source's copy as they're needed, which may
+    // have changed since this push. It only changes through tracked changes
+    // that are also pushed here as bytewise updates, so applying those on top
+    // of a page fetched after they were made leaves it the same.
+    snap->setLazyPageFetcher(
+      [key, sourceHost](uint32_t offset, std::span<uint8_t> pages) {
+          faabric::scheduler::getScheduler()
+            .getSnapshotClient(sourceHost)
+            ->getSnapshotPages(key, offset, pages);
+      });
 
-    // Add the merge regions
     for (const auto* mr : *r->merge_regions()) {
         snap->addMergeRegion(
           mr->offset(),
@@ -92,15 +546,43 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::recvPushSnapshot(
           static_cast<SnapshotMergeOperation>(mr->merge_op()));
     }
 
-    // Register snapshot
-    reg.registerSnapshot(snapKey, snap);
-
-    snap->clearTrackedChanges();
+    // The pages aren't held yet, so can't be registered for reuse
+    reg.registerSnapshot(key, snap);
+    if (!reg.isSnapshotPinned(key)) {
+        reg.pinSnapshot(key);
+    }
 
-    // Send response
     return std::make_unique<faabric::EmptyResponse>();
 }
 
+std::unique_ptr<google::protobuf::Message>
+SnapshotServer::recvGetSnapshotPages(std::span<const uint8_t> buffer)
+{
+    const SnapshotPageContentsRequest* r =
+      flatbuffers::GetRoot<SnapshotPageContentsRequest>(buffer.data());
+
+    SPDLOG_TRACE("Sending {} bytes of snapshot {} at {}",
+                 r->length(),
+                 r->key()->c_str(),
+                 r->offset());
+
+    auto snap = reg.getSnapshot(r->key()->str());
+    std::vector<uint8_t> contents =
+      snap->getDataCopy(r->offset(), r->length());
+
+    auto response = std::make_unique<faabric::SnapshotPageContentsResponse>();
+    response->set_contents(contents.data(), contents.size());
+
+    return response;
+}
+
+size_t SnapshotServer::getPendingPushCount()
+{
+    faabric::util::UniqueLock lock(pendingPushesMx);
+    expirePendingPushes();
+    return pendingPushes.size();
+}
+
 std::unique_ptr<google::protobuf::Message> SnapshotServer::recvThreadResult(
   faabric::transport::Message& message)
 {
@@ -112,20 +594,21 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::recvThreadResult(
                  r->message_id(),
                  r->diffs()->size());
 
+    // Compressed diffs are decompressed into a message of their own, which
+    // then holds the data for all of them
+    std::optional<faabric::transport::Message> decompressed;
+    size_t decompressedSize = getDecompressedDiffsSize(r->diffs());
+    if (decompressedSize > 0) {
+        decompressed = faabric::transport::Message::allocate(decompressedSize);
+    }
+
     if (r->diffs()->size() > 0) {
         auto snap = reg.getSnapshot(r->key()->str());
 
         // Convert diffs to snapshot diff objects
-        std::vector<SnapshotDiff> diffs;
-        diffs.reserve(r->diffs()->size());
-        for (const auto* diff : *r->diffs()) {
-            diffs.emplace_back(
-              static_cast<SnapshotDataType>(diff->data_type()),
-              static_cast<SnapshotMergeOperation>(diff->merge_op()),
-              diff->offset(),
-              std::span<const uint8_t>(diff->data()->Data(),
-                                       diff->data()->size()));
-        }
+        std::vector<SnapshotDiff> diffs =
+          getDiffs(r->diffs(),
+                   decompressed ? decompressed->udata() : std::span<uint8_t>());
 
         // Queue on the snapshot
         snap->queueDiffs(diffs);
@@ -133,9 +616,11 @@ std::unique_ptr<google::protobuf::Message> SnapshotServer::recvThreadResult(
 
     // Set the result locally
     // Because we don't take ownership of the data in the diffs, we must also
-    // ensure that the underlying message is cached
+    // ensure that the message holding it is cached
     faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
-    sch.setThreadResultLocally(r->message_id(), r->return_value(), message);
+    sch.setThreadResultLocally(r->message_id(),
+                               r->return_value(),
+                               decompressed ? *decompressed : message);
 
     return std::make_unique<faabric::EmptyResponse>();
 }
@@ -152,16 +637,9 @@ SnapshotServer::recvPushSnapshotUpdate(std::span<const uint8_t> buffer)
     // Get the snapshot
     auto snap = reg.getSnapshot(r->key()->str());
 
-    // Convert diffs to snapshot diff objects
-    std::vector<SnapshotDiff> diffs;
-    diffs.reserve(r->diffs()->size());
-    for (const auto* diff : *r->diffs()) {
-        diffs.emplace_back(
-          static_cast<SnapshotDataType>(diff->data_type()),
-          static_cast<SnapshotMergeOperation>(diff->merge_op()),
-          diff->offset(),
-          std::span<const uint8_t>(diff->data()->data(), diff->data()->size()));
-    }
+    // Convert diffs to snapshot diff objects, decompressing them if need be
+    std::vector<uint8_t> decompressed(getDecompressedDiffsSize(r->diffs()));
+    std::vector<SnapshotDiff> diffs = getDiffs(r->diffs(), decompressed);
 
     // Write diffs and set merge regions
     SPDLOG_DEBUG("Writing queued diffs to snapshot {} ({} regions)",
@@ -0,0 +1,72 @@
+#include <faabric/transport/FlatBufferMessageBuilder.h>
+#include <faabric/util/bytes.h>
+#include <faabric/util/logging.h>
+
+#include <nng/nng.h>
+
+namespace faabric::transport {
+
+static_assert(HEADER_MSG_SIZE >= sizeof(nng_msg*),
+              "Header must be big enough to hold the nng message pointer");
+
+/**
+ * Allocates flatbuffer buffers as the body of an nng message, leaving room for
+ * the transport header in front. The owning nng message is stashed in the
+ * header space until the buffer is released, so that the allocator itself can
+ * remain stateless and be shared by all builders.
+ */
+class NngMessageAllocator final : public flatbuffers::Allocator
+{
+  public:
+    uint8_t* allocate(size_t size) override
+    {
+        nng_msg* msg = nullptr;
+        if (int ec = nng_msg_alloc(&msg, HEADER_MSG_SIZE + size); ec < 0) {
+            SPDLOG_CRITICAL("Error allocating a flatbuffer of size {}: {}",
+                            size,
+                            nng_strerror(ec));
+            throw std::bad_alloc();
+        }
+
+        uint8_t* body = reinterpret_cast<uint8_t*>(nng_msg_body(msg));
+        faabric::util::unalignedWrite<nng_msg*>(msg, body);
+
+        return body + HEADER_MSG_SIZE;
+    }
+
+    void deallocate(uint8_t* p, size_t size) override
+    {
+        nng_msg_free(owningMessage(p));
+    }
+
+    static nng_msg* owningMessage(uint8_t* p)
+    {
+        return faabric::util::unalignedRead<nng_msg*>(p - HEADER_MSG_SIZE);
+    }
+};
+
+static NngMessageAllocator nngMessageAllocator;
+
+FlatBufferMessageBuilder::FlatBufferMessageBuilder(size_t initialSize)
+  : flatbuffers::FlatBufferBuilder(initialSize, &nngMessageAllocator, false)
+{}
+
+Message FlatBufferMessageBuilder::releaseMessage()
+{
+    // The builder fills its buffer from the back, so the finished data starts
+    // offset bytes into the allocation. Trimming that gap off the front of the
+    // nng message leaves exactly the header space followed by the data.
+    size_t reservedSize = 0;
+    size_t offset = 0;
+    uint8_t* raw = ReleaseRaw(reservedSize, offset);
+
+    nng_msg* msg = NngMessageAllocator::owningMessage(raw);
+    if (int ec = nng_msg_trim(msg, offset); ec != 0) {
+        nng_msg_free(msg);
+        SPDLOG_ERROR("Error trimming flatbuffer message: {}", nng_strerror(ec));
+        throw std::runtime_error("Error trimming flatbuffer message");
+    }
+
+    return Message(msg);
+}
+}
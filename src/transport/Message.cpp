@@ -1,6 +1,8 @@
 #include <faabric/transport/Message.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
+
+#include <google/protobuf/message.h>
 #include <nng/nng.h>
 
 namespace faabric::transport {
@@ -15,6 +17,31 @@ Message::Message(size_t bufferSize)
     }
 }
 
+Message Message::allocate(size_t dataSize)
+{
+    Message msg(HEADER_MSG_SIZE + dataSize);
+    std::fill_n(msg.allData().data(), HEADER_MSG_SIZE, uint8_t(0));
+    return msg;
+}
+
+Message Message::fromProtobuf(const google::protobuf::Message& msg)
+{
+    const size_t dataSize = msg.ByteSizeLong();
+    Message result = allocate(dataSize);
+    // ByteSizeLong caches the sizes of all sub-messages, so this won't walk the
+    // message a second time to compute them
+    uint8_t* start = result.udata().data();
+    uint8_t* end = msg.SerializeWithCachedSizesToArray(start);
+    if (end != start + dataSize) {
+        SPDLOG_ERROR("Serialised {} bytes of message, expected {}",
+                     end - start,
+                     dataSize);
+        throw std::runtime_error("Error serialising message");
+    }
+
+    return result;
+}
+
 Message::Message(nng_msg* nngMsg)
   : nngMsg(nngMsg)
 {}
@@ -62,4 +89,22 @@ std::vector<uint8_t> Message::dataCopy() const
 {
     return std::vector<uint8_t>(udata().begin(), udata().end());
 }
+
+void Message::writeHeader(uint8_t header, int sequenceNum)
+{
+    std::span<uint8_t> buffer = allData();
+    if (buffer.size() < HEADER_MSG_SIZE) {
+        SPDLOG_ERROR("Message of size {} too small to hold a header",
+                     buffer.size());
+        throw std::runtime_error("Message too small for header");
+    }
+
+    faabric::util::unalignedWrite<uint8_t>(header, buffer.data());
+    faabric::util::unalignedWrite<uint64_t>(
+      static_cast<uint64_t>(buffer.size() - HEADER_MSG_SIZE),
+      buffer.data() + sizeof(uint8_t));
+    faabric::util::unalignedWrite<int32_t>(static_cast<int32_t>(sequenceNum),
+                                           buffer.data() + sizeof(uint8_t) +
+                                             sizeof(uint64_t));
+}
 }
@@ -3,6 +3,7 @@
 #include <faabric/transport/common.h>
 #include <faabric/util/bytes.h>
 #include <faabric/util/gids.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 
@@ -70,6 +71,142 @@ void checkNngErrorRetryOnce(Op op,
 
 namespace faabric::transport {
 
+// ----------------------------------------------
+// AIO POOL
+// ----------------------------------------------
+
+AioPool::AioPool(size_t maxPooledIn)
+  : maxPooled(maxPooledIn)
+{
+    freeAios.reserve(maxPooled);
+}
+
+AioPool::~AioPool()
+{
+    for (nng_aio* aio : freeAios) {
+        nng_aio_free(aio);
+    }
+    freeAios.clear();
+}
+
+nng_aio* AioPool::acquire()
+{
+    {
+        faabric::util::UniqueLock lock(mx);
+        if (!freeAios.empty()) {
+            nng_aio* aio = freeAios.back();
+            freeAios.pop_back();
+            return aio;
+        }
+    }
+
+    nng_aio* aio = nullptr;
+    checkNngError(nng_aio_alloc(&aio, nullptr, nullptr), "nng_aio_alloc", "");
+    return aio;
+}
+
+void AioPool::release(nng_aio* aio)
+{
+    // Make sure the aio doesn't keep hold of a message it no longer owns, or a
+    // timeout that was only meant for the last operation
+    nng_aio_set_msg(aio, nullptr);
+    nng_aio_set_timeout(aio, NNG_DURATION_DEFAULT);
+
+    {
+        faabric::util::UniqueLock lock(mx);
+        if (freeAios.size() < maxPooled) {
+            freeAios.push_back(aio);
+            return;
+        }
+    }
+
+    nng_aio_free(aio);
+}
+
+// ----------------------------------------------
+// ASYNC OPERATIONS
+// ----------------------------------------------
+
+// State for an asynchronous operation on an endpoint. These are reused once
+// their operation has completed, each one keeping its aio (and the callback
+// bound to it) for the lifetime of the endpoint.
+struct MessageEndpoint::AsyncOp
+{
+    MessageEndpoint* endpoint = nullptr;
+
+    nng_aio* aio = nullptr;
+
+    std::function<void(int, nng_msg*)> onComplete;
+};
+
+MessageEndpoint::AsyncOp* MessageEndpoint::acquireAsyncOp()
+{
+    faabric::util::UniqueLock lock(asyncOpsMx);
+    asyncOpsCv.wait(
+      lock, [this] { return asyncOpsInFlight < MAX_ASYNC_OPS_IN_FLIGHT; });
+
+    AsyncOp* op = nullptr;
+    if (freeAsyncOps.empty()) {
+        auto newOp = std::make_unique<AsyncOp>();
+        newOp->endpoint = this;
+        checkNngError(nng_aio_alloc(&newOp->aio,
+                                    &MessageEndpoint::asyncOpCallback,
+                                    newOp.get()),
+                      "nng_aio_alloc",
+                      address);
+        op = newOp.get();
+        asyncOps.emplace_back(std::move(newOp));
+    } else {
+        op = freeAsyncOps.back();
+        freeAsyncOps.pop_back();
+    }
+
+    asyncOpsInFlight++;
+    return op;
+}
+
+void MessageEndpoint::releaseAsyncOp(AsyncOp* op)
+{
+    faabric::util::UniqueLock lock(asyncOpsMx);
+    freeAsyncOps.push_back(op);
+    asyncOpsInFlight--;
+    asyncOpsCv.notify_all();
+}
+
+void MessageEndpoint::asyncOpCallback(void* arg)
+{
+    auto* op = static_cast<AsyncOp*>(arg);
+    MessageEndpoint* endpoint = op->endpoint;
+
+    int ec = nng_aio_result(op->aio);
+    nng_msg* rawMsg = nng_aio_get_msg(op->aio);
+    nng_aio_set_msg(op->aio, nullptr);
+
+    auto onComplete = std::move(op->onComplete);
+    op->onComplete = nullptr;
+
+    // Exceptions must not propagate into nng's callback threads
+    try {
+        onComplete(ec, rawMsg);
+    } catch (std::exception& e) {
+        SPDLOG_ERROR("Error completing async operation on {}: {}",
+                     endpoint->address,
+                     e.what());
+    }
+
+    endpoint->releaseAsyncOp(op);
+}
+
+void MessageEndpoint::awaitAsyncOps()
+{
+    faabric::util::UniqueLock lock(asyncOpsMx);
+    asyncOpsCv.wait(lock, [this] { return asyncOpsInFlight == 0; });
+}
+
+// ----------------------------------------------
+// MESSAGE ENDPOINT
+// ----------------------------------------------
+
 MessageEndpoint::MessageEndpoint(const std::string& addressIn, int timeoutMsIn)
   : address(addressIn)
   , timeoutMs(timeoutMsIn)
@@ -93,12 +230,20 @@ MessageEndpoint::MessageEndpoint(const std::string& hostIn,
 
 MessageEndpoint::~MessageEndpoint()
 {
+    // Async operations refer back to this endpoint, so must all be done
+    // before it goes away. They are bounded by the socket timeouts.
+    awaitAsyncOps();
+
     if (socket.id != 0) {
         if (lingerMs > 0) {
             std::this_thread::sleep_for(std::chrono::milliseconds(lingerMs));
         }
         close();
     }
+
+    for (auto& op : asyncOps) {
+        nng_aio_free(op->aio);
+    }
 }
 
 std::string MessageEndpoint::getAddress()
@@ -258,26 +403,24 @@ void MessageEndpoint::sendMessage(uint8_t header,
                                   int sequenceNum,
                                   std::optional<nng_ctx> context)
 {
-    const size_t allocSize = HEADER_MSG_SIZE + dataSize;
-    nng_msg* msg = nullptr;
-    checkNngError(nng_msg_alloc(&msg, allocSize), "msg_alloc", address);
-    uint8_t* buffer = reinterpret_cast<uint8_t*>(nng_msg_body(msg));
-    std::uninitialized_fill_n(buffer, HEADER_MSG_SIZE, uint8_t(0));
-    faabric::util::unalignedWrite<uint8_t>(header, buffer);
-    faabric::util::unalignedWrite<uint64_t>(static_cast<uint64_t>(dataSize),
-                                            buffer + sizeof(uint8_t));
-    faabric::util::unalignedWrite<int32_t>(static_cast<int32_t>(sequenceNum),
-                                           buffer + sizeof(uint8_t) +
-                                             sizeof(uint64_t));
-    std::copy_n(data, dataSize, buffer + HEADER_MSG_SIZE);
+    Message msg = Message::allocate(dataSize);
+    std::copy_n(data, dataSize, msg.udata().data());
 
-    nng_aio* aio = nullptr;
-    if (int ec = nng_aio_alloc(&aio, nullptr, nullptr); ec < 0) {
-        nng_msg_free(msg);
-        checkNngError(ec, "nng_aio_alloc", address);
-    }
+    sendMessage(header, std::move(msg), sequenceNum, context);
+}
 
-    nng_aio_set_msg(aio, msg);
+void MessageEndpoint::sendMessage(uint8_t header,
+                                  Message&& msg,
+                                  int sequenceNum,
+                                  std::optional<nng_ctx> context)
+{
+    msg.writeHeader(header, sequenceNum);
+
+    nng_aio* aio = aioPool.acquire();
+
+    // The socket takes ownership of the nng message if the send succeeds
+    nng_msg* rawMsg = msg.release();
+    nng_aio_set_msg(aio, rawMsg);
 
     if (context.has_value()) {
         nng_ctx_send(*context, aio);
@@ -287,18 +430,67 @@ void MessageEndpoint::sendMessage(uint8_t header,
 
     nng_aio_wait(aio);
     int ec = nng_aio_result(aio);
-    nng_aio_free(aio);
+    aioPool.release(aio);
     if (ec != 0) {
-        nng_msg_free(msg); // Owned by the socket if succeeded
+        nng_msg_free(rawMsg);
         checkNngError(ec, "sendMessage", address);
     }
 }
 
-Message MessageEndpoint::recvMessage(bool async, std::optional<nng_ctx> context)
+void MessageEndpoint::sendMessageAsync(uint8_t header,
+                                       Message&& msg,
+                                       int sequenceNum,
+                                       SendCallback callback)
 {
-    nng_aio* aio = nullptr;
-    checkNngError(
-      nng_aio_alloc(&aio, nullptr, nullptr), "nng_aio_alloc", address);
+    msg.writeHeader(header, sequenceNum);
+
+    AsyncOp* op = acquireAsyncOp();
+    op->onComplete = [this, callback = std::move(callback)](int ec,
+                                                            nng_msg* rawMsg) {
+        if (ec != 0) {
+            // Still ours to free if the socket didn't accept it
+            nng_msg_free(rawMsg);
+            SPDLOG_ERROR("Async send on {} failed: {} ({})",
+                         address,
+                         nng_strerror(ec),
+                         ec);
+        }
+
+        if (callback) {
+            callback(ec);
+        }
+    };
+
+    nng_aio_set_msg(op->aio, msg.release());
+    nng_send_aio(socket, op->aio);
+}
+
+void MessageEndpoint::recvMessageAsync(RecvCallback callback)
+{
+    AsyncOp* op = acquireAsyncOp();
+    op->onComplete = [this, callback = std::move(callback)](int ec,
+                                                            nng_msg* rawMsg) {
+        Message msg(MessageResponseCode::ERROR);
+        try {
+            msg = checkReceivedMessage(ec, rawMsg, true);
+        } catch (std::exception& e) {
+            SPDLOG_ERROR("Async receive on {} failed: {}", address, e.what());
+        }
+
+        callback(std::move(msg));
+    };
+
+    nng_recv_aio(socket, op->aio);
+}
+
+Message MessageEndpoint::recvMessage(bool async,
+                                     std::optional<nng_ctx> context,
+                                     std::optional<int> recvTimeoutMs)
+{
+    nng_aio* aio = aioPool.acquire();
+    if (recvTimeoutMs.has_value()) {
+        nng_aio_set_timeout(aio, *recvTimeoutMs);
+    }
 
     if (context.has_value()) {
         nng_ctx_recv(*context, aio);
@@ -309,8 +501,15 @@ Message MessageEndpoint::recvMessage(bool async, std::optional<nng_ctx> context)
     nng_aio_wait(aio);
     const int ec = nng_aio_result(aio);
     nng_msg* rawMsg = nng_aio_get_msg(aio);
-    nng_aio_free(aio);
+    aioPool.release(aio);
+
+    return checkReceivedMessage(ec, rawMsg, async);
+}
 
+Message MessageEndpoint::checkReceivedMessage(int ec,
+                                              nng_msg* rawMsg,
+                                              bool async)
+{
     if (ec == NNG_ETIMEDOUT) {
         SPDLOG_TRACE(
           "Did not receive message within {}ms on {}", timeoutMs, address);
@@ -427,6 +626,42 @@ void AsyncSendMessageEndpoint::send(uint8_t header,
     sendMessage(header, data, dataSize, sequenceNum);
 }
 
+void AsyncSendMessageEndpoint::send(uint8_t header,
+                                    Message&& msg,
+                                    int sequenceNum)
+{
+    SPDLOG_TRACE("PUSH {} ({} bytes)", address, msg.udata().size());
+    sendMessage(header, std::move(msg), sequenceNum);
+}
+
+void AsyncSendMessageEndpoint::sendAsync(uint8_t header,
+                                         Message&& msg,
+                                         int sequenceNum,
+                                         SendCallback callback)
+{
+    SPDLOG_TRACE("PUSH (async) {} ({} bytes)", address, msg.udata().size());
+    sendMessageAsync(header, std::move(msg), sequenceNum, std::move(callback));
+}
+
+std::future<void> AsyncSendMessageEndpoint::sendAsync(uint8_t header,
+                                                      Message&& msg,
+                                                      int sequenceNum)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+
+    sendAsync(header, std::move(msg), sequenceNum, [promise](int ec) {
+        if (ec == 0) {
+            promise->set_value();
+        } else {
+            promise->set_exception(
+              std::make_exception_ptr(std::runtime_error(nng_strerror(ec))));
+        }
+    });
+
+    return future;
+}
+
 AsyncInternalSendMessageEndpoint::AsyncInternalSendMessageEndpoint(
   const std::string& inprocLabel,
   int timeoutMs)
@@ -470,7 +705,21 @@ Message SyncSendMessageEndpoint::sendAwaitResponse(uint8_t header,
     auto ctx = createContext();
     sendMessage(header, data, dataSize, NO_SEQUENCE_NUM, ctx.context);
 
-    // Do the receive
+    return awaitResponse(ctx);
+}
+
+Message SyncSendMessageEndpoint::sendAwaitResponse(uint8_t header,
+                                                   Message&& msg)
+{
+    SPDLOG_TRACE("REQ {} ({} bytes)", address, msg.udata().size());
+    auto ctx = createContext();
+    sendMessage(header, std::move(msg), NO_SEQUENCE_NUM, ctx.context);
+
+    return awaitResponse(ctx);
+}
+
+Message SyncSendMessageEndpoint::awaitResponse(const MessageContext& ctx)
+{
     SPDLOG_TRACE("RECV (REQ) {}", address);
     Message msg = recvMessage(false, ctx.context);
     if (msg.getResponseCode() != MessageResponseCode::SUCCESS) {
@@ -539,12 +788,14 @@ void FanMessageEndpoint::stop()
     this->close();
 }
 
-Message FanMessageEndpoint::recv(const MessageContext& ctx)
+Message FanMessageEndpoint::recv(const MessageContext& ctx,
+                                 std::optional<int> recvTimeoutMs)
 {
     // Async (PULL) fan endpoints don't support context objects, a simple
     // receive is enough.
     return recvMessage(isAsync,
-                       isAsync ? std::nullopt : std::optional(ctx.context));
+                       isAsync ? std::nullopt : std::optional(ctx.context),
+                       recvTimeoutMs);
 }
 
 void FanMessageEndpoint::sendResponse(const MessageContext& ctx,
@@ -555,6 +806,13 @@ void FanMessageEndpoint::sendResponse(const MessageContext& ctx,
     return sendMessage(header, data, dataSize, NO_SEQUENCE_NUM, ctx.context);
 }
 
+void FanMessageEndpoint::sendResponse(const MessageContext& ctx,
+                                      uint8_t header,
+                                      Message&& msg)
+{
+    sendMessage(header, std::move(msg), NO_SEQUENCE_NUM, ctx.context);
+}
+
 AsyncFanMessageEndpoint::AsyncFanMessageEndpoint(int portIn, int timeoutMs)
   : FanMessageEndpoint(portIn, timeoutMs, SocketType::pull, true)
 {}
@@ -590,6 +848,23 @@ Message AsyncRecvMessageEndpoint::recv()
     return RecvMessageEndpoint::recvMessage(true);
 }
 
+void AsyncRecvMessageEndpoint::recvAsync(RecvCallback callback)
+{
+    SPDLOG_TRACE("PULL (async) {}", address);
+    recvMessageAsync(std::move(callback));
+}
+
+std::future<Message> AsyncRecvMessageEndpoint::recvAsync()
+{
+    auto promise = std::make_shared<std::promise<Message>>();
+    std::future<Message> future = promise->get_future();
+
+    recvAsync(
+      [promise](Message&& msg) { promise->set_value(std::move(msg)); });
+
+    return future;
+}
+
 AsyncInternalRecvMessageEndpoint::AsyncInternalRecvMessageEndpoint(
   const std::string& inprocLabel,
   int timeoutMs)
@@ -11,6 +11,7 @@ MessageEndpointClient::MessageEndpointClient(std::string hostIn,
   : host(hostIn)
   , asyncPort(asyncPortIn)
   , syncPort(syncPortIn)
+  , timeoutMs(timeoutMs)
   , asyncEndpoint(std::nullopt)
   , syncEndpoint(std::nullopt)
 {
@@ -20,20 +21,45 @@ MessageEndpointClient::MessageEndpointClient(std::string hostIn,
     }
 }
 
-void MessageEndpointClient::asyncSend(int header,
-                                      google::protobuf::Message* msg,
-                                      int sequenceNum)
+void MessageEndpointClient::addPriorityLane(int priorityAsyncPort,
+                                            int prioritySyncPort)
+{
+    if (!faabric::util::isMockMode()) {
+        priorityAsyncEndpoint.emplace(host, priorityAsyncPort, timeoutMs);
+        prioritySyncEndpoint.emplace(host, prioritySyncPort, timeoutMs);
+    }
+}
+
+bool MessageEndpointClient::isPriorityCall(int header)
 {
-    std::string buffer;
+    return false;
+}
 
-    if (!msg->SerializeToString(&buffer)) {
-        throw std::runtime_error("Error serialising message");
+std::optional<AsyncSendMessageEndpoint>&
+MessageEndpointClient::asyncEndpointFor(int header)
+{
+    if (priorityAsyncEndpoint.has_value() && isPriorityCall(header)) {
+        return priorityAsyncEndpoint;
     }
 
-    asyncSend(header,
-              reinterpret_cast<uint8_t*>(buffer.data()),
-              buffer.size(),
-              sequenceNum);
+    return asyncEndpoint;
+}
+
+std::optional<SyncSendMessageEndpoint>& MessageEndpointClient::syncEndpointFor(
+  int header)
+{
+    if (prioritySyncEndpoint.has_value() && isPriorityCall(header)) {
+        return prioritySyncEndpoint;
+    }
+
+    return syncEndpoint;
+}
+
+void MessageEndpointClient::asyncSend(int header,
+                                      google::protobuf::Message* msg,
+                                      int sequenceNum)
+{
+    asyncSend(header, Message::fromProtobuf(*msg), sequenceNum);
 }
 
 void MessageEndpointClient::asyncSend(int header,
@@ -41,24 +67,43 @@ void MessageEndpointClient::asyncSend(int header,
                                       size_t bufferSize,
                                       int sequenceNum)
 {
-    if (asyncEndpoint.has_value()) {
-        asyncEndpoint->send(header, buffer, bufferSize, sequenceNum);
+    auto& endpoint = asyncEndpointFor(header);
+    if (endpoint.has_value()) {
+        endpoint->send(header, buffer, bufferSize, sequenceNum);
+    }
+}
+
+void MessageEndpointClient::asyncSend(int header,
+                                      Message&& msg,
+                                      int sequenceNum)
+{
+    auto& endpoint = asyncEndpointFor(header);
+    if (endpoint.has_value()) {
+        endpoint->send(header, std::move(msg), sequenceNum);
+    }
+}
+
+std::future<void> MessageEndpointClient::asyncSendNoWait(
+  int header,
+  google::protobuf::Message* msg,
+  int sequenceNum)
+{
+    auto& endpoint = asyncEndpointFor(header);
+    if (!endpoint.has_value()) {
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future();
     }
+
+    return endpoint->sendAsync(
+      header, Message::fromProtobuf(*msg), sequenceNum);
 }
 
 void MessageEndpointClient::syncSend(int header,
                                      google::protobuf::Message* msg,
                                      google::protobuf::Message* response)
 {
-    std::string buffer;
-    if (!msg->SerializeToString(&buffer)) {
-        throw std::runtime_error("Error serialising message");
-    }
-
-    syncSend(header,
-             reinterpret_cast<uint8_t*>(buffer.data()),
-             buffer.size(),
-             response);
+    syncSend(header, Message::fromProtobuf(*msg), response);
 }
 
 void MessageEndpointClient::syncSend(int header,
@@ -66,15 +111,34 @@ void MessageEndpointClient::syncSend(int header,
                                      const size_t bufferSize,
                                      google::protobuf::Message* response)
 {
-    if (syncEndpoint.has_value()) {
+    auto& endpoint = syncEndpointFor(header);
+    if (endpoint.has_value()) {
         Message responseMsg =
-          syncEndpoint->sendAwaitResponse(header, buffer, bufferSize);
+          endpoint->sendAwaitResponse(header, buffer, bufferSize);
 
-        // Deserialise response
-        if (!response->ParseFromArray(responseMsg.data().data(),
-                                      responseMsg.data().size())) {
-            throw std::runtime_error("Error deserialising message");
-        }
+        parseResponse(responseMsg, response);
+    }
+}
+
+void MessageEndpointClient::syncSend(int header,
+                                     Message&& msg,
+                                     google::protobuf::Message* response)
+{
+    auto& endpoint = syncEndpointFor(header);
+    if (endpoint.has_value()) {
+        Message responseMsg =
+          endpoint->sendAwaitResponse(header, std::move(msg));
+
+        parseResponse(responseMsg, response);
+    }
+}
+
+void MessageEndpointClient::parseResponse(const Message& responseMsg,
+                                          google::protobuf::Message* response)
+{
+    if (!response->ParseFromArray(responseMsg.data().data(),
+                                  responseMsg.data().size())) {
+        throw std::runtime_error("Error deserialising message");
     }
 }
 }
@@ -3,13 +3,17 @@
 #include <faabric/transport/MessageEndpointServer.h>
 #include <faabric/transport/common.h>
 #include <faabric/util/bytes.h>
+#include <faabric/util/config.h>
 #include <faabric/util/latch.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/network.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <csignal>
 #include <cstdlib>
 #include <memory>
@@ -20,11 +24,16 @@ MessageEndpointServerHandler::MessageEndpointServerHandler(
   MessageEndpointServer* serverIn,
   bool asyncIn,
   const std::string& inprocLabelIn,
+  int portIn,
   int nThreadsIn)
   : server(serverIn)
   , async(asyncIn)
   , inprocLabel(inprocLabelIn)
+  , port(portIn)
   , nThreads(nThreadsIn)
+  , maxThreads(nThreadsIn)
+  , idleTimeoutMs(0)
+  , recvTimeoutMs(DEFAULT_SOCKET_TIMEOUT_MS)
 {}
 
 void MessageEndpointServerHandler::start(int timeoutMs)
@@ -34,15 +43,25 @@ void MessageEndpointServerHandler::start(int timeoutMs)
     // Unlike zeromq, using nng_context objects we can have multiple
     // load-balanced threads receiving from the same req-rep/push-pull socket.
 
+    const auto& conf = faabric::util::getSystemConfig();
+    maxThreads = std::max(nThreads, conf.serverMaxThreads);
+    idleTimeoutMs = conf.serverIdleThreadTimeoutMs;
+
+    // Workers wake up at least once per idle period to check if they should
+    // be retired
+    recvTimeoutMs = timeoutMs;
+    if (maxThreads > nThreads && idleTimeoutMs > 0) {
+        recvTimeoutMs = std::min(timeoutMs, idleTimeoutMs);
+    }
+
     // Latch to make sure we can control the order of the setup
     std::shared_ptr<faabric::util::Latch> startupLatch =
       faabric::util::Latch::create(nThreads + 1);
 
-    SPDLOG_TRACE("Setting up endpoint server {} with {} worker threads",
+    SPDLOG_TRACE("Setting up endpoint server {} with {}-{} worker threads",
                  inprocLabel,
-                 nThreads);
-
-    int port = async ? server->asyncPort : server->syncPort;
+                 nThreads,
+                 maxThreads);
 
     // Connect the relevant fan-in/ out sockets (these will run until
     // they receive a terminate message)
@@ -56,78 +75,13 @@ void MessageEndpointServerHandler::start(int timeoutMs)
 
     SPDLOG_TRACE("Endpoint server {} receiver set up", port);
 
-    for (int i = 0; i < nThreads; i++) {
-        workerThreads.emplace_back([this, startupLatch] {
-            // Here we want to isolate all ZeroMQ stuff in its own
-            // context, so we can do things after it's been destroyed
-            {
-                MessageContext endpointContext = fan->attachFanOut();
-
-                // Notify receiver that this worker is set up
-
-                startupLatch->wait();
-
-                while (true) {
-                    // Receive the message
-                    Message body = fan->recv(endpointContext);
-
-                    // Shut down if necessary
-                    if (body.getResponseCode() == MessageResponseCode::TERM) {
-                        break;
-                    }
-
-                    // On timeout we listen again
-                    if (body.getResponseCode() ==
-                        MessageResponseCode::TIMEOUT) {
-                        continue;
-                    }
-
-                    // Catch-all for other forms of unsuccessful message
-                    if (body.getResponseCode() !=
-                        MessageResponseCode::SUCCESS) {
-                        SPDLOG_ERROR("Unsuccessful message to server {}: {}",
-                                     inprocLabel,
-                                     static_cast<int>(body.getResponseCode()));
-
-                        throw std::runtime_error(
-                          "Unsuccessful message to server");
-                    }
-
-                    if (async) {
-                        // Server-specific async handling
-                        server->doAsyncRecv(body);
-                    } else {
-                        // Server-specific sync handling
-                        std::unique_ptr<google::protobuf::Message> resp =
-                          server->doSyncRecv(body);
-
-                        std::string buffer;
-                        if (!resp->SerializeToString(&buffer)) {
-                            throw std::runtime_error(
-                              "Error serialising message");
-                        }
-
-                        // Return the response
-                        fan->sendResponse(
-                          endpointContext,
-                          NO_HEADER,
-                          reinterpret_cast<uint8_t*>(buffer.data()),
-                          buffer.size());
-                    }
-
-                    // Wait on the request latch if necessary
-                    auto requestLatch = std::atomic_load_explicit(
-                      &server->requestLatch, std::memory_order_acquire);
-                    if (requestLatch != nullptr) {
-                        SPDLOG_TRACE("Server thread waiting on worker latch");
-                        requestLatch->wait();
-                    }
-                }
-            }
-
-            // Perform the tidy-up
-            server->onWorkerStop();
-        });
+    {
+        faabric::util::UniqueLock lock(workersMx);
+        stopping = false;
+        stats = MessageEndpointServerStats();
+        for (int i = 0; i < nThreads; i++) {
+            spawnWorker(startupLatch);
+        }
     }
 
     // Wait for the workers and receiver to be set up
@@ -138,15 +92,194 @@ void MessageEndpointServerHandler::start(int timeoutMs)
                  nThreads);
 }
 
+void MessageEndpointServerHandler::spawnWorker(
+  std::shared_ptr<faabric::util::Latch> startupLatch)
+{
+    // Tidy up any workers that have been retired since the last spawn
+    for (int retiredId : retiredWorkers) {
+        workerThreads.erase(retiredId);
+    }
+    retiredWorkers.clear();
+
+    int workerId = nextWorkerId++;
+    workerThreads.emplace(
+      workerId, std::jthread([this, workerId, startupLatch] {
+          runWorker(workerId, startupLatch);
+      }));
+
+    stats.nWorkers++;
+    stats.peakWorkers = std::max(stats.peakWorkers, stats.nWorkers);
+}
+
+void MessageEndpointServerHandler::runWorker(
+  int workerId,
+  std::shared_ptr<faabric::util::Latch> startupLatch)
+{
+    bool retired = false;
+
+    // Here we want to isolate all ZeroMQ stuff in its own
+    // context, so we can do things after it's been destroyed
+    {
+        MessageContext endpointContext = fan->attachFanOut();
+
+        // Notify receiver that this worker is set up
+        if (startupLatch != nullptr) {
+            startupLatch->wait();
+        }
+
+        auto lastActive = std::chrono::steady_clock::now();
+        while (true) {
+            // Receive the message
+            Message body = fan->recv(endpointContext, recvTimeoutMs);
+
+            // Shut down if necessary
+            if (body.getResponseCode() == MessageResponseCode::TERM) {
+                break;
+            }
+
+            // On timeout we listen again, unless this worker has been idle for
+            // long enough to be retired
+            if (body.getResponseCode() == MessageResponseCode::TIMEOUT) {
+                auto idleMs =
+                  std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - lastActive)
+                    .count();
+                if (idleTimeoutMs > 0 && idleMs >= idleTimeoutMs &&
+                    tryRetireWorker(workerId)) {
+                    retired = true;
+                    break;
+                }
+
+                continue;
+            }
+
+            // Catch-all for other forms of unsuccessful message
+            if (body.getResponseCode() != MessageResponseCode::SUCCESS) {
+                SPDLOG_ERROR("Unsuccessful message to server {}: {}",
+                             inprocLabel,
+                             static_cast<int>(body.getResponseCode()));
+
+                throw std::runtime_error("Unsuccessful message to server");
+            }
+
+            onMessageStart();
+            auto handlingStart = std::chrono::steady_clock::now();
+
+            if (async) {
+                // Server-specific async handling
+                server->doAsyncRecv(body);
+            } else {
+                // Server-specific sync handling
+                std::unique_ptr<google::protobuf::Message> resp =
+                  server->doSyncRecv(body);
+
+                // Return the response, serialised straight into the outgoing
+                // message
+                fan->sendResponse(
+                  endpointContext, NO_HEADER, Message::fromProtobuf(*resp));
+            }
+
+            lastActive = std::chrono::steady_clock::now();
+            onMessageEnd(std::chrono::duration_cast<std::chrono::microseconds>(
+                           lastActive - handlingStart)
+                           .count());
+
+            // Wait on the request latch if necessary
+            auto requestLatch = std::atomic_load_explicit(
+              &server->requestLatch, std::memory_order_acquire);
+            if (requestLatch != nullptr) {
+                SPDLOG_TRACE("Server thread waiting on worker latch");
+                requestLatch->wait();
+            }
+        }
+    }
+
+    // Perform the tidy-up
+    if (retired) {
+        server->onWorkerRetired();
+
+        // Last thing this thread does, so that it can be joined promptly
+        faabric::util::UniqueLock lock(workersMx);
+        retiredWorkers.push_back(workerId);
+    } else {
+        server->onWorkerStop();
+    }
+}
+
+void MessageEndpointServerHandler::onMessageStart()
+{
+    faabric::util::UniqueLock lock(workersMx);
+    stats.nMessages++;
+    stats.nBusyWorkers++;
+
+    // If every worker is now busy, further messages will queue, so add a
+    // worker if we're allowed to
+    if (stats.nBusyWorkers >= stats.nWorkers) {
+        stats.nSaturated++;
+
+        if (!stopping && stats.nWorkers < maxThreads) {
+            SPDLOG_DEBUG("Server {} saturated, adding worker ({}/{})",
+                         inprocLabel,
+                         stats.nWorkers + 1,
+                         maxThreads);
+            spawnWorker(nullptr);
+        }
+    }
+}
+
+void MessageEndpointServerHandler::onMessageEnd(uint64_t handlingUs)
+{
+    faabric::util::UniqueLock lock(workersMx);
+    stats.nBusyWorkers--;
+    stats.totalHandlingUs += handlingUs;
+    stats.maxHandlingUs = std::max(stats.maxHandlingUs, handlingUs);
+}
+
+bool MessageEndpointServerHandler::tryRetireWorker(int workerId)
+{
+    faabric::util::UniqueLock lock(workersMx);
+    if (stopping || stats.nWorkers <= nThreads) {
+        return false;
+    }
+
+    stats.nWorkers--;
+    SPDLOG_DEBUG("Server {} retiring idle worker {} ({} left)",
+                 inprocLabel,
+                 workerId,
+                 stats.nWorkers);
+
+    return true;
+}
+
+MessageEndpointServerStats MessageEndpointServerHandler::getStats()
+{
+    faabric::util::UniqueLock lock(workersMx);
+    return stats;
+}
+
 void MessageEndpointServerHandler::join()
 {
+    // No more workers may be added once we start shutting down
+    {
+        faabric::util::UniqueLock lock(workersMx);
+        stopping = true;
+    }
+
     // Shut down the sockets to gracefully terminate all worker threads.
     if (fan != nullptr) {
         fan->stop();
     }
 
     // Join each worker
-    for (auto& t : workerThreads) {
+    std::map<int, std::jthread> toJoin;
+    {
+        faabric::util::UniqueLock lock(workersMx);
+        toJoin = std::move(workerThreads);
+        workerThreads.clear();
+        retiredWorkers.clear();
+    }
+
+    for (auto& [workerId, t] : toJoin) {
         if (t.joinable()) {
             t.join();
         }
@@ -168,10 +301,34 @@ MessageEndpointServer::MessageEndpointServer(int asyncPortIn,
   , syncPort(syncPortIn)
   , inprocLabel(inprocLabelIn)
   , nThreads(nThreadsIn)
-  , asyncHandler(this, true, inprocLabel + "-async", nThreadsIn)
-  , syncHandler(this, false, inprocLabel, nThreadsIn)
+  , asyncHandler(this, true, inprocLabel + "-async", asyncPort, nThreadsIn)
+  , syncHandler(this, false, inprocLabel, syncPort, nThreadsIn)
 {}
 
+void MessageEndpointServer::addPriorityLane(int priorityAsyncPort,
+                                            int prioritySyncPort,
+                                            int priorityThreads)
+{
+    if (started) {
+        SPDLOG_ERROR("Cannot add priority lane to running server {}",
+                     inprocLabel);
+        throw std::runtime_error("Adding priority lane to running server");
+    }
+
+    priorityAsyncHandler = std::make_unique<MessageEndpointServerHandler>(
+      this,
+      true,
+      inprocLabel + "-priority-async",
+      priorityAsyncPort,
+      priorityThreads);
+    prioritySyncHandler = std::make_unique<MessageEndpointServerHandler>(
+      this,
+      false,
+      inprocLabel + "-priority",
+      prioritySyncPort,
+      priorityThreads);
+}
+
 /**
  * We need to guarantee to callers of this function, that when it returns, the
  * server will be ready to use.
@@ -183,6 +340,11 @@ void MessageEndpointServer::start(int timeoutMs)
     asyncHandler.start(timeoutMs);
     syncHandler.start(timeoutMs);
 
+    if (hasPriorityLane()) {
+        priorityAsyncHandler->start(timeoutMs);
+        prioritySyncHandler->start(timeoutMs);
+    }
+
     // Unfortunately we can't know precisely when the proxies have started,
     // hence have to add a sleep.
     SLEEP_MS(500);
@@ -199,6 +361,11 @@ void MessageEndpointServer::stop()
     asyncHandler.join();
     syncHandler.join();
 
+    if (hasPriorityLane()) {
+        priorityAsyncHandler->join();
+        prioritySyncHandler->join();
+    }
+
     started = false;
 }
 
@@ -207,6 +374,11 @@ void MessageEndpointServer::onWorkerStop()
     // Nothing to do by default
 }
 
+void MessageEndpointServer::onWorkerRetired()
+{
+    // Nothing to do by default
+}
+
 void MessageEndpointServer::setRequestLatch()
 {
     std::atomic_store_explicit(&requestLatch,
@@ -229,4 +401,31 @@ int MessageEndpointServer::getNThreads()
 {
     return nThreads;
 }
+
+MessageEndpointServerStats MessageEndpointServer::getAsyncStats(
+  bool priorityLane)
+{
+    if (priorityLane) {
+        return hasPriorityLane() ? priorityAsyncHandler->getStats()
+                                 : MessageEndpointServerStats();
+    }
+
+    return asyncHandler.getStats();
+}
+
+MessageEndpointServerStats MessageEndpointServer::getSyncStats(
+  bool priorityLane)
+{
+    if (priorityLane) {
+        return hasPriorityLane() ? prioritySyncHandler->getStats()
+                                 : MessageEndpointServerStats();
+    }
+
+    return syncHandler.getStats();
+}
+
+bool MessageEndpointServer::hasPriorityLane()
+{
+    return prioritySyncHandler != nullptr;
+}
 }
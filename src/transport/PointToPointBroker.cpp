@@ -447,24 +447,17 @@ void PointToPointBroker::setAndSendMappingsFromSchedulingDecision(
     std::set<std::string> otherHosts =
       setUpLocalMappingsFromSchedulingDecision(decision);
 
-    // Send out to other hosts
-    for (const auto& host : otherHosts) {
-        faabric::PointToPointMappings msg;
-        msg.set_appid(decision.appId);
-        msg.set_groupid(decision.groupId);
-
-        std::set<int>& indexes = groupIdIdxsMap[decision.groupId];
+    if (otherHosts.empty()) {
+        return;
+    }
 
-        for (int i = 0; i < decision.nFunctions; i++) {
-            auto* mapping = msg.add_mappings();
-            mapping->set_host(decision.hosts.at(i));
-            mapping->set_messageid(decision.messageIds.at(i));
-            mapping->set_appidx(decision.appIdxs.at(i));
-            mapping->set_groupidx(decision.groupIdxs.at(i));
-        }
+    // The mappings are the same for all hosts, so only build them once
+    faabric::PointToPointMappings msg = decision.toPointToPointMappings();
 
+    // Send out to other hosts
+    for (const auto& host : otherHosts) {
         SPDLOG_DEBUG("Sending {} point-to-point mappings for {} to {}",
-                     indexes.size(),
+                     msg.mappings_size(),
                      decision.groupId,
                      host);
 
@@ -473,6 +466,33 @@ void PointToPointBroker::setAndSendMappingsFromSchedulingDecision(
     }
 }
 
+/**
+ * Sets up the mappings locally and returns them ready to be piggybacked on the
+ * batch requests sent to the other hosts in the decision. This avoids the
+ * synchronous round trip per host made by
+ * setAndSendMappingsFromSchedulingDecision. Receivers still block in
+ * waitForMappingsOnThisHost until their batch request arrives.
+ */
+faabric::PointToPointMappings
+PointToPointBroker::setUpLocalAndGetRemoteMappings(
+  const faabric::util::SchedulingDecision& decision)
+{
+    setUpLocalMappingsFromSchedulingDecision(decision);
+
+    return decision.toPointToPointMappings();
+}
+
+void PointToPointBroker::setUpLocalMappingsFromPiggyback(
+  const faabric::PointToPointMappings& mappings)
+{
+    SPDLOG_DEBUG("Receiving {} piggybacked point-to-point mappings for {}",
+                 mappings.mappings_size(),
+                 mappings.groupid());
+
+    setUpLocalMappingsFromSchedulingDecision(
+      faabric::util::SchedulingDecision::fromPointToPointMappings(mappings));
+}
+
 std::shared_ptr<faabric::util::FlagWaiter> PointToPointBroker::getGroupFlag(
   int groupId)
 {
@@ -552,18 +572,32 @@ void PointToPointBroker::incrementRecvMsgCount(int groupId, int sendIdx)
 void PointToPointBroker::updateHostForIdx(int groupId,
                                           int groupIdx,
                                           std::string newHost)
+{
+    updateHostsForIdxs(groupId, { { groupIdx, std::move(newHost) } });
+}
+
+/**
+ * Applies an incremental update to the mappings of a group, e.g. after a
+ * migration. Only the given indexes are changed, and the whole delta is
+ * applied under a single lock acquisition.
+ */
+void PointToPointBroker::updateHostsForIdxs(
+  int groupId,
+  const std::map<int, std::string>& newHosts)
 {
     faabric::util::FullLock lock(brokerMutex);
 
-    std::string key = getPointToPointKey(groupId, groupIdx);
+    for (const auto& [groupIdx, newHost] : newHosts) {
+        std::string key = getPointToPointKey(groupId, groupIdx);
 
-    SPDLOG_DEBUG("Updating point-to-point mapping for {}:{} from {} to {}",
-                 groupId,
-                 groupIdx,
-                 mappings[key],
-                 newHost);
+        SPDLOG_DEBUG("Updating point-to-point mapping for {}:{} from {} to {}",
+                     groupId,
+                     groupIdx,
+                     mappings[key],
+                     newHost);
 
-    mappings[key] = newHost;
+        mappings[key] = newHost;
+    }
 }
 
 void PointToPointBroker::sendMessage(int groupId,
@@ -130,4 +130,10 @@ void PointToPointServer::onWorkerStop()
     broker.resetThreadLocalCache();
     broker.clear();
 }
+
+void PointToPointServer::onWorkerRetired()
+{
+    // The server is still running, so only the thread-local state goes
+    broker.resetThreadLocalCache();
+}
 }
@@ -11,29 +11,44 @@ void PeriodicBackgroundThread::start(int intervalSecondsIn)
                  intervalSeconds);
 
     workThread = std::make_unique<std::jthread>([&](std::stop_token st) {
+        faabric::util::UniqueLock lock(mx);
         while (!st.stop_requested()) {
-            faabric::util::UniqueLock lock(mx);
-            if (st.stop_requested()) {
-                break;
-            }
-
-            bool isStopped = timeoutCv.wait_for(
+            timeoutCv.wait_for(
               lock,
               st,
               std::chrono::milliseconds(intervalSeconds * 1000),
-              [&st] { return st.stop_requested(); });
+              [this] { return wakeUpRequested; });
 
-            // If we hit the timeout it means we have not been notified to
-            // stop. Thus we can do work
-            if (!isStopped) {
-                doWork();
+            // If we hit the timeout or were woken up, and have not been
+            // notified to stop, we can do work
+            if (st.stop_requested()) {
+                break;
             }
+
+            // The work is done without the lock, so that wake-ups requested
+            // while it runs aren't blocked, and are picked up straight after
+            wakeUpRequested = false;
+            lock.unlock();
+            doWork();
+            lock.lock();
         };
 
         SPDLOG_DEBUG("Exiting periodic background thread");
     });
 }
 
+void PeriodicBackgroundThread::wakeUp()
+{
+    // Setting the flag under the lock means it can't be missed between the
+    // thread checking it and starting to wait
+    {
+        faabric::util::UniqueLock lock(mx);
+        wakeUpRequested = true;
+    }
+
+    timeoutCv.notify_one();
+}
+
 void PeriodicBackgroundThread::tidyUp()
 {
     // Hook for subclasses
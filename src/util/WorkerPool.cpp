@@ -0,0 +1,113 @@
+#include <faabric/util/WorkerPool.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+
+namespace faabric::util {
+
+WorkerPool::~WorkerPool()
+{
+    {
+        UniqueLock lock(mx);
+        stopping = true;
+        pending.clear();
+    }
+    workCv.notify_all();
+
+    for (auto& w : workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+}
+
+void WorkerPool::run(int nThreads, const std::function<void()>& work)
+{
+    auto job = std::make_shared<Job>();
+    job->work = &work;
+
+    int nCopies = std::max(nThreads - 1, 0);
+    if (nCopies > 0) {
+        UniqueLock lock(mx);
+        while (workers.size() < nCopies) {
+            SPDLOG_DEBUG("Adding worker {} to pool", workers.size());
+            workers.emplace_back(&WorkerPool::workerLoop, this);
+        }
+
+        for (int i = 0; i < nCopies; i++) {
+            pending.push_back(job);
+        }
+        workCv.notify_all();
+    }
+
+    std::exception_ptr callerError = nullptr;
+    try {
+        work();
+    } catch (...) {
+        callerError = std::current_exception();
+    }
+
+    if (nCopies > 0) {
+        UniqueLock lock(mx);
+
+        // The work is done, so copies that haven't started have nothing to do
+        std::erase_if(pending,
+                      [&job](const auto& other) { return other == job; });
+
+        doneCv.wait(lock, [&job] { return job->nRunning == 0; });
+    }
+
+    if (callerError != nullptr) {
+        std::rethrow_exception(callerError);
+    }
+
+    if (job->error != nullptr) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+int WorkerPool::getThreadCount()
+{
+    UniqueLock lock(mx);
+    return workers.size();
+}
+
+void WorkerPool::workerLoop()
+{
+    UniqueLock lock(mx);
+    for (;;) {
+        workCv.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        std::shared_ptr<Job> job = std::move(pending.front());
+        pending.pop_front();
+        job->nRunning++;
+
+        lock.unlock();
+        std::exception_ptr error = nullptr;
+        try {
+            (*job->work)();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error != nullptr && job->error == nullptr) {
+            job->error = error;
+        }
+
+        if (--job->nRunning == 0) {
+            doneCv.notify_all();
+        }
+    }
+}
+
+WorkerPool& getSnapshotWorkerPool()
+{
+    static WorkerPool pool;
+    return pool;
+}
+}
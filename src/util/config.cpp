@@ -38,6 +38,12 @@ void SystemConfig::initialise()
     isStorageNode = this->getSystemConfIntParam("IS_STORAGE_NODE", "0");
     noSingleHostOptimisations =
       this->getSystemConfIntParam("NO_SINGLE_HOST", "0");
+    // Executors are placed on a NUMA node, with their memory and snapshots
+    // allocated on it, and batches are kept within one node where possible
+    numaPlacement = this->getSystemConfIntParam("NUMA_PLACEMENT", "0");
+    // Pinning of executor pool threads, either "none", "core" to pin each to
+    // one CPU of its executor's node, or "node" to all CPUs of the node
+    threadPinning = getEnvVar("THREAD_PINNING", "none");
 
     // Worker-related timeouts (all in seconds)
     globalMessageTimeout =
@@ -46,6 +52,21 @@ void SystemConfig::initialise()
     reaperIntervalSeconds =
       this->getSystemConfIntParam("REAPER_INTERVAL_SECS", "30");
 
+    // Executor pre-warming
+    // Idle executors kept ready for each function in demand, scaled up to the
+    // maximum with the expected arrivals per interval. A maximum of zero turns
+    // pre-warming off.
+    prewarmMinExecutors =
+      this->getSystemConfIntParam("PREWARM_MIN_EXECUTORS", "1");
+    prewarmMaxExecutors =
+      this->getSystemConfIntParam("PREWARM_MAX_EXECUTORS", "0");
+    prewarmIntervalSeconds =
+      this->getSystemConfIntParam("PREWARM_INTERVAL_SECS", "1");
+    // New executors map a snapshot of a function's memory taken after its
+    // first initialisation rather than initialising it again. Only for
+    // executors whose state after a reset is all in their memory.
+    zygoteSnapshots = this->getSystemConfIntParam("ZYGOTE_SNAPSHOTS", "0");
+
     // MPI
     defaultMpiWorldSize =
       this->getSystemConfIntParam("DEFAULT_MPI_WORLD_SIZE", "5");
@@ -70,16 +91,77 @@ void SystemConfig::initialise()
     // Transport
     functionServerThreads =
       this->getSystemConfIntParam("FUNCTION_SERVER_THREADS", "2");
+    functionServerPriorityThreads =
+      this->getSystemConfIntParam("FUNCTION_SERVER_PRIORITY_THREADS", "1");
     stateServerThreads =
       this->getSystemConfIntParam("STATE_SERVER_THREADS", "2");
     snapshotServerThreads =
       this->getSystemConfIntParam("SNAPSHOT_SERVER_THREADS", "2");
     pointToPointServerThreads =
       this->getSystemConfIntParam("POINT_TO_POINT_SERVER_THREADS", "2");
+    // The per-server thread counts above are the minimum, servers add workers
+    // up to this limit under load and retire them after being idle for the
+    // given period
+    serverMaxThreads = this->getSystemConfIntParam("SERVER_MAX_THREADS", "8");
+    serverIdleThreadTimeoutMs =
+      this->getSystemConfIntParam("SERVER_IDLE_THREAD_TIMEOUT_MS", "10000");
 
     // Dirty tracking
     dirtyTrackingMode = getEnvVar("DIRTY_TRACKING_MODE", "segfault");
     diffingMode = getEnvVar("DIFFING_MODE", "xor");
+    // Bytes of unchanged data allowed between two changes for them to be sent
+    // as a single bytewise diff. Off by default, as the merged diff overwrites
+    // the gap, which is only safe if no other thread may write to it.
+    diffMergeGap = this->getSystemConfIntParam("DIFF_MERGE_GAP", "0");
+    // Threads used to diff large sets of dirty pages, including the caller
+    diffThreads = this->getSystemConfIntParam("DIFF_THREADS", "4");
+    // Threads handling userfaultfd events in the uffd-thread tracking modes
+    uffdHandlerThreads =
+      this->getSystemConfIntParam("UFFD_HANDLER_THREADS", "1");
+    // Pages resolved ahead of a thread writing sequentially through tracked
+    // memory, which are marked dirty without seeing their writes. Off by
+    // default as it makes the dirty pages less precise.
+    uffdFaultAroundPages =
+      this->getSystemConfIntParam("UFFD_FAULT_AROUND_PAGES", "0");
+
+    // Memory
+    // Backing of large allocations, either "none" for host pages,
+    // "transparent" to advise transparent huge pages, or "explicit" to use huge
+    // TLB pages where possible, falling back to transparent huge pages
+    hugePagesMode = getEnvVar("HUGE_PAGES_MODE", "none");
+    // Cgroup v2 directory whose memory usage and pressure drive evictions,
+    // empty to use the cgroup this process is in
+    memoryCgroupDir = getEnvVar("MEMORY_CGROUP_DIR", "");
+    // Idle executors and unpinned snapshots are evicted when memory usage goes
+    // over this percentage of the limit, or when memory stalls go over this
+    // percentage of the time. Zero turns either check off.
+    memoryEvictionUsagePercent =
+      this->getSystemConfIntParam("MEMORY_EVICTION_USAGE_PERCENT", "0");
+    memoryEvictionStallPercent =
+      this->getSystemConfIntParam("MEMORY_EVICTION_STALL_PERCENT", "0");
+
+    // Snapshot transfers
+    // Compression of snapshot data sent between hosts, either "none", "diff"
+    // to compress each diff on its own, or "message" to compress whole diff
+    // messages. Pushed snapshot pages are compressed in both modes.
+    snapshotCompression = getEnvVar("SNAPSHOT_COMPRESSION", "none");
+    snapshotCompressionMinSize =
+      this->getSystemConfIntParam("SNAPSHOT_COMPRESSION_MIN_SIZE", "4096");
+    // Zero picks the level from the payload size and measured link speed
+    snapshotCompressionLevel =
+      this->getSystemConfIntParam("SNAPSHOT_COMPRESSION_LEVEL", "0");
+    // Snapshot pages bigger than this are pushed in chunks of up to this size
+    snapshotPushChunkSize =
+      this->getSystemConfIntParam("SNAPSHOT_PUSH_CHUNK_SIZE", "67108864");
+    // Pushes that receive nothing for this long are dropped by the receiver
+    snapshotPushTimeoutMs =
+      this->getSystemConfIntParam("SNAPSHOT_PUSH_TIMEOUT_MS", "60000");
+    // Either "eager" to push whole snapshots to other hosts before executing
+    // there, or "lazy" to only push their metadata and fetch pages on demand
+    snapshotRestoreMode = getEnvVar("SNAPSHOT_RESTORE_MODE", "eager");
+    // Pages following a lazily fetched page that are fetched along with it
+    snapshotPrefetchPages =
+      this->getSystemConfIntParam("SNAPSHOT_PREFETCH_PAGES", "16");
 }
 
 int SystemConfig::getSystemConfIntParam(const char* name,
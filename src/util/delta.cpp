@@ -4,8 +4,10 @@
 #include <zstd.h>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <functional>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
@@ -207,18 +209,11 @@ std::vector<uint8_t> serializeDelta(
         appendBytesOf(compressBuffer, uint64_t(outb.size()));
         size_t idxCDataStart = compressBuffer.size();
         compressBuffer.insert(compressBuffer.end(), compressBound, uint8_t(0));
-        auto zstdResult = ZSTD_compress(compressBuffer.data() + idxCDataStart,
-                                        compressBuffer.size() - idxCDataStart,
-                                        outb.data(),
-                                        outb.size(),
-                                        cfg.zstdLevel);
-        if (ZSTD_isError(zstdResult)) {
-            auto error = ZSTD_getErrorName(zstdResult);
-            throw std::runtime_error(std::string("ZSTD compression error: ") +
-                                     error);
-        } else {
-            compressBuffer.resize(idxCDataStart + zstdResult);
-        }
+        size_t zstdResult = zstdCompress(
+          outb,
+          std::span<uint8_t>(compressBuffer).subspan(idxCDataStart),
+          cfg.zstdLevel);
+        compressBuffer.resize(idxCDataStart + zstdResult);
         {
             uint64_t comprLen = zstdResult;
             std::copy_n(reinterpret_cast<uint8_t*>(&comprLen),
@@ -262,18 +257,8 @@ void applyDelta(std::span<const uint8_t> delta,
                       "Delta compressed commands block goes out of range:");
                 }
                 std::vector<uint8_t> decompressedCmds(decompressedSize, 0);
-                auto zstdResult = ZSTD_decompress(decompressedCmds.data(),
-                                                  decompressedCmds.size(),
-                                                  delta.data() + readIdx,
-                                                  compressedSize);
-                if (ZSTD_isError(zstdResult)) {
-                    auto error = ZSTD_getErrorName(zstdResult);
-                    throw std::runtime_error(
-                      std::string("ZSTD compression error: ") + error);
-                } else if (zstdResult != decompressedCmds.size()) {
-                    throw std::runtime_error(
-                      "Mismatched decompression sizes in the NDP delta");
-                }
+                zstdDecompress(delta.subspan(readIdx, compressedSize),
+                               decompressedCmds);
                 applyDelta(decompressedCmds, setDataSize, getDataPointer);
                 readIdx += compressedSize;
                 break;
@@ -315,4 +300,165 @@ void applyDelta(std::span<const uint8_t> delta,
     }
 }
 
+// Compression contexts are expensive to set up, so each thread keeps its own
+struct ZstdContextDeleter
+{
+    void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+    void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+static void checkZstdResult(size_t result)
+{
+    if (ZSTD_isError(result)) {
+        throw std::runtime_error(std::string("ZSTD compression error: ") +
+                                 ZSTD_getErrorName(result));
+    }
+}
+
+size_t zstdCompressBound(size_t srcSize)
+{
+    return ZSTD_compressBound(srcSize);
+}
+
+size_t zstdCompress(std::span<const std::span<const uint8_t>> srcs,
+                    std::span<uint8_t> dest,
+                    int level)
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, ZstdContextDeleter> cctx(
+      ZSTD_createCCtx());
+
+    size_t srcSize = 0;
+    for (const auto& src : srcs) {
+        srcSize += src.size();
+    }
+
+    if (dest.size() < ZSTD_compressBound(srcSize)) {
+        throw std::runtime_error("ZSTD compression buffer too small");
+    }
+
+    ZSTD_CCtx_reset(cctx.get(), ZSTD_reset_session_and_parameters);
+    checkZstdResult(
+      ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, level));
+    checkZstdResult(ZSTD_CCtx_setPledgedSrcSize(cctx.get(), srcSize));
+
+    ZSTD_outBuffer out{ dest.data(), dest.size(), 0 };
+    for (size_t i = 0; i < srcs.size(); i++) {
+        ZSTD_inBuffer in{ srcs[i].data(), srcs[i].size(), 0 };
+        bool last = i + 1 == srcs.size();
+        ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+
+        // The output has room for the whole frame, so this only loops while
+        // zstd flushes its internal buffers
+        size_t remaining = 0;
+        do {
+            remaining = ZSTD_compressStream2(cctx.get(), &out, &in, mode);
+            checkZstdResult(remaining);
+        } while (last ? remaining != 0 : in.pos < in.size);
+    }
+
+    // Still need to end the frame if there was no input at all
+    if (srcs.empty()) {
+        ZSTD_inBuffer in{ nullptr, 0, 0 };
+        size_t remaining = 0;
+        do {
+            remaining = ZSTD_compressStream2(cctx.get(), &out, &in, ZSTD_e_end);
+            checkZstdResult(remaining);
+        } while (remaining != 0);
+    }
+
+    return out.pos;
+}
+
+size_t zstdCompress(std::span<const uint8_t> src,
+                    std::span<uint8_t> dest,
+                    int level)
+{
+    return zstdCompress(std::span(&src, 1), dest, level);
+}
+
+void zstdDecompress(std::span<const uint8_t> src,
+                    std::span<const std::span<uint8_t>> dests)
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, ZstdContextDeleter> dctx(
+      ZSTD_createDCtx());
+
+    ZSTD_DCtx_reset(dctx.get(), ZSTD_reset_session_only);
+
+    ZSTD_inBuffer in{ src.data(), src.size(), 0 };
+    size_t remaining = 1;
+    for (const auto& dest : dests) {
+        ZSTD_outBuffer out{ dest.data(), dest.size(), 0 };
+        while (out.pos < out.size) {
+            if (remaining == 0) {
+                throw std::runtime_error(
+                  "ZSTD frame shorter than decompression buffers");
+            }
+
+            size_t inBefore = in.pos;
+            size_t outBefore = out.pos;
+            remaining = ZSTD_decompressStream(dctx.get(), &out, &in);
+            checkZstdResult(remaining);
+
+            if (in.pos == inBefore && out.pos == outBefore) {
+                throw std::runtime_error("Truncated ZSTD frame");
+            }
+        }
+    }
+
+    // Consume the end of the frame, which must not hold any more data
+    while (remaining != 0) {
+        uint8_t extra = 0;
+        ZSTD_outBuffer out{ &extra, 1, 0 };
+        size_t inBefore = in.pos;
+        remaining = ZSTD_decompressStream(dctx.get(), &out, &in);
+        checkZstdResult(remaining);
+
+        if (out.pos > 0) {
+            throw std::runtime_error(
+              "ZSTD frame longer than decompression buffers");
+        }
+        if (remaining != 0 && in.pos == inBefore) {
+            throw std::runtime_error("Truncated ZSTD frame");
+        }
+    }
+
+    if (in.pos != in.size) {
+        throw std::runtime_error("Trailing data after ZSTD frame");
+    }
+}
+
+void zstdDecompress(std::span<const uint8_t> src, std::span<uint8_t> dest)
+{
+    zstdDecompress(src, std::span(&dest, 1));
+}
+
+int zstdAdaptiveLevel(size_t payloadSize, double linkBytesPerSecond)
+{
+    // Rough single-threaded compression speeds of each level in bytes per
+    // second, from fastest to slowest
+    static constexpr std::array<std::pair<int, double>, 4> levelSpeeds = {
+        { { 1, 500e6 }, { 3, 300e6 }, { 6, 120e6 }, { 9, 60e6 } }
+    };
+
+    // Without a measurement assume a fast link
+    if (linkBytesPerSecond <= 0) {
+        return levelSpeeds.front().first;
+    }
+
+    // Use the slowest level that still compresses at least twice as fast as
+    // the link sends
+    int level = levelSpeeds.front().first;
+    for (const auto& [l, speed] : levelSpeeds) {
+        if (speed >= 2 * linkBytesPerSecond) {
+            level = l;
+        }
+    }
+
+    if (payloadSize >= ZSTD_LARGE_PAYLOAD_SIZE) {
+        level = std::min(level, 3);
+    }
+
+    return level;
+}
+
 }
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
@@ -13,6 +15,7 @@
 #include <sys/syscall.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <faabric/util/crash.h>
@@ -38,22 +41,62 @@ class DirtyTrackingRecord
     virtual void trackRegion(std::span<uint8_t> region)
     {
         nPages = faabric::util::getRequiredHostPages(region.size());
-        dirtyFlags = std::vector<char>(nPages, 0);
+        dirtyFlags = DirtyPages(nPages);
         regionBase = region.data();
         regionTop = region.data() + region.size();
+        backingPageSize = faabric::util::getBackingPageSize(region);
     }
 
     virtual void markPage(void* addr)
     {
         long pageNum = ((uint8_t*)addr - regionBase) / HOST_PAGE_SIZE;
-        dirtyFlags[pageNum] = 1;
+        dirtyFlags.markDirty(pageNum);
+    }
+
+    // Marks the given number of pages from the address, stopping at the end
+    // of the region, and returns how many were marked
+    virtual size_t markPages(void* addr, size_t nPagesToMark)
+    {
+        size_t pageNum = ((uint8_t*)addr - regionBase) / HOST_PAGE_SIZE;
+        size_t endPage = std::min<size_t>(pageNum + nPagesToMark, nPages);
+        dirtyFlags.markDirty(pageNum, endPage);
+        return endPage - pageNum;
+    }
+
+    // Marks all the host pages in the backing page holding the address, and
+    // returns the start of the backing page. Writes to memory backed by huge
+    // pages can only be seen for whole huge pages.
+    virtual void* markBackingPage(void* addr)
+    {
+        auto* pageStart = (uint8_t*)((uintptr_t)addr & -backingPageSize);
+        uint8_t* pageEnd = pageStart + backingPageSize;
+        uint8_t* markStart = std::max(pageStart, regionBase);
+        markPages(markStart, getRequiredHostPages(pageEnd - markStart));
+        return pageStart;
+    }
+
+    virtual size_t getBackingPageSize() { return backingPageSize; }
+
+    virtual bool isPageDirty(void* addr)
+    {
+        if (!isTracking(addr)) {
+            return false;
+        }
+
+        return dirtyFlags.isDirty(((uint8_t*)addr - regionBase) /
+                                  HOST_PAGE_SIZE);
     }
 
     virtual bool isInitialised() { return regionTop != nullptr; }
 
+    virtual bool isTracking(void* addr)
+    {
+        return (uint8_t*)addr >= regionBase && (uint8_t*)addr < regionTop;
+    }
+
     virtual int getNPages() { return nPages; }
 
-    virtual std::vector<char> getDirtyFlags() { return dirtyFlags; }
+    virtual DirtyPages getDirtyFlags() { return dirtyFlags; }
 
     virtual void reset()
     {
@@ -61,17 +104,19 @@ class DirtyTrackingRecord
         dirtyFlags.clear();
         regionBase = nullptr;
         regionTop = nullptr;
+        backingPageSize = HOST_PAGE_SIZE;
     }
 
   protected:
     int nPages = 0;
 
-    // std::vector<bool> here seems to worsen performance by >4x
-    // std::vector<char> seems to be optimal
-    std::vector<char> dirtyFlags;
+    // One bit per page, marking a page only touches a single word
+    DirtyPages dirtyFlags;
 
     uint8_t* regionBase = nullptr;
     uint8_t* regionTop = nullptr;
+
+    size_t backingPageSize = HOST_PAGE_SIZE;
 };
 
 /**
@@ -97,7 +142,19 @@ class ThreadSafeDirtyTrackingRecord final : public DirtyTrackingRecord
         DirtyTrackingRecord::markPage(addr);
     }
 
-    std::vector<char> getDirtyFlags() override
+    size_t markPages(void* addr, size_t nPagesToMark) override
+    {
+        FullLock lock(mx);
+        return DirtyTrackingRecord::markPages(addr, nPagesToMark);
+    }
+
+    bool isPageDirty(void* addr) override
+    {
+        SharedLock lock(mx);
+        return DirtyTrackingRecord::isPageDirty(addr);
+    }
+
+    DirtyPages getDirtyFlags() override
     {
         SharedLock lock(mx);
         return DirtyTrackingRecord::getDirtyFlags();
@@ -109,6 +166,12 @@ class ThreadSafeDirtyTrackingRecord final : public DirtyTrackingRecord
         return DirtyTrackingRecord::isInitialised();
     }
 
+    bool isTracking(void* addr) override
+    {
+        SharedLock lock(mx);
+        return DirtyTrackingRecord::isTracking(addr);
+    }
+
     int getNPages() override
     {
         SharedLock lock(mx);
@@ -133,6 +196,27 @@ void* pageAlignAddress(void* faultAddr)
     return alignedAddr;
 }
 
+// Memory backed by huge TLB pages can only be protected in whole huge pages
+static std::span<uint8_t> alignToBackingPages(std::span<uint8_t> region)
+{
+    size_t pageSize = getBackingPageSize(region);
+    size_t nPages = (region.size() + pageSize - 1) / pageSize;
+    return { region.data(), nPages * pageSize };
+}
+
+// Tracking that resolves or inspects single host pages can't be used on memory
+// backed by huge TLB pages
+static void checkHostPageBacked(std::span<uint8_t> region,
+                                const std::string& mode)
+{
+    if (getBackingPageSize(region) != HOST_PAGE_SIZE) {
+        SPDLOG_ERROR("Dirty tracking mode {} does not support huge TLB pages",
+                     mode);
+        throw std::runtime_error("Dirty tracking mode does not support huge "
+                                 "TLB pages");
+    }
+}
+
 // Thread-local tracking information for dirty tracking using signal
 // handlers in the same thread as the fault.
 static thread_local DirtyTrackingRecord tracking;
@@ -150,6 +234,8 @@ void resetDirtyTracker()
 
     if (mode == "softpte") {
         tracker = std::make_shared<SoftPTEDirtyTracker>(mode);
+    } else if (mode == "pagemap-scan") {
+        tracker = std::make_shared<PagemapScanDirtyTracker>(mode);
     } else if (mode == "segfault") {
         tracker = std::make_shared<SegfaultDirtyTracker>(mode);
     } else if (mode == "none") {
@@ -209,6 +295,7 @@ void SoftPTEDirtyTracker::clearAll()
 
 void SoftPTEDirtyTracker::startTracking(std::span<uint8_t> region)
 {
+    checkHostPageBacked(region, mode);
     resetPTEs();
 }
 
@@ -245,7 +332,7 @@ void SoftPTEDirtyTracker::stopThreadLocalTracking(std::span<uint8_t> region)
     // Do nothing
 }
 
-std::vector<char> SoftPTEDirtyTracker::getDirtyPages(std::span<uint8_t> region)
+DirtyPages SoftPTEDirtyTracker::getDirtyPages(std::span<uint8_t> region)
 {
     PROF_START(GetDirtyRegions)
 
@@ -273,33 +360,249 @@ std::vector<char> SoftPTEDirtyTracker::getDirtyPages(std::span<uint8_t> region)
     }
 
     // Iterate through the pagemap entries to work out which are dirty
-    std::vector<char> regions(nPages, 0);
+    DirtyPages regions(nPages);
     for (int i = 0; i < nPages; i++) {
         bool isDirty = entries.at(i) & PAGEMAP_SOFT_DIRTY;
         if (isDirty) {
-            regions[i] = 1;
+            regions.markDirty(i);
         }
     }
 
-    SPDLOG_TRACE(
-      "Out of {} pages, found {} dirty regions", nPages, regions.size());
+    SPDLOG_TRACE("Out of {} pages, found {} dirty", nPages, regions.count());
 
     PROF_END(GetDirtyRegions)
     return regions;
 }
 
-std::vector<char> SoftPTEDirtyTracker::getBothDirtyPages(
-  std::span<uint8_t> region)
+DirtyPages SoftPTEDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
 {
     return getDirtyPages(region);
 }
 
-std::vector<char> SoftPTEDirtyTracker::getThreadLocalDirtyPages(
+DirtyPages SoftPTEDirtyTracker::getThreadLocalDirtyPages(
+  std::span<uint8_t> region)
+{
+    return {};
+}
+
+// ------------------------------
+// PAGEMAP_SCAN
+// ------------------------------
+
+PagemapScanDirtyTracker::PagemapScanDirtyTracker(const std::string& modeIn)
+  : DirtyTracker(modeIn)
+{
+    // Writes to registered memory are resolved by the kernel, so the fd never
+    // has any events to read
+    try {
+        uffd.create(O_CLOEXEC | O_NONBLOCK,
+                    false,
+                    UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED |
+                      UFFD_FEATURE_WP_HUGETLBFS_SHMEM);
+    } catch (std::runtime_error& ex) {
+        SPDLOG_ERROR("Asynchronous userfaultfd write-protection unsupported");
+        throw std::runtime_error("PAGEMAP_SCAN dirty tracking unsupported");
+    }
+
+    pagemapFd = ::open(PAGEMAP, O_RDONLY | O_CLOEXEC);
+    if (pagemapFd < 0) {
+        SPDLOG_ERROR("Could not open pagemap ({})", strerror(errno));
+        throw std::runtime_error("Could not open pagemap");
+    }
+
+    // Kernels without the ioctl reject even an empty scan
+    pm_scan_arg arg = {};
+    arg.size = sizeof(pm_scan_arg);
+    if (::ioctl(pagemapFd, PAGEMAP_SCAN, &arg) < 0) {
+        SPDLOG_ERROR(
+          "PAGEMAP_SCAN unsupported: {} ({})", errno, strerror(errno));
+        ::close(pagemapFd);
+        throw std::runtime_error("PAGEMAP_SCAN dirty tracking unsupported");
+    }
+}
+
+bool PagemapScanDirtyTracker::isSupported()
+{
+    static const bool supported = [] {
+        try {
+            PagemapScanDirtyTracker tracker("pagemap-scan");
+            return true;
+        } catch (std::runtime_error& ex) {
+            return false;
+        }
+    }();
+
+    return supported;
+}
+
+PagemapScanDirtyTracker::~PagemapScanDirtyTracker()
+{
+    ::close(pagemapFd);
+}
+
+void PagemapScanDirtyTracker::clearAll()
+{
+    std::map<uintptr_t, size_t> toReset;
+    {
+        UniqueLock lock(regionsMx);
+        toReset = regions;
+    }
+
+    for (const auto& [start, length] : toReset) {
+        scanRegion({ (uint8_t*)start, length }, true, nullptr);
+    }
+}
+
+void PagemapScanDirtyTracker::startTracking(std::span<uint8_t> region)
+{
+    SPDLOG_TRACE("Starting tracking on region size {}", region.size());
+
+    if (region.empty() || region.data() == nullptr) {
+        SPDLOG_WARN("Empty region passed, not starting tracking");
+        return;
+    }
+
+    PROF_START(PagemapScanStart)
+
+    // Memory that's been remapped since it was last tracked loses its
+    // registration, registering again is a no-op otherwise
+    size_t length = alignToBackingPages(region).size();
+    uffd.registerAddressRange((uintptr_t)region.data(), length, false, true);
+    {
+        // Drop regions this one replaces, e.g. memory remapped at a new size
+        uintptr_t start = (uintptr_t)region.data();
+        UniqueLock lock(regionsMx);
+        auto it = regions.lower_bound(start);
+        if (it != regions.begin()) {
+            auto prev = std::prev(it);
+            if (prev->first + prev->second > start) {
+                it = prev;
+            }
+        }
+        while (it != regions.end() && it->first < start + length) {
+            it = regions.erase(it);
+        }
+
+        regions[start] = length;
+    }
+
+    scanRegion(region, true, nullptr);
+
+    PROF_END(PagemapScanStart)
+}
+
+void PagemapScanDirtyTracker::stopTracking(std::span<uint8_t> region)
+{
+    // Unregistering would discard which pages have been written, so the
+    // region is only forgotten, as its memory may be unmapped after this
+    UniqueLock lock(regionsMx);
+    regions.erase((uintptr_t)region.data());
+}
+
+void PagemapScanDirtyTracker::startThreadLocalTracking(
+  std::span<uint8_t> region)
+{
+    // Do nothing
+}
+
+void PagemapScanDirtyTracker::stopThreadLocalTracking(
+  std::span<uint8_t> region)
+{
+    // Do nothing
+}
+
+void PagemapScanDirtyTracker::scanRegion(
+  std::span<uint8_t> region,
+  bool reset,
+  std::vector<std::pair<size_t, size_t>>* ranges)
+{
+    uintptr_t regionStart = (uintptr_t)region.data();
+    uintptr_t regionEnd =
+      regionStart + getRequiredHostPages(region.size()) * HOST_PAGE_SIZE;
+
+    std::array<page_region, PAGEMAP_SCAN_BATCH_SIZE> vec;
+
+    pm_scan_arg arg = {};
+    arg.size = sizeof(pm_scan_arg);
+    arg.flags = reset ? (PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC) : 0;
+    arg.start = regionStart;
+    arg.end = regionEnd;
+    // Only memory registered for tracking counts as written, the kernel
+    // reports all other memory as written
+    arg.category_mask = PAGE_IS_WRITTEN | PAGE_IS_WPALLOWED;
+    arg.return_mask = PAGE_IS_WRITTEN;
+    if (ranges != nullptr) {
+        arg.vec = (uintptr_t)vec.data();
+        arg.vec_len = vec.size();
+    }
+
+    // The scan stops early once the output is full, so carry on from where
+    // it got to
+    while (arg.start < regionEnd) {
+        int nRanges = ::ioctl(pagemapFd, PAGEMAP_SCAN, &arg);
+        if (nRanges < 0) {
+            SPDLOG_ERROR(
+              "PAGEMAP_SCAN failed: {} ({})", errno, strerror(errno));
+            throw std::runtime_error("PAGEMAP_SCAN failed");
+        }
+
+        for (int i = 0; i < nRanges; i++) {
+            // Regions can be 4GiB or more, so sizes mustn't be truncated
+            size_t offset = vec[i].start - regionStart;
+            size_t length = vec[i].end - vec[i].start;
+
+            if (!ranges->empty() &&
+                ranges->back().first + ranges->back().second == offset) {
+                ranges->back().second += length;
+            } else {
+                ranges->emplace_back(offset, length);
+            }
+        }
+
+        arg.start = arg.walk_end;
+    }
+}
+
+std::vector<std::pair<size_t, size_t>>
+PagemapScanDirtyTracker::getDirtyRanges(std::span<uint8_t> region, bool reset)
+{
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (region.empty() || region.data() == nullptr) {
+        return ranges;
+    }
+
+    PROF_START(PagemapScanDirty)
+    scanRegion(region, reset, &ranges);
+    PROF_END(PagemapScanDirty)
+
+    return ranges;
+}
+
+DirtyPages PagemapScanDirtyTracker::getDirtyPages(std::span<uint8_t> region)
+{
+    size_t nPages = getRequiredHostPages(region.size());
+    DirtyPages dirtyPages(nPages);
+    for (auto [offset, length] : getDirtyRanges(region)) {
+        dirtyPages.markDirty(offset / HOST_PAGE_SIZE,
+                             getRequiredHostPages(offset + length));
+    }
+
+    SPDLOG_TRACE("Out of {} pages, found {} dirty", nPages, dirtyPages.count());
+
+    return dirtyPages;
+}
+
+DirtyPages PagemapScanDirtyTracker::getThreadLocalDirtyPages(
   std::span<uint8_t> region)
 {
     return {};
 }
 
+DirtyPages PagemapScanDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
+{
+    return getDirtyPages(region);
+}
+
 // ------------------------------
 // Segfaults
 // ------------------------------
@@ -339,13 +642,12 @@ void SegfaultDirtyTracker::handler(int sig,
         faabric::util::handleCrash(sig);
     }
 
-    tracking.markPage(faultAddr);
-
-    // Align down to nearest page boundary
-    void* alignedAddr = pageAlignAddress(faultAddr);
+    void* alignedAddr = tracking.markBackingPage(faultAddr);
 
     // Remove write protection from page
-    if (::mprotect(alignedAddr, HOST_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+    if (::mprotect(alignedAddr,
+                   tracking.getBackingPageSize(),
+                   PROT_READ | PROT_WRITE) != 0) {
         SPDLOG_ERROR("WARNING: mprotect failed to unset read-only");
     }
 }
@@ -375,7 +677,8 @@ void SegfaultDirtyTracker::startTracking(std::span<uint8_t> region)
 
     // Note that here we want to mark the memory read-only, this is to
     // ensure that only writes are counted as dirtying a page.
-    if (::mprotect(region.data(), region.size(), PROT_READ) != 0) {
+    std::span<uint8_t> aligned = alignToBackingPages(region);
+    if (::mprotect(aligned.data(), aligned.size(), PROT_READ) != 0) {
         SPDLOG_ERROR("Failed to start tracking with mprotect: {} ({})",
                      errno,
                      strerror(errno));
@@ -396,7 +699,8 @@ void SegfaultDirtyTracker::stopTracking(std::span<uint8_t> region)
 
     PROF_START(MprotectEnd)
 
-    if (::mprotect(region.data(), region.size(), PROT_READ | PROT_WRITE) ==
+    std::span<uint8_t> aligned = alignToBackingPages(region);
+    if (::mprotect(aligned.data(), aligned.size(), PROT_READ | PROT_WRITE) ==
         -1) {
         SPDLOG_ERROR("Failed to stop tracking with mprotect: {} ({})",
                      errno,
@@ -415,24 +719,23 @@ void SegfaultDirtyTracker::stopThreadLocalTracking(std::span<uint8_t> region)
                  region.size());
 }
 
-std::vector<char> SegfaultDirtyTracker::getThreadLocalDirtyPages(
+DirtyPages SegfaultDirtyTracker::getThreadLocalDirtyPages(
   std::span<uint8_t> region)
 {
     if (!tracking.isInitialised()) {
         size_t nPages = getRequiredHostPages(region.size());
-        return std::vector<char>(nPages, 0);
+        return DirtyPages(nPages);
     }
 
     return tracking.getDirtyFlags();
 }
 
-std::vector<char> SegfaultDirtyTracker::getDirtyPages(std::span<uint8_t> region)
+DirtyPages SegfaultDirtyTracker::getDirtyPages(std::span<uint8_t> region)
 {
     return {};
 }
 
-std::vector<char> SegfaultDirtyTracker::getBothDirtyPages(
-  std::span<uint8_t> region)
+DirtyPages SegfaultDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
 {
     return getThreadLocalDirtyPages(region);
 }
@@ -448,8 +751,74 @@ static long uffd = -1;
 static bool uffdWriteProtect = false;
 static bool uffdSigbus = false;
 
+static int uffdFaultAroundPages = 0;
+
 static int closeFd = -1;
-static std::shared_ptr<std::jthread> eventThread = nullptr;
+static std::vector<std::jthread> eventThreads;
+static std::atomic<size_t> handledFaultCount = 0;
+
+// When faults are handled by the event thread, the dirty pages of threads
+// doing thread-local tracking are kept here, keyed on their thread id. The
+// event thread attributes each write to the thread that caused it.
+static std::shared_mutex threadTrackingMx;
+static std::unordered_map<pid_t, std::unique_ptr<ThreadSafeDirtyTrackingRecord>>
+  threadTracking;
+
+// Once a thread stops tracking, later writes are attributed to the global
+// record, and the thread's dirty pages wait here until it reads them
+static std::unordered_map<pid_t, DirtyPages> stoppedThreadTracking;
+
+// Marks the pages written by a fault handled by an event thread, against the
+// faulting thread if it's tracking its own writes. A thread that has also
+// written the page before is likely writing sequentially, so the pages ahead
+// of it are resolved along with this one, and marked dirty as their writes
+// won't be seen. Returns the number of pages to resolve.
+static size_t markWrite(pid_t tid, void* faultAddr)
+{
+    SharedLock lock(threadTrackingMx);
+
+    ThreadSafeDirtyTrackingRecord* record = &globalTracking;
+    auto it = threadTracking.find(tid);
+    if (it != threadTracking.end() && it->second->isTracking(faultAddr)) {
+        record = it->second.get();
+    }
+
+    if (!record->isTracking(faultAddr)) {
+        return 1;
+    }
+
+    void* alignedAddr = pageAlignAddress(faultAddr);
+    size_t nPages = 1;
+    if (uffdFaultAroundPages > 0 &&
+        record->isPageDirty((uint8_t*)alignedAddr - HOST_PAGE_SIZE)) {
+        nPages += uffdFaultAroundPages;
+    }
+
+    return std::max<size_t>(1, record->markPages(alignedAddr, nPages));
+}
+
+// Sorts the ranges of addresses and merges those that overlap or touch
+static void mergeAddressRanges(
+  std::vector<std::pair<uintptr_t, uintptr_t>>& ranges)
+{
+    if (ranges.size() < 2) {
+        return;
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+
+    size_t last = 0;
+    for (size_t i = 1; i < ranges.size(); i++) {
+        if (ranges[i].first <= ranges[last].second) {
+            ranges[last].second =
+              std::max(ranges[last].second, ranges[i].second);
+        } else {
+            ranges[++last] = ranges[i];
+        }
+    }
+
+    ranges.resize(last + 1);
+}
 
 UffdDirtyTracker::UffdDirtyTracker(const std::string& modeIn)
   : DirtyTracker(modeIn)
@@ -474,6 +843,7 @@ UffdDirtyTracker::UffdDirtyTracker(const std::string& modeIn)
     // Set up global flags
     uffdWriteProtect = writeProtect;
     uffdSigbus = sigbus;
+    uffdFaultAroundPages = std::max(0, getSystemConfig().uffdFaultAroundPages);
 
     if (uffdSigbus) {
         // Set up the sigbus handler
@@ -544,9 +914,12 @@ void UffdDirtyTracker::initUffd()
             throw std::runtime_error("Failed to open eventfd");
         }
 
-        // Start event thread
-        eventThread = std::make_shared<std::jthread>(
-          &UffdDirtyTracker::eventThreadEntrypoint);
+        // Start event threads
+        handledFaultCount = 0;
+        int nThreads = std::max(1, getSystemConfig().uffdHandlerThreads);
+        for (int i = 0; i < nThreads; i++) {
+            eventThreads.emplace_back(&UffdDirtyTracker::eventThreadEntrypoint);
+        }
     }
 
     SPDLOG_DEBUG("Initialised uffd {} (sigbus {}, write-protect {})",
@@ -557,18 +930,21 @@ void UffdDirtyTracker::initUffd()
 
 void UffdDirtyTracker::stopUffd()
 {
-    if (!uffdSigbus && eventThread != nullptr) {
-        SPDLOG_DEBUG("Sending shutdown to event thread on {}", closeFd);
+    if (!uffdSigbus && !eventThreads.empty()) {
+        SPDLOG_DEBUG("Sending shutdown to event threads on {}", closeFd);
 
-        // This message can be anything, so its value doesn't matter.
+        // This message can be anything, so its value doesn't matter. It's
+        // never read, so all the event threads see it.
         uint64_t msg = 1;
         ::write(closeFd, &msg, sizeof(uint64_t));
 
-        if (eventThread->joinable()) {
-            eventThread->join();
+        for (auto& t : eventThreads) {
+            if (t.joinable()) {
+                t.join();
+            }
         }
 
-        eventThread = nullptr;
+        eventThreads.clear();
 
         ::close(closeFd);
         closeFd = -1;
@@ -599,6 +975,12 @@ void UffdDirtyTracker::eventThreadEntrypoint()
     pollfds[1].fd = closeFd;
     pollfds[1].events = POLLIN;
 
+    std::array<uffd_msg, UFFD_EVENT_BATCH_SIZE> msgs;
+
+    // Ranges of addresses to resolve for each batch of events
+    std::vector<std::pair<uintptr_t, uintptr_t>> writeProtectedRanges;
+    std::vector<std::pair<uintptr_t, uintptr_t>> missingRanges;
+
     for (;;) {
         int nReady = poll(pollfds.data(), pollfds.size(), -1);
         if (nReady == -1) {
@@ -616,61 +998,103 @@ void UffdDirtyTracker::eventThreadEntrypoint()
             return;
         }
 
-        // Read an event
-        uffd_msg msg;
-        ssize_t nRead = read(uffd, &msg, sizeof(msg));
+        // Read a batch of events, another event thread may have got them
+        // first
+        ssize_t nRead = read(uffd, msgs.data(), sizeof(msgs));
         if (nRead == 0) {
             SPDLOG_ERROR("EOF on userfaultfd: {} ({})", errno, strerror(errno));
             throw std::runtime_error("EOF on uffd");
         }
 
         if (nRead == -1) {
+            if (errno == EAGAIN) {
+                continue;
+            }
+
             SPDLOG_ERROR("Read failed: {} ({})", errno, strerror(errno));
             throw std::runtime_error("Read failed");
         }
 
-        if (msg.event != UFFD_EVENT_PAGEFAULT) {
-            SPDLOG_ERROR("Unexpected userfault event: {}", msg.event);
-            throw std::runtime_error("Unexpected userfault event");
+        size_t nMsgs = nRead / sizeof(uffd_msg);
+        handledFaultCount += nMsgs;
+
+        writeProtectedRanges.clear();
+        missingRanges.clear();
+        for (size_t i = 0; i < nMsgs; i++) {
+            const uffd_msg& msg = msgs[i];
+            if (msg.event != UFFD_EVENT_PAGEFAULT) {
+                SPDLOG_ERROR("Unexpected userfault event: {}", msg.event);
+                throw std::runtime_error("Unexpected userfault event");
+            }
+
+            // Get page-aligned address
+            void* faultAddr = (void*)msg.arg.pagefault.address;
+            uintptr_t alignedAddr = (uintptr_t)pageAlignAddress(faultAddr);
+
+            // Events will ALWAYS have UFFD_PAGEFAULT_FLAG_WRITE set, but will
+            // only have UFFD_PAGEFAULT_FLAG_WP set when it's a write-protected
+            // event
+            bool isWriteEvent =
+              msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE;
+            bool isWriteProtected =
+              msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP;
+
+            // Mark the page dirty if there's been a write
+            size_t nPages = 1;
+            if (isWriteEvent) {
+                nPages = markWrite(msg.arg.pagefault.feat.ptid, faultAddr);
+            }
+
+            SPDLOG_TRACE("Uffd thread got {} event at {} (write={}, pages={})",
+                         isWriteProtected ? "write-protected" : "missing page",
+                         alignedAddr,
+                         isWriteEvent,
+                         nPages);
+
+            auto& ranges =
+              isWriteProtected ? writeProtectedRanges : missingRanges;
+            ranges.emplace_back(alignedAddr,
+                                alignedAddr + nPages * HOST_PAGE_SIZE);
         }
 
-        // Get page-aligned address
-        void* faultAddr = (void*)msg.arg.pagefault.address;
-        void* alignedAddr = pageAlignAddress(faultAddr);
-
-        // Events will ALWAYS have UFFD_PAGEFAULT_FLAG_WRITE set, but will
-        // only have UFFD_PAGEFAULT_FLAG_WP set when it's a write-protected
-        // event
-        bool isWriteEvent = msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE;
-        bool isWriteProtected =
-          msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP;
-
-        // Mark the page dirty if there's been a write
-        if (isWriteEvent) {
-            globalTracking.markPage(faultAddr);
-        }
-
-        if (isWriteProtected) {
-            SPDLOG_TRACE("Uffd thread got write on write-protected page {}",
-                         __u64(alignedAddr));
-
+        // Resolve the faults with one ioctl per run of pages
+        mergeAddressRanges(writeProtectedRanges);
+        for (auto [start, end] : writeProtectedRanges) {
             removeWriteProtect(
-              std::span<uint8_t>((uint8_t*)alignedAddr, HOST_PAGE_SIZE), true);
-        } else {
-            SPDLOG_TRACE("Uffd thread got missing page event at {} (write={})",
-                         __u64(alignedAddr),
-                         isWriteEvent);
+              std::span<uint8_t>((uint8_t*)start, end - start), true);
+        }
 
-            zeroRegion(
-              std::span<uint8_t>((uint8_t*)alignedAddr, HOST_PAGE_SIZE));
+        mergeAddressRanges(missingRanges);
+        for (auto [start, end] : missingRanges) {
+            std::span<uint8_t> range((uint8_t*)start, end - start);
+            if (!zeroRegion(range) || range.size() == HOST_PAGE_SIZE) {
+                continue;
+            }
+
+            // Filling a range stops at the first page that already exists,
+            // e.g. one filled by another event thread, so fill the rest one
+            // at a time
+            for (size_t offset = 0; offset < range.size();
+                 offset += HOST_PAGE_SIZE) {
+                zeroRegion(range.subspan(offset, HOST_PAGE_SIZE));
+            }
         }
     }
 }
 
+size_t UffdDirtyTracker::getHandledFaultCount()
+{
+    return handledFaultCount;
+}
+
 void UffdDirtyTracker::clearAll()
 {
     tracking.reset();
     globalTracking.reset();
+
+    FullLock lock(threadTrackingMx);
+    threadTracking.clear();
+    stoppedThreadTracking.clear();
 }
 
 void UffdDirtyTracker::sigbusHandler(int sig,
@@ -709,7 +1133,22 @@ void UffdDirtyTracker::startThreadLocalTracking(std::span<uint8_t> region)
                  (__u64)region.data(),
                  region.size());
 
-    tracking.trackRegion(region);
+    checkHostPageBacked(region, mode);
+
+    if (sigbus) {
+        tracking.trackRegion(region);
+        return;
+    }
+
+    pid_t tid = ::gettid();
+    FullLock lock(threadTrackingMx);
+    stoppedThreadTracking.erase(tid);
+
+    auto& record = threadTracking[tid];
+    if (record == nullptr) {
+        record = std::make_unique<ThreadSafeDirtyTrackingRecord>();
+    }
+    record->trackRegion(region);
 }
 
 void UffdDirtyTracker::startTracking(std::span<uint8_t> region)
@@ -721,6 +1160,8 @@ void UffdDirtyTracker::startTracking(std::span<uint8_t> region)
         return;
     }
 
+    checkHostPageBacked(region, mode);
+
     globalTracking.trackRegion(region);
 
     registerRegion(region);
@@ -838,20 +1279,55 @@ void UffdDirtyTracker::stopThreadLocalTracking(std::span<uint8_t> region)
 {
     SPDLOG_TRACE("Stopping thread-local tracking on region size {}",
                  region.size());
+
+    if (sigbus) {
+        return;
+    }
+
+    pid_t tid = ::gettid();
+    FullLock lock(threadTrackingMx);
+    auto it = threadTracking.find(tid);
+    if (it == threadTracking.end()) {
+        return;
+    }
+
+    if (it->second->isInitialised()) {
+        stoppedThreadTracking[tid] = it->second->getDirtyFlags();
+    }
+
+    threadTracking.erase(it);
 }
 
-std::vector<char> UffdDirtyTracker::getThreadLocalDirtyPages(
-  std::span<uint8_t> region)
+DirtyPages UffdDirtyTracker::getThreadLocalDirtyPages(std::span<uint8_t> region)
 {
-    if (!tracking.isInitialised()) {
-        size_t nPages = getRequiredHostPages(region.size());
-        return std::vector<char>(nPages, 0);
+    size_t nPages = getRequiredHostPages(region.size());
+    if (sigbus) {
+        if (!tracking.isInitialised()) {
+            return DirtyPages(nPages);
+        }
+
+        return tracking.getDirtyFlags();
     }
 
-    return tracking.getDirtyFlags();
+    pid_t tid = ::gettid();
+    FullLock lock(threadTrackingMx);
+    auto it = threadTracking.find(tid);
+    if (it != threadTracking.end() && it->second->isInitialised()) {
+        return it->second->getDirtyFlags();
+    }
+
+    // Reading the pages of a stopped thread consumes them
+    auto stoppedIt = stoppedThreadTracking.find(tid);
+    if (stoppedIt != stoppedThreadTracking.end()) {
+        DirtyPages dirtyPages = std::move(stoppedIt->second);
+        stoppedThreadTracking.erase(stoppedIt);
+        return dirtyPages;
+    }
+
+    return DirtyPages(nPages);
 }
 
-std::vector<char> UffdDirtyTracker::getDirtyPages(std::span<uint8_t> region)
+DirtyPages UffdDirtyTracker::getDirtyPages(std::span<uint8_t> region)
 {
     if (sigbus) {
         return {};
@@ -859,19 +1335,22 @@ std::vector<char> UffdDirtyTracker::getDirtyPages(std::span<uint8_t> region)
 
     if (!globalTracking.isInitialised()) {
         size_t nPages = getRequiredHostPages(region.size());
-        return std::vector<char>(nPages, 0);
+        return DirtyPages(nPages);
     }
 
     return globalTracking.getDirtyFlags();
 }
 
-std::vector<char> UffdDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
+DirtyPages UffdDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
 {
     if (sigbus) {
         return getThreadLocalDirtyPages(region);
     }
 
-    return getDirtyPages(region);
+    // Writes by this thread are only in its own set
+    DirtyPages dirtyPages = getDirtyPages(region);
+    mergeDirtyPages(dirtyPages, getThreadLocalDirtyPages(region));
+    return dirtyPages;
 }
 
 // ------------------------------
@@ -892,25 +1371,24 @@ void NoneDirtyTracker::startThreadLocalTracking(std::span<uint8_t> region) {}
 void NoneDirtyTracker::startTracking(std::span<uint8_t> region)
 {
     size_t nPages = getRequiredHostPages(region.size());
-    dirtyPages = std::vector<char>(nPages, 1);
+    dirtyPages = DirtyPages(nPages, true);
 }
 
 void NoneDirtyTracker::stopTracking(std::span<uint8_t> region) {}
 
 void NoneDirtyTracker::stopThreadLocalTracking(std::span<uint8_t> region) {}
 
-std::vector<char> NoneDirtyTracker::getThreadLocalDirtyPages(
-  std::span<uint8_t> region)
+DirtyPages NoneDirtyTracker::getThreadLocalDirtyPages(std::span<uint8_t> region)
 {
     return {};
 }
 
-std::vector<char> NoneDirtyTracker::getDirtyPages(std::span<uint8_t> region)
+DirtyPages NoneDirtyTracker::getDirtyPages(std::span<uint8_t> region)
 {
     return dirtyPages;
 }
 
-std::vector<char> NoneDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
+DirtyPages NoneDirtyTracker::getBothDirtyPages(std::span<uint8_t> region)
 {
     return getDirtyPages(region);
 }
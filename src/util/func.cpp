@@ -7,6 +7,7 @@
 #include <faabric/util/environment.h>
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/random.h>
 
 namespace faabric::util {
@@ -47,9 +48,106 @@ std::string buildAsyncResponse(const faabric::Message& msg)
     return std::to_string(msg.id());
 }
 
+static void initMessage(faabric::Message& msg,
+                        const std::string& user,
+                        const std::string& function)
+{
+    msg.set_user(user);
+    msg.set_function(function);
+
+    setMessageId(msg);
+
+    std::string thisHost = faabric::util::getSystemConfig().endpointHost;
+    msg.set_masterhost(thisHost);
+
+    msg.set_recordexecgraph(false);
+}
+
+namespace {
+// Arena starting with its own block, which is kept when the arena is reset
+struct PooledArena
+{
+    std::unique_ptr<char[]> block;
+    google::protobuf::Arena arena;
+
+    PooledArena()
+      : block(new char[REQUEST_ARENA_BLOCK_SIZE])
+      , arena(arenaOptions(block.get()))
+    {}
+
+    static google::protobuf::ArenaOptions arenaOptions(char* block)
+    {
+        google::protobuf::ArenaOptions options;
+        options.initial_block = block;
+        options.initial_block_size = REQUEST_ARENA_BLOCK_SIZE;
+        return options;
+    }
+};
+
+// Requests are often created by one thread and dropped by another, so arenas
+// are pooled across threads. The pool is never destroyed, as requests may
+// still be dropped while static objects are destroyed at exit.
+struct ArenaPool
+{
+    std::mutex mx;
+    std::vector<std::unique_ptr<PooledArena>> arenas;
+};
+
+ArenaPool& getArenaPool()
+{
+    static auto* pool = new ArenaPool();
+    return *pool;
+}
+}
+
+static void returnRequestArena(PooledArena* pooled)
+{
+    std::unique_ptr<PooledArena> owned(pooled);
+    owned->arena.Reset();
+
+    ArenaPool& pool = getArenaPool();
+    faabric::util::UniqueLock lock(pool.mx);
+    if (pool.arenas.size() < REQUEST_ARENA_POOL_SIZE) {
+        pool.arenas.emplace_back(std::move(owned));
+    }
+}
+
+std::shared_ptr<google::protobuf::Arena> getRequestArena()
+{
+    std::unique_ptr<PooledArena> pooled;
+    {
+        ArenaPool& pool = getArenaPool();
+        faabric::util::UniqueLock lock(pool.mx);
+        if (!pool.arenas.empty()) {
+            pooled = std::move(pool.arenas.back());
+            pool.arenas.pop_back();
+        }
+    }
+
+    if (pooled == nullptr) {
+        pooled = std::make_unique<PooledArena>();
+    }
+
+    google::protobuf::Arena* arena = &pooled->arena;
+    return std::shared_ptr<google::protobuf::Arena>(
+      arena, [pooled = pooled.release()](google::protobuf::Arena*) {
+          returnRequestArena(pooled);
+      });
+}
+
+std::shared_ptr<faabric::BatchExecuteRequest> arenaBatchExecRequest()
+{
+    std::shared_ptr<google::protobuf::Arena> arena = getRequestArena();
+    auto* req = google::protobuf::Arena::CreateMessage<
+      faabric::BatchExecuteRequest>(arena.get());
+
+    // The request shares ownership of the arena it lives on
+    return std::shared_ptr<faabric::BatchExecuteRequest>(std::move(arena), req);
+}
+
 std::shared_ptr<faabric::BatchExecuteRequest> batchExecFactory()
 {
-    auto req = std::make_shared<faabric::BatchExecuteRequest>();
+    auto req = arenaBatchExecRequest();
     req->set_id(faabric::util::generateGid());
     return req;
 }
@@ -72,11 +170,13 @@ std::shared_ptr<faabric::BatchExecuteRequest> batchExecFactory(
 {
     auto req = batchExecFactory();
 
-    // Force the messages to have the same app ID
+    // Force the messages to have the same app ID, the messages are built in
+    // place to avoid copying them onto the request's arena
     uint32_t appId = faabric::util::generateGid();
     for (int i = 0; i < count; i++) {
-        *req->add_messages() = messageFactory(user, function);
-        req->mutable_messages()->at(i).set_appid(appId);
+        faabric::Message* msg = req->add_messages();
+        initMessage(*msg, user, function);
+        msg->set_appid(appId);
     }
 
     return req;
@@ -105,16 +205,7 @@ faabric::Message messageFactory(const std::string& user,
                                 const std::string& function)
 {
     faabric::Message msg;
-    msg.set_user(user);
-    msg.set_function(function);
-
-    setMessageId(msg);
-
-    std::string thisHost = faabric::util::getSystemConfig().endpointHost;
-    msg.set_masterhost(thisHost);
-
-    msg.set_recordexecgraph(false);
-
+    initMessage(msg, user, function);
     return msg;
 }
 
@@ -193,4 +284,9 @@ std::string getMainThreadSnapshotKey(const faabric::Message& msg)
     std::string snapshotKey = funcStr + "_" + std::to_string(msg.appid());
     return snapshotKey;
 }
+
+std::string getZygoteSnapshotKey(const faabric::Message& msg)
+{
+    return "zygote_" + faabric::util::funcToString(msg, false);
+}
 }
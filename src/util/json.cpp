@@ -353,6 +353,13 @@ std::map<std::string, int> getStringIntMapFromJson(Document& doc,
 }
 
 faabric::Message jsonToMessage(const std::string& jsonIn)
+{
+    faabric::Message msg;
+    jsonToMessage(jsonIn, msg);
+    return msg;
+}
+
+void jsonToMessage(const std::string& jsonIn, faabric::Message& msg)
 {
     PROF_START(jsonDecode)
 
@@ -360,8 +367,6 @@ faabric::Message jsonToMessage(const std::string& jsonIn)
     Document d;
     d.ParseStream(ms);
 
-    faabric::Message msg;
-
     // Set the message type
     int msgType = getIntFromJson(d, "type", 0);
     if (!faabric::Message::MessageType_IsValid(msgType)) {
@@ -437,8 +442,6 @@ faabric::Message jsonToMessage(const std::string& jsonIn)
     msg.set_forbidndp(getBoolFromJson(d, "forbid_ndp", false));
 
     PROF_END(jsonDecode)
-
-    return msg;
 }
 
 std::string getValueFromJsonString(const std::string& key,
@@ -1,42 +1,203 @@
+#include <faabric/util/config.h>
+#include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <fcntl.h>
+#include <fstream>
+#include <limits>
+#include <poll.h>
 #include <shared_mutex>
 #include <stdexcept>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 
 namespace faabric::util {
 
-void mergeManyDirtyPages(std::vector<char>& dest,
-                         const std::vector<std::vector<char>>& source)
+static size_t dirtyPageWords(size_t nPages)
 {
-    for (const auto& v : source) {
-        mergeDirtyPages(dest, v);
+    return (nPages + 63) / 64;
+}
+
+DirtyPages::DirtyPages(size_t nPagesIn, bool dirty)
+  : nPages(nPagesIn)
+  , words(dirtyPageWords(nPagesIn), 0)
+{
+    if (dirty) {
+        markDirty(0, nPages);
+    }
+}
+
+DirtyPages::DirtyPages(const std::vector<char>& flags)
+  : DirtyPages(flags.size())
+{
+    for (size_t p = 0; p < flags.size(); p++) {
+        if (flags[p] != 0) {
+            markDirty(p);
+        }
+    }
+}
+
+void DirtyPages::markDirty(size_t startPage, size_t endPage)
+{
+    endPage = std::min(endPage, nPages);
+    if (startPage >= endPage) {
+        return;
+    }
+
+    size_t startWord = startPage / 64;
+    size_t lastWord = (endPage - 1) / 64;
+    uint64_t startMask = ~0Ull << (startPage % 64);
+    uint64_t endMask = ~0Ull >> (63 - ((endPage - 1) % 64));
+
+    if (startWord == lastWord) {
+        words[startWord] |= startMask & endMask;
+        return;
+    }
+
+    words[startWord] |= startMask;
+    std::fill(words.begin() + startWord + 1, words.begin() + lastWord, ~0Ull);
+    words[lastWord] |= endMask;
+}
+
+void DirtyPages::resize(size_t nPagesIn)
+{
+    if (nPagesIn < nPages) {
+        words.resize(dirtyPageWords(nPagesIn));
+
+        // Keep the bits past the last page clear
+        if (nPagesIn % 64 != 0) {
+            words.back() &= ~0Ull >> (64 - (nPagesIn % 64));
+        }
+    } else {
+        words.resize(dirtyPageWords(nPagesIn), 0);
+    }
+
+    nPages = nPagesIn;
+}
+
+void DirtyPages::clear()
+{
+    nPages = 0;
+    words.clear();
+}
+
+bool DirtyPages::any() const
+{
+    return std::any_of(
+      words.begin(), words.end(), [](uint64_t w) { return w != 0; });
+}
+
+size_t DirtyPages::count() const
+{
+    size_t total = 0;
+    for (uint64_t w : words) {
+        total += std::popcount(w);
+    }
+
+    return total;
+}
+
+size_t DirtyPages::nextDirty(size_t page) const
+{
+    if (page >= nPages) {
+        return nPages;
+    }
+
+    size_t w = page / 64;
+    uint64_t word = words[w] & (~0Ull << (page % 64));
+    while (word == 0) {
+        if (++w == words.size()) {
+            return nPages;
+        }
+
+        word = words[w];
+    }
+
+    return w * 64 + std::countr_zero(word);
+}
+
+size_t DirtyPages::nextClean(size_t page) const
+{
+    if (page >= nPages) {
+        return nPages;
+    }
+
+    size_t w = page / 64;
+    uint64_t word = ~words[w] & (~0Ull << (page % 64));
+    while (word == 0) {
+        if (++w == words.size()) {
+            return nPages;
+        }
+
+        word = ~words[w];
+    }
+
+    // Bits past the last page are clear, so may be found here
+    return std::min(nPages, w * 64 + std::countr_zero(word));
+}
+
+std::vector<std::pair<size_t, size_t>> DirtyPages::getRanges() const
+{
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t p = nextDirty(0); p < nPages;) {
+        size_t runEnd = nextClean(p);
+        ranges.emplace_back(p, runEnd);
+        p = nextDirty(runEnd);
+    }
+
+    return ranges;
+}
+
+std::vector<char> DirtyPages::toFlags() const
+{
+    std::vector<char> flags(nPages, 0);
+    for (auto [start, end] : getRanges()) {
+        std::fill(flags.begin() + start, flags.begin() + end, 1);
+    }
+
+    return flags;
+}
+
+void DirtyPages::merge(const DirtyPages& other)
+{
+    if (other.nPages > nPages) {
+        resize(other.nPages);
     }
+
+    std::transform(other.words.begin(),
+                   other.words.end(),
+                   words.begin(),
+                   words.begin(),
+                   std::bit_or<uint64_t>());
 }
 
-void mergeDirtyPages(std::vector<char>& dest, const std::vector<char>& source)
+void mergeManyDirtyPages(DirtyPages& dest,
+                         const std::vector<DirtyPages>& source)
 {
-    // Extend a to fit
-    size_t overlap = dest.size();
-    if (source.size() > dest.size()) {
-        dest.reserve(source.size());
-        dest.insert(dest.end(), source.begin() + dest.size(), source.end());
-    } else if (source.size() < dest.size()) {
-        overlap = source.size();
+    // Grow the destination once up front
+    size_t maxPages = dest.size();
+    for (const auto& s : source) {
+        maxPages = std::max(maxPages, s.size());
+    }
+    dest.resize(maxPages);
+
+    for (const auto& s : source) {
+        mergeDirtyPages(dest, s);
     }
+}
 
-    std::transform(dest.begin(),
-                   dest.begin() + overlap,
-                   source.begin(),
-                   dest.begin(),
-                   std::logical_or<char>());
+void mergeDirtyPages(DirtyPages& dest, const DirtyPages& source)
+{
+    dest.merge(source);
 }
 
 // -------------------------
@@ -98,6 +259,66 @@ AlignedChunk getPageAlignedChunk(long offset, long length)
     return c;
 }
 
+// -------------------------
+// Huge pages
+// -------------------------
+
+#define MEMINFO "/proc/meminfo"
+
+#define DEFAULT_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Memory allocated with huge TLB pages, as start address and size
+static std::shared_mutex hugeTlbMx;
+static std::map<uintptr_t, size_t> hugeTlbRegions;
+
+static size_t readHugePageSize()
+{
+    std::ifstream meminfo(MEMINFO);
+    std::string key;
+    while (meminfo >> key) {
+        if (key == "Hugepagesize:") {
+            size_t sizeKb = 0;
+            meminfo >> sizeKb;
+            return sizeKb * 1024;
+        }
+
+        meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    SPDLOG_WARN("Could not read huge page size, defaulting to {}",
+                DEFAULT_HUGE_PAGE_SIZE);
+    return DEFAULT_HUGE_PAGE_SIZE;
+}
+
+size_t getHugePageSize()
+{
+    static const size_t hugePageSize = readHugePageSize();
+    return hugePageSize;
+}
+
+bool isHugePageAligned(const void* ptr)
+{
+    return ((uintptr_t)ptr) % getHugePageSize() == 0;
+}
+
+size_t getBackingPageSize(std::span<const uint8_t> region)
+{
+    SharedLock lock(hugeTlbMx);
+
+    uintptr_t start = (uintptr_t)region.data();
+    auto it = hugeTlbRegions.upper_bound(start);
+    if (it == hugeTlbRegions.begin()) {
+        return HOST_PAGE_SIZE;
+    }
+
+    it--;
+    if (start < it->first + it->second) {
+        return getHugePageSize();
+    }
+
+    return HOST_PAGE_SIZE;
+}
+
 // UserfaultFd wrapper
 std::pair<int, uffdio_api> UserfaultFd::release()
 {
@@ -108,7 +329,7 @@ std::pair<int, uffdio_api> UserfaultFd::release()
     return std::make_pair(oldFd, oldApi);
 }
 
-void UserfaultFd::create(int flags, bool sigbus)
+void UserfaultFd::create(int flags, bool sigbus, uint64_t extraFeatures)
 {
     clear();
     int result = syscall(SYS_userfaultfd, flags);
@@ -123,6 +344,7 @@ void UserfaultFd::create(int flags, bool sigbus)
     if (sigbus) {
         api.features |= UFFD_FEATURE_SIGBUS;
     }
+    api.features |= extraFeatures;
     api.ioctls = 0;
     result = ioctl(fd, UFFDIO_API, &api);
     if (result < 0) {
@@ -292,11 +514,267 @@ retry:
     }
 }
 
+// -------------------------
+// Lazy pages
+// -------------------------
+
+struct LazyPageHandler::LazyRegion
+{
+    uintptr_t start = 0;
+    size_t length = 0;
+    LazyPageSource source;
+    size_t prefetchPages = 0;
+    const void* owner = nullptr;
+
+    // Pages that have been filled, which are skipped when prefetching
+    std::vector<bool> filledPages;
+};
+
+LazyPageHandler::LazyPageHandler()
+{
+    uffd.create(O_CLOEXEC | O_NONBLOCK);
+
+    closeFd = ::eventfd(0, EFD_CLOEXEC);
+    if (closeFd == -1) {
+        SPDLOG_ERROR("Failed to open eventfd for lazy page handler: {} ({})",
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed to open eventfd");
+    }
+
+    eventThread = std::jthread(&LazyPageHandler::eventLoop, this);
+}
+
+LazyPageHandler::~LazyPageHandler()
+{
+    uint64_t msg = 1;
+    if (::write(closeFd, &msg, sizeof(msg)) != sizeof(msg)) {
+        SPDLOG_ERROR("Failed to shut down lazy page handler: {} ({})",
+                     errno,
+                     ::strerror(errno));
+    }
+
+    if (eventThread.joinable()) {
+        eventThread.join();
+    }
+
+    ::close(closeFd);
+    closeFd = -1;
+}
+
+void LazyPageHandler::addRegion(std::span<uint8_t> region,
+                                LazyPageSource source,
+                                size_t prefetchPages,
+                                const void* owner)
+{
+    if (!isPageAligned(region.data())) {
+        SPDLOG_ERROR("Adding non page-aligned lazy region");
+        throw std::runtime_error("Adding non page-aligned lazy region");
+    }
+
+    auto r = std::make_shared<LazyRegion>();
+    r->start = (uintptr_t)region.data();
+    r->length = getRequiredHostPages(region.size()) * HOST_PAGE_SIZE;
+    r->source = std::move(source);
+    r->prefetchPages = prefetchPages;
+    r->owner = owner;
+    r->filledPages.resize(r->length / HOST_PAGE_SIZE, false);
+
+    faabric::util::UniqueLock lock(mx);
+
+    // Any regions this overlaps must have been remapped since being added
+    auto it = regions.lower_bound(r->start);
+    if (it != regions.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second->length > r->start) {
+            it = prev;
+        }
+    }
+    while (it != regions.end() && it->first < r->start + r->length) {
+        it = regions.erase(it);
+    }
+
+    // Fresh anonymous memory has no pages, so the first access to each faults
+    void* mmapRes = ::mmap(region.data(),
+                           r->length,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,
+                           -1,
+                           0);
+    if (mmapRes == MAP_FAILED) {
+        SPDLOG_ERROR("Mapping lazy region failed: {} ({})",
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Mapping lazy region failed");
+    }
+
+    uffd.registerAddressRange(r->start, r->length, true, false);
+
+    SPDLOG_TRACE("Added lazy region {} {}", r->start, r->length);
+    regions[r->start] = std::move(r);
+}
+
+void LazyPageHandler::removeRegions(const void* owner)
+{
+    {
+        faabric::util::UniqueLock lock(mx);
+        std::erase_if(
+          regions, [owner](const auto& r) { return r.second->owner == owner; });
+    }
+
+    // A fetch from one of the regions may have started before they were
+    // removed, and its source may not outlive them
+    faabric::util::UniqueLock fetchLock(fetchMx);
+}
+
+size_t LazyPageHandler::getRegionCount()
+{
+    faabric::util::UniqueLock lock(mx);
+    return regions.size();
+}
+
+void LazyPageHandler::eventLoop()
+{
+    std::array<struct pollfd, 2> pollfds;
+
+    pollfds[0].fd = uffd.fd;
+    pollfds[0].events = POLLIN;
+
+    pollfds[1].fd = closeFd;
+    pollfds[1].events = POLLIN;
+
+    for (;;) {
+        int nReady = ::poll(pollfds.data(), pollfds.size(), -1);
+        if (nReady == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            SPDLOG_ERROR("Poll failed: {} ({})", errno, ::strerror(errno));
+            throw std::runtime_error("Poll failed");
+        }
+
+        if (pollfds[1].revents & (POLLIN | POLLERR)) {
+            SPDLOG_DEBUG("Lazy page handler shutting down");
+            return;
+        }
+
+        if (!(pollfds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        std::optional<uffd_msg> msg = uffd.readEvent();
+        if (!msg.has_value()) {
+            continue;
+        }
+
+        if (msg->event != UFFD_EVENT_PAGEFAULT) {
+            SPDLOG_ERROR("Unexpected userfault event: {}", msg->event);
+            throw std::runtime_error("Unexpected userfault event");
+        }
+
+        uintptr_t faultAddr = msg->arg.pagefault.address;
+        try {
+            handleFault(faultAddr);
+        } catch (const std::exception& e) {
+            SPDLOG_ERROR(
+              "Failed to handle lazy page fault at {}: {}", faultAddr, e.what());
+        }
+    }
+}
+
+void LazyPageHandler::handleFault(uintptr_t faultAddr)
+{
+    uintptr_t pageAddr = faultAddr & ~(uintptr_t)(HOST_PAGE_SIZE - 1);
+
+    faabric::util::UniqueLock fetchLock(fetchMx);
+
+    // Sources may fetch pages from another host, so mx isn't held while
+    // fetching, and regions may be replaced or removed in the meantime. In
+    // that case the fault is handled again with whatever is there now.
+    for (;;) {
+        std::shared_ptr<LazyRegion> r = nullptr;
+        size_t firstPage = 0;
+        size_t endPage = 0;
+        {
+            faabric::util::UniqueLock lock(mx);
+
+            auto it = regions.upper_bound(pageAddr);
+            if (it != regions.begin()) {
+                --it;
+                if (pageAddr < it->first + it->second->length) {
+                    r = it->second;
+                }
+            }
+
+            // The fault must not be left unresolved, or the thread will hang
+            if (r == nullptr) {
+                SPDLOG_WARN("No lazy region for fault at {}, zero-filling",
+                            pageAddr);
+                uffd.zeroPages(pageAddr, HOST_PAGE_SIZE);
+                return;
+            }
+
+            // The faulting page is always filled, as it may have been dropped
+            // since it was last filled. Prefetching stops at the first page
+            // already filled.
+            firstPage = (pageAddr - r->start) / HOST_PAGE_SIZE;
+            endPage = firstPage + 1;
+            while (endPage < r->filledPages.size() &&
+                   endPage - firstPage <= r->prefetchPages &&
+                   !r->filledPages.at(endPage)) {
+                endPage++;
+            }
+        }
+
+        size_t offset = firstPage * HOST_PAGE_SIZE;
+        size_t length = (endPage - firstPage) * HOST_PAGE_SIZE;
+
+        SPDLOG_TRACE(
+          "Filling {} lazy pages at {}", endPage - firstPage, pageAddr);
+
+        const uint8_t* data = nullptr;
+        try {
+            data = r->source(offset, length);
+        } catch (const std::exception& e) {
+            SPDLOG_ERROR(
+              "Failed to fetch lazy pages at {}: {}", pageAddr, e.what());
+        }
+
+        faabric::util::UniqueLock lock(mx);
+        auto it = regions.find(r->start);
+        if (it == regions.end() || it->second != r) {
+            continue;
+        }
+
+        // Fetching would most likely fail again, so stop filling the region
+        if (data == nullptr) {
+            SPDLOG_ERROR("Removing lazy region {}, zero-filling", r->start);
+            regions.erase(it);
+            uffd.zeroPages(pageAddr, HOST_PAGE_SIZE);
+            return;
+        }
+
+        uffd.copyPages(pageAddr, length, (uintptr_t)data);
+
+        std::fill(r->filledPages.begin() + firstPage,
+                  r->filledPages.begin() + endPage,
+                  true);
+        return;
+    }
+}
+
+LazyPageHandler& getLazyPageHandler()
+{
+    static LazyPageHandler handler;
+    return handler;
+}
+
 // -------------------------
 // Allocation
 // -------------------------
 
-MemoryRegion doAlloc(size_t size, int prot, int flags)
+static MemoryRegion doMmap(size_t size, int prot, int flags)
 {
     auto deleter = [size](uint8_t* u) { munmap(u, size); };
     MemoryRegion mem((uint8_t*)::mmap(nullptr, size, prot, flags, -1, 0),
@@ -312,6 +790,101 @@ MemoryRegion doAlloc(size_t size, int prot, int flags)
     return mem;
 }
 
+// Huge TLB mappings are made up of whole huge pages, and fail if not enough
+// are reserved, in which case this returns an empty region
+static MemoryRegion doHugeTlbAlloc(size_t size, int prot, int flags)
+{
+    size_t hugePageSize = getHugePageSize();
+    size_t mapSize = ((size + hugePageSize - 1) / hugePageSize) * hugePageSize;
+
+    void* mmapRes =
+      ::mmap(nullptr, mapSize, prot, flags | MAP_HUGETLB, -1, 0);
+    if (mmapRes == MAP_FAILED) {
+        SPDLOG_DEBUG("Could not allocate {} bytes of huge TLB pages ({}), "
+                     "falling back to transparent huge pages",
+                     mapSize,
+                     ::strerror(errno));
+        return MemoryRegion(nullptr, [](uint8_t* u) {});
+    }
+
+    {
+        FullLock lock(hugeTlbMx);
+        hugeTlbRegions[(uintptr_t)mmapRes] = mapSize;
+    }
+
+    auto deleter = [mapSize](uint8_t* u) {
+        {
+            FullLock lock(hugeTlbMx);
+            hugeTlbRegions.erase((uintptr_t)u);
+        }
+
+        munmap(u, mapSize);
+    };
+
+    return MemoryRegion((uint8_t*)mmapRes, deleter);
+}
+
+// Transparent huge pages are only used for memory aligned to the huge page
+// size, so this maps an extra huge page and trims the mapping to align it
+static MemoryRegion doTransparentHugePageAlloc(size_t size, int prot, int flags)
+{
+    size_t hugePageSize = getHugePageSize();
+    size_t mapSize = getRequiredHostPages(size) * HOST_PAGE_SIZE;
+
+    auto* mmapRes = (uint8_t*)::mmap(
+      nullptr, mapSize + hugePageSize, prot, flags, -1, 0);
+    if (mmapRes == MAP_FAILED) {
+        SPDLOG_ERROR("Allocating memory with mmap failed: {} ({})",
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Allocating memory failed");
+    }
+
+    uintptr_t alignedStart =
+      (((uintptr_t)mmapRes + hugePageSize - 1) / hugePageSize) * hugePageSize;
+    auto* aligned = (uint8_t*)alignedStart;
+
+    size_t headSize = aligned - mmapRes;
+    if (headSize > 0) {
+        ::munmap(mmapRes, headSize);
+    }
+
+    size_t tailSize = hugePageSize - headSize;
+    if (tailSize > 0) {
+        ::munmap(aligned + mapSize, tailSize);
+    }
+
+    // Not all kernels support transparent huge pages for all types of memory,
+    // in which case they use host pages as normal
+    if (::madvise(aligned, mapSize, MADV_HUGEPAGE) != 0) {
+        SPDLOG_DEBUG("Could not advise transparent huge pages: {}",
+                     ::strerror(errno));
+    }
+
+    auto deleter = [mapSize](uint8_t* u) { munmap(u, mapSize); };
+    return MemoryRegion(aligned, deleter);
+}
+
+MemoryRegion doAlloc(size_t size, int prot, int flags)
+{
+    const std::string& mode = getSystemConfig().hugePagesMode;
+    if (mode == "none" || size < getHugePageSize()) {
+        return doMmap(size, prot, flags);
+    }
+
+    if (mode == "explicit" && prot != PROT_NONE) {
+        MemoryRegion mem = doHugeTlbAlloc(size, prot, flags);
+        if (mem != nullptr) {
+            return mem;
+        }
+    } else if (mode != "explicit" && mode != "transparent") {
+        SPDLOG_ERROR("Unrecognised huge pages mode: {}", mode);
+        throw std::runtime_error("Unrecognised huge pages mode");
+    }
+
+    return doTransparentHugePageAlloc(size, prot, flags);
+}
+
 MemoryRegion allocatePrivateMemory(size_t size)
 {
     return doAlloc(size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
@@ -349,6 +922,11 @@ void mapMemory(std::span<uint8_t> target, int fd, int flags)
         throw std::runtime_error("Invalid fd for mapping");
     }
 
+    if (getBackingPageSize(target) != HOST_PAGE_SIZE) {
+        SPDLOG_ERROR("Mapping fd {} onto huge TLB memory", fd);
+        throw std::runtime_error("Mapping memory onto huge TLB memory");
+    }
+
     void* mmapRes = ::mmap(
       target.data(), target.size(), PROT_READ | PROT_WRITE, flags, fd, 0);
 
@@ -359,6 +937,17 @@ void mapMemory(std::span<uint8_t> target, int fd, int flags)
                      ::strerror(errno));
         throw std::runtime_error("mmapping memory failed");
     }
+
+    // Memory fds are backed by shared memory, which uses transparent huge
+    // pages for mappings advised to when the kernel allows it
+    if (getSystemConfig().hugePagesMode != "none" &&
+        isHugePageAligned(target.data()) &&
+        target.size() >= getHugePageSize()) {
+        if (::madvise(target.data(), target.size(), MADV_HUGEPAGE) != 0) {
+            SPDLOG_DEBUG("Could not advise transparent huge pages: {}",
+                         ::strerror(errno));
+        }
+    }
 }
 
 void mapMemoryPrivate(std::span<uint8_t> target, int fd)
@@ -371,6 +960,53 @@ void mapMemoryShared(std::span<uint8_t> target, int fd)
     mapMemory(target, fd, MAP_SHARED | MAP_FIXED);
 }
 
+size_t countPrivatePages(std::span<const uint8_t> region)
+{
+    if (region.empty()) {
+        return 0;
+    }
+
+    int pagemapFd = ::open(PAGEMAP, O_RDONLY);
+    if (pagemapFd < 0) {
+        SPDLOG_ERROR("Could not open pagemap ({})", ::strerror(errno));
+        throw std::runtime_error("Could not open pagemap");
+    }
+
+    uintptr_t firstPage = (uintptr_t)region.data() / HOST_PAGE_SIZE;
+    uintptr_t endPage =
+      getRequiredHostPages((uintptr_t)region.data() + region.size());
+
+    // Read the pagemap in batches to bound the buffer size
+    std::array<uint64_t, 512> entries;
+    size_t nPrivate = 0;
+    for (uintptr_t p = firstPage; p < endPage; p += entries.size()) {
+        size_t nPages = std::min<size_t>(entries.size(), endPage - p);
+        ssize_t nRead = ::pread(pagemapFd,
+                                entries.data(),
+                                nPages * PAGEMAP_ENTRY_BYTES,
+                                p * PAGEMAP_ENTRY_BYTES);
+        if (nRead != nPages * PAGEMAP_ENTRY_BYTES) {
+            ::close(pagemapFd);
+            SPDLOG_ERROR("Could not read pagemap ({} != {})",
+                         nRead,
+                         nPages * PAGEMAP_ENTRY_BYTES);
+            throw std::runtime_error("Could not read pagemap");
+        }
+
+        for (size_t i = 0; i < nPages; i++) {
+            uint64_t entry = entries.at(i);
+            if ((entry & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) != 0 &&
+                (entry & PAGEMAP_FILE_OR_SHARED) == 0) {
+                nPrivate++;
+            }
+        }
+    }
+
+    ::close(pagemapFd);
+
+    return nPrivate;
+}
+
 void resizeFd(int fd, size_t size)
 {
     int ferror = ::ftruncate(fd, size);
@@ -0,0 +1,120 @@
+#include <faabric/util/config.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/memory_pressure.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#define MEMINFO "/proc/meminfo"
+
+namespace faabric::util {
+
+static bool readFileIfExists(const std::string& path, std::string& contents)
+{
+    std::ifstream stream(path);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+void parsePressureStall(const std::string& psi, MemoryPressure& pressure)
+{
+    std::istringstream lines(psi);
+    std::string line;
+    while (std::getline(lines, line)) {
+        char kind[8] = { 0 };
+        double avg10 = 0;
+        if (std::sscanf(line.c_str(), "%7s avg10=%lf", kind, &avg10) != 2) {
+            continue;
+        }
+
+        if (std::string(kind) == "some") {
+            pressure.someStallPercent = avg10;
+        } else if (std::string(kind) == "full") {
+            pressure.fullStallPercent = avg10;
+        }
+    }
+}
+
+std::string getCgroupDir()
+{
+    // The cgroup v2 hierarchy is listed with id zero and no controllers
+    std::ifstream cgroups(PROC_SELF_CGROUP);
+    std::string line;
+    while (std::getline(cgroups, line)) {
+        if (line.starts_with("0::")) {
+            std::string path = line.substr(3);
+            return path == "/" ? CGROUP_ROOT : CGROUP_ROOT + path;
+        }
+    }
+
+    return CGROUP_ROOT;
+}
+
+MemoryPressure readMemoryPressure()
+{
+    std::string cgroupDir = getSystemConfig().memoryCgroupDir;
+    if (cgroupDir.empty()) {
+        cgroupDir = getCgroupDir();
+    }
+
+    return readMemoryPressure(cgroupDir);
+}
+
+MemoryPressure readMemoryPressure(const std::string& cgroupDir)
+{
+    MemoryPressure pressure;
+
+    std::string contents;
+    if (readFileIfExists(cgroupDir + "/memory.pressure", contents) ||
+        readFileIfExists(SYSTEM_MEMORY_PRESSURE, contents)) {
+        parsePressureStall(contents, pressure);
+    }
+
+    // Cgroups without a limit have "max" as their limit
+    std::string current;
+    std::string max;
+    if (readFileIfExists(cgroupDir + "/memory.current", current) &&
+        readFileIfExists(cgroupDir + "/memory.max", max) &&
+        !max.starts_with("max")) {
+        pressure.usageBytes = std::stoull(current);
+        pressure.limitBytes = std::stoull(max);
+        return pressure;
+    }
+
+    // Otherwise the limit is the host's memory
+    std::ifstream meminfo(MEMINFO);
+    std::string key;
+    size_t totalKb = 0;
+    size_t availableKb = 0;
+    while (meminfo >> key) {
+        size_t valueKb = 0;
+        meminfo >> valueKb;
+        if (key == "MemTotal:") {
+            totalKb = valueKb;
+        } else if (key == "MemAvailable:") {
+            availableKb = valueKb;
+        }
+
+        meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    if (totalKb == 0) {
+        SPDLOG_WARN("Could not read host memory from {}", MEMINFO);
+        return pressure;
+    }
+
+    pressure.limitBytes = totalKb * 1024;
+    pressure.usageBytes = (totalKb - std::min(availableKb, totalKb)) * 1024;
+
+    return pressure;
+}
+}
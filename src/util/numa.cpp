@@ -0,0 +1,223 @@
+#include <faabric/util/logging.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/numa.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#define NODE_DIR_PREFIX "node"
+
+namespace faabric::util {
+
+const NumaNode* CpuTopology::getNode(int nodeId) const
+{
+    for (const auto& node : nodes) {
+        if (node.id == nodeId) {
+            return &node;
+        }
+    }
+
+    return nullptr;
+}
+
+std::vector<int> CpuTopology::getCpus() const
+{
+    std::vector<int> cpus;
+    for (const auto& node : nodes) {
+        cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    return cpus;
+}
+
+std::vector<int> parseCpuList(const std::string& cpuList)
+{
+    std::vector<int> cpus;
+
+    std::istringstream ranges(cpuList);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        int first = 0;
+        int last = 0;
+        int nParsed = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (nParsed == 1) {
+            last = first;
+        } else if (nParsed != 2) {
+            continue;
+        }
+
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<int> getAffinityCpus()
+{
+    std::vector<int> cpus;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (::sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &cpuSet)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+
+    if (cpus.empty()) {
+        int nCpus = std::jthread::hardware_concurrency();
+        for (int cpu = 0; cpu < nCpus; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+CpuTopology readCpuTopology(const std::string& nodesDir,
+                            const std::vector<int>& usableCpus)
+{
+    CpuTopology topology;
+
+    std::error_code ec;
+    for (const auto& entry :
+         std::filesystem::directory_iterator(nodesDir, ec)) {
+        std::string name = entry.path().filename();
+        if (!name.starts_with(NODE_DIR_PREFIX) ||
+            name.size() == std::strlen(NODE_DIR_PREFIX) ||
+            !std::all_of(name.begin() + std::strlen(NODE_DIR_PREFIX),
+                         name.end(),
+                         ::isdigit)) {
+            continue;
+        }
+
+        std::ifstream cpuListFile(entry.path() / "cpulist");
+        std::string cpuList;
+        if (!std::getline(cpuListFile, cpuList)) {
+            continue;
+        }
+
+        NumaNode node;
+        node.id = std::stoi(name.substr(std::strlen(NODE_DIR_PREFIX)));
+        for (int cpu : parseCpuList(cpuList)) {
+            if (std::find(usableCpus.begin(), usableCpus.end(), cpu) !=
+                usableCpus.end()) {
+                node.cpus.push_back(cpu);
+            }
+        }
+
+        if (!node.cpus.empty()) {
+            topology.nodes.push_back(std::move(node));
+        }
+    }
+
+    // No NUMA information, e.g. without sysfs or on a kernel without NUMA
+    if (topology.nodes.empty()) {
+        topology.nodes.push_back({ 0, usableCpus });
+    }
+
+    std::sort(topology.nodes.begin(),
+              topology.nodes.end(),
+              [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+
+    return topology;
+}
+
+const CpuTopology& getCpuTopology()
+{
+    static CpuTopology topology = [] {
+        CpuTopology t = readCpuTopology(NUMA_NODES_DIR, getAffinityCpus());
+        for (const auto& node : t.nodes) {
+            SPDLOG_DEBUG("NUMA node {} has {} usable CPUs",
+                         node.id,
+                         node.cpus.size());
+        }
+        return t;
+    }();
+
+    return topology;
+}
+
+void pinThreadToCpus(const std::vector<int>& cpus)
+{
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpuSet);
+    }
+
+    if (::sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+        SPDLOG_ERROR("Failed pinning thread to {} CPUs: {}",
+                     cpus.size(),
+                     ::strerror(errno));
+        throw std::runtime_error("Failed pinning thread");
+    }
+}
+
+static std::vector<unsigned long> getNodeMask(int nodeId)
+{
+    constexpr int bitsPerWord = sizeof(unsigned long) * CHAR_BIT;
+    std::vector<unsigned long> mask(nodeId / bitsPerWord + 1, 0);
+    mask.at(nodeId / bitsPerWord) |= 1UL << (nodeId % bitsPerWord);
+
+    return mask;
+}
+
+void setThreadNumaNode(int nodeId)
+{
+    std::vector<unsigned long> mask = getNodeMask(nodeId);
+    unsigned long maxNode = mask.size() * sizeof(unsigned long) * CHAR_BIT + 1;
+
+    if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask.data(), maxNode) !=
+        0) {
+        SPDLOG_DEBUG("Could not prefer NUMA node {} for thread: {}",
+                     nodeId,
+                     ::strerror(errno));
+    }
+}
+
+void bindToNumaNode(std::span<uint8_t> region, int nodeId)
+{
+    // Only whole pages can be bound
+    auto start = (uintptr_t)region.data();
+    uintptr_t alignedStart =
+      ((start + HOST_PAGE_SIZE - 1) / HOST_PAGE_SIZE) * HOST_PAGE_SIZE;
+    uintptr_t alignedEnd =
+      ((start + region.size()) / HOST_PAGE_SIZE) * HOST_PAGE_SIZE;
+    if (alignedEnd <= alignedStart) {
+        return;
+    }
+
+    std::vector<unsigned long> mask = getNodeMask(nodeId);
+    unsigned long maxNode = mask.size() * sizeof(unsigned long) * CHAR_BIT + 1;
+
+    if (::syscall(SYS_mbind,
+                  alignedStart,
+                  alignedEnd - alignedStart,
+                  MPOL_PREFERRED,
+                  mask.data(),
+                  maxNode,
+                  MPOL_MF_MOVE) != 0) {
+        SPDLOG_DEBUG("Could not bind {} bytes to NUMA node {}: {}",
+                     alignedEnd - alignedStart,
+                     nodeId,
+                     ::strerror(errno));
+    }
+}
+}
@@ -118,7 +118,7 @@ void SchedulingDecision::addMessage(const std::string& host,
 }
 
 SchedulingDecision SchedulingDecision::fromPointToPointMappings(
-  faabric::PointToPointMappings& mappings)
+  const faabric::PointToPointMappings& mappings)
 {
     SchedulingDecision decision(mappings.appid(), mappings.groupid());
 
@@ -128,4 +128,21 @@ SchedulingDecision SchedulingDecision::fromPointToPointMappings(
 
     return decision;
 }
+
+faabric::PointToPointMappings SchedulingDecision::toPointToPointMappings() const
+{
+    faabric::PointToPointMappings mappings;
+    mappings.set_appid(appId);
+    mappings.set_groupid(groupId);
+
+    for (int i = 0; i < nFunctions; i++) {
+        auto* mapping = mappings.add_mappings();
+        mapping->set_host(hosts.at(i));
+        mapping->set_messageid(messageIds.at(i));
+        mapping->set_appidx(appIdxs.at(i));
+        mapping->set_groupidx(groupIdxs.at(i));
+    }
+
+    return mappings;
+}
 }
@@ -1,4 +1,7 @@
+#include <faabric/util/WorkerPool.h>
 #include <faabric/util/bytes.h>
+#include <faabric/util/config.h>
+#include <faabric/util/delta.h>
 #include <faabric/util/dirty.h>
 #include <faabric/util/gids.h>
 #include <faabric/util/locks.h>
@@ -8,8 +11,20 @@
 #include <faabric/util/snapshot.h>
 #include <faabric/util/timing.h>
 
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <exception>
+#include <openssl/evp.h>
+#include <unordered_set>
 #include <sys/mman.h>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace faabric::util {
 
 SnapshotDiff::SnapshotDiff(SnapshotDataType dataTypeIn,
@@ -27,73 +42,243 @@ std::vector<uint8_t> SnapshotDiff::getDataCopy() const
     return std::vector<uint8_t>(data.begin(), data.end());
 }
 
+// The diff kernel compares a block of bytes at a time, producing a mask in
+// which every differing byte sets a lane of DIFF_LANE_BITS bits. Lanes are
+// either all set or all clear, so counting trailing zeros of the mask (or its
+// inverse) finds the next differing (or matching) byte in the block.
+#if defined(__AVX512BW__)
+static constexpr uint32_t DIFF_BLOCK_SIZE = 64;
+static constexpr uint32_t DIFF_LANE_BITS = 1;
+
+static inline uint64_t diffBlockMask(const uint8_t* a, const uint8_t* b)
+{
+    __m512i va = _mm512_loadu_si512(a);
+    __m512i vb = _mm512_loadu_si512(b);
+    return _mm512_cmpneq_epi8_mask(va, vb);
+}
+#elif defined(__AVX2__)
+static constexpr uint32_t DIFF_BLOCK_SIZE = 32;
+static constexpr uint32_t DIFF_LANE_BITS = 1;
+
+static inline uint64_t diffBlockMask(const uint8_t* a, const uint8_t* b)
+{
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    uint32_t eqMask =
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+    return static_cast<uint64_t>(~eqMask);
+}
+#elif defined(__SSE2__)
+static constexpr uint32_t DIFF_BLOCK_SIZE = 16;
+static constexpr uint32_t DIFF_LANE_BITS = 1;
+
+static inline uint64_t diffBlockMask(const uint8_t* a, const uint8_t* b)
+{
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    uint32_t eqMask =
+      static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+    return static_cast<uint64_t>(~eqMask & 0xFFFF);
+}
+#elif defined(__ARM_NEON)
+static constexpr uint32_t DIFF_BLOCK_SIZE = 16;
+static constexpr uint32_t DIFF_LANE_BITS = 4;
+
+static inline uint64_t diffBlockMask(const uint8_t* a, const uint8_t* b)
+{
+    // NEON has no movemask, narrowing the comparison result by four bits
+    // leaves a nibble per byte instead
+    uint8x16_t eq = vceqq_u8(vld1q_u8(a), vld1q_u8(b));
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return ~vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+#else
+static constexpr uint32_t DIFF_BLOCK_SIZE = 8;
+static constexpr uint32_t DIFF_LANE_BITS = 8;
+
+static inline uint64_t diffBlockMask(const uint8_t* a, const uint8_t* b)
+{
+    // Set the top bit of every non-zero byte in the XOR of the two words, then
+    // widen each of those bits to fill its byte
+    uint64_t x = unalignedRead<uint64_t>(a) ^ unalignedRead<uint64_t>(b);
+    constexpr uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t topBits = (((x & low7) + low7) | x) & ~low7;
+    return (topBits >> 7) * 0xFF;
+}
+#endif
+
+static_assert(DIFF_BLOCK_SIZE * DIFF_LANE_BITS <= 64,
+              "Diff block mask must fit in 64 bits");
+static_assert(ARRAY_COMP_CHUNK_SIZE % DIFF_BLOCK_SIZE == 0,
+              "Comparison chunks must be a whole number of diff blocks");
+
+static constexpr uint64_t DIFF_BLOCK_FULL_MASK =
+  DIFF_BLOCK_SIZE * DIFF_LANE_BITS == 64
+    ? ~0ULL
+    : (1ULL << (DIFF_BLOCK_SIZE * DIFF_LANE_BITS)) - 1;
+
+namespace {
+/**
+ * Tracks the run of changed bytes currently being scanned, and the last
+ * finished run, which may still absorb the next one if the gap between them is
+ * small enough.
+ */
+class DiffRunBuilder
+{
+  public:
+    DiffRunBuilder(std::vector<SnapshotDiff>& diffsIn,
+                   std::span<const uint8_t> updatedIn,
+                   uint32_t mergeGapIn)
+      : diffs(diffsIn)
+      , updated(updatedIn)
+      , mergeGap(mergeGapIn)
+    {}
+
+    bool inRun = false;
+
+    void startRun(uint32_t offset)
+    {
+        inRun = true;
+        runStart = offset;
+    }
+
+    void endRun(uint32_t offset)
+    {
+        inRun = false;
+
+        if (hasPending && runStart - pendingEnd <= mergeGap) {
+            pendingEnd = offset;
+            return;
+        }
+
+        flush();
+        hasPending = true;
+        pendingStart = runStart;
+        pendingEnd = offset;
+    }
+
+    void flush()
+    {
+        if (hasPending) {
+            diffs.emplace_back(
+              SnapshotDataType::Raw,
+              SnapshotMergeOperation::Bytewise,
+              pendingStart,
+              updated.subspan(pendingStart, pendingEnd - pendingStart));
+            hasPending = false;
+        }
+    }
+
+    // Walks the differing and matching lanes of a block's mask, starting and
+    // ending runs at each boundary
+    void scanBlock(uint64_t mask, uint32_t blockOffset)
+    {
+        uint32_t pos = 0;
+        while (pos < DIFF_BLOCK_SIZE) {
+            uint64_t remaining =
+              (inRun ? (~mask & DIFF_BLOCK_FULL_MASK) : mask) >>
+              (pos * DIFF_LANE_BITS);
+            if (remaining == 0) {
+                return;
+            }
+
+            pos += std::countr_zero(remaining) / DIFF_LANE_BITS;
+            if (inRun) {
+                endRun(blockOffset + pos);
+            } else {
+                startRun(blockOffset + pos);
+            }
+        }
+    }
+
+  private:
+    std::vector<SnapshotDiff>& diffs;
+    std::span<const uint8_t> updated;
+    const uint32_t mergeGap;
+
+    uint32_t runStart = 0;
+
+    bool hasPending = false;
+    uint32_t pendingStart = 0;
+    uint32_t pendingEnd = 0;
+};
+}
+
 void diffArrayRegions(std::vector<SnapshotDiff>& snapshotDiffs,
                       uint32_t startOffset,
                       uint32_t endOffset,
                       std::span<const uint8_t> a,
-                      std::span<const uint8_t> b)
+                      std::span<const uint8_t> b,
+                      uint32_t mergeGap)
 {
-    // Iterate through diffs and work out start and finish offsets of each dirty
-    // region
-    uint32_t diffStart = 0;
-    bool diffInProgress = false;
+    DiffRunBuilder runs(snapshotDiffs, b, mergeGap);
     const uint8_t* aPtr = a.data();
     const uint8_t* bPtr = b.data();
 
-    // Check chunks at a time, only do byte-wise checks if we find a diff within
-    // a given chunk
-    size_t chunkSize = ARRAY_COMP_CHUNK_SIZE;
-
-    for (uint32_t i = startOffset; i < endOffset; i += chunkSize) {
-        const uint8_t* thisAPtr = aPtr + i;
-        const uint8_t* thisBPtr = bPtr + i;
+    uint32_t i = startOffset;
 
-        // Check to see if we can skip this chunk
-        size_t thisStep = chunkSize;
-        if (endOffset > 0) {
-            thisStep = std::min<size_t>(endOffset - i, chunkSize);
+    // Skip whole chunks at a time while nothing has changed, and only look for
+    // run boundaries within chunks that do contain changes
+    for (; i + ARRAY_COMP_CHUNK_SIZE <= endOffset; i += ARRAY_COMP_CHUNK_SIZE) {
+        if (!runs.inRun &&
+            std::memcmp(aPtr + i, bPtr + i, ARRAY_COMP_CHUNK_SIZE) == 0) {
+            continue;
         }
 
-        if (memcmp(thisAPtr, thisBPtr, thisStep) == 0) {
-            if (diffInProgress) {
-                // Finished on byte before
-                diffInProgress = false;
-                snapshotDiffs.emplace_back(SnapshotDataType::Raw,
-                                           SnapshotMergeOperation::Bytewise,
-                                           diffStart,
-                                           b.subspan(diffStart, i - diffStart));
+        for (uint32_t j = i; j < i + ARRAY_COMP_CHUNK_SIZE;
+             j += DIFF_BLOCK_SIZE) {
+            uint64_t mask = diffBlockMask(aPtr + j, bPtr + j);
+
+            // Nothing to do for blocks that don't end or start a run
+            if (mask == (runs.inRun ? DIFF_BLOCK_FULL_MASK : 0)) {
+                continue;
             }
 
-            continue;
+            runs.scanBlock(mask, j);
         }
+    }
 
-        for (uint32_t c = i; c < i + thisStep; c++) {
-            thisAPtr = aPtr + c;
-            thisBPtr = bPtr + c;
-
-            bool dirty = *thisAPtr != *thisBPtr;
-            if (dirty && !diffInProgress) {
-                // Starts at this byte
-                diffInProgress = true;
-                diffStart = c;
-            } else if (!dirty && diffInProgress) {
-                // Finished on byte before
-                diffInProgress = false;
-                snapshotDiffs.emplace_back(SnapshotDataType::Raw,
-                                           SnapshotMergeOperation::Bytewise,
-                                           diffStart,
-                                           b.subspan(diffStart, c - diffStart));
-            }
+    // Any whole blocks left over after the last chunk
+    for (; i + DIFF_BLOCK_SIZE <= endOffset; i += DIFF_BLOCK_SIZE) {
+        uint64_t mask = diffBlockMask(aPtr + i, bPtr + i);
+        if (mask != (runs.inRun ? DIFF_BLOCK_FULL_MASK : 0)) {
+            runs.scanBlock(mask, i);
+        }
+    }
+
+    // Then bytewise for anything smaller than a block
+    for (; i < endOffset; i++) {
+        bool dirty = aPtr[i] != bPtr[i];
+        if (dirty && !runs.inRun) {
+            runs.startRun(i);
+        } else if (!dirty && runs.inRun) {
+            runs.endRun(i);
         }
     }
 
-    // If we finish with a diff in progress, add it
-    if (diffInProgress) {
-        snapshotDiffs.emplace_back(SnapshotDataType::Raw,
-                                   SnapshotMergeOperation::Bytewise,
-                                   diffStart,
-                                   b.subspan(diffStart, endOffset - diffStart));
+    // If we finish with a diff in progress, it runs to the end
+    if (runs.inRun) {
+        runs.endRun(endOffset);
     }
+
+    runs.flush();
+}
+
+SnapshotPageHash hashSnapshotPage(std::span<const uint8_t> page)
+{
+    // Look up the digest once, rather than on every call
+    static EVP_MD* sha256 = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+
+    SnapshotPageHash hash;
+    if (sha256 == nullptr ||
+        EVP_Digest(
+          page.data(), page.size(), hash.data(), nullptr, sha256, nullptr) !=
+          1) {
+        SPDLOG_ERROR("Failed to hash snapshot page of {} bytes", page.size());
+        throw std::runtime_error("Failed to hash snapshot page");
+    }
+
+    return hash;
 }
 
 SnapshotData::SnapshotData(size_t sizeIn)
@@ -134,6 +319,11 @@ SnapshotData::SnapshotData(std::span<const uint8_t> dataIn, size_t maxSizeIn)
 
 SnapshotData::~SnapshotData()
 {
+    // Stop any memory this was mapped onto lazily from reading from it
+    if (mappedLazily) {
+        getLazyPageHandler().removeRegions(this);
+    }
+
     if (fd > 0) {
         SPDLOG_TRACE("Closing fd {}", fd);
         ::close(fd);
@@ -148,12 +338,39 @@ void SnapshotData::copyInData(std::span<const uint8_t> buffer, uint32_t offset)
     writeData(buffer, offset);
 }
 
-void SnapshotData::checkWriteExtension(std::span<const uint8_t> buffer,
-                                       uint32_t offset)
+void SnapshotData::copyInCompressedData(
+  std::span<const uint8_t> compressed,
+  const std::vector<std::pair<uint32_t, size_t>>& regions)
+{
+    faabric::util::FullLock lock(snapMx);
+
+    std::vector<std::span<uint8_t>> targets;
+    targets.reserve(regions.size());
+    for (const auto& [offset, length] : regions) {
+        if (offset + length > size) {
+            SPDLOG_ERROR("Decompressing snapshot data exceeding size: {} > {}",
+                         offset + length,
+                         size);
+            throw std::runtime_error("Decompressing data exceeding size");
+        }
+
+        fetchMissingPages(offset, length);
+        preserveVersionPages(offset, length);
+        targets.emplace_back(validatedOffsetPtr(offset), length);
+    }
+
+    zstdDecompress(compressed, targets);
+
+    for (const auto& [offset, length] : regions) {
+        trackedChanges.emplace_back(offset, offset + length);
+    }
+    writeCount++;
+}
+
+void SnapshotData::checkWriteExtension(size_t regionEnd)
 {
     // Try to allocate more memory on top of existing data if necessary.
     // Will throw an exception if not possible
-    size_t regionEnd = offset + buffer.size();
     if (regionEnd > size) {
         if (regionEnd > maxSize) {
             SPDLOG_ERROR(
@@ -177,7 +394,9 @@ void SnapshotData::checkWriteExtension(std::span<const uint8_t> buffer,
 void SnapshotData::writeData(std::span<const uint8_t> buffer, uint32_t offset)
 {
     size_t regionEnd = offset + buffer.size();
-    checkWriteExtension(buffer, offset);
+    checkWriteExtension(regionEnd);
+    fetchMissingPages(offset, buffer.size());
+    preserveVersionPages(offset, buffer.size());
 
     // Copy in new data
     uint8_t* copyTarget = validatedOffsetPtr(offset);
@@ -185,6 +404,7 @@ void SnapshotData::writeData(std::span<const uint8_t> buffer, uint32_t offset)
 
     // Record the change
     trackedChanges.emplace_back(offset, regionEnd);
+    writeCount++;
 }
 
 void SnapshotData::xorData(std::span<const uint8_t> buffer, uint32_t offset)
@@ -196,11 +416,41 @@ void SnapshotData::xorData(std::span<const uint8_t> buffer, uint32_t offset)
         throw std::runtime_error("XORing data exceeding size");
     }
 
+    fetchMissingPages(offset, buffer.size());
+    preserveVersionPages(offset, buffer.size());
+
     uint8_t* copyTarget = validatedOffsetPtr(offset);
     std::transform(
       buffer.begin(), buffer.end(), copyTarget, copyTarget, std::bit_xor());
 
     trackedChanges.emplace_back(offset, regionEnd);
+    writeCount++;
+}
+
+std::vector<SnapshotPageHash> SnapshotData::getPageHashes()
+{
+    faabric::util::SharedLock lock(snapMx);
+    faabric::util::UniqueLock hashesLock(pageHashesMx);
+
+    if (pageHashes.empty() || pageHashesWriteCount != writeCount) {
+        PROF_START(HashSnapshotPages)
+        fetchMissingPages(0, size);
+
+        size_t nPages = getRequiredHostPages(size);
+        pageHashes.resize(nPages);
+        for (size_t p = 0; p < nPages; p++) {
+            size_t pageStart = p * HOST_PAGE_SIZE;
+            size_t pageSize =
+              std::min<size_t>(HOST_PAGE_SIZE, size - pageStart);
+            pageHashes.at(p) =
+              hashSnapshotPage({ data.get() + pageStart, pageSize });
+        }
+
+        pageHashesWriteCount = writeCount;
+        PROF_END(HashSnapshotPages)
+    }
+
+    return pageHashes;
 }
 
 const uint8_t* SnapshotData::getDataPtr(uint32_t offset)
@@ -236,6 +486,8 @@ std::vector<uint8_t> SnapshotData::getDataCopy(uint32_t offset, size_t dataSize)
         throw std::runtime_error("Out of bounds snapshot access");
     }
 
+    fetchMissingPages(offset, dataSize);
+
     uint8_t* ptr = validatedOffsetPtr(offset);
     return std::vector<uint8_t>(ptr, ptr + dataSize);
 }
@@ -329,7 +581,12 @@ void SnapshotData::mapToMemory(std::span<uint8_t> target)
     // OS will handle synchronisation of the mapping itself
     PROF_START(MapSnapshot)
     faabric::util::SharedLock lock(snapMx);
+    doMapToMemory(target);
+    PROF_END(MapSnapshot)
+}
 
+void SnapshotData::doMapToMemory(std::span<uint8_t> target)
+{
     if (target.size() > size) {
         SPDLOG_ERROR("Mapping target memory larger than snapshot ({} > {})",
                      target.size(),
@@ -337,9 +594,130 @@ void SnapshotData::mapToMemory(std::span<uint8_t> target)
         throw std::runtime_error("Target memory larger than snapshot");
     }
 
-    faabric::util::mapMemoryPrivate(target, fd);
+    // Mapping shares the fd's pages, so any missing ones are needed up front
+    fetchMissingPages(0, size);
 
-    PROF_END(MapSnapshot)
+    // Huge TLB memory can't be mapped over with host pages, so is copied into
+    if (faabric::util::getBackingPageSize(target) != HOST_PAGE_SIZE) {
+        SPDLOG_TRACE("Copying snapshot into huge TLB memory");
+        std::memcpy(target.data(), data.get(), target.size());
+    } else {
+        faabric::util::mapMemoryPrivate(target, fd);
+    }
+}
+
+void SnapshotData::mapToMemoryLazily(std::span<uint8_t> target,
+                                     size_t prefetchPages,
+                                     bool committedOnly)
+{
+    // Faults on huge TLB memory would have to be filled in whole huge pages
+    if (faabric::util::getBackingPageSize(target) != HOST_PAGE_SIZE) {
+        if (committedOnly) {
+            mapCommittedToMemory(target);
+        } else {
+            mapToMemory(target);
+        }
+        return;
+    }
+
+    PROF_START(MapSnapshotLazily)
+    uint64_t atVersion = 0;
+    {
+        faabric::util::SharedLock lock(snapMx);
+        if (target.size() > size) {
+            SPDLOG_ERROR(
+              "Mapping target memory larger than snapshot ({} > {})",
+              target.size(),
+              size);
+            throw std::runtime_error("Target memory larger than snapshot");
+        }
+
+        atVersion = version;
+    }
+
+    // Pages are copied from the snapshot's own memory, which always covers
+    // whole pages, so the target's last page can be filled in full
+    LazyPageSource source = [this](size_t offset, size_t length) {
+        fetchMissingPages(offset, length);
+        return data.get() + offset;
+    };
+
+    // Pages of a committed version may come from their copies, so are
+    // gathered into a buffer. Faults are handled one at a time, so only one
+    // is ever using it.
+    if (committedOnly) {
+        auto buffer = std::make_shared<std::vector<uint8_t>>();
+        source = [this, atVersion, buffer](size_t offset, size_t length) {
+            fetchMissingPages(offset, length);
+
+            faabric::util::SharedLock lock(snapMx);
+            uint64_t readVersion = std::max(atVersion, prunedVersion);
+            buffer->resize(length);
+            for (size_t p = 0; p < length / HOST_PAGE_SIZE; p++) {
+                std::memcpy(buffer->data() + (p * HOST_PAGE_SIZE),
+                            getVersionPagePtr(readVersion,
+                                              (offset / HOST_PAGE_SIZE) + p),
+                            HOST_PAGE_SIZE);
+            }
+
+            return (const uint8_t*)buffer->data();
+        };
+    }
+
+    mappedLazily = true;
+    getLazyPageHandler().addRegion(target, source, prefetchPages, this);
+
+    PROF_END(MapSnapshotLazily)
+}
+
+void SnapshotData::setLazyPageFetcher(SnapshotPageFetcher fetcherIn)
+{
+    faabric::util::SharedLock lock(snapMx);
+    faabric::util::UniqueLock missingLock(missingPagesMx);
+
+    pageFetcher = std::move(fetcherIn);
+    lazySize = size;
+    missingPages.assign(getRequiredHostPages(size), true);
+    nMissingPages = missingPages.size();
+}
+
+void SnapshotData::fetchMissingPages(uint32_t offset, size_t length)
+{
+    if (nMissingPages == 0 || length == 0) {
+        return;
+    }
+
+    faabric::util::UniqueLock lock(missingPagesMx);
+
+    size_t endPage =
+      std::min(getRequiredHostPages(offset + length), missingPages.size());
+    size_t p = offset / HOST_PAGE_SIZE;
+    while (p < endPage) {
+        if (!missingPages.at(p)) {
+            p++;
+            continue;
+        }
+
+        // Fetch each run of missing pages in one go
+        size_t runEnd = p + 1;
+        while (runEnd < endPage && missingPages.at(runEnd)) {
+            runEnd++;
+        }
+
+        size_t runOffset = p * HOST_PAGE_SIZE;
+        size_t runLength =
+          std::min<size_t>((runEnd - p) * HOST_PAGE_SIZE, lazySize - runOffset);
+
+        SPDLOG_TRACE("Fetching {} missing snapshot pages from {}",
+                     runEnd - p,
+                     runOffset);
+        pageFetcher(runOffset, { data.get() + runOffset, runLength });
+
+        std::fill(
+          missingPages.begin() + p, missingPages.begin() + runEnd, false);
+        nMissingPages -= runEnd - p;
+        p = runEnd;
+    }
 }
 
 std::vector<SnapshotMergeRegion> SnapshotData::getMergeRegions()
@@ -362,9 +740,7 @@ size_t SnapshotData::getQueuedDiffsCount()
 
 void SnapshotData::applyDiffs(const std::vector<SnapshotDiff>& diffs)
 {
-    for (const auto& diff : diffs) {
-        applyDiff(diff);
-    }
+    writeDiffs(diffs);
 }
 
 void SnapshotData::queueDiffs(const std::vector<SnapshotDiff>& diffs)
@@ -386,11 +762,8 @@ int SnapshotData::writeQueuedDiffs()
 
     SPDLOG_DEBUG("Writing {} queued diffs to snapshot", queuedDiffs.size());
 
-    // Iterate through diffs
     int nDiffs = queuedDiffs.size();
-    for (auto& diff : queuedDiffs) {
-        applyDiff(diff);
-    }
+    writeDiffs(queuedDiffs);
 
     // Clear queue
     queuedDiffs.clear();
@@ -399,6 +772,343 @@ int SnapshotData::writeQueuedDiffs()
     return nDiffs;
 }
 
+// Checks whether any of the given merge regions overlap, assuming they are
+// sorted by offset. Zero-length regions extend to the end of the data.
+static bool mergeRegionsOverlap(const std::vector<SnapshotMergeRegion>& regions,
+                                size_t dataSize)
+{
+    for (size_t i = 1; i < regions.size(); i++) {
+        const SnapshotMergeRegion& prev = regions.at(i - 1);
+        size_t prevEnd = prev.length > 0 ? prev.offset + prev.length : dataSize;
+        if (prevEnd > regions.at(i).offset) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Sorts the given ranges and merges any that overlap or touch
+static void mergeChangeRanges(
+  std::vector<std::pair<uint32_t, uint32_t>>& ranges)
+{
+    std::sort(ranges.begin(), ranges.end());
+
+    size_t nMerged = 0;
+    for (const auto& [begin, end] : ranges) {
+        if (nMerged > 0 && begin <= ranges.at(nMerged - 1).second) {
+            ranges.at(nMerged - 1).second =
+              std::max(ranges.at(nMerged - 1).second, end);
+        } else {
+            ranges.at(nMerged++) = { begin, end };
+        }
+    }
+
+    ranges.resize(nMerged);
+}
+
+// Applies a typed merge operation to a run of consecutive values. Keeping
+// the switch outside the loop lets the compiler vectorise each operation.
+template<typename T>
+static void applyDiffValues(uint8_t* target,
+                            const uint8_t* diff,
+                            size_t nValues,
+                            SnapshotMergeOperation operation)
+{
+    auto applyOp = [&](auto op) {
+        for (size_t i = 0; i < nValues; i++) {
+            T result = op(unalignedRead<T>(target + i * sizeof(T)),
+                          unalignedRead<T>(diff + i * sizeof(T)));
+            ::memcpy(target + i * sizeof(T), &result, sizeof(T));
+        }
+    };
+
+    switch (operation) {
+        case (SnapshotMergeOperation::Sum): {
+            applyOp([](T original, T d) { return d + original; });
+            break;
+        }
+        case (SnapshotMergeOperation::Subtract): {
+            applyOp([](T original, T d) { return original - d; });
+            break;
+        }
+        case (SnapshotMergeOperation::Product): {
+            applyOp([](T original, T d) { return original * d; });
+            break;
+        }
+        case (SnapshotMergeOperation::Max): {
+            applyOp([](T original, T d) { return std::max<T>(original, d); });
+            break;
+        }
+        case (SnapshotMergeOperation::Min): {
+            applyOp([](T original, T d) { return std::min<T>(original, d); });
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Can't apply merge operation: {}", operation);
+            throw std::runtime_error("Can't apply merge operation");
+        }
+    }
+}
+
+static void applyTypedDiffValues(uint8_t* target,
+                                 const uint8_t* diff,
+                                 size_t length,
+                                 SnapshotDataType dataType,
+                                 SnapshotMergeOperation operation)
+{
+    switch (dataType) {
+        case (SnapshotDataType::Int): {
+            applyDiffValues<int32_t>(
+              target, diff, length / sizeof(int32_t), operation);
+            break;
+        }
+        case (SnapshotDataType::Long): {
+            applyDiffValues<long>(
+              target, diff, length / sizeof(long), operation);
+            break;
+        }
+        case (SnapshotDataType::Float): {
+            applyDiffValues<float>(
+              target, diff, length / sizeof(float), operation);
+            break;
+        }
+        case (SnapshotDataType::Double): {
+            applyDiffValues<double>(
+              target, diff, length / sizeof(double), operation);
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Unsupported data type: {}", dataType);
+            throw std::runtime_error("Unsupported merge data type");
+        }
+    }
+}
+
+void SnapshotData::writeDiffs(const std::vector<SnapshotDiff>& diffs)
+{
+    PROF_START(WriteDiffs)
+
+    // Bytewise diffs may extend the snapshot, so do that once up front. Any
+    // other diff must fall within the (possibly extended) data.
+    size_t maxEnd = 0;
+    for (const auto& diff : diffs) {
+        if (diff.getOperation() == SnapshotMergeOperation::Bytewise) {
+            maxEnd = std::max<size_t>(maxEnd,
+                                      diff.getOffset() + diff.getData().size());
+        }
+    }
+    checkWriteExtension(maxEnd);
+
+    // Group the diffs into clusters touching disjoint sets of pages. Within a
+    // cluster diffs keep their queued order, so overlapping diffs are applied
+    // exactly as they would be one at a time.
+    struct DiffCluster
+    {
+        size_t startPage;
+        size_t endPage;
+        std::vector<size_t> diffIdxs;
+    };
+
+    std::vector<size_t> order;
+    order.reserve(diffs.size());
+    for (size_t i = 0; i < diffs.size(); i++) {
+        const SnapshotDiff& diff = diffs.at(i);
+        if (diff.getOperation() == SnapshotMergeOperation::Ignore ||
+            diff.getData().empty()) {
+            continue;
+        }
+
+        size_t diffEnd = diff.getOffset() + diff.getData().size();
+        if (diffEnd > size) {
+            SPDLOG_ERROR(
+              "Applying snapshot diff exceeding size: {} > {}", diffEnd, size);
+            throw std::runtime_error("Applying diff exceeding size");
+        }
+
+        order.push_back(i);
+    }
+
+    auto diffPages = [&diffs](size_t idx) {
+        const SnapshotDiff& diff = diffs.at(idx);
+        return std::pair<size_t, size_t>(
+          diff.getOffset() / HOST_PAGE_SIZE,
+          getRequiredHostPages(diff.getOffset() + diff.getData().size()));
+    };
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return diffs.at(a).getOffset() < diffs.at(b).getOffset();
+    });
+
+    std::vector<DiffCluster> clusters;
+    for (size_t idx : order) {
+        auto [startPage, endPage] = diffPages(idx);
+        if (clusters.empty() || startPage >= clusters.back().endPage) {
+            clusters.push_back({ startPage, endPage, {} });
+        } else {
+            clusters.back().endPage =
+              std::max(clusters.back().endPage, endPage);
+        }
+
+        clusters.back().diffIdxs.push_back(idx);
+    }
+
+    for (auto& cluster : clusters) {
+        std::sort(cluster.diffIdxs.begin(), cluster.diffIdxs.end());
+
+        // Fetch lazily restored pages and copy pages of committed versions up
+        // front rather than from the workers
+        size_t clusterOffset = cluster.startPage * HOST_PAGE_SIZE;
+        size_t clusterLength =
+          (cluster.endPage - cluster.startPage) * HOST_PAGE_SIZE;
+        fetchMissingPages(clusterOffset, clusterLength);
+        preserveVersionPages(clusterOffset, clusterLength);
+    }
+
+    // Each cluster records its own changes, merging adjacent ones
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> clusterChanges(
+      clusters.size());
+
+    auto writeCluster = [&](size_t c) {
+        const std::vector<size_t>& idxs = clusters.at(c).diffIdxs;
+        std::vector<std::pair<uint32_t, uint32_t>> changes;
+        std::vector<uint8_t> gathered;
+
+        size_t i = 0;
+        while (i < idxs.size()) {
+            const SnapshotDiff& diff = diffs.at(idxs.at(i));
+            uint32_t offset = diff.getOffset();
+            uint32_t end = offset + diff.getData().size();
+            uint8_t* target = data.get() + offset;
+
+            switch (diff.getOperation()) {
+                case (SnapshotMergeOperation::Bytewise): {
+                    // Consecutive bytewise diffs whose data is also
+                    // consecutive, e.g. cut from one received message, are
+                    // copied in one go
+                    const uint8_t* src = diff.getData().data();
+                    size_t runEnd = i + 1;
+                    while (runEnd < idxs.size()) {
+                        const SnapshotDiff& next = diffs.at(idxs.at(runEnd));
+                        if (next.getOffset() != end ||
+                            next.getOperation() !=
+                              SnapshotMergeOperation::Bytewise ||
+                            next.getData().data() != src + (end - offset)) {
+                            break;
+                        }
+
+                        end += next.getData().size();
+                        runEnd++;
+                    }
+
+                    ::memcpy(target, src, end - offset);
+                    i = runEnd;
+                    break;
+                }
+                case (SnapshotMergeOperation::XOR): {
+                    std::transform(diff.getData().begin(),
+                                   diff.getData().end(),
+                                   target,
+                                   target,
+                                   std::bit_xor());
+                    i++;
+                    break;
+                }
+                default: {
+                    // Gather a run of typed diffs with the same type and
+                    // operation covering consecutive values, and apply them
+                    // in one go
+                    size_t runEnd = i + 1;
+                    while (runEnd < idxs.size()) {
+                        const SnapshotDiff& next = diffs.at(idxs.at(runEnd));
+                        if (next.getOffset() != end ||
+                            next.getOperation() != diff.getOperation() ||
+                            next.getDataType() != diff.getDataType()) {
+                            break;
+                        }
+
+                        end += next.getData().size();
+                        runEnd++;
+                    }
+
+                    const uint8_t* values = diff.getData().data();
+                    if (runEnd > i + 1) {
+                        gathered.clear();
+                        for (size_t j = i; j < runEnd; j++) {
+                            auto d = diffs.at(idxs.at(j)).getData();
+                            gathered.insert(gathered.end(), d.begin(), d.end());
+                        }
+                        values = gathered.data();
+                    }
+
+                    applyTypedDiffValues(target,
+                                         values,
+                                         end - offset,
+                                         diff.getDataType(),
+                                         diff.getOperation());
+                    i = runEnd;
+                    break;
+                }
+            }
+
+            changes.emplace_back(offset, end);
+        }
+
+        mergeChangeRanges(changes);
+        clusterChanges.at(c) = std::move(changes);
+    };
+
+    int nThreads = getSystemConfig().diffThreads;
+    if (nThreads > 1 && clusters.size() > 1 &&
+        order.size() >= WRITE_DIFFS_PARALLEL_MIN_DIFFS) {
+        std::atomic<size_t> nextCluster = 0;
+        std::mutex errorMx;
+        std::exception_ptr error = nullptr;
+
+        auto runClusters = [&]() {
+            try {
+                for (size_t c = nextCluster++; c < clusters.size();
+                     c = nextCluster++) {
+                    writeCluster(c);
+                }
+            } catch (...) {
+                faabric::util::UniqueLock lock(errorMx);
+                if (error == nullptr) {
+                    error = std::current_exception();
+                }
+                nextCluster = clusters.size();
+            }
+        };
+
+        // The calling thread also writes clusters
+        size_t nWorkers = std::min<size_t>(nThreads, clusters.size());
+        SPDLOG_TRACE("Writing {} diffs in {} clusters on {} threads",
+                     order.size(),
+                     clusters.size(),
+                     nWorkers);
+        getSnapshotWorkerPool().run(nWorkers, runClusters);
+
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        for (size_t c = 0; c < clusters.size(); c++) {
+            writeCluster(c);
+        }
+    }
+
+    for (const auto& changes : clusterChanges) {
+        trackedChanges.insert(
+          trackedChanges.end(), changes.begin(), changes.end());
+    }
+
+    if (!clusters.empty()) {
+        writeCount++;
+    }
+
+    PROF_END(WriteDiffs)
+}
+
 void SnapshotData::applyDiff(const SnapshotDiff& diff)
 {
     if (diff.getOperation() == faabric::util::SnapshotMergeOperation::Ignore) {
@@ -421,80 +1131,242 @@ void SnapshotData::applyDiff(const SnapshotDiff& diff)
         return;
     }
 
-    uint8_t* copyTarget = validatedOffsetPtr(diff.getOffset());
-    switch (diff.getDataType()) {
-        case (faabric::util::SnapshotDataType::Int): {
-            int32_t finalValue =
-              applyDiffValue<int32_t>(validatedOffsetPtr(diff.getOffset()),
-                                      diff.getData().data(),
-                                      diff.getOperation());
+    // Typed diffs hold one or more consecutive values
+    size_t diffEnd = diff.getOffset() + diff.getData().size();
+    if (diffEnd > size) {
+        SPDLOG_ERROR(
+          "Applying snapshot diff exceeding size: {} > {}", diffEnd, size);
+        throw std::runtime_error("Applying diff exceeding size");
+    }
 
-            SPDLOG_TRACE("Writing int {} diff: {} {} -> {}",
-                         snapshotMergeOpStr(diff.getOperation()),
-                         unalignedRead<int32_t>(copyTarget),
-                         unalignedRead<int32_t>(diff.getData().data()),
-                         finalValue);
+    fetchMissingPages(diff.getOffset(), diff.getData().size());
+    preserveVersionPages(diff.getOffset(), diff.getData().size());
 
-            writeData({ BYTES(&finalValue), sizeof(int32_t) },
-                      diff.getOffset());
-            break;
+    SPDLOG_TRACE("Writing {} {} diff of {} bytes at {}",
+                 snapshotDataTypeStr(diff.getDataType()),
+                 snapshotMergeOpStr(diff.getOperation()),
+                 diff.getData().size(),
+                 diff.getOffset());
+
+    applyTypedDiffValues(validatedOffsetPtr(diff.getOffset()),
+                         diff.getData().data(),
+                         diff.getData().size(),
+                         diff.getDataType(),
+                         diff.getOperation());
+
+    trackedChanges.emplace_back(diff.getOffset(), diffEnd);
+    writeCount++;
+}
+
+void SnapshotData::clearTrackedChanges()
+{
+    faabric::util::FullLock lock(snapMx);
+    trackedChanges.clear();
+}
+
+uint64_t SnapshotData::commitVersion()
+{
+    faabric::util::FullLock lock(snapMx);
+
+    versioned = true;
+    if (trackedChanges.empty()) {
+        return version;
+    }
+
+    version++;
+    mergeChangeRanges(trackedChanges);
+    versionChanges[version] = std::move(trackedChanges);
+    trackedChanges.clear();
+
+    SPDLOG_TRACE("Committed snapshot version {} with {} changes",
+                 version,
+                 versionChanges[version].size());
+
+    return version;
+}
+
+uint64_t SnapshotData::getVersion()
+{
+    faabric::util::SharedLock lock(snapMx);
+    return version;
+}
+
+std::vector<SnapshotDiff> SnapshotData::getChangesSinceVersion(
+  uint64_t sinceVersion)
+{
+    faabric::util::SharedLock lock(snapMx);
+    checkVersionReadable(sinceVersion);
+
+    std::vector<std::pair<uint32_t, uint32_t>> changes;
+    for (auto it = versionChanges.upper_bound(sinceVersion);
+         it != versionChanges.end();
+         ++it) {
+        changes.insert(changes.end(), it->second.begin(), it->second.end());
+    }
+    mergeChangeRanges(changes);
+
+    // Changes are bytewise, so the latest committed data is all that's
+    // needed. Pages changed since then are read from their copies, splitting
+    // a change wherever its data stops being contiguous.
+    std::vector<SnapshotDiff> diffs;
+    diffs.reserve(changes.size());
+    for (auto [regionBegin, regionEnd] : changes) {
+        uint32_t runBegin = regionBegin;
+        const uint8_t* runData = nullptr;
+        for (uint32_t pos = regionBegin; pos < regionEnd;) {
+            size_t page = pos / HOST_PAGE_SIZE;
+            const uint8_t* posData =
+              getVersionPagePtr(version, page) + (pos % HOST_PAGE_SIZE);
+
+            if (runData == nullptr) {
+                runData = posData;
+            } else if (runData + (pos - runBegin) != posData) {
+                diffs.emplace_back(
+                  SnapshotDataType::Raw,
+                  SnapshotMergeOperation::Bytewise,
+                  runBegin,
+                  std::span<const uint8_t>(runData, pos - runBegin));
+                runBegin = pos;
+                runData = posData;
+            }
+
+            pos = std::min<size_t>(regionEnd, (page + 1) * HOST_PAGE_SIZE);
         }
-        case (faabric::util::SnapshotDataType::Long): {
-            long finalValue =
-              applyDiffValue<long>(validatedOffsetPtr(diff.getOffset()),
-                                   diff.getData().data(),
-                                   diff.getOperation());
 
-            SPDLOG_TRACE("Writing long {} diff: {} {} -> {}",
-                         snapshotMergeOpStr(diff.getOperation()),
-                         unalignedRead<long>(copyTarget),
-                         unalignedRead<long>(diff.getData().data()),
-                         finalValue);
+        diffs.emplace_back(
+          SnapshotDataType::Raw,
+          SnapshotMergeOperation::Bytewise,
+          runBegin,
+          std::span<const uint8_t>(runData, regionEnd - runBegin));
+    }
 
-            writeData({ BYTES(&finalValue), sizeof(long) }, diff.getOffset());
-            break;
+    return diffs;
+}
+
+std::vector<uint8_t> SnapshotData::getVersionDataCopy(uint64_t atVersion)
+{
+    faabric::util::SharedLock lock(snapMx);
+    checkVersionReadable(atVersion);
+
+    fetchMissingPages(0, size);
+
+    std::vector<uint8_t> result(data.get(), data.get() + size);
+    for (size_t page = 0; page < getRequiredHostPages(size); page++) {
+        const uint8_t* pageData = getVersionPagePtr(atVersion, page);
+        size_t pageOffset = page * HOST_PAGE_SIZE;
+        if (pageData != data.get() + pageOffset) {
+            size_t pageLength =
+              std::min<size_t>(HOST_PAGE_SIZE, size - pageOffset);
+            std::memcpy(result.data() + pageOffset, pageData, pageLength);
         }
-        case (faabric::util::SnapshotDataType::Float): {
-            float finalValue =
-              applyDiffValue<float>(validatedOffsetPtr(diff.getOffset()),
-                                    diff.getData().data(),
-                                    diff.getOperation());
+    }
 
-            SPDLOG_TRACE("Writing float {} diff: {} {} -> {}",
-                         snapshotMergeOpStr(diff.getOperation()),
-                         unalignedRead<float>(copyTarget),
-                         unalignedRead<float>(diff.getData().data()),
-                         finalValue);
+    return result;
+}
 
-            writeData({ BYTES(&finalValue), sizeof(float) }, diff.getOffset());
-            break;
+void SnapshotData::mapVersionToMemory(std::span<uint8_t> target,
+                                      uint64_t atVersion)
+{
+    PROF_START(MapSnapshotVersion)
+    faabric::util::SharedLock lock(snapMx);
+    checkVersionReadable(atVersion);
+    doMapVersionToMemory(target, atVersion);
+    PROF_END(MapSnapshotVersion)
+}
+
+void SnapshotData::mapCommittedToMemory(std::span<uint8_t> target)
+{
+    PROF_START(MapSnapshotVersion)
+    faabric::util::SharedLock lock(snapMx);
+    doMapVersionToMemory(target, version);
+    PROF_END(MapSnapshotVersion)
+}
+
+void SnapshotData::doMapVersionToMemory(std::span<uint8_t> target,
+                                        uint64_t atVersion)
+{
+    doMapToMemory(target);
+
+    // Only the first copy of each page after the version holds its contents
+    std::unordered_set<size_t> restored;
+    for (auto it = versionPages.upper_bound(atVersion);
+         it != versionPages.end();
+         ++it) {
+        for (const auto& [page, pageData] : it->second) {
+            size_t pageOffset = page * HOST_PAGE_SIZE;
+            if (pageOffset >= target.size() || !restored.insert(page).second) {
+                continue;
+            }
+
+            size_t pageLength =
+              std::min<size_t>(pageData.size(), target.size() - pageOffset);
+            std::memcpy(
+              target.data() + pageOffset, pageData.data(), pageLength);
         }
-        case (faabric::util::SnapshotDataType::Double): {
-            double finalValue =
-              applyDiffValue<double>(validatedOffsetPtr(diff.getOffset()),
-                                     diff.getData().data(),
-                                     diff.getOperation());
+    }
+}
 
-            SPDLOG_TRACE("Writing double {} diff: {} {} -> {}",
-                         snapshotMergeOpStr(diff.getOperation()),
-                         unalignedRead<double>(copyTarget),
-                         unalignedRead<double>(diff.getData().data()),
-                         finalValue);
+void SnapshotData::checkVersionReadable(uint64_t atVersion)
+{
+    if (atVersion < prunedVersion) {
+        SPDLOG_ERROR("Snapshot version {} has been pruned (up to {})",
+                     atVersion,
+                     prunedVersion);
+        throw std::runtime_error("Snapshot version has been pruned");
+    }
 
-            writeData({ BYTES(&finalValue), sizeof(double) }, diff.getOffset());
-            break;
+    if (atVersion > version) {
+        SPDLOG_ERROR(
+          "Snapshot version {} not committed (at {})", atVersion, version);
+        throw std::runtime_error("Snapshot version not committed");
+    }
+}
+
+const uint8_t* SnapshotData::getVersionPagePtr(uint64_t atVersion, size_t page)
+{
+    for (auto it = versionPages.upper_bound(atVersion);
+         it != versionPages.end();
+         ++it) {
+        auto pageIt = it->second.find(page);
+        if (pageIt != it->second.end()) {
+            return pageIt->second.data();
         }
-        default: {
-            SPDLOG_ERROR("Unsupported data type: {}", diff.getDataType());
-            throw std::runtime_error("Unsupported merge data type");
+    }
+
+    return data.get() + (page * HOST_PAGE_SIZE);
+}
+
+void SnapshotData::preserveVersionPages(uint32_t offset, size_t length)
+{
+    if (!versioned || length == 0) {
+        return;
+    }
+
+    auto& pages = versionPages[version + 1];
+    for (size_t page = offset / HOST_PAGE_SIZE;
+         page < getRequiredHostPages(offset + length);
+         page++) {
+        if (!pages.contains(page)) {
+            const uint8_t* pageData = data.get() + (page * HOST_PAGE_SIZE);
+            pages.try_emplace(page, pageData, pageData + HOST_PAGE_SIZE);
         }
     }
 }
 
-void SnapshotData::clearTrackedChanges()
+void SnapshotData::pruneVersions(uint64_t upToVersion)
 {
     faabric::util::FullLock lock(snapMx);
-    trackedChanges.clear();
+
+    upToVersion = std::min(upToVersion, version);
+    if (upToVersion <= prunedVersion) {
+        return;
+    }
+
+    versionChanges.erase(versionChanges.begin(),
+                         versionChanges.upper_bound(upToVersion));
+    versionPages.erase(versionPages.begin(),
+                       versionPages.upper_bound(upToVersion));
+    prunedVersion = upToVersion;
 }
 
 std::vector<faabric::util::SnapshotDiff> SnapshotData::getTrackedChanges()
@@ -523,7 +1395,7 @@ std::vector<faabric::util::SnapshotDiff> SnapshotData::getTrackedChanges()
 
 std::vector<faabric::util::SnapshotDiff> SnapshotData::diffWithDirtyRegions(
   std::span<uint8_t> updated,
-  const std::vector<char>& dirtyRegions)
+  const DirtyPages& dirtyRegions)
 {
     faabric::util::SharedLock lock(snapMx);
 
@@ -546,14 +1418,20 @@ std::vector<faabric::util::SnapshotDiff> SnapshotData::diffWithDirtyRegions(
 
     // Check to see if we can skip with no dirty regions
     PROF_START(DiffDirtySkip)
-    if (dirtyRegions.empty() ||
-        (std::find(dirtyRegions.begin(), dirtyRegions.end(), 1) ==
-         dirtyRegions.end())) {
+    if (!dirtyRegions.any()) {
         SPDLOG_TRACE("No dirty pages, no diffs");
         return diffs;
     }
     PROF_END(DiffDirtySkip)
 
+    // Dirty pages have been accessed so will usually have been fetched already
+    if (nMissingPages > 0) {
+        for (auto [startPage, endPage] : dirtyRegions.getRanges()) {
+            fetchMissingPages(startPage * HOST_PAGE_SIZE,
+                              (endPage - startPage) * HOST_PAGE_SIZE);
+        }
+    }
+
     // Check to see if we can skip with no merge regions
     if (mergeRegions.empty()) {
         SPDLOG_TRACE("No merge regions, no diffs");
@@ -566,17 +1444,128 @@ std::vector<faabric::util::SnapshotDiff> SnapshotData::diffWithDirtyRegions(
     std::sort(mergeRegions.begin(), mergeRegions.end());
 
     // Iterate through merge regions, allow them to add diffs based on the
-    // dirty regions
+    // dirty regions. If there are lots of dirty pages we split the work across
+    // threads, unless merge regions overlap, in which case the order in which
+    // they update the data matters.
     std::span<const uint8_t> original(data.get(), size);
     std::span<uint8_t> updatedOverlap = updated.subspan(0, size);
-    for (auto& mr : mergeRegions) {
-        mr.addDiffs(diffs, original, updatedOverlap, dirtyRegions);
+
+    int nThreads = getSystemConfig().diffThreads;
+    size_t nDirtyPages = dirtyRegions.count();
+    if (nThreads > 1 && nDirtyPages >= DIFF_PARALLEL_MIN_DIRTY_PAGES &&
+        !mergeRegionsOverlap(mergeRegions, size)) {
+        diffRegionsInParallel(
+          diffs, original, updatedOverlap, dirtyRegions, nThreads);
+    } else {
+        for (auto& mr : mergeRegions) {
+            mr.addDiffs(diffs, original, updatedOverlap, dirtyRegions);
+        }
     }
 
     PROF_END(DiffWithSnapshot)
     return diffs;
 }
 
+void SnapshotData::diffRegionsInParallel(
+  std::vector<SnapshotDiff>& diffs,
+  std::span<const uint8_t> original,
+  std::span<uint8_t> updated,
+  const DirtyPages& dirtyRegions,
+  int nThreads)
+{
+    PROF_START(ParallelDiff)
+
+    // Split the merge regions into tasks, in the order they'd be diffed
+    // serially. Bytewise, XOR and array regions are split into runs of pages,
+    // whereas other regions hold a single value so make up a task on their
+    // own.
+    struct DiffTask
+    {
+        SnapshotMergeRegion* region;
+        size_t fromPage;
+        size_t toPage;
+    };
+
+    std::vector<DiffTask> tasks;
+    for (auto& mr : mergeRegions) {
+        if (mr.operation == SnapshotMergeOperation::Ignore ||
+            mr.offset > original.size()) {
+            continue;
+        }
+
+        if (mr.operation != SnapshotMergeOperation::Bytewise &&
+            mr.operation != SnapshotMergeOperation::XOR &&
+            !mr.isTypedArray()) {
+            tasks.push_back({ &mr, 0, std::numeric_limits<size_t>::max() });
+            continue;
+        }
+
+        uint32_t mrEnd =
+          mr.length > 0 ? mr.offset + mr.length : original.size();
+        mrEnd = std::min<uint32_t>(mrEnd, original.size());
+
+        size_t startPage = getRequiredHostPagesRoundDown(mr.offset);
+        size_t endPage = getRequiredHostPages(mrEnd);
+        for (size_t p = startPage; p < endPage; p += DIFF_TASK_PAGES) {
+            tasks.push_back(
+              { &mr, p, std::min<size_t>(p + DIFF_TASK_PAGES, endPage) });
+        }
+    }
+
+    // Each task adds its diffs to its own list, threads pick up the next
+    // unclaimed task until there are none left
+    std::vector<std::vector<SnapshotDiff>> taskDiffs(tasks.size());
+    std::atomic<size_t> nextTask = 0;
+    std::mutex errorMx;
+    std::exception_ptr error = nullptr;
+
+    auto runTasks = [&]() {
+        try {
+            for (size_t t = nextTask++; t < tasks.size(); t = nextTask++) {
+                DiffTask& task = tasks.at(t);
+                task.region->addDiffs(taskDiffs.at(t),
+                                      original,
+                                      updated,
+                                      dirtyRegions,
+                                      task.fromPage,
+                                      task.toPage);
+            }
+        } catch (...) {
+            // Keep the first error and stop the other threads early
+            faabric::util::UniqueLock lock(errorMx);
+            if (error == nullptr) {
+                error = std::current_exception();
+            }
+            nextTask = tasks.size();
+        }
+    };
+
+    // The calling thread also runs tasks
+    size_t nWorkers = std::min<size_t>(nThreads, tasks.size());
+    SPDLOG_TRACE("Diffing {} tasks on {} threads", tasks.size(), nWorkers);
+    getSnapshotWorkerPool().run(nWorkers, runTasks);
+
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+
+    // Merge the diffs in task order, which keeps them in offset order and
+    // makes the result identical to diffing on a single thread
+    size_t nDiffs = diffs.size();
+    for (const auto& td : taskDiffs) {
+        nDiffs += td.size();
+    }
+    diffs.reserve(nDiffs);
+
+    for (auto& td : taskDiffs) {
+        diffs.insert(diffs.end(),
+                     std::make_move_iterator(td.begin()),
+                     std::make_move_iterator(td.end()));
+    }
+
+    PROF_END(ParallelDiff)
+}
+
 std::string snapshotDataTypeStr(SnapshotDataType dt)
 {
     switch (dt) {
@@ -649,10 +1638,148 @@ SnapshotMergeRegion::SnapshotMergeRegion(uint32_t offsetIn,
   , operation(operationIn)
 {}
 
+// Size of a single value of the given type, zero for untyped data
+static size_t snapshotDataTypeSize(SnapshotDataType dataType)
+{
+    switch (dataType) {
+        case (SnapshotDataType::Int):
+            return sizeof(int32_t);
+        case (SnapshotDataType::Long):
+            return sizeof(long);
+        case (SnapshotDataType::Float):
+            return sizeof(float);
+        case (SnapshotDataType::Double):
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+bool SnapshotMergeRegion::isTypedArray() const
+{
+    if (operation == SnapshotMergeOperation::Bytewise ||
+        operation == SnapshotMergeOperation::XOR ||
+        operation == SnapshotMergeOperation::Ignore) {
+        return false;
+    }
+
+    size_t valueSize = snapshotDataTypeSize(dataType);
+    return valueSize > 0 && length > valueSize;
+}
+
+// Diffs the values of a typed region that start on the pages in
+// [startPage, endPage), emitting a diff for each run of changed values. A
+// value is only checked if it starts or ends on a dirty page.
+template<typename T>
+static void addTypedDiffs(std::vector<SnapshotDiff>& diffs,
+                          const SnapshotMergeRegion& mr,
+                          size_t nValues,
+                          std::span<const uint8_t> originalData,
+                          std::span<uint8_t> updatedData,
+                          const DirtyPages& dirtyRegions,
+                          size_t startPage,
+                          size_t endPage)
+{
+    constexpr size_t valueSize = sizeof(T);
+    constexpr size_t blockValues = DIFF_BLOCK_SIZE / valueSize;
+    static_assert(DIFF_BLOCK_SIZE % valueSize == 0);
+
+    const uint8_t* original = originalData.data() + mr.offset;
+    uint8_t* updated = updatedData.data() + mr.offset;
+
+    // First value starting at or after the given byte offset in the data
+    auto firstValueFrom = [&](size_t byteOffset) {
+        if (byteOffset <= mr.offset) {
+            return (size_t)0;
+        }
+
+        return std::min(nValues,
+                        (byteOffset - mr.offset + valueSize - 1) / valueSize);
+    };
+
+    auto isDirty = [&dirtyRegions](size_t p) {
+        return dirtyRegions.isDirty(p);
+    };
+
+    size_t p = startPage;
+    while (p < endPage) {
+        // Skip to the page before the next dirty one
+        if (!isDirty(p) && !isDirty(p + 1)) {
+            size_t nextDirty = dirtyRegions.nextDirty(p + 2);
+            if (nextDirty == dirtyRegions.size()) {
+                break;
+            }
+
+            p = nextDirty - 1;
+            continue;
+        }
+
+        // Check values starting on this run of pages in one go
+        size_t runEndPage = p + 1;
+        while (runEndPage < endPage &&
+               (isDirty(runEndPage) || isDirty(runEndPage + 1))) {
+            runEndPage++;
+        }
+
+        size_t v = firstValueFrom(p * HOST_PAGE_SIZE);
+        size_t endValue = firstValueFrom(runEndPage * HOST_PAGE_SIZE);
+        p = runEndPage;
+
+        while (v < endValue) {
+            // Skip whole blocks of unchanged values
+            while (v + blockValues <= endValue &&
+                   diffBlockMask(original + v * valueSize,
+                                 updated + v * valueSize) == 0) {
+                v += blockValues;
+            }
+
+            while (v < endValue &&
+                   unalignedRead<T>(original + v * valueSize) ==
+                     unalignedRead<T>(updated + v * valueSize)) {
+                v++;
+            }
+
+            if (v == endValue) {
+                break;
+            }
+
+            size_t runStart = v;
+            while (v < endValue &&
+                   unalignedRead<T>(original + v * valueSize) !=
+                     unalignedRead<T>(updated + v * valueSize)) {
+                v++;
+            }
+
+            size_t runOffset = runStart * valueSize;
+            size_t runLength = (v - runStart) * valueSize;
+            calculateDiffValues<T>(original + runOffset,
+                                   updated + runOffset,
+                                   v - runStart,
+                                   mr.operation);
+
+            SPDLOG_TRACE("Adding {} {} merge of {} values at {}",
+                         snapshotDataTypeStr(mr.dataType),
+                         snapshotMergeOpStr(mr.operation),
+                         v - runStart,
+                         mr.offset + runOffset);
+
+            // Data here does not need to be owned by the snapshot diff object,
+            // as it's been changed in place above
+            diffs.emplace_back(mr.dataType,
+                               mr.operation,
+                               mr.offset + runOffset,
+                               std::span<const uint8_t>(updated + runOffset,
+                                                        runLength));
+        }
+    }
+}
+
 void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
                                    std::span<const uint8_t> originalData,
                                    std::span<uint8_t> updatedData,
-                                   const std::vector<char>& dirtyRegions)
+                                   const DirtyPages& dirtyRegions,
+                                   size_t fromPage,
+                                   size_t toPage)
 {
     if (operation == SnapshotMergeOperation::Ignore) {
         return;
@@ -680,6 +1807,24 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
     size_t startPage = getRequiredHostPagesRoundDown(offset);
     size_t endPage = getRequiredHostPages(mrEnd);
 
+    // Only diff the requested pages of bytewise, XOR and array regions. A
+    // value in an array starting on the last requested page may end on the
+    // next one, so that page's dirtiness matters too.
+    size_t dirtyEndPage = endPage;
+    bool typedArray = isTypedArray();
+    if (operation == SnapshotMergeOperation::Bytewise ||
+        operation == SnapshotMergeOperation::XOR || typedArray) {
+        startPage = std::max(startPage, fromPage);
+        if (toPage < endPage) {
+            endPage = toPage;
+            dirtyEndPage = typedArray ? toPage + 1 : toPage;
+        }
+
+        if (startPage >= endPage) {
+            return;
+        }
+    }
+
     SPDLOG_TRACE("Checking {} {} merge {}-{} over pages {}-{}",
                  snapshotDataTypeStr(dataType),
                  snapshotMergeOpStr(operation),
@@ -688,12 +1833,9 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
                  startPage,
                  endPage - 1);
 
-    // Check if anything dirty in the given region (std::find range is
-    // exclusive)
-    auto startIt = dirtyRegions.begin() + startPage;
-    auto endIt = dirtyRegions.begin() + endPage;
-    auto foundIt = std::find(startIt, endIt, 1);
-    if (foundIt == endIt) {
+    // Check if anything dirty in the given region
+    size_t firstDirtyPage = dirtyRegions.nextDirty(startPage);
+    if (firstDirtyPage >= dirtyEndPage) {
         SPDLOG_TRACE("No dirty pages for {} {} {}-{} ({})",
                      snapshotDataTypeStr(dataType),
                      snapshotMergeOpStr(operation),
@@ -702,23 +1844,21 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
                      mrEnd);
         return;
     }
-    startPage += std::distance(startIt, foundIt);
 
-    // Seems to be quicker to access this via a raw ptr
-    const char* dirtyRegionsPtr = dirtyRegions.data();
+    // Typed values may start on the page before the first dirty one
+    size_t typedStartPage = startPage;
+    startPage = firstDirtyPage;
+
+    const uint32_t diffMergeGap = getSystemConfig().diffMergeGap;
 
     // Bytewise and XOR both deal with overwriting bytes without any
     // other logic. Bytewise will filter in only the modified bytes,
     // whereas XOR will transmit the XOR of the whole page and the original
     if (operation == SnapshotMergeOperation::Bytewise ||
         operation == SnapshotMergeOperation::XOR) {
-        // Iterate through pages
-        for (int p = startPage; p < endPage; p++) {
-            // Skip if page not dirty
-            if (dirtyRegionsPtr[p] == 0) {
-                continue;
-            }
-
+        // Iterate through dirty pages
+        for (size_t p = startPage; p < endPage;
+             p = dirtyRegions.nextDirty(p + 1)) {
             // Stop at merge region boundaries, making sure we don't start
             // checking before the merge region offset, or go over the merge
             // region end on the final page (may not be page-aligned)
@@ -729,8 +1869,12 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
             SPDLOG_TRACE("Checking page {} {}-{}", p, startByte, endByte);
 
             if (operation == SnapshotMergeOperation::Bytewise) {
-                diffArrayRegions(
-                  diffs, startByte, endByte, originalData, updatedData);
+                diffArrayRegions(diffs,
+                                 startByte,
+                                 endByte,
+                                 originalData,
+                                 updatedData,
+                                 diffMergeGap);
             } else {
                 uint32_t rangeSize = endByte - startByte;
                 std::transform(originalData.begin() + startByte,
@@ -756,53 +1900,52 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
         return;
     }
 
-    uint8_t* updated = updatedData.data() + offset;
-    const uint8_t* original = originalData.data() + offset;
-
-    bool changed = false;
+    // Typed regions hold a single value, or an array of them
+    size_t valueSize = snapshotDataTypeSize(dataType);
+    size_t nValues = typedArray ? (mrEnd - offset) / valueSize : 1;
     switch (dataType) {
         case (SnapshotDataType::Int): {
-            int preUpdate = unalignedRead<int>(updated);
-            changed = calculateDiffValue<int>(original, updated, operation);
-
-            SPDLOG_TRACE("Calculated int {} merge: {} {} -> {}",
-                         snapshotMergeOpStr(operation),
-                         preUpdate,
-                         unalignedRead<int>(original),
-                         unalignedRead<int>(updated));
+            addTypedDiffs<int32_t>(diffs,
+                                   *this,
+                                   nValues,
+                                   originalData,
+                                   updatedData,
+                                   dirtyRegions,
+                                   typedStartPage,
+                                   endPage);
             break;
         }
         case (SnapshotDataType::Long): {
-            long preUpdate = unalignedRead<long>(updated);
-            changed = calculateDiffValue<long>(original, updated, operation);
-
-            SPDLOG_TRACE("Calculated long {} merge: {} {} -> {}",
-                         snapshotMergeOpStr(operation),
-                         preUpdate,
-                         unalignedRead<long>(original),
-                         unalignedRead<long>(updated));
+            addTypedDiffs<long>(diffs,
+                                *this,
+                                nValues,
+                                originalData,
+                                updatedData,
+                                dirtyRegions,
+                                typedStartPage,
+                                endPage);
             break;
         }
         case (SnapshotDataType::Float): {
-            float preUpdate = unalignedRead<float>(updated);
-            changed = calculateDiffValue<float>(original, updated, operation);
-
-            SPDLOG_TRACE("Calculated float {} merge: {} {} -> {}",
-                         snapshotMergeOpStr(operation),
-                         preUpdate,
-                         unalignedRead<float>(original),
-                         unalignedRead<float>(updated));
+            addTypedDiffs<float>(diffs,
+                                 *this,
+                                 nValues,
+                                 originalData,
+                                 updatedData,
+                                 dirtyRegions,
+                                 typedStartPage,
+                                 endPage);
             break;
         }
         case (SnapshotDataType::Double): {
-            double preUpdate = unalignedRead<double>(updated);
-            changed = calculateDiffValue<double>(original, updated, operation);
-
-            SPDLOG_TRACE("Calculated double {} merge: {} {} -> {}",
-                         snapshotMergeOpStr(operation),
-                         preUpdate,
-                         unalignedRead<double>(original),
-                         unalignedRead<double>(updated));
+            addTypedDiffs<double>(diffs,
+                                  *this,
+                                  nValues,
+                                  originalData,
+                                  updatedData,
+                                  dirtyRegions,
+                                  typedStartPage,
+                                  endPage);
             break;
         }
         default: {
@@ -812,14 +1955,5 @@ void SnapshotMergeRegion::addDiffs(std::vector<SnapshotDiff>& diffs,
             throw std::runtime_error("Unsupported merge op combination");
         }
     }
-
-    // Add the diff. Data here does not need to be owned by the snapshot diff
-    // object, as it's been changed in place above
-    if (changed) {
-        diffs.emplace_back(dataType,
-                           operation,
-                           offset,
-                           std::span<const uint8_t>(updated, length));
-    }
 }
 }
@@ -2,6 +2,7 @@
 
 #include "faabric_utils.h"
 
+#include <sched.h>
 #include <sys/mman.h>
 
 #include <faabric/proto/faabric.pb.h>
@@ -18,8 +19,12 @@
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/memory.h>
+#include <faabric/util/numa.h>
 #include <faabric/util/testing.h>
 
+#include <cstring>
+#include <set>
+
 using namespace faabric::scheduler;
 using namespace faabric::util;
 
@@ -30,6 +35,7 @@ namespace tests {
 
 std::atomic<int> restoreCount = 0;
 std::atomic<int> resetCount = 0;
+std::string zygoteVersion;
 
 TestExecutor::TestExecutor(faabric::MessageInBatch msg)
   : Executor(std::move(msg))
@@ -55,6 +61,11 @@ size_t TestExecutor::getMaxMemorySize()
     return maxMemorySize;
 }
 
+std::string TestExecutor::getZygoteVersion()
+{
+    return zygoteVersion;
+}
+
 void TestExecutor::restore(const std::string& snapshotKey)
 {
     if (dummyMemory == nullptr) {
@@ -201,6 +212,11 @@ int32_t TestExecutor::executeTask(
         return 0;
     }
 
+    if (msg.function() == "cpu-check") {
+        msg.set_outputdata(std::to_string(::sched_getcpu()));
+        return getNumaNode();
+    }
+
     if (msg.function() == "error") {
         throw std::runtime_error("This is a test error");
     }
@@ -292,6 +308,7 @@ class TestExecutorFixture
 
         restoreCount = 0;
         resetCount = 0;
+        zygoteVersion = "";
     }
 
     ~TestExecutorFixture() = default;
@@ -1178,6 +1195,17 @@ TEST_CASE_METHOD(TestExecutorFixture, "Test executor restore", "[executor]")
     REQUIRE(actualDataA == dataA);
     REQUIRE(actualDataB == dataB);
 
+    // Only pages written after restoring are copied
+    REQUIRE(exec->getRestoredDirtyPageCount() == 0);
+    memViewAfter[offsetA] = 7;
+    memViewAfter[offsetA + 1] = 7;
+    memViewAfter[offsetB] = 7;
+    REQUIRE(exec->getRestoredDirtyPageCount() == 2);
+
+    exec->restore(snapKey);
+    REQUIRE(exec->getRestoredDirtyPageCount() == 0);
+    REQUIRE(memViewAfter[offsetA] == dataA.at(0));
+
     exec->shutdown();
 }
 
@@ -1249,4 +1277,213 @@ TEST_CASE_METHOD(TestExecutorFixture,
     testExec->shutdown();
 }
 
+TEST_CASE_METHOD(TestExecutorFixture,
+                 "Test initialising executors from zygotes",
+                 "[executor]")
+{
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    std::string zygoteKey = faabric::util::getZygoteSnapshotKey(msg);
+
+    std::shared_ptr<faabric::scheduler::ExecutorFactory> fac =
+      faabric::scheduler::getExecutorFactory();
+    auto createExecutor = [&fac, &msg]() {
+        faabric::Message m = msg;
+        return fac->createExecutor(faabric::MessageInBatch(m));
+    };
+
+    // Data written to the memory as if by the first initialisation
+    std::vector<uint8_t> data = { 1, 2, 3, 4 };
+    size_t offset = 2 * HOST_PAGE_SIZE;
+
+    SECTION("Zygotes disabled")
+    {
+        conf.zygoteSnapshots = 0;
+
+        auto exec = createExecutor();
+        REQUIRE(!exec->initialise());
+        REQUIRE(resetCount == 1);
+        REQUIRE(!reg.snapshotExists(zygoteKey));
+
+        exec->shutdown();
+    }
+
+    SECTION("Zygotes enabled")
+    {
+        conf.zygoteSnapshots = 1;
+
+        // The first executor is reset, and its memory captured
+        auto execA = createExecutor();
+        std::span<uint8_t> memA = execA->getMemoryView();
+        std::copy(data.begin(), data.end(), memA.begin() + offset);
+
+        REQUIRE(!execA->initialise());
+        REQUIRE(resetCount == 1);
+        REQUIRE(reg.snapshotExists(zygoteKey));
+
+        // Later executors map it rather than resetting
+        auto execB = createExecutor();
+        REQUIRE(execB->initialise());
+        REQUIRE(resetCount == 1);
+
+        std::span<uint8_t> memB = execB->getMemoryView();
+        std::vector<uint8_t> actual(memB.begin() + offset,
+                                    memB.begin() + offset + data.size());
+        REQUIRE(actual == data);
+
+        // Writes are copy-on-write, so don't change the zygote
+        REQUIRE(execB->getRestoredDirtyPageCount() == 0);
+        memB[offset] = 9;
+        REQUIRE(execB->getRestoredDirtyPageCount() == 1);
+        REQUIRE(reg.getSnapshot(zygoteKey)->getDataPtr(offset)[0] ==
+                data.at(0));
+
+        // Changing the function's binary invalidates the zygote
+        zygoteVersion = "v2";
+        auto execC = createExecutor();
+        REQUIRE(!execC->initialise());
+        REQUIRE(resetCount == 2);
+
+        auto execD = createExecutor();
+        REQUIRE(execD->initialise());
+        REQUIRE(resetCount == 2);
+
+        // As does invalidating it directly
+        sch.invalidateZygote(msg);
+        REQUIRE(!reg.snapshotExists(zygoteKey));
+
+        auto execE = createExecutor();
+        REQUIRE(!execE->initialise());
+        REQUIRE(resetCount == 3);
+
+        for (auto& e : { execA, execB, execC, execD, execE }) {
+            e->shutdown();
+        }
+    }
+}
+
+TEST_CASE_METHOD(TestExecutorFixture,
+                 "Test placing executors on NUMA nodes",
+                 "[executor]")
+{
+    const CpuTopology& topology = getCpuTopology();
+
+    int nMessages = 2;
+    int expectedNode = -1;
+    std::vector<int> expectedCpus = topology.getCpus();
+
+    SECTION("Placement off") { conf.numaPlacement = 0; }
+
+    SECTION("Placement on")
+    {
+        conf.numaPlacement = 1;
+
+        SECTION("Node pinning") { conf.threadPinning = "node"; }
+
+        SECTION("Core pinning") { conf.threadPinning = "core"; }
+
+        // With nothing running, the batch goes on the first node that fits it
+        for (const auto& node : topology.nodes) {
+            if (node.cpus.size() >= nMessages) {
+                expectedNode = node.id;
+                expectedCpus = node.cpus;
+                break;
+            }
+        }
+
+        if (expectedNode < 0) {
+            expectedNode = topology.nodes.at(0).id;
+            expectedCpus = topology.nodes.at(0).cpus;
+        }
+    }
+
+    std::shared_ptr<BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("dummy", "cpu-check", nMessages);
+    executeWithTestExecutor(req, true);
+
+    std::set<int> usedCpus;
+    for (const auto& m : req->messages()) {
+        faabric::Message res =
+          sch.getFunctionResult(m.id(), SHORT_TEST_TIMEOUT_MS);
+        REQUIRE(res.returnvalue() == expectedNode);
+
+        int cpu = std::stoi(res.outputdata());
+        REQUIRE(std::find(expectedCpus.begin(), expectedCpus.end(), cpu) !=
+                expectedCpus.end());
+        usedCpus.insert(cpu);
+    }
+
+    // With core pinning, each executor gets a core of its own while the node
+    // has enough of them
+    int nExecutors = sch.getFunctionExecutorCount(req->messages().at(0));
+    if (conf.threadPinning == "core" && nExecutors == nMessages &&
+        expectedCpus.size() >= nMessages) {
+        REQUIRE(usedCpus.size() == nMessages);
+    }
+}
+
+// Executor whose initialisation writes all of its memory, as instantiating a
+// module with large data segments would
+class SlowInitExecutor final : public Executor
+{
+  public:
+    SlowInitExecutor(faabric::MessageInBatch msg, size_t memSizeIn)
+      : Executor(std::move(msg))
+      , memSize(memSizeIn)
+      , memory(allocatePrivateMemory(memSizeIn))
+    {}
+
+    void reset(faabric::Message& msg) override
+    {
+        for (size_t i = 0; i < memSize; i += sizeof(size_t)) {
+            size_t value = i * 7;
+            std::memcpy(memory.get() + i, &value, sizeof(size_t));
+        }
+    }
+
+    std::span<uint8_t> getMemoryView() override
+    {
+        return { memory.get(), memSize };
+    }
+
+  protected:
+    void setMemorySize(size_t newSize) override {}
+
+  private:
+    size_t memSize;
+
+    MemoryRegion memory;
+};
+
+TEST_CASE_METHOD(TestExecutorFixture,
+                 "Benchmark executor creation with and without zygotes",
+                 "[.][benchmark]")
+{
+    // Creates and initialises executors, run with:
+    // faabric_tests "Benchmark executor creation with and without zygotes"
+    faabric::Message msg = faabric::util::messageFactory("demo", "zygote");
+
+    for (size_t memSize : { 4UL << 20, 64UL << 20 }) {
+        for (int zygotes : { 0, 1 }) {
+            conf.zygoteSnapshots = zygotes;
+
+            // The first initialisation captures the zygote
+            faabric::Message firstMsg = msg;
+            SlowInitExecutor first(faabric::MessageInBatch(firstMsg), memSize);
+            first.initialise();
+            first.shutdown();
+
+            BENCHMARK(fmt::format(
+              "{}MiB, zygotes {}", memSize >> 20, zygotes ? "on" : "off"))
+            {
+                faabric::Message m = msg;
+                SlowInitExecutor exec(faabric::MessageInBatch(m), memSize);
+                bool fromZygote = exec.initialise();
+                exec.shutdown();
+                return fromZygote;
+            };
+
+            sch.invalidateZygote(msg);
+        }
+    }
+}
 }
@@ -5,6 +5,7 @@
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/util/func.h>
 #include <faabric/util/memory.h>
+#include <faabric/util/memory_pressure.h>
 
 using namespace faabric::scheduler;
 
@@ -12,6 +13,7 @@ namespace tests {
 
 class SchedulerReapingTestFixture
   : public SchedulerTestFixture
+  , public SnapshotTestFixture
   , public ConfTestFixture
 {
   public:
@@ -86,4 +88,183 @@ TEST_CASE_METHOD(SchedulerReapingTestFixture,
         REQUIRE(sch.getFunctionExecutorCount(firstMsg) == nMsgs);
     }
 }
+
+TEST_CASE_METHOD(SchedulerReapingTestFixture,
+                 "Test evicting executors and snapshots under memory pressure",
+                 "[scheduler]")
+{
+    conf.memoryEvictionUsagePercent = 90;
+    conf.memoryEvictionStallPercent = 20;
+
+    // An unpinned snapshot, which is used least recently, and a pinned one
+    std::string evictableKey = "evictable";
+    std::string pinnedKey = "pinned";
+    int snapPages = 2;
+    size_t snapSize = snapPages * faabric::util::HOST_PAGE_SIZE;
+    setUpSnapshot(evictableKey, snapPages);
+    setUpSnapshot(pinnedKey, snapPages);
+    reg.pinSnapshot(pinnedKey);
+
+    SLEEP_MS(10);
+
+    // Set up some executors and wait for them to go idle
+    int nMsgs = 3;
+    auto req = faabric::util::batchExecFactory("foo", "bar", nMsgs);
+    faabric::Message firstMsg = req->messages().at(0);
+    sch.callFunctions(req);
+    SLEEP_MS(500);
+
+    REQUIRE(sch.getFunctionExecutorCount(firstMsg) == nMsgs);
+
+    // The usage limit is 900 pages
+    faabric::util::MemoryPressure pressure;
+    pressure.limitBytes = 1000 * faabric::util::HOST_PAGE_SIZE;
+
+    int expectedEvicted = 0;
+    int expectedExecutors = nMsgs;
+    bool expectSnapshotEvicted = false;
+
+    SECTION("No pressure")
+    {
+        pressure.usageBytes = 500 * faabric::util::HOST_PAGE_SIZE;
+        pressure.someStallPercent = 10;
+    }
+
+    SECTION("Stalls only")
+    {
+        pressure.usageBytes = 500 * faabric::util::HOST_PAGE_SIZE;
+        pressure.someStallPercent = 30;
+
+        expectedEvicted = 1;
+        expectSnapshotEvicted = true;
+    }
+
+    SECTION("Over the usage limit by the snapshot's size")
+    {
+        pressure.usageBytes = 900 * faabric::util::HOST_PAGE_SIZE + snapSize;
+
+        expectedEvicted = 1;
+        expectSnapshotEvicted = true;
+    }
+
+    SECTION("Over the usage limit by more than there is to evict")
+    {
+        pressure.usageBytes = 999 * faabric::util::HOST_PAGE_SIZE;
+
+        expectedEvicted = nMsgs + 1;
+        expectedExecutors = 0;
+        expectSnapshotEvicted = true;
+    }
+
+    REQUIRE(sch.evictForMemoryPressure(pressure) == expectedEvicted);
+
+    REQUIRE(sch.getFunctionExecutorCount(firstMsg) == expectedExecutors);
+    REQUIRE(reg.snapshotExists(evictableKey) == !expectSnapshotEvicted);
+    REQUIRE(reg.snapshotExists(pinnedKey));
+
+    MemoryStats stats = sch.getMemoryStats();
+    REQUIRE(stats.nExecutors == expectedExecutors);
+    REQUIRE(stats.nSnapshots == (expectSnapshotEvicted ? 1 : 2));
+    REQUIRE(stats.snapshotBytes == stats.nSnapshots * snapSize);
+    REQUIRE(stats.pressure.usageBytes == pressure.usageBytes);
+    REQUIRE(stats.evictedExecutors == nMsgs - expectedExecutors);
+    REQUIRE(stats.evictedSnapshots == (expectSnapshotEvicted ? 1 : 0));
+    REQUIRE(stats.evictedBytes == (expectSnapshotEvicted ? snapSize : 0));
+}
+
+TEST_CASE_METHOD(SchedulerReapingTestFixture,
+                 "Test pre-warming executors ahead of calls",
+                 "[scheduler]")
+{
+    conf.prewarmMinExecutors = 1;
+    conf.prewarmMaxExecutors = 4;
+    conf.prewarmIntervalSeconds = 1;
+
+    faabric::Message msg = faabric::util::messageFactory("foo", "bar");
+    REQUIRE(sch.getArrivalRate(msg) == 0);
+    REQUIRE(sch.getPrewarmTarget(msg) == 0);
+
+    // Make some calls and wait for them to finish
+    int nMsgs = 3;
+    auto req = faabric::util::batchExecFactory("foo", "bar", nMsgs);
+    sch.callFunctions(req);
+    SLEEP_MS(500);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == nMsgs);
+
+    // Reap all the executors, as no target has been set yet
+    conf.boundTimeout = 10;
+    REQUIRE(sch.reapStaleExecutors() == nMsgs);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == 0);
+
+    // Pre-warming creates executors for the expected calls
+    int nCreated = sch.prewarmExecutors();
+    int target = sch.getPrewarmTarget(msg);
+    REQUIRE(sch.getArrivalRate(msg) > 0);
+    REQUIRE(target >= conf.prewarmMinExecutors);
+    REQUIRE(target <= conf.prewarmMaxExecutors);
+    REQUIRE(nCreated == target);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == target);
+
+    // Already enough executors, and the target only falls without calls
+    SLEEP_MS(100);
+    REQUIRE(sch.prewarmExecutors() == 0);
+    REQUIRE(sch.getPrewarmTarget(msg) <= target);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == target);
+
+    // The next call uses a pre-warmed executor
+    auto reqB = faabric::util::batchExecFactory("foo", "bar", 1);
+    sch.callFunctions(reqB);
+    SLEEP_MS(500);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == target);
+
+    // Reaping keeps the executors needed for the current target
+    int currentTarget = sch.getPrewarmTarget(msg);
+    REQUIRE(sch.reapStaleExecutors() == target - currentTarget);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == currentTarget);
+}
+
+TEST_CASE_METHOD(SchedulerReapingTestFixture,
+                 "Test threaded functions aren't pre-warmed",
+                 "[scheduler]")
+{
+    conf.prewarmMinExecutors = 1;
+    conf.prewarmMaxExecutors = 4;
+    conf.prewarmIntervalSeconds = 1;
+
+    // Call the main thread, which then spawns some threads
+    auto req = faabric::util::batchExecFactory("foo", "bar", 1);
+    faabric::Message msg = req->messages().at(0);
+    sch.callFunctions(req);
+    SLEEP_MS(500);
+
+    auto threadsReq = faabric::util::batchExecFactory("foo", "bar", 2);
+    threadsReq->set_type(faabric::BatchExecuteRequest::THREADS);
+    sch.callFunctions(threadsReq);
+    SLEEP_MS(500);
+
+    // Further calls to the main thread aren't counted
+    auto reqB = faabric::util::batchExecFactory("foo", "bar", 1);
+    sch.callFunctions(reqB);
+    SLEEP_MS(500);
+
+    REQUIRE(sch.getArrivalRate(msg) == 0);
+    REQUIRE(sch.prewarmExecutors() == 0);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == 1);
+}
+
+TEST_CASE_METHOD(SchedulerReapingTestFixture,
+                 "Test pre-warming disabled",
+                 "[scheduler]")
+{
+    REQUIRE(conf.prewarmMaxExecutors == 0);
+
+    auto req = faabric::util::batchExecFactory("foo", "bar", 2);
+    faabric::Message msg = req->messages().at(0);
+    sch.callFunctions(req);
+    SLEEP_MS(500);
+
+    REQUIRE(sch.prewarmExecutors() == 0);
+    REQUIRE(sch.getArrivalRate(msg) == 0);
+    REQUIRE(sch.getFunctionExecutorCount(msg) == 2);
+}
 }
@@ -150,6 +150,57 @@ TEST_CASE_METHOD(ClientServerFixture,
     faabric::scheduler::clearMockRequests();
 }
 
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test sending function updated message",
+                 "[scheduler]")
+{
+    faabric::snapshot::SnapshotRegistry& reg =
+      faabric::snapshot::getSnapshotRegistry();
+
+    faabric::Message msg = faabric::util::messageFactory("dummy", "foo");
+    std::string zygoteKey = faabric::util::getZygoteSnapshotKey(msg);
+
+    auto zygote = std::make_shared<faabric::util::SnapshotData>(
+      faabric::util::HOST_PAGE_SIZE);
+    sch.registerZygote(msg, "v1", zygote);
+    REQUIRE(sch.getZygote(msg, "v1") != nullptr);
+
+    // The function's zygote is dropped when it's updated
+    server.setRequestLatch();
+    cli.sendFunctionUpdated(msg);
+    server.awaitRequestLatch();
+
+    REQUIRE(!reg.snapshotExists(zygoteKey));
+    REQUIRE(sch.getZygote(msg, "v1") == nullptr);
+}
+
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test broadcasting function updated message",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    std::string hostA = "alpha";
+    std::string hostB = "beta";
+    sch.addHostToGlobalSet(hostA);
+    sch.addHostToGlobalSet(hostB);
+
+    faabric::Message msg = faabric::util::messageFactory("dummy", "foo");
+    sch.broadcastFunctionUpdated(msg);
+
+    auto calls = faabric::scheduler::getFunctionUpdatedCalls();
+    std::set<std::string> actualHosts;
+    for (const auto& [host, calledMsg] : calls) {
+        REQUIRE(calledMsg.function() == msg.function());
+        actualHosts.insert(host);
+    }
+
+    REQUIRE(actualHosts == std::set<std::string>{ hostA, hostB });
+
+    faabric::util::setMockMode(false);
+    faabric::scheduler::clearMockRequests();
+}
+
 TEST_CASE_METHOD(ClientServerFixture,
                  "Test client batch execution request",
                  "[scheduler]")
@@ -176,6 +227,65 @@ TEST_CASE_METHOD(ClientServerFixture,
     REQUIRE(sch.getRecordedMessagesShared().empty());
 }
 
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test batch execution request with piggybacked mappings",
+                 "[scheduler]")
+{
+    int nCalls = 2;
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", nCalls);
+
+    int appId = req->messages().at(0).appid();
+    faabric::util::SchedulingDecision decision(appId, groupId);
+    for (int i = 0; i < nCalls; i++) {
+        faabric::Message& m = req->mutable_messages()->at(i);
+        m.set_groupid(groupId);
+        m.set_groupidx(i);
+        m.set_groupsize(nCalls);
+        decision.addMessage(LOCALHOST, m);
+    }
+
+    *req->mutable_mappings() = decision.toPointToPointMappings();
+
+    cli.executeFunctions(req);
+
+    for (const auto& m : req->messages()) {
+        sch.getFunctionResult(m.id(), 5 * SHORT_TEST_TIMEOUT_MS);
+    }
+
+    // Check the mappings have been set up on receipt of the request
+    faabric::transport::PointToPointBroker& broker =
+      faabric::transport::getPointToPointBroker();
+    REQUIRE(broker.getIdxsRegisteredForGroup(groupId).size() == nCalls);
+    REQUIRE(broker.getHostForReceiver(groupId, 0) == LOCALHOST);
+    REQUIRE(broker.getHostForReceiver(groupId, 1) == LOCALHOST);
+}
+
+TEST_CASE_METHOD(ClientServerFixture,
+                 "Test control calls use the priority lane",
+                 "[scheduler]")
+{
+    REQUIRE(server.hasPriorityLane());
+
+    // Resource requests go on the priority lane
+    cli.getResources();
+    REQUIRE(server.getSyncStats(true).nMessages == 1);
+    REQUIRE(server.getSyncStats(false).nMessages == 0);
+
+    // Batches stay on the main lane
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("foo", "bar", 1);
+
+    server.setRequestLatch();
+    cli.executeFunctions(req);
+    server.awaitRequestLatch();
+
+    sch.getFunctionResult(req->messages().at(0).id(), SHORT_TEST_TIMEOUT_MS);
+
+    REQUIRE(server.getAsyncStats(false).nMessages == 1);
+    REQUIRE(server.getAsyncStats(true).nMessages == 0);
+}
+
 TEST_CASE_METHOD(ClientServerFixture,
                  "Test get resources request",
                  "[scheduler]")
@@ -226,6 +226,8 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
     size_t snapSize = 2 * faabric::util::HOST_PAGE_SIZE;
     auto snap = std::make_shared<faabric::util::SnapshotData>(snapSize);
 
+    bool isLazy = false;
+
     SECTION("Threads")
     {
         execMode = faabric::BatchExecuteRequest::THREADS;
@@ -235,6 +237,18 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
         expectedContextData = "thread context";
     }
 
+    SECTION("Threads with lazy snapshots")
+    {
+        execMode = faabric::BatchExecuteRequest::THREADS;
+        expectedSnapshot = faabric::util::getMainThreadSnapshotKey(firstMsg);
+
+        expectedSubType = 123;
+        expectedContextData = "thread context";
+
+        conf.snapshotRestoreMode = "lazy";
+        isLazy = true;
+    }
+
     SECTION("Processes")
     {
         execMode = faabric::BatchExecuteRequest::PROCESSES;
@@ -325,7 +339,12 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
     REQUIRE(resRequestsOne.at(0).first == otherHost);
 
     // Check snapshots have been pushed
-    auto snapshotPushes = faabric::snapshot::getSnapshotPushes();
+    auto snapshotPushes = isLazy ? faabric::snapshot::getLazySnapshotPushes()
+                                 : faabric::snapshot::getSnapshotPushes();
+    if (isLazy) {
+        REQUIRE(faabric::snapshot::getSnapshotPushes().empty());
+    }
+
     if (expectedSnapshot.empty()) {
         REQUIRE(snapshotPushes.empty());
     } else {
@@ -439,6 +458,18 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test batch scheduling", "[scheduler]")
 
     // Check the request to the other host
     REQUIRE(pTwo.second->messages_size() == nCallsTwo - thisCores);
+
+    // Hosts a snapshot was pushed to lazily are sent its deletion even once
+    // they're no longer registered for the function
+    if (isLazy) {
+        sch.removeRegisteredHost(otherHost, m.user(), m.function());
+        sch.broadcastSnapshotDelete(m, expectedSnapshot);
+
+        std::vector<std::pair<std::string, std::string>> expectedDeletes = {
+            { otherHost, expectedSnapshot }
+        };
+        REQUIRE(faabric::snapshot::getSnapshotDeletes() == expectedDeletes);
+    }
 }
 
 TEST_CASE_METHOD(SlowExecutorFixture,
@@ -579,6 +610,69 @@ TEST_CASE_METHOD(SlowExecutorFixture, "Test unregistering host", "[scheduler]")
     REQUIRE(sch.getFunctionRegisteredHostCount(msg) == 0);
 }
 
+TEST_CASE_METHOD(SlowExecutorFixture,
+                 "Test snapshot versions pruned after unregistering host",
+                 "[scheduler]")
+{
+    faabric::util::setMockMode(true);
+
+    std::string otherHost = "beta";
+    sch.addHostToGlobalSet(otherHost);
+
+    int nCores = 5;
+    faabric::HostResources res;
+    res.set_slots(nCores);
+    sch.setThisHostResources(res);
+
+    std::string snapKey = "procSnap";
+    auto snap = std::make_shared<faabric::util::SnapshotData>(
+      2 * faabric::util::HOST_PAGE_SIZE);
+    reg.registerSnapshot(snapKey, snap);
+
+    std::vector<uint8_t> update(10, 1);
+    auto runBatch = [&](int nCalls) {
+        snap->copyInData(update);
+        update.at(0)++;
+
+        auto req = faabric::util::batchExecFactory("foo", "bar", nCalls);
+        req->set_type(faabric::BatchExecuteRequest::PROCESSES);
+        for (auto& m : *req->mutable_messages()) {
+            m.set_snapshotkey(snapKey);
+        }
+
+        if (nCalls > nCores) {
+            faabric::scheduler::queueResourceResponse(otherHost, res);
+        }
+        sch.callFunctions(req);
+
+        for (int i = 0; i < std::min(nCalls, nCores); i++) {
+            sch.getFunctionResult(req->messages().at(i).id(), 10000);
+        }
+
+        return req->messages().at(0);
+    };
+
+    // Other host is sent the snapshot, so holds the first version
+    faabric::Message msg = runBatch(nCores + 1);
+    REQUIRE(snap->getVersion() == 1);
+    REQUIRE(faabric::snapshot::getSnapshotPushes().size() == 1);
+
+    // Once it's unregistered, older versions aren't kept for it
+    sch.removeRegisteredHost(otherHost, msg.user(), msg.function());
+    runBatch(nCores);
+    REQUIRE(snap->getVersion() == 2);
+    REQUIRE_THROWS(snap->getChangesSinceVersion(1));
+
+    // If it comes back, it's sent the snapshot in full
+    faabric::snapshot::clearMockSnapshotRequests();
+    runBatch(nCores + 1);
+
+    auto pushes = faabric::snapshot::getSnapshotPushes();
+    REQUIRE(pushes.size() == 1);
+    REQUIRE(pushes.at(0).first == otherHost);
+    REQUIRE(faabric::snapshot::getSnapshotDiffPushes().empty());
+}
+
 TEST_CASE_METHOD(SlowExecutorFixture, "Check test mode", "[scheduler]")
 {
     faabric::Message msgA = faabric::util::messageFactory("demo", "echo");
@@ -1038,15 +1132,22 @@ TEST_CASE_METHOD(DummyExecutorFixture,
         REQUIRE(registeredIdxs.empty());
     }
 
-    // Check mappings sent or not
-    std::vector<std::pair<std::string, faabric::PointToPointMappings>>
-      sentMappings = faabric::transport::getSentMappings();
+    // Check mappings are never sent separately, and are piggybacked on the
+    // batch request to the other host when needed
+    REQUIRE(faabric::transport::getSentMappings().empty());
 
+    auto batchRequests = faabric::scheduler::getBatchRequests();
     if (expectMappingsSent) {
-        REQUIRE(sentMappings.size() == 1);
-        REQUIRE(sentMappings.at(0).first == otherHost);
+        REQUIRE(batchRequests.size() == 1);
+        REQUIRE(batchRequests.at(0).first == otherHost);
+
+        const auto& sentMappings = batchRequests.at(0).second->mappings();
+        REQUIRE(sentMappings.groupid() == groupId);
+        REQUIRE(sentMappings.mappings_size() == 4);
     } else {
-        REQUIRE(sentMappings.empty());
+        for (const auto& p : batchRequests) {
+            REQUIRE(!p.second->has_mappings());
+        }
     }
 
     // Wait for the functions on this host to complete
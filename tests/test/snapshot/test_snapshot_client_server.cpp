@@ -5,9 +5,12 @@
 
 #include <sys/mman.h>
 
+#include <faabric/flat/faabric_generated.h>
+#include <faabric/snapshot/SnapshotApi.h>
 #include <faabric/snapshot/SnapshotClient.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/snapshot/SnapshotServer.h>
+#include <faabric/transport/FlatBufferMessageBuilder.h>
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/environment.h>
@@ -130,6 +133,69 @@ TEST_CASE_METHOD(SnapshotClientServerFixture,
     REQUIRE(actualDataB == dataB);
 }
 
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test pushing snapshots with shared pages",
+                 "[snapshot]")
+{
+    // Snapshot A has three distinct pages, B has two of A's pages, one of
+    // them twice, and one new partial page
+    std::string snapKeyA = "foo";
+    std::string snapKeyB = "bar";
+
+    std::vector<std::vector<uint8_t>> pages;
+    for (int i = 0; i < 4; i++) {
+        pages.emplace_back(HOST_PAGE_SIZE, i + 1);
+    }
+    pages.back().resize(100);
+
+    auto joinPages = [&pages](std::vector<int> idxs) {
+        std::vector<uint8_t> data;
+        for (int i : idxs) {
+            data.insert(data.end(), pages.at(i).begin(), pages.at(i).end());
+        }
+        return data;
+    };
+
+    std::vector<uint8_t> dataA = joinPages({ 0, 1, 2 });
+    std::vector<uint8_t> dataB = joinPages({ 2, 0, 2, 3 });
+
+    auto snapA = std::make_shared<SnapshotData>(dataA);
+    auto snapB = std::make_shared<SnapshotData>(dataB);
+
+    cli.pushSnapshot(snapKeyA, snapA);
+
+    REQUIRE(reg.getStoredPageCount() == 3);
+    REQUIRE(reg.getSnapshot(snapKeyA)->getDataCopy() == dataA);
+
+    SECTION("Stored pages unchanged") {}
+
+    SECTION("Stored page changed")
+    {
+        // Modify a page B shares with A on the receiving side, so it can't be
+        // reused
+        std::vector<uint8_t> update(10, 9);
+        reg.getSnapshot(snapKeyA)->copyInData(update, 2 * HOST_PAGE_SIZE);
+    }
+
+    cli.pushSnapshot(snapKeyB, snapB);
+
+    REQUIRE(reg.getSnapshotCount() == 2);
+    REQUIRE(reg.getSnapshot(snapKeyB)->getDataCopy() == dataB);
+
+    // Pages are shared between the two
+    REQUIRE(reg.getStoredPageCount() == 4);
+    REQUIRE(reg.getStoredPageRefCount(hashSnapshotPage(pages.at(0))) == 2);
+    REQUIRE(reg.getStoredPageRefCount(hashSnapshotPage(pages.at(1))) == 1);
+    REQUIRE(reg.getStoredPageRefCount(hashSnapshotPage(pages.at(2))) == 3);
+    REQUIRE(reg.getStoredPageRefCount(hashSnapshotPage(pages.at(3))) == 1);
+
+    // Deleting a snapshot drops its pages
+    cli.deleteSnapshot(snapKeyA);
+    REQUIRE_RETRY({}, reg.getSnapshotCount() == 1);
+    REQUIRE(reg.getStoredPageCount() == 2);
+    REQUIRE(reg.getStoredPageRefCount(hashSnapshotPage(pages.at(2))) == 2);
+}
+
 void checkDiffsApplied(const uint8_t* snapBase, std::vector<SnapshotDiff> diffs)
 {
     for (auto& d : diffs) {
@@ -416,6 +482,264 @@ TEST_CASE_METHOD(SnapshotClientServerFixture,
     sch.deregisterThread(msgId);
 }
 
+class SnapshotClientServerConfFixture
+  : public SnapshotClientServerFixture
+  , public ConfTestFixture
+{};
+
+TEST_CASE_METHOD(SnapshotClientServerConfFixture,
+                 "Test compressed snapshot transfers",
+                 "[snapshot]")
+{
+    conf.snapshotCompressionMinSize = 64;
+
+    SECTION("Per-diff compression") { conf.snapshotCompression = "diff"; }
+
+    SECTION("Whole message compression")
+    {
+        conf.snapshotCompression = "message";
+    }
+
+    SECTION("Fixed level")
+    {
+        conf.snapshotCompression = "diff";
+        conf.snapshotCompressionLevel = 5;
+    }
+
+    // Compressible snapshot data, with each page different
+    int snapPages = 10;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+    std::vector<uint8_t> data(snapSize, 0);
+    for (int p = 0; p < snapPages; p++) {
+        std::fill_n(data.begin() + (p * HOST_PAGE_SIZE) + 100, 50, p + 1);
+    }
+
+    std::string snapKey = std::to_string(generateGid());
+    auto snap = std::make_shared<SnapshotData>(data);
+    cli.pushSnapshot(snapKey, snap);
+
+    auto actualSnap = reg.getSnapshot(snapKey);
+    REQUIRE(actualSnap->getDataCopy() == data);
+
+    // Updates with diffs above and below the minimum size
+    std::vector<uint8_t> largeDiffData(2 * HOST_PAGE_SIZE, 7);
+    std::vector<uint8_t> smallDiffData = { 1, 2, 3 };
+
+    SnapshotDiff largeDiff(SnapshotDataType::Raw,
+                           SnapshotMergeOperation::Bytewise,
+                           HOST_PAGE_SIZE,
+                           largeDiffData);
+    SnapshotDiff smallDiff(SnapshotDataType::Raw,
+                           SnapshotMergeOperation::Bytewise,
+                           5 * HOST_PAGE_SIZE + 3,
+                           smallDiffData);
+
+    std::vector<SnapshotDiff> diffs = { largeDiff, smallDiff };
+    cli.pushSnapshotUpdate(snapKey, snap, diffs);
+
+    std::copy(largeDiffData.begin(),
+              largeDiffData.end(),
+              data.begin() + HOST_PAGE_SIZE);
+    std::copy(smallDiffData.begin(),
+              smallDiffData.end(),
+              data.begin() + 5 * HOST_PAGE_SIZE + 3);
+    REQUIRE(actualSnap->getDataCopy() == data);
+
+    // Thread results, whose diffs are written after the request has been
+    // handled
+    int baseValue = 10;
+    int diffValue = 5;
+    uint32_t intOffset = 8 * HOST_PAGE_SIZE;
+    actualSnap->copyInData({ BYTES(&baseValue), sizeof(int) }, intOffset);
+
+    std::vector<uint8_t> otherDiffData(HOST_PAGE_SIZE, 9);
+    SnapshotDiff otherDiff(SnapshotDataType::Raw,
+                           SnapshotMergeOperation::Bytewise,
+                           3 * HOST_PAGE_SIZE,
+                           otherDiffData);
+    SnapshotDiff intDiff(SnapshotDataType::Int,
+                         SnapshotMergeOperation::Sum,
+                         intOffset,
+                         valueToBytes<int>(diffValue));
+
+    int msgId = 456;
+    int returnValue = 22;
+    sch.registerThread(msgId);
+    cli.pushThreadResult(msgId, returnValue, snapKey, { otherDiff, intDiff });
+
+    REQUIRE(sch.awaitThreadResult(msgId) == returnValue);
+
+    REQUIRE(actualSnap->writeQueuedDiffs() == 2);
+    std::copy(otherDiffData.begin(),
+              otherDiffData.end(),
+              data.begin() + 3 * HOST_PAGE_SIZE);
+    int expectedValue = baseValue + diffValue;
+    std::copy_n(BYTES(&expectedValue), sizeof(int), data.begin() + intOffset);
+    REQUIRE(actualSnap->getDataCopy() == data);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerConfFixture,
+                 "Test pushing snapshots in chunks",
+                 "[snapshot]")
+{
+    // Small chunks, which don't line up with the end of the snapshot
+    conf.snapshotPushChunkSize = 3 * HOST_PAGE_SIZE;
+
+    SECTION("Uncompressed") { conf.snapshotCompression = "none"; }
+
+    SECTION("Compressed")
+    {
+        conf.snapshotCompression = "diff";
+        conf.snapshotCompressionMinSize = 64;
+    }
+
+    // Every page different, with a partial page at the end
+    int snapPages = 10;
+    size_t snapSize = (snapPages * HOST_PAGE_SIZE) + 100;
+    std::vector<uint8_t> dataA(snapSize, 0);
+    for (int p = 0; p <= snapPages; p++) {
+        std::fill_n(dataA.begin() + (p * HOST_PAGE_SIZE), 10, p + 1);
+    }
+
+    auto snapA = std::make_shared<SnapshotData>(dataA, 2 * snapSize);
+    snapA->addMergeRegion(
+      100, sizeof(int), SnapshotDataType::Int, SnapshotMergeOperation::Sum);
+
+    std::string keyA = "foo";
+    cli.pushSnapshot(keyA, snapA);
+
+    REQUIRE(server.getPendingPushCount() == 0);
+
+    auto actualA = reg.getSnapshot(keyA);
+    REQUIRE(actualA->getSize() == snapSize);
+    REQUIRE(actualA->getMaxSize() == 2 * snapSize);
+    REQUIRE(actualA->getDataCopy() == dataA);
+    REQUIRE(actualA->getMergeRegions().size() == 1);
+    REQUIRE(actualA->getMergeRegions().at(0).offset == 100);
+
+    // Another snapshot sharing most of its pages with the first, and with a
+    // repeated page, so that only some pages need sending
+    std::vector<uint8_t> dataB(dataA);
+    std::fill_n(dataB.begin() + (2 * HOST_PAGE_SIZE), 10, 50);
+    std::fill_n(dataB.begin() + (7 * HOST_PAGE_SIZE), 10, 60);
+    std::copy_n(dataB.begin() + (2 * HOST_PAGE_SIZE),
+                HOST_PAGE_SIZE,
+                dataB.begin() + (5 * HOST_PAGE_SIZE));
+
+    auto snapB = std::make_shared<SnapshotData>(dataB);
+
+    // Only two distinct pages are missing, so make sure they're still chunked
+    conf.snapshotPushChunkSize = HOST_PAGE_SIZE;
+
+    std::string keyB = "bar";
+    cli.pushSnapshot(keyB, snapB);
+
+    REQUIRE(server.getPendingPushCount() == 0);
+    REQUIRE(reg.getSnapshot(keyB)->getDataCopy() == dataB);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerConfFixture,
+                 "Test abandoned snapshot pushes expire",
+                 "[snapshot]")
+{
+    // Begin a push that's never committed, as if the client had failed
+    std::vector<SnapshotPageHash> hashes(1);
+    size_t hashesSize = hashes.size() * sizeof(SnapshotPageHash);
+
+    faabric::transport::FlatBufferMessageBuilder mb;
+    auto keyOffset = mb.CreateString("foo");
+    auto mrsOffset =
+      mb.CreateVector<flatbuffers::Offset<SnapshotMergeRegionRequest>>({});
+    auto hashesOffset =
+      mb.CreateVector<uint8_t>(BYTES_CONST(hashes.data()), hashesSize);
+    auto requestOffset = CreateSnapshotPushBeginRequest(mb,
+                                                        generateGid(),
+                                                        keyOffset,
+                                                        HOST_PAGE_SIZE,
+                                                        HOST_PAGE_SIZE,
+                                                        mrsOffset,
+                                                        hashesOffset);
+    mb.Finish(requestOffset);
+
+    faabric::EmptyResponse response;
+    cli.syncSend(faabric::snapshot::SnapshotCalls::PushSnapshotBegin,
+                 mb.releaseMessage(),
+                 &response);
+
+    REQUIRE(server.getPendingPushCount() == 1);
+
+    // Pushes that have been idle for longer than the timeout are dropped
+    conf.snapshotPushTimeoutMs = 0;
+    REQUIRE(server.getPendingPushCount() == 0);
+}
+
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test measuring snapshot link throughput",
+                 "[snapshot]")
+{
+    faabric::snapshot::clearSnapshotLinkThroughputs();
+    REQUIRE(faabric::snapshot::getSnapshotLinkThroughput(LOCALHOST) == 0);
+
+    // Small pushes aren't measured
+    auto smallSnap = std::make_shared<SnapshotData>(HOST_PAGE_SIZE);
+    cli.pushSnapshot("small", smallSnap);
+    REQUIRE(faabric::snapshot::getSnapshotLinkThroughput(LOCALHOST) == 0);
+
+    // Pages must differ to all be sent
+    int snapPages = 32;
+    std::vector<uint8_t> data(snapPages * HOST_PAGE_SIZE, 0);
+    for (int p = 0; p < snapPages; p++) {
+        data.at(p * HOST_PAGE_SIZE) = p + 1;
+    }
+
+    auto largeSnap = std::make_shared<SnapshotData>(data);
+    cli.pushSnapshot("large", largeSnap);
+    REQUIRE(faabric::snapshot::getSnapshotLinkThroughput(LOCALHOST) > 0);
+
+    faabric::snapshot::clearSnapshotLinkThroughputs();
+}
+
+TEST_CASE_METHOD(SnapshotClientServerFixture,
+                 "Test pushing snapshots lazily",
+                 "[snapshot]")
+{
+    int snapPages = 5;
+    size_t snapSize = (snapPages * HOST_PAGE_SIZE) + 10;
+    std::vector<uint8_t> data(snapSize);
+    for (size_t i = 0; i < snapSize; i++) {
+        data.at(i) = (i / HOST_PAGE_SIZE) + 1;
+    }
+
+    auto snap = std::make_shared<SnapshotData>(data, 2 * snapSize);
+    snap->addMergeRegion(
+      123, sizeof(int), SnapshotDataType::Int, SnapshotMergeOperation::Sum);
+
+    // Pages are fetched from the host the snapshot was pushed from
+    std::string sourceKey = "source";
+    reg.registerSnapshot(sourceKey, snap);
+
+    std::vector<uint8_t> actualPages(2 * HOST_PAGE_SIZE);
+    cli.getSnapshotPages(sourceKey, HOST_PAGE_SIZE, actualPages);
+    std::vector<uint8_t> expectedPages(data.begin() + HOST_PAGE_SIZE,
+                                       data.begin() + (3 * HOST_PAGE_SIZE));
+    REQUIRE(actualPages == expectedPages);
+
+    // The last page may be partial
+    std::vector<uint8_t> actualLastPage(10);
+    cli.getSnapshotPages(sourceKey, snapPages * HOST_PAGE_SIZE, actualLastPage);
+    REQUIRE(actualLastPage == std::vector<uint8_t>(10, snapPages + 1));
+
+    // Lazy pushes only send the snapshot's metadata
+    std::string lazyKey = "lazy";
+    cli.pushLazySnapshot(lazyKey, snap);
+
+    auto actual = reg.getSnapshot(lazyKey);
+    REQUIRE(actual->getSize() == snapSize);
+    REQUIRE(actual->getMaxSize() == 2 * snapSize);
+    REQUIRE(actual->getMergeRegions() == snap->getMergeRegions());
+    REQUIRE(actual->getMissingPageCount() == snapPages + 1);
+}
+
 TEST_CASE_METHOD(SnapshotClientServerFixture,
                  "Test set thread result",
                  "[snapshot]")
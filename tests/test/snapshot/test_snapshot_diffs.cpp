@@ -73,7 +73,7 @@ TEST_CASE_METHOD(SnapshotTestFixture,
 
     // Check there are no diffs even though we have dirty regions
     auto dirtyRegions = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyRegions == expected);
+    REQUIRE(dirtyRegions == DirtyPages(expected));
 
     std::vector<SnapshotDiff> changeDiffs =
       snap->diffWithDirtyRegions(memView, dirtyRegions);
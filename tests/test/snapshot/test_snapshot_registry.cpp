@@ -111,4 +111,145 @@ TEST_CASE_METHOD(SnapshotTestFixture,
 {
     REQUIRE_THROWS(reg.getSnapshot(""));
 }
+
+TEST_CASE_METHOD(SnapshotTestFixture,
+                 "Test snapshot registry page store",
+                 "[snapshot]")
+{
+    REQUIRE(reg.getStoredPageCount() == 0);
+
+    // Two snapshots, the second sharing its first page with the first
+    std::string keyA = "snapA";
+    std::string keyB = "snapB";
+    std::vector<uint8_t> pageA(HOST_PAGE_SIZE, 1);
+    std::vector<uint8_t> pageB(HOST_PAGE_SIZE, 2);
+    std::vector<uint8_t> pageC(HOST_PAGE_SIZE, 3);
+
+    std::vector<uint8_t> dataA = pageA;
+    dataA.insert(dataA.end(), pageB.begin(), pageB.end());
+    std::vector<uint8_t> dataB = pageA;
+    dataB.insert(dataB.end(), pageC.begin(), pageC.end());
+
+    auto snapA = std::make_shared<SnapshotData>(dataA);
+    auto snapB = std::make_shared<SnapshotData>(dataB);
+
+    SnapshotPageHash hashA = hashSnapshotPage(pageA);
+    SnapshotPageHash hashB = hashSnapshotPage(pageB);
+    SnapshotPageHash hashC = hashSnapshotPage(pageC);
+
+    REQUIRE(snapA->getPageHashes() ==
+            std::vector<SnapshotPageHash>({ hashA, hashB }));
+    REQUIRE(snapB->getPageHashes() ==
+            std::vector<SnapshotPageHash>({ hashA, hashC }));
+
+    // Can't store pages of unregistered snapshots, or with the wrong number
+    // of hashes
+    REQUIRE_THROWS(reg.registerSnapshotPages(keyA, snapA->getPageHashes()));
+
+    reg.registerSnapshot(keyA, snapA);
+    reg.registerSnapshot(keyB, snapB);
+    REQUIRE_THROWS(reg.registerSnapshotPages(keyA, { hashA }));
+
+    reg.registerSnapshotPages(keyA, snapA->getPageHashes());
+    REQUIRE(reg.getStoredPageCount() == 2);
+    REQUIRE(reg.getMissingPages({ hashA, hashC, hashB }) ==
+            std::vector<int>({ 1 }));
+
+    reg.registerSnapshotPages(keyB, snapB->getPageHashes());
+    REQUIRE(reg.getStoredPageCount() == 3);
+    REQUIRE(reg.getStoredPageRefCount(hashA) == 2);
+    REQUIRE(reg.getStoredPageRefCount(hashB) == 1);
+    REQUIRE(reg.getStoredPageRefCount(hashC) == 1);
+    REQUIRE(reg.getMissingPages({ hashA, hashC, hashB }).empty());
+
+    // Build a new snapshot from the stored pages
+    SnapshotData target(3 * HOST_PAGE_SIZE);
+    REQUIRE(reg.copyStoredPage(hashC, target, 0, HOST_PAGE_SIZE));
+    REQUIRE(reg.copyStoredPage(hashB, target, HOST_PAGE_SIZE, HOST_PAGE_SIZE));
+    REQUIRE(
+      reg.copyStoredPage(hashA, target, 2 * HOST_PAGE_SIZE, HOST_PAGE_SIZE));
+
+    std::vector<uint8_t> expected = pageC;
+    expected.insert(expected.end(), pageB.begin(), pageB.end());
+    expected.insert(expected.end(), pageA.begin(), pageA.end());
+    REQUIRE(target.getDataCopy() == expected);
+
+    // Pages modified since they were stored aren't used
+    std::vector<uint8_t> update(10, 5);
+    snapA->copyInData(update, HOST_PAGE_SIZE);
+    REQUIRE(!reg.copyStoredPage(hashB, target, 0, HOST_PAGE_SIZE));
+
+    // Deleting a snapshot drops its references
+    reg.deleteSnapshot(keyA);
+    REQUIRE(reg.getStoredPageCount() == 2);
+    REQUIRE(reg.getStoredPageRefCount(hashA) == 1);
+    REQUIRE(reg.getStoredPageRefCount(hashB) == 0);
+    REQUIRE(reg.getMissingPages({ hashA, hashB }) == std::vector<int>({ 1 }));
+
+    // As does replacing it
+    reg.registerSnapshot(keyB, std::make_shared<SnapshotData>(dataB));
+    REQUIRE(reg.getStoredPageCount() == 0);
+    REQUIRE(!reg.copyStoredPage(hashA, target, 0, HOST_PAGE_SIZE));
+}
+
+TEST_CASE_METHOD(SnapshotTestFixture,
+                 "Test pinning and evicting snapshots",
+                 "[snapshot]")
+{
+    std::string keyA = "snapA";
+    std::string keyB = "snapB";
+    std::string keyC = "snapC";
+
+    REQUIRE_THROWS(reg.pinSnapshot(keyA));
+
+    // Register and use the snapshots, so that A is used least recently
+    setUpSnapshot(keyA, 1);
+    setUpSnapshot(keyB, 2);
+    setUpSnapshot(keyC, 3);
+    REQUIRE(reg.getTotalSnapshotBytes() == 6 * HOST_PAGE_SIZE);
+
+    SLEEP_MS(10);
+    reg.getSnapshot(keyC);
+    SLEEP_MS(10);
+    reg.getSnapshot(keyB);
+
+    // Pins are counted
+    REQUIRE_THROWS(reg.unpinSnapshot(keyB));
+    reg.pinSnapshot(keyB);
+    reg.pinSnapshot(keyB);
+    REQUIRE(reg.isSnapshotPinned(keyB));
+    reg.unpinSnapshot(keyB);
+    REQUIRE(reg.isSnapshotPinned(keyB));
+
+    // Replacing the snapshot keeps its pins
+    setUpSnapshot(keyB, 2);
+    REQUIRE(reg.isSnapshotPinned(keyB));
+
+    auto evictable = reg.getEvictableSnapshots();
+    REQUIRE(evictable.size() == 2);
+    REQUIRE(evictable.at(0).key == keyA);
+    REQUIRE(evictable.at(0).sizeBytes == HOST_PAGE_SIZE);
+    REQUIRE(evictable.at(1).key == keyC);
+    REQUIRE(evictable.at(1).sizeBytes == 3 * HOST_PAGE_SIZE);
+    REQUIRE(evictable.at(0).idleMillis >= evictable.at(1).idleMillis);
+
+    // Pinned snapshots can't be evicted
+    REQUIRE(!reg.evictSnapshot(keyB));
+    REQUIRE(reg.evictSnapshot(keyA));
+    REQUIRE(!reg.evictSnapshot(keyA));
+    REQUIRE(!reg.snapshotExists(keyA));
+    REQUIRE(reg.tryGetSnapshot(keyA) == nullptr);
+    REQUIRE(reg.tryGetSnapshot(keyB) != nullptr);
+    REQUIRE(reg.getTotalSnapshotBytes() == 5 * HOST_PAGE_SIZE);
+
+    reg.unpinSnapshot(keyB);
+    REQUIRE(!reg.isSnapshotPinned(keyB));
+    REQUIRE(reg.getEvictableSnapshots().size() == 2);
+
+    // Deleting a snapshot drops its pins
+    reg.pinSnapshot(keyC);
+    reg.deleteSnapshot(keyC);
+    setUpSnapshot(keyC, 3);
+    REQUIRE(!reg.isSnapshotPinned(keyC));
+}
 }
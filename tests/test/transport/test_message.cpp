@@ -4,6 +4,9 @@
 
 #include <thread>
 
+#include <faabric/flat/faabric_generated.h>
+#include <faabric/proto/faabric.pb.h>
+#include <faabric/transport/FlatBufferMessageBuilder.h>
 #include <faabric/transport/Message.h>
 #include <faabric/transport/common.h>
 #include <faabric/util/logging.h>
@@ -38,4 +41,58 @@ TEST_CASE("Test message moving", "[transport]")
     REQUIRE(dataPtr[1] == 2);
     REQUIRE(dataPtr[2] == 3);
 }
+
+TEST_CASE("Test serialising protobuf in place", "[transport]")
+{
+    faabric::Message call;
+    call.set_user("foo");
+    call.set_function("bar");
+    call.set_inputdata(std::string(1000, 'a'));
+
+    faabric::transport::Message m =
+      faabric::transport::Message::fromProtobuf(call);
+
+    REQUIRE(m.allData().size() == HEADER_MSG_SIZE + call.ByteSizeLong());
+    REQUIRE(m.udata().size() == call.ByteSizeLong());
+
+    faabric::Message parsed;
+    REQUIRE(parsed.ParseFromArray(m.udata().data(), m.udata().size()));
+    REQUIRE(parsed.user() == "foo");
+    REQUIRE(parsed.function() == "bar");
+    REQUIRE(parsed.inputdata() == call.inputdata());
+}
+
+TEST_CASE("Test building flatbuffers in place", "[transport]")
+{
+    std::string key = "foobar";
+    std::vector<uint8_t> data(5000, 3);
+
+    size_t initialSize = 0;
+    SECTION("Small initial size, buffer regrows") { initialSize = 16; }
+
+    SECTION("Buffer fits") { initialSize = 10000; }
+
+    FlatBufferMessageBuilder mb(initialSize);
+    auto keyOffset = mb.CreateString(key);
+    auto dataOffset = mb.CreateVector<uint8_t>(data.data(), data.size());
+    auto requestOffset =
+      CreateSnapshotPushRequest(mb, keyOffset, 0, dataOffset);
+    mb.Finish(requestOffset);
+
+    size_t expectedSize = mb.GetSize();
+    std::vector<uint8_t> expected(mb.GetBufferPointer(),
+                                  mb.GetBufferPointer() + expectedSize);
+
+    faabric::transport::Message m = mb.releaseMessage();
+
+    REQUIRE(m.allData().size() == HEADER_MSG_SIZE + expectedSize);
+    REQUIRE(m.dataCopy() == expected);
+
+    auto* request =
+      flatbuffers::GetRoot<SnapshotPushRequest>(m.udata().data());
+    REQUIRE(request->key()->str() == key);
+    std::vector<uint8_t> actualData(request->contents()->begin(),
+                                    request->contents()->end());
+    REQUIRE(actualData == data);
+}
 }
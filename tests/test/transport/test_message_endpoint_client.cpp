@@ -331,6 +331,65 @@ TEST_CASE_METHOD(SchedulerTestFixture,
     }
 }
 
+TEST_CASE_METHOD(SchedulerTestFixture,
+                 "Test pipelined async send and recv",
+                 "[transport]")
+{
+    AsyncSendMessageEndpoint src(LOCALHOST, TEST_PORT);
+    AsyncRecvMessageEndpoint dst(TEST_PORT);
+
+    int numMessages = 50;
+    uint8_t dummyHeader = 3;
+
+    // Queue up all the sends without waiting on any of them
+    std::vector<std::future<void>> sendFutures;
+    for (int i = 0; i < numMessages; i++) {
+        std::string msgData = "Message " + std::to_string(i);
+        faabric::transport::Message msg =
+          faabric::transport::Message::allocate(msgData.size());
+        std::copy(msgData.begin(), msgData.end(), msg.data().begin());
+
+        sendFutures.emplace_back(src.sendAsync(dummyHeader, std::move(msg)));
+    }
+
+    for (int i = 0; i < numMessages; i++) {
+        faabric::transport::Message recvMsg = dst.recvAsync().get();
+        REQUIRE(recvMsg.getResponseCode() == MessageResponseCode::SUCCESS);
+        REQUIRE(recvMsg.getMessageCode() == dummyHeader);
+
+        std::string actualMsg(recvMsg.data().begin(), recvMsg.data().end());
+        REQUIRE(actualMsg == "Message " + std::to_string(i));
+    }
+
+    for (auto& f : sendFutures) {
+        REQUIRE_NOTHROW(f.get());
+    }
+}
+
+TEST_CASE_METHOD(SchedulerTestFixture,
+                 "Test async send completion callback",
+                 "[transport]")
+{
+    AsyncSendMessageEndpoint src(LOCALHOST, TEST_PORT);
+    AsyncRecvMessageEndpoint dst(TEST_PORT);
+
+    std::string expectedMsg = "Hello world!";
+    std::promise<int> sendResult;
+
+    faabric::transport::Message msg =
+      faabric::transport::Message::allocate(expectedMsg.size());
+    std::copy(expectedMsg.begin(), expectedMsg.end(), msg.data().begin());
+    src.sendAsync(1, std::move(msg), NO_SEQUENCE_NUM, [&sendResult](int ec) {
+        sendResult.set_value(ec);
+    });
+
+    REQUIRE(sendResult.get_future().get() == 0);
+
+    faabric::transport::Message recvMsg = dst.recv();
+    std::string actualMsg(recvMsg.data().begin(), recvMsg.data().end());
+    REQUIRE(actualMsg == expectedMsg);
+}
+
 #endif // End ThreadSanitizer exclusion
 
 }
@@ -8,6 +8,7 @@
 #include <faabric/transport/MessageEndpointClient.h>
 #include <faabric/transport/MessageEndpointServer.h>
 #include <faabric/transport/common.h>
+#include <faabric/util/config.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/macros.h>
 
@@ -121,6 +122,36 @@ class BlockServer final : public MessageEndpointServer
     std::shared_ptr<faabric::util::Latch> latch = nullptr;
 };
 
+class ConcurrentServer final : public MessageEndpointServer
+{
+  public:
+    ConcurrentServer(int nConcurrent)
+      : MessageEndpointServer(TEST_PORT_ASYNC,
+                              TEST_PORT_SYNC,
+                              "test-concurrent",
+                              2)
+      , latch(faabric::util::Latch::create(nConcurrent))
+    {}
+
+  protected:
+    void doAsyncRecv(transport::Message& message) override
+    {
+        throw std::runtime_error("Concurrent server not expecting async recv");
+    }
+
+    std::unique_ptr<google::protobuf::Message> doSyncRecv(
+      transport::Message& message) override
+    {
+        // Only returns once enough requests are being handled in parallel
+        latch->wait();
+
+        return std::make_unique<faabric::EmptyResponse>();
+    }
+
+  private:
+    std::shared_ptr<faabric::util::Latch> latch = nullptr;
+};
+
 namespace tests {
 
 TEST_CASE("Test sending one message to server", "[transport]")
@@ -359,4 +390,55 @@ TEST_CASE("Test server keeps listening after socket timeout", "[transport]")
 
     server.stop();
 }
+
+TEST_CASE_METHOD(ConfTestFixture,
+                 "Test server scales workers with load",
+                 "[transport]")
+{
+    conf.serverMaxThreads = 4;
+    conf.serverIdleThreadTimeoutMs = 200;
+
+    // Four requests must be handled at once, more than the two workers the
+    // server starts with
+    int nRequests = 4;
+    ConcurrentServer server(nRequests);
+    server.start();
+
+    REQUIRE(server.getSyncStats().nWorkers == 2);
+
+    std::vector<std::jthread> clientThreads;
+    std::atomic<int> nSuccesses = 0;
+    for (int i = 0; i < nRequests; i++) {
+        clientThreads.emplace_back([&nSuccesses] {
+            MessageEndpointClient cli(
+              LOCALHOST, TEST_PORT_ASYNC, TEST_PORT_SYNC);
+
+            std::string msg = "hello";
+            faabric::EmptyResponse response;
+            cli.syncSend(0, BYTES(msg.data()), msg.size(), &response);
+            nSuccesses++;
+        });
+    }
+
+    for (auto& t : clientThreads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+
+    REQUIRE(nSuccesses == nRequests);
+
+    MessageEndpointServerStats stats = server.getSyncStats();
+    REQUIRE(stats.peakWorkers == nRequests);
+    REQUIRE(stats.nMessages == nRequests);
+    REQUIRE(stats.nSaturated > 0);
+    REQUIRE(stats.nBusyWorkers == 0);
+    REQUIRE(stats.maxHandlingUs > 0);
+
+    // Extra workers are retired once idle
+    SLEEP_MS(5 * conf.serverIdleThreadTimeoutMs);
+    REQUIRE(server.getSyncStats().nWorkers == 2);
+
+    server.stop();
+}
 }
@@ -81,6 +81,14 @@ TEST_CASE_METHOD(PointToPointClientServerFixture,
     std::string newHost = "new-host";
     broker.updateHostForIdx(groupIdA, groupIdxA1, newHost);
     REQUIRE(broker.getHostForReceiver(groupIdA, groupIdxA1) == newHost);
+
+    // Test applying a delta to several indexes at once
+    std::string otherNewHost = "other-new-host";
+    broker.updateHostsForIdxs(
+      groupIdA, { { groupIdxA1, otherNewHost }, { groupIdxA2, newHost } });
+    REQUIRE(broker.getHostForReceiver(groupIdA, groupIdxA1) == otherNewHost);
+    REQUIRE(broker.getHostForReceiver(groupIdA, groupIdxA2) == newHost);
+    REQUIRE(broker.getHostForReceiver(groupIdB, groupIdxB1) == hostA);
 }
 
 TEST_CASE_METHOD(PointToPointClientServerFixture,
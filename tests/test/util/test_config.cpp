@@ -24,14 +24,42 @@ TEST_CASE("Test default system config initialisation", "[util]")
     REQUIRE(conf.overrideCpuCount == 0);
     REQUIRE(conf.noTopologyHints == "off");
     REQUIRE(conf.noSingleHostOptimisations == 0);
+    REQUIRE(conf.numaPlacement == 0);
+    REQUIRE(conf.threadPinning == "none");
 
     REQUIRE(conf.globalMessageTimeout == 60000);
     REQUIRE(conf.boundTimeout == 30000);
 
+    REQUIRE(conf.prewarmMinExecutors == 1);
+    REQUIRE(conf.prewarmMaxExecutors == 0);
+    REQUIRE(conf.prewarmIntervalSeconds == 1);
+    REQUIRE(conf.zygoteSnapshots == 0);
+
     REQUIRE(conf.defaultMpiWorldSize == 5);
     REQUIRE(conf.mpiBasePort == 10800);
 
+    REQUIRE(conf.functionServerPriorityThreads == 1);
+    REQUIRE(conf.serverMaxThreads == 8);
+    REQUIRE(conf.serverIdleThreadTimeoutMs == 10000);
+
     REQUIRE(conf.dirtyTrackingMode == "segfault");
+    REQUIRE(conf.diffMergeGap == 0);
+    REQUIRE(conf.diffThreads == 4);
+    REQUIRE(conf.uffdHandlerThreads == 1);
+    REQUIRE(conf.uffdFaultAroundPages == 0);
+
+    REQUIRE(conf.hugePagesMode == "none");
+    REQUIRE(conf.memoryCgroupDir.empty());
+    REQUIRE(conf.memoryEvictionUsagePercent == 0);
+    REQUIRE(conf.memoryEvictionStallPercent == 0);
+
+    REQUIRE(conf.snapshotCompression == "none");
+    REQUIRE(conf.snapshotCompressionMinSize == 4096);
+    REQUIRE(conf.snapshotCompressionLevel == 0);
+    REQUIRE(conf.snapshotPushChunkSize == 64 * 1024 * 1024);
+    REQUIRE(conf.snapshotPushTimeoutMs == 60000);
+    REQUIRE(conf.snapshotRestoreMode == "eager");
+    REQUIRE(conf.snapshotPrefetchPages == 16);
 }
 
 TEST_CASE("Test overriding system config initialisation", "[util]")
@@ -50,20 +78,60 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     std::string overrideCpuCount = setEnvVar("OVERRIDE_CPU_COUNT", "4");
     std::string noTopologyHints = setEnvVar("NO_TOPOLOGY_HINTS", "on");
     std::string noSingleHost = setEnvVar("NO_SINGLE_HOST", "1");
+    std::string numaPlacement = setEnvVar("NUMA_PLACEMENT", "1");
+    std::string threadPinning = setEnvVar("THREAD_PINNING", "core");
 
     std::string globalTimeout = setEnvVar("GLOBAL_MESSAGE_TIMEOUT", "9876");
     std::string boundTimeout = setEnvVar("BOUND_TIMEOUT", "6666");
 
+    std::string prewarmMin = setEnvVar("PREWARM_MIN_EXECUTORS", "2");
+    std::string prewarmMax = setEnvVar("PREWARM_MAX_EXECUTORS", "7");
+    std::string prewarmInterval = setEnvVar("PREWARM_INTERVAL_SECS", "3");
+    std::string zygoteSnapshots = setEnvVar("ZYGOTE_SNAPSHOTS", "1");
+
     std::string functionThreads = setEnvVar("FUNCTION_SERVER_THREADS", "111");
+    std::string functionPriorityThreads =
+      setEnvVar("FUNCTION_SERVER_PRIORITY_THREADS", "11");
     std::string stateThreads = setEnvVar("STATE_SERVER_THREADS", "222");
     std::string snapshotThreads = setEnvVar("SNAPSHOT_SERVER_THREADS", "333");
     std::string pointToPointThreads =
       setEnvVar("POINT_TO_POINT_SERVER_THREADS", "444");
+    std::string serverMaxThreads = setEnvVar("SERVER_MAX_THREADS", "555");
+    std::string serverIdleTimeout =
+      setEnvVar("SERVER_IDLE_THREAD_TIMEOUT_MS", "666");
 
     std::string mpiSize = setEnvVar("DEFAULT_MPI_WORLD_SIZE", "2468");
     std::string mpiPort = setEnvVar("MPI_BASE_PORT", "9999");
 
     std::string dirtyMode = setEnvVar("DIRTY_TRACKING_MODE", "dummy-track");
+    std::string diffMergeGap = setEnvVar("DIFF_MERGE_GAP", "32");
+    std::string diffThreads = setEnvVar("DIFF_THREADS", "7");
+    std::string uffdHandlerThreads = setEnvVar("UFFD_HANDLER_THREADS", "3");
+    std::string uffdFaultAroundPages =
+      setEnvVar("UFFD_FAULT_AROUND_PAGES", "8");
+
+    std::string hugePagesMode = setEnvVar("HUGE_PAGES_MODE", "transparent");
+    std::string memoryCgroupDir =
+      setEnvVar("MEMORY_CGROUP_DIR", "/sys/fs/cgroup/foo");
+    std::string memoryEvictionUsagePercent =
+      setEnvVar("MEMORY_EVICTION_USAGE_PERCENT", "90");
+    std::string memoryEvictionStallPercent =
+      setEnvVar("MEMORY_EVICTION_STALL_PERCENT", "20");
+
+    std::string snapshotCompression =
+      setEnvVar("SNAPSHOT_COMPRESSION", "message");
+    std::string snapshotCompressionMinSize =
+      setEnvVar("SNAPSHOT_COMPRESSION_MIN_SIZE", "123");
+    std::string snapshotCompressionLevel =
+      setEnvVar("SNAPSHOT_COMPRESSION_LEVEL", "5");
+    std::string snapshotPushChunkSize =
+      setEnvVar("SNAPSHOT_PUSH_CHUNK_SIZE", "4096");
+    std::string snapshotPushTimeoutMs =
+      setEnvVar("SNAPSHOT_PUSH_TIMEOUT_MS", "500");
+    std::string snapshotRestoreMode =
+      setEnvVar("SNAPSHOT_RESTORE_MODE", "lazy");
+    std::string snapshotPrefetchPages =
+      setEnvVar("SNAPSHOT_PREFETCH_PAGES", "4");
 
     // Create new conf for test
     SystemConfig conf;
@@ -80,19 +148,46 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     REQUIRE(conf.overrideCpuCount == 4);
     REQUIRE(conf.noTopologyHints == "on");
     REQUIRE(conf.noSingleHostOptimisations == 1);
+    REQUIRE(conf.numaPlacement == 1);
+    REQUIRE(conf.threadPinning == "core");
 
     REQUIRE(conf.globalMessageTimeout == 9876);
     REQUIRE(conf.boundTimeout == 6666);
 
+    REQUIRE(conf.prewarmMinExecutors == 2);
+    REQUIRE(conf.prewarmMaxExecutors == 7);
+    REQUIRE(conf.prewarmIntervalSeconds == 3);
+    REQUIRE(conf.zygoteSnapshots == 1);
+
     REQUIRE(conf.functionServerThreads == 111);
+    REQUIRE(conf.functionServerPriorityThreads == 11);
     REQUIRE(conf.stateServerThreads == 222);
     REQUIRE(conf.snapshotServerThreads == 333);
     REQUIRE(conf.pointToPointServerThreads == 444);
+    REQUIRE(conf.serverMaxThreads == 555);
+    REQUIRE(conf.serverIdleThreadTimeoutMs == 666);
 
     REQUIRE(conf.defaultMpiWorldSize == 2468);
     REQUIRE(conf.mpiBasePort == 9999);
 
     REQUIRE(conf.dirtyTrackingMode == "dummy-track");
+    REQUIRE(conf.diffMergeGap == 32);
+    REQUIRE(conf.diffThreads == 7);
+    REQUIRE(conf.uffdHandlerThreads == 3);
+    REQUIRE(conf.uffdFaultAroundPages == 8);
+
+    REQUIRE(conf.hugePagesMode == "transparent");
+    REQUIRE(conf.memoryCgroupDir == "/sys/fs/cgroup/foo");
+    REQUIRE(conf.memoryEvictionUsagePercent == 90);
+    REQUIRE(conf.memoryEvictionStallPercent == 20);
+
+    REQUIRE(conf.snapshotCompression == "message");
+    REQUIRE(conf.snapshotCompressionMinSize == 123);
+    REQUIRE(conf.snapshotCompressionLevel == 5);
+    REQUIRE(conf.snapshotPushChunkSize == 4096);
+    REQUIRE(conf.snapshotPushTimeoutMs == 500);
+    REQUIRE(conf.snapshotRestoreMode == "lazy");
+    REQUIRE(conf.snapshotPrefetchPages == 4);
 
     // Be careful with host type
     setEnvVar("LOG_LEVEL", logLevel);
@@ -109,19 +204,46 @@ TEST_CASE("Test overriding system config initialisation", "[util]")
     setEnvVar("OVERRIDE_CPU_COUNT", overrideCpuCount);
     setEnvVar("USE_TOPOLOGY_HINTS", noTopologyHints);
     setEnvVar("NO_SINGLE_HOST", noSingleHost);
+    setEnvVar("NUMA_PLACEMENT", numaPlacement);
+    setEnvVar("THREAD_PINNING", threadPinning);
 
     setEnvVar("GLOBAL_MESSAGE_TIMEOUT", globalTimeout);
     setEnvVar("BOUND_TIMEOUT", boundTimeout);
 
+    setEnvVar("PREWARM_MIN_EXECUTORS", prewarmMin);
+    setEnvVar("PREWARM_MAX_EXECUTORS", prewarmMax);
+    setEnvVar("PREWARM_INTERVAL_SECS", prewarmInterval);
+    setEnvVar("ZYGOTE_SNAPSHOTS", zygoteSnapshots);
+
     setEnvVar("FUNCTION_SERVER_THREADS", functionThreads);
+    setEnvVar("FUNCTION_SERVER_PRIORITY_THREADS", functionPriorityThreads);
     setEnvVar("STATE_SERVER_THREADS", stateThreads);
     setEnvVar("SNAPSHOT_SERVER_THREADS", snapshotThreads);
     setEnvVar("POINT_TO_POINT_SERVER_THREADS", pointToPointThreads);
+    setEnvVar("SERVER_MAX_THREADS", serverMaxThreads);
+    setEnvVar("SERVER_IDLE_THREAD_TIMEOUT_MS", serverIdleTimeout);
 
     setEnvVar("DEFAULT_MPI_WORLD_SIZE", mpiSize);
     setEnvVar("MPI_BASE_PORT", mpiPort);
 
     setEnvVar("DIRTY_TRACKING_MODE", dirtyMode);
+    setEnvVar("DIFF_MERGE_GAP", diffMergeGap);
+    setEnvVar("DIFF_THREADS", diffThreads);
+    setEnvVar("UFFD_HANDLER_THREADS", uffdHandlerThreads);
+    setEnvVar("UFFD_FAULT_AROUND_PAGES", uffdFaultAroundPages);
+
+    setEnvVar("HUGE_PAGES_MODE", hugePagesMode);
+    setEnvVar("MEMORY_CGROUP_DIR", memoryCgroupDir);
+    setEnvVar("MEMORY_EVICTION_USAGE_PERCENT", memoryEvictionUsagePercent);
+    setEnvVar("MEMORY_EVICTION_STALL_PERCENT", memoryEvictionStallPercent);
+
+    setEnvVar("SNAPSHOT_COMPRESSION", snapshotCompression);
+    setEnvVar("SNAPSHOT_COMPRESSION_MIN_SIZE", snapshotCompressionMinSize);
+    setEnvVar("SNAPSHOT_COMPRESSION_LEVEL", snapshotCompressionLevel);
+    setEnvVar("SNAPSHOT_PUSH_CHUNK_SIZE", snapshotPushChunkSize);
+    setEnvVar("SNAPSHOT_PUSH_TIMEOUT_MS", snapshotPushTimeoutMs);
+    setEnvVar("SNAPSHOT_RESTORE_MODE", snapshotRestoreMode);
+    setEnvVar("SNAPSHOT_PREFETCH_PAGES", snapshotPrefetchPages);
 }
 
 }
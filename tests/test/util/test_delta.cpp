@@ -1,8 +1,11 @@
 #include <catch2/catch.hpp>
 
-#include <algorithm>
 #include <faabric/util/delta.h>
 
+#include <algorithm>
+#include <span>
+#include <vector>
+
 using namespace faabric::util;
 
 namespace tests {
@@ -138,4 +141,114 @@ TEST_CASE("Test delta calculate and apply", "[util][delta]")
     }
 }
 
+
+TEST_CASE("Test zstd compression round trip", "[util][delta]")
+{
+    // Some compressible data, with a few changes in it
+    std::vector<uint8_t> dataA(10000, 3);
+    std::vector<uint8_t> dataB(5000, 7);
+    std::fill(dataA.begin() + 100, dataA.begin() + 200, 9);
+    dataB.at(1234) = 1;
+
+    std::vector<uint8_t> expected(dataA);
+    expected.insert(expected.end(), dataB.begin(), dataB.end());
+
+    std::vector<std::span<const uint8_t>> srcs = { dataA, dataB };
+    std::vector<uint8_t> compressed(zstdCompressBound(expected.size()));
+    size_t compressedSize = zstdCompress(srcs, compressed, 3);
+    REQUIRE(compressedSize > 0);
+    REQUIRE(compressedSize < expected.size());
+    compressed.resize(compressedSize);
+
+    // The same data compressed in one go decompresses the same way
+    std::vector<uint8_t> compressedWhole(zstdCompressBound(expected.size()));
+    compressedWhole.resize(zstdCompress(expected, compressedWhole, 3));
+
+    std::vector<uint8_t> actualWhole(expected.size());
+    zstdDecompress(compressedWhole, actualWhole);
+    REQUIRE(actualWhole == expected);
+
+    SECTION("Single buffer")
+    {
+        std::vector<uint8_t> actual(expected.size());
+        zstdDecompress(compressed, actual);
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("Multiple buffers")
+    {
+        // Split differently to the input
+        std::vector<uint8_t> actual(expected.size());
+        std::vector<std::span<uint8_t>> dests = {
+            { actual.data(), 1 },
+            { actual.data() + 1, 12000 },
+            { actual.data() + 12001, 0 },
+            { actual.data() + 12001, expected.size() - 12001 },
+        };
+        zstdDecompress(compressed, dests);
+        REQUIRE(actual == expected);
+    }
+
+    SECTION("Buffers too small")
+    {
+        std::vector<uint8_t> actual(expected.size() - 1);
+        REQUIRE_THROWS(zstdDecompress(compressed, actual));
+    }
+
+    SECTION("Buffers too big")
+    {
+        std::vector<uint8_t> actual(expected.size() + 1);
+        REQUIRE_THROWS(zstdDecompress(compressed, actual));
+    }
+
+    SECTION("Truncated frame")
+    {
+        std::vector<uint8_t> actual(expected.size());
+        std::span<const uint8_t> truncated(compressed.data(),
+                                           compressed.size() - 1);
+        REQUIRE_THROWS(zstdDecompress(truncated, actual));
+    }
+
+    SECTION("Compression buffer too small")
+    {
+        std::vector<uint8_t> tooSmall(expected.size() / 2);
+        REQUIRE_THROWS(zstdCompress(expected, tooSmall, 1));
+    }
+}
+
+TEST_CASE("Test zstd compression of empty data", "[util][delta]")
+{
+    std::vector<uint8_t> compressed(zstdCompressBound(0));
+    compressed.resize(zstdCompress(std::vector<uint8_t>(), compressed, 1));
+    REQUIRE(!compressed.empty());
+
+    std::vector<uint8_t> actual;
+    zstdDecompress(compressed, actual);
+
+    std::vector<uint8_t> tooBig(1);
+    REQUIRE_THROWS(zstdDecompress(compressed, tooBig));
+}
+
+TEST_CASE("Test choosing adaptive zstd levels", "[util][delta]")
+{
+    size_t smallPayload = 1024 * 1024;
+    size_t largePayload = ZSTD_LARGE_PAYLOAD_SIZE;
+
+    // Unknown and fast links get the fastest level
+    REQUIRE(zstdAdaptiveLevel(smallPayload, 0) == 1);
+    REQUIRE(zstdAdaptiveLevel(smallPayload, 10e9) == 1);
+
+    // Slower links get higher levels
+    int prevLevel = 1;
+    for (double throughput : { 1e9, 200e6, 100e6, 50e6, 10e6, 1e6 }) {
+        int level = zstdAdaptiveLevel(smallPayload, throughput);
+        REQUIRE(level >= prevLevel);
+        prevLevel = level;
+    }
+    REQUIRE(prevLevel > 3);
+
+    // Large payloads are capped at a low level
+    REQUIRE(zstdAdaptiveLevel(largePayload, 1e6) <= 3);
+    REQUIRE(zstdAdaptiveLevel(largePayload, 0) == 1);
+}
 }
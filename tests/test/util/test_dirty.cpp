@@ -5,6 +5,7 @@
 #include <faabric/util/dirty.h>
 #include <faabric/util/memory.h>
 
+#include <chrono>
 #include <cstring>
 #include <sys/mman.h>
 #include <unistd.h>
@@ -23,6 +24,16 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
 
     SECTION("Soft PTEs") { mode = "softpte"; }
 
+    SECTION("Pagemap scan")
+    {
+        if (!PagemapScanDirtyTracker::isSupported()) {
+            WARN("PAGEMAP_SCAN unsupported, needs Linux 6.7 or later");
+            return;
+        }
+
+        mode = "pagemap-scan";
+    }
+
     SECTION("None") { mode = "none"; }
 
     SECTION("Uffd") { mode = "uffd"; }
@@ -78,6 +89,34 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
         }
     }
 
+    SECTION("Pagemap scan")
+    {
+        if (!PagemapScanDirtyTracker::isSupported()) {
+            WARN("PAGEMAP_SCAN unsupported, needs Linux 6.7 or later");
+            return;
+        }
+
+        setTrackingMode("pagemap-scan");
+        checkPostReset = true;
+        dirtyReads = false;
+
+        SECTION("Shared") { sharedMemory = true; }
+
+        SECTION("Private") { sharedMemory = false; }
+
+        SECTION("Mapped shared")
+        {
+            sharedMemory = true;
+            mappedMemory = true;
+        }
+
+        SECTION("Mapped private")
+        {
+            sharedMemory = false;
+            mappedMemory = true;
+        }
+    }
+
     SECTION("Segfaults")
     {
         setTrackingMode("segfault");
@@ -201,9 +240,9 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
     // Make sure we clear all, relevant for anything with system-wide state
     tracker->clearAll();
 
-    std::vector<char> actual = tracker->getBothDirtyPages(memView);
+    DirtyPages actual = tracker->getBothDirtyPages(memView);
     std::vector<char> expected(nPages, 0);
-    REQUIRE(actual == expected);
+    REQUIRE(actual == DirtyPages(expected));
 
     tracker->startTracking(memView);
     tracker->startThreadLocalTracking(memView);
@@ -228,7 +267,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
     }
 
     actual = tracker->getBothDirtyPages(memView);
-    REQUIRE(actual == expected);
+    REQUIRE(actual == DirtyPages(expected));
 
     // And another
     uint8_t* pageFive = pageThree + (2 * HOST_PAGE_SIZE);
@@ -236,7 +275,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
 
     expected[5] = 1;
     actual = tracker->getBothDirtyPages(memView);
-    REQUIRE(actual == expected);
+    REQUIRE(actual == DirtyPages(expected));
 
     // Reset
     tracker->stopTracking(memView);
@@ -246,7 +285,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
 
     actual = tracker->getBothDirtyPages(memView);
     expected = std::vector<char>(nPages, 0);
-    REQUIRE(actual == expected);
+    REQUIRE(actual == DirtyPages(expected));
 
     // Check the data hasn't changed
     REQUIRE(pageOne[10] == 1);
@@ -265,7 +304,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
         expected[3] = 1;
         expected[4] = 1;
         actual = tracker->getBothDirtyPages(memView);
-        REQUIRE(actual == expected);
+        REQUIRE(actual == DirtyPages(expected));
 
         // Final reset and check
         tracker->stopTracking(memView);
@@ -275,19 +314,290 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
         tracker->startThreadLocalTracking(memView);
         actual = tracker->getBothDirtyPages(memView);
         expected = std::vector<char>(nPages, 0);
-        REQUIRE(actual == expected);
+        REQUIRE(actual == DirtyPages(expected));
 
         tracker->stopTracking(memView);
         tracker->stopThreadLocalTracking(memView);
     }
 }
 
+TEST_CASE_METHOD(DirtyTrackingTestFixture,
+                 "Test pagemap scan dirty ranges",
+                 "[util][dirty]")
+{
+    if (!PagemapScanDirtyTracker::isSupported()) {
+        WARN("PAGEMAP_SCAN unsupported, needs Linux 6.7 or later");
+        return;
+    }
+
+    setTrackingMode("pagemap-scan");
+    auto tracker =
+      std::static_pointer_cast<PagemapScanDirtyTracker>(getDirtyTracker());
+
+    int nPages = 10;
+    size_t memSize = nPages * HOST_PAGE_SIZE;
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+
+    tracker->startTracking(memView);
+    REQUIRE(tracker->getDirtyRanges(memView).empty());
+
+    // Neighbouring pages are merged into a single range
+    memView[2 * HOST_PAGE_SIZE + 5] = 1;
+    memView[3 * HOST_PAGE_SIZE + 10] = 2;
+    memView[4 * HOST_PAGE_SIZE] = 3;
+    memView[8 * HOST_PAGE_SIZE + 100] = 4;
+
+    std::vector<std::pair<size_t, size_t>> expected = {
+        { 2 * HOST_PAGE_SIZE, 3 * HOST_PAGE_SIZE },
+        { 8 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+    };
+    REQUIRE(tracker->getDirtyRanges(memView) == expected);
+
+    // Getting the ranges and resetting in one go
+    REQUIRE(tracker->getDirtyRanges(memView, true) == expected);
+    REQUIRE(tracker->getDirtyRanges(memView).empty());
+
+    // Only the given region is reset
+    memView[HOST_PAGE_SIZE] = 5;
+    memView[9 * HOST_PAGE_SIZE] = 6;
+
+    std::span<uint8_t> firstHalf = memView.subspan(0, 5 * HOST_PAGE_SIZE);
+    expected = { { HOST_PAGE_SIZE, HOST_PAGE_SIZE } };
+    REQUIRE(tracker->getDirtyRanges(firstHalf, true) == expected);
+
+    expected = { { 9 * HOST_PAGE_SIZE, HOST_PAGE_SIZE } };
+    REQUIRE(tracker->getDirtyRanges(memView) == expected);
+
+    std::vector<char> expectedPages(nPages, 0);
+    expectedPages[9] = 1;
+    REQUIRE(tracker->getDirtyPages(memView) == DirtyPages(expectedPages));
+
+    tracker->stopTracking(memView);
+}
+
+TEST_CASE_METHOD(DirtyTrackingTestFixture,
+                 "Test dirty tracking on huge pages",
+                 "[util][dirty]")
+{
+    conf.hugePagesMode = "explicit";
+
+    SECTION("Segfaults") { setTrackingMode("segfault"); }
+
+    SECTION("Pagemap scan")
+    {
+        if (!PagemapScanDirtyTracker::isSupported()) {
+            WARN("PAGEMAP_SCAN unsupported, needs Linux 6.7 or later");
+            return;
+        }
+
+        setTrackingMode("pagemap-scan");
+    }
+
+    // Uses host pages if no huge pages are reserved
+    size_t hugePageSize = getHugePageSize();
+    size_t memSize = 2 * hugePageSize;
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+    size_t pageSize = getBackingPageSize(memView);
+
+    // Track less than the whole memory, the tracked region is extended to
+    // whole huge pages
+    std::span<uint8_t> trackedView =
+      memView.subspan(0, memSize - 3 * HOST_PAGE_SIZE);
+
+    auto tracker = getDirtyTracker();
+    tracker->startTracking(trackedView);
+    tracker->startThreadLocalTracking(trackedView);
+
+    // Writes dirty all the host pages in the page backing them
+    size_t writeOffset = hugePageSize + 10 * HOST_PAGE_SIZE + 5;
+    memView[writeOffset] = 1;
+
+    tracker->stopTracking(trackedView);
+    tracker->stopThreadLocalTracking(trackedView);
+
+    size_t nPages = trackedView.size() / HOST_PAGE_SIZE;
+    size_t startPage = (writeOffset / pageSize) * (pageSize / HOST_PAGE_SIZE);
+    size_t endPage = std::min(startPage + pageSize / HOST_PAGE_SIZE, nPages);
+    DirtyPages expected(nPages);
+    expected.markDirty(startPage, endPage);
+
+    REQUIRE(tracker->getBothDirtyPages(trackedView) == expected);
+    REQUIRE(memView[writeOffset] == 1);
+
+    // Trackers resolving faults in host pages can't track huge TLB pages
+    if (pageSize == hugePageSize) {
+        setTrackingMode("uffd");
+        REQUIRE_THROWS(getDirtyTracker()->startTracking(trackedView));
+    }
+}
+
+TEST_CASE_METHOD(DirtyTrackingTestFixture,
+                 "Test userfaultfd event threads",
+                 "[util][dirty]")
+{
+    conf.uffdHandlerThreads = 4;
+    conf.uffdFaultAroundPages = 3;
+    setTrackingMode("uffd-thread-wp");
+    std::shared_ptr<DirtyTracker> tracker = getDirtyTracker();
+
+    int nPages = 40;
+    size_t memSize = nPages * HOST_PAGE_SIZE;
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+
+    // Fill the memory, so that all faults are on write-protected pages
+    std::memset(mem.get(), 1, memSize);
+
+    tracker->startTracking(memView);
+    size_t faultsBefore = UffdDirtyTracker::getHandledFaultCount();
+
+    // A write following one to the page before resolves the pages ahead too,
+    // which are marked dirty without faulting
+    memView[5] = 2;
+    memView[HOST_PAGE_SIZE + 5] = 3;
+    memView[2 * HOST_PAGE_SIZE + 5] = 4;
+    memView[4 * HOST_PAGE_SIZE + 5] = 5;
+    memView[10 * HOST_PAGE_SIZE + 5] = 6;
+
+    REQUIRE(UffdDirtyTracker::getHandledFaultCount() - faultsBefore == 3);
+
+    DirtyPages expected(nPages);
+    expected.markDirty(0, 5);
+    expected.markDirty(10);
+    REQUIRE(tracker->getDirtyPages(memView) == expected);
+
+    // Several threads writing sequentially through their own pages
+    int nThreads = 4;
+    int pagesPerThread = 5;
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&memView, i, pagesPerThread] {
+            size_t startPage = 20 + i * pagesPerThread;
+            for (int p = 0; p < pagesPerThread; p++) {
+                memView[(startPage + p) * HOST_PAGE_SIZE + 7] = i + 10;
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    tracker->stopTracking(memView);
+
+    expected.markDirty(20, 20 + nThreads * pagesPerThread);
+    REQUIRE(tracker->getDirtyPages(memView) == expected);
+
+    REQUIRE(memView[4 * HOST_PAGE_SIZE + 5] == 5);
+    for (int i = 0; i < nThreads; i++) {
+        for (int p = 0; p < pagesPerThread; p++) {
+            size_t page = 20 + i * pagesPerThread + p;
+            REQUIRE(memView[page * HOST_PAGE_SIZE + 7] == i + 10);
+        }
+    }
+}
+
+TEST_CASE_METHOD(DirtyTrackingTestFixture,
+                 "Test writes after stopping thread-local tracking",
+                 "[util][dirty]")
+{
+    setTrackingMode("uffd-thread-wp");
+    std::shared_ptr<DirtyTracker> tracker = getDirtyTracker();
+
+    int nPages = 6;
+    size_t memSize = nPages * HOST_PAGE_SIZE;
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+    std::memset(mem.get(), 1, memSize);
+
+    tracker->startTracking(memView);
+    tracker->startThreadLocalTracking(memView);
+
+    memView[HOST_PAGE_SIZE + 5] = 2;
+    tracker->stopThreadLocalTracking(memView);
+
+    // Writes after stopping go to the global record
+    memView[4 * HOST_PAGE_SIZE + 5] = 3;
+
+    DirtyPages expectedGlobal(nPages);
+    expectedGlobal.markDirty(4);
+    REQUIRE(tracker->getDirtyPages(memView) == expectedGlobal);
+
+    // The thread's own pages can still be read once
+    DirtyPages expectedLocal(nPages);
+    expectedLocal.markDirty(1);
+    REQUIRE(tracker->getThreadLocalDirtyPages(memView) == expectedLocal);
+    REQUIRE(tracker->getThreadLocalDirtyPages(memView) == DirtyPages(nPages));
+
+    tracker->stopTracking(memView);
+}
+
+TEST_CASE_METHOD(DirtyTrackingTestFixture,
+                 "Benchmark userfaultfd write faults",
+                 "[.][benchmark]")
+{
+    // Reports the faults per second handled by the userfaultfd event threads
+    // when several threads write sequentially through tracked memory, run
+    // with:
+    // faabric_tests "Benchmark userfaultfd write faults"
+    int nWriters = 4;
+    size_t pagesPerWriter = 16384;
+    size_t memSize = nWriters * pagesPerWriter * HOST_PAGE_SIZE;
+
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+    std::memset(mem.get(), 1, memSize);
+
+    for (int nHandlers : { 1, 2, 4 }) {
+        for (int faultAround : { 0, 15 }) {
+            conf.uffdHandlerThreads = nHandlers;
+            conf.uffdFaultAroundPages = faultAround;
+            setTrackingMode("uffd-thread-wp");
+            std::shared_ptr<DirtyTracker> tracker = getDirtyTracker();
+
+            tracker->startTracking(memView);
+            size_t faultsBefore = UffdDirtyTracker::getHandledFaultCount();
+
+            auto start = std::chrono::steady_clock::now();
+            {
+                std::vector<std::jthread> writers;
+                for (int i = 0; i < nWriters; i++) {
+                    writers.emplace_back([&memView, i, pagesPerWriter] {
+                        size_t offset = i * pagesPerWriter * HOST_PAGE_SIZE;
+                        for (size_t p = 0; p < pagesPerWriter; p++) {
+                            memView[offset + p * HOST_PAGE_SIZE] = 2;
+                        }
+                    });
+                }
+            }
+            std::chrono::duration<double> elapsed =
+              std::chrono::steady_clock::now() - start;
+
+            size_t nFaults =
+              UffdDirtyTracker::getHandledFaultCount() - faultsBefore;
+            tracker->stopTracking(memView);
+
+            SPDLOG_INFO("{} handler threads, fault-around {}: {} faults in "
+                        "{:.1f}ms, {:.0f} faults/s, {:.0f} pages/s",
+                        nHandlers,
+                        faultAround,
+                        nFaults,
+                        elapsed.count() * 1000,
+                        nFaults / elapsed.count(),
+                        (nWriters * pagesPerWriter) / elapsed.count());
+        }
+    }
+}
+
 TEST_CASE_METHOD(DirtyTrackingTestFixture,
                  "Test thread-local dirty tracking",
                  "[util][dirty]")
 {
     // Here we just want to check that thread-local tracking works for the
-    // trackers that support it, i.e. those based on signal handling
+    // trackers that support it, i.e. those based on signal handling, and the
+    // userfaultfd event thread, which gets the id of the faulting thread
 
     // Certain trackers support repeat tracking on the same address space, while
     // others don't, so we may or may not loop
@@ -311,6 +621,18 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
         nLoops = 20;
     }
 
+    SECTION("Userfaultfd thread")
+    {
+        setTrackingMode("uffd-thread");
+        nLoops = 1;
+    }
+
+    SECTION("Userfaultfd thread wp")
+    {
+        setTrackingMode("uffd-thread-wp");
+        nLoops = 20;
+    }
+
     std::shared_ptr<DirtyTracker> tracker = getDirtyTracker();
     REQUIRE(tracker->getType() == conf.dirtyTrackingMode);
 
@@ -356,7 +678,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
                   tracker->stopThreadLocalTracking(memView);
 
                   // Check we get the right size for the dirty pages
-                  std::vector<char> dirtyPages =
+                  DirtyPages dirtyPages =
                     tracker->getThreadLocalDirtyPages(memView);
                   if (dirtyPages.size() != nPages) {
                       SPDLOG_ERROR("Thread {} failed on loop {}. Got {} "
@@ -368,15 +690,13 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
                       return;
                   }
 
-                  std::vector<char> expected = std::vector<char>(nPages, 0);
-                  expected[pageOffset] = 1;
-                  expected[pageOffset + 1] = 1;
+                  DirtyPages expected(nPages);
+                  expected.markDirty(pageOffset);
+                  expected.markDirty(pageOffset + 1);
 
                   if (dirtyPages != expected) {
-                      int actualCount =
-                        std::count(dirtyPages.begin(), dirtyPages.end(), 1);
-                      int expectedCount =
-                        std::count(expected.begin(), expected.end(), 1);
+                      int actualCount = dirtyPages.count();
+                      int expectedCount = expected.count();
 
                       SPDLOG_ERROR("Thread {} failed on loop {}. Regions not "
                                    "equal ({} != {})",
@@ -402,7 +722,7 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture,
         tracker->stopTracking(memView);
 
         // Check no global offsets
-        REQUIRE(tracker->getDirtyPages(memView).empty());
+        REQUIRE(!tracker->getDirtyPages(memView).any());
 
         bool thisLoopSuccess = true;
         for (int i = 0; i < nThreads; i++) {
@@ -51,6 +51,38 @@ TEST_CASE("Test batch exec factory", "[util]")
     }
 }
 
+TEST_CASE("Test batch requests on pooled arenas", "[util]")
+{
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory("demo", "echo", 3);
+
+    google::protobuf::Arena* arena = req->GetArena();
+    REQUIRE(arena != nullptr);
+    REQUIRE(req->messages(0).GetArena() == arena);
+
+    // Copies out of the request are on the heap
+    faabric::Message msgCopy = req->messages(1);
+    REQUIRE(msgCopy.GetArena() == nullptr);
+
+    // Messages moved into a request are copied onto its arena
+    faabric::Message msg = faabric::util::messageFactory("demo", "foo");
+    std::shared_ptr<faabric::BatchExecuteRequest> reqB =
+      faabric::util::batchExecFactory(std::move(msg));
+    REQUIRE(reqB->GetArena() != nullptr);
+    REQUIRE(reqB->GetArena() != arena);
+    REQUIRE(reqB->messages(0).function() == "foo");
+
+    // Once the request is dropped its arena is reset and reused
+    req.reset();
+    std::shared_ptr<faabric::BatchExecuteRequest> reqC =
+      faabric::util::batchExecFactory();
+    REQUIRE(reqC->GetArena() == arena);
+    REQUIRE(reqC->messages_size() == 0);
+
+    REQUIRE(msgCopy.user() == "demo");
+    REQUIRE(msgCopy.function() == "echo");
+}
+
 TEST_CASE("Test adding ids to message", "[util]")
 {
     faabric::Message msgA;
@@ -62,6 +62,12 @@ TEST_CASE("Test message to JSON round trip", "[util]")
     faabric::Message actual = faabric::util::jsonToMessage(jsonString);
 
     checkMessageEquality(msg, actual);
+
+    // Parse into a message in a request
+    auto req = faabric::util::batchExecFactory();
+    faabric::util::jsonToMessage(jsonString, *req->add_messages());
+
+    checkMessageEquality(msg, req->messages(0));
 }
 
 TEST_CASE("Test get JSON property from JSON string", "[util]")
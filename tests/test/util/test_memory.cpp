@@ -6,7 +6,9 @@
 #include <faabric/util/macros.h>
 #include <faabric/util/memory.h>
 
+#include <atomic>
 #include <cstring>
+#include <mutex>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -275,6 +277,92 @@ TEST_CASE("Test allocating and claiming memory", "[util][memory]")
     REQUIRE(vMem[sizeA + 4 * HOST_PAGE_SIZE + 10] == 6);
 }
 
+TEST_CASE_METHOD(ConfTestFixture,
+                 "Test allocating memory backed by huge pages",
+                 "[util][memory]")
+{
+    size_t hugePageSize = getHugePageSize();
+    REQUIRE(hugePageSize > HOST_PAGE_SIZE);
+    REQUIRE(hugePageSize % HOST_PAGE_SIZE == 0);
+
+    size_t memSize = 2 * hugePageSize + 5 * HOST_PAGE_SIZE;
+    bool expectAligned = true;
+    bool expectHugeTlb = false;
+
+    SECTION("None")
+    {
+        conf.hugePagesMode = "none";
+        expectAligned = false;
+    }
+
+    SECTION("Transparent") { conf.hugePagesMode = "transparent"; }
+
+    SECTION("Explicit")
+    {
+        conf.hugePagesMode = "explicit";
+        expectHugeTlb = true;
+    }
+
+    MemoryRegion privateMem = allocatePrivateMemory(memSize);
+    MemoryRegion sharedMem = allocateSharedMemory(memSize);
+    MemoryRegion virtualMem = allocateVirtualMemory(memSize);
+    claimVirtualMemory({ virtualMem.get(), memSize });
+
+    std::vector<uint8_t*> mems = { privateMem.get(),
+                                   sharedMem.get(),
+                                   virtualMem.get() };
+    for (uint8_t* mem : mems) {
+        if (expectAligned) {
+            REQUIRE(isHugePageAligned(mem));
+        }
+
+        // Whole region is usable
+        mem[0] = 1;
+        mem[memSize - 1] = 2;
+        REQUIRE(mem[0] == 1);
+        REQUIRE(mem[memSize - 1] == 2);
+    }
+
+    // Huge TLB pages fall back to transparent huge pages when not enough are
+    // reserved, and virtual memory never uses them
+    std::span<uint8_t> privateView(privateMem.get(), memSize);
+    size_t privatePageSize = getBackingPageSize(privateView);
+    if (expectHugeTlb) {
+        REQUIRE((privatePageSize == hugePageSize ||
+                 privatePageSize == HOST_PAGE_SIZE));
+    } else {
+        REQUIRE(privatePageSize == HOST_PAGE_SIZE);
+    }
+
+    REQUIRE(getBackingPageSize({ virtualMem.get(), memSize }) ==
+            HOST_PAGE_SIZE);
+
+    // Memory backed by huge TLB pages can't have fds mapped onto it
+    if (privatePageSize == hugePageSize) {
+        int fd = createFd(memSize, "foobar");
+        REQUIRE_THROWS(mapMemoryPrivate(privateView, fd));
+        ::close(fd);
+    }
+
+    // Small allocations always use host pages
+    MemoryRegion smallMem = allocatePrivateMemory(10 * HOST_PAGE_SIZE);
+    REQUIRE(getBackingPageSize({ smallMem.get(), 10 * HOST_PAGE_SIZE }) ==
+            HOST_PAGE_SIZE);
+
+    // Page size is no longer recorded once the memory is freed
+    privateMem.reset();
+    REQUIRE(getBackingPageSize(privateView) == HOST_PAGE_SIZE);
+}
+
+TEST_CASE_METHOD(ConfTestFixture,
+                 "Test allocating with invalid huge pages mode",
+                 "[util][memory]")
+{
+    conf.hugePagesMode = "foobar";
+
+    REQUIRE_THROWS(allocatePrivateMemory(2 * getHugePageSize()));
+}
+
 TEST_CASE("Test mapping memory", "[util][memory]")
 {
     size_t vMemSize = 100 * HOST_PAGE_SIZE;
@@ -369,6 +457,145 @@ TEST_CASE("Test remapping memory", "[util][memory]")
     REQUIRE(actualDataAfter == expectedData);
 }
 
+TEST_CASE("Test counting copied-on-write pages", "[util][memory]")
+{
+    size_t dataSize = 10 * HOST_PAGE_SIZE;
+    std::vector<uint8_t> data(dataSize, 3);
+    int fd = createFd(dataSize, "foobar");
+    writeToFd(fd, 0, data);
+
+    MemoryRegion mem = allocatePrivateMemory(dataSize);
+    std::span<uint8_t> memView(mem.get(), dataSize);
+    mapMemoryPrivate(memView, fd);
+    REQUIRE(countPrivatePages(memView) == 0);
+
+    // Reading pages shares them with the fd
+    int total = 0;
+    for (size_t i = 0; i < dataSize; i += HOST_PAGE_SIZE) {
+        total += memView[i];
+    }
+    REQUIRE(total == 30);
+    REQUIRE(countPrivatePages(memView) == 0);
+
+    // Writing pages copies them
+    memView[0] = 4;
+    memView[(3 * HOST_PAGE_SIZE) + 10] = 4;
+    memView[(3 * HOST_PAGE_SIZE) + 20] = 4;
+    memView[dataSize - 1] = 4;
+    REQUIRE(countPrivatePages(memView) == 3);
+    REQUIRE(countPrivatePages(memView.subspan(HOST_PAGE_SIZE)) == 2);
+
+    // Remapping discards the copies
+    mapMemoryPrivate(memView, fd);
+    REQUIRE(countPrivatePages(memView) == 0);
+    REQUIRE(memView[0] == 3);
+
+    ::close(fd);
+}
+
+TEST_CASE("Test lazily filling memory pages", "[util][memory]")
+{
+    int nPages = 10;
+    size_t dataSize = nPages * HOST_PAGE_SIZE;
+    std::vector<uint8_t> sourceData(dataSize);
+    for (int p = 0; p < nPages; p++) {
+        std::fill(sourceData.begin() + (p * HOST_PAGE_SIZE),
+                  sourceData.begin() + ((p + 1) * HOST_PAGE_SIZE),
+                  p + 1);
+    }
+
+    // Sources are called from the handler's thread
+    std::mutex requestsMx;
+    std::vector<std::pair<size_t, size_t>> requests;
+    LazyPageSource source = [&](size_t offset, size_t length) {
+        std::lock_guard<std::mutex> lock(requestsMx);
+        requests.emplace_back(offset, length);
+        return sourceData.data() + offset;
+    };
+
+    // Existing contents are replaced
+    MemoryRegion mem = allocatePrivateMemory(dataSize);
+    std::memset(mem.get(), 9, dataSize);
+
+    LazyPageHandler& handler = getLazyPageHandler();
+    size_t regionsBefore = handler.getRegionCount();
+
+    int owner = 0;
+    handler.addRegion({ mem.get(), dataSize }, source, 2, &owner);
+    REQUIRE(handler.getRegionCount() == regionsBefore + 1);
+
+    // Adding the same memory again replaces the region
+    handler.addRegion({ mem.get(), dataSize }, source, 2, &owner);
+    REQUIRE(handler.getRegionCount() == regionsBefore + 1);
+    REQUIRE(requests.empty());
+
+    // Reading a page fills it along with the following pages
+    REQUIRE(mem.get()[(3 * HOST_PAGE_SIZE) + 5] == 4);
+
+    // Writing a page fills it too, stopping at pages already filled
+    mem.get()[HOST_PAGE_SIZE] = 20;
+
+    // Prefetching stops at the end of the region
+    REQUIRE(mem.get()[9 * HOST_PAGE_SIZE] == 10);
+
+    std::vector<std::pair<size_t, size_t>> expectedRequests = {
+        { 3 * HOST_PAGE_SIZE, 3 * HOST_PAGE_SIZE },
+        { HOST_PAGE_SIZE, 2 * HOST_PAGE_SIZE },
+        { 9 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+    };
+    REQUIRE(requests == expectedRequests);
+
+    // Filled pages don't need filling again
+    std::vector<uint8_t> expectedData(sourceData.begin() + HOST_PAGE_SIZE,
+                                      sourceData.begin() +
+                                        (6 * HOST_PAGE_SIZE));
+    expectedData.at(0) = 20;
+    std::vector<uint8_t> actualData(mem.get() + HOST_PAGE_SIZE,
+                                    mem.get() + (6 * HOST_PAGE_SIZE));
+    REQUIRE(actualData == expectedData);
+    REQUIRE(requests.size() == 3);
+
+    // Once removed, pages that weren't filled read as zero
+    handler.removeRegions(&owner);
+    REQUIRE(handler.getRegionCount() == regionsBefore);
+
+    REQUIRE(mem.get()[0] == 0);
+    REQUIRE(mem.get()[(3 * HOST_PAGE_SIZE) + 5] == 4);
+    REQUIRE(requests.size() == 3);
+}
+
+TEST_CASE("Test lazy page sources failing", "[util][memory]")
+{
+    size_t dataSize = 4 * HOST_PAGE_SIZE;
+    std::vector<uint8_t> sourceData(dataSize, 3);
+
+    std::atomic<int> nCalls = 0;
+    LazyPageSource source = [&](size_t offset, size_t length) {
+        if (nCalls++ > 0) {
+            throw std::runtime_error("Fetching pages failed");
+        }
+
+        return sourceData.data() + offset;
+    };
+
+    MemoryRegion mem = allocatePrivateMemory(dataSize);
+
+    LazyPageHandler& handler = getLazyPageHandler();
+    size_t regionsBefore = handler.getRegionCount();
+
+    int owner = 0;
+    handler.addRegion({ mem.get(), dataSize }, source, 0, &owner);
+    REQUIRE(mem.get()[0] == 3);
+
+    // The failing page is zero-filled and the region is removed rather than
+    // leaving the thread hanging
+    REQUIRE(mem.get()[2 * HOST_PAGE_SIZE] == 0);
+    REQUIRE(handler.getRegionCount() == regionsBefore);
+
+    REQUIRE(mem.get()[3 * HOST_PAGE_SIZE] == 0);
+    REQUIRE(nCalls == 2);
+}
+
 TEST_CASE("Test merging dirty pages", "[util][memory]")
 {
     std::vector<char> source;
@@ -396,9 +623,10 @@ TEST_CASE("Test merging dirty pages", "[util][memory]")
         expected = { 0, 1, 1, 1, 1, 0 };
     }
 
-    mergeDirtyPages(dest, source);
+    DirtyPages destPages(dest);
+    mergeDirtyPages(destPages, DirtyPages(source));
 
-    REQUIRE(dest == expected);
+    REQUIRE(destPages == DirtyPages(expected));
 }
 
 TEST_CASE("Test merging multiple dirty pages", "[util][memory]")
@@ -440,8 +668,140 @@ TEST_CASE("Test merging multiple dirty pages", "[util][memory]")
         expected = { 0, 1, 1, 1, 1, 0, 0, 1, 1 };
     }
 
-    mergeManyDirtyPages(dest, sources);
+    DirtyPages destPages(dest);
+    std::vector<DirtyPages> sourcePages;
+    for (const auto& source : sources) {
+        sourcePages.emplace_back(source);
+    }
+    mergeManyDirtyPages(destPages, sourcePages);
+
+    REQUIRE(destPages == DirtyPages(expected));
+}
+
+TEST_CASE("Test dirty page sets", "[util][memory]")
+{
+    // Spans several words, with a partial word at the end
+    DirtyPages pages(200);
+    REQUIRE(pages.size() == 200);
+    REQUIRE(!pages.any());
+    REQUIRE(pages.nextDirty(0) == 200);
+    REQUIRE(pages.nextClean(0) == 0);
+
+    pages.markDirty(3);
+    pages.markDirty(60, 130);
+    pages.markDirty(199);
+
+    REQUIRE(pages.any());
+    REQUIRE(pages.count() == 72);
+    REQUIRE(pages.isDirty(3));
+    REQUIRE(!pages.isDirty(4));
+    REQUIRE(pages.isDirty(64));
+    REQUIRE(!pages.isDirty(130));
+    REQUIRE(!pages.isDirty(500));
+
+    REQUIRE(pages.nextDirty(4) == 60);
+    REQUIRE(pages.nextClean(60) == 130);
+    REQUIRE(pages.nextDirty(131) == 199);
+    REQUIRE(pages.nextClean(199) == 200);
+
+    std::vector<std::pair<size_t, size_t>> expectedRanges = {
+        { 3, 4 },
+        { 60, 130 },
+        { 199, 200 },
+    };
+    REQUIRE(pages.getRanges() == expectedRanges);
+
+    std::vector<char> expectedFlags(200, 0);
+    expectedFlags[3] = 1;
+    std::fill(expectedFlags.begin() + 60, expectedFlags.begin() + 130, 1);
+    expectedFlags[199] = 1;
+    REQUIRE(pages.toFlags() == expectedFlags);
+    REQUIRE(DirtyPages(expectedFlags) == pages);
+
+    // Shrinking drops the pages past the new end, growing adds clean ones
+    pages.resize(100);
+    REQUIRE(pages.count() == 41);
+    pages.resize(300);
+    REQUIRE(pages.count() == 41);
+    REQUIRE(pages.nextDirty(100) == 300);
+
+    // All pages dirty
+    DirtyPages allDirty(130, true);
+    REQUIRE(allDirty.count() == 130);
+    REQUIRE(allDirty.nextClean(0) == 130);
+
+    pages.clear();
+    REQUIRE(pages.empty());
+    REQUIRE(!pages.any());
+}
+
+TEST_CASE("Benchmark merging dirty pages", "[.][benchmark]")
+{
+    // Merges and scans the dirty pages of a 4GiB memory from several threads,
+    // each of which has only written a few pages, run with:
+    // faabric_tests "Benchmark merging dirty pages"
+    size_t nPages = (4UL * 1024 * 1024 * 1024) / HOST_PAGE_SIZE;
+    int nThreads = 16;
+    int pagesPerThread = 8;
+
+    std::vector<std::vector<char>> threadFlags;
+    std::vector<DirtyPages> threadPages;
+    for (int t = 0; t < nThreads; t++) {
+        std::vector<char> flags(nPages, 0);
+        for (int i = 0; i < pagesPerThread; i++) {
+            flags.at((t * 7919 + i * 104729) % nPages) = 1;
+        }
+
+        threadPages.emplace_back(flags);
+        threadFlags.emplace_back(std::move(flags));
+    }
+
+    BENCHMARK("Merge one byte per page")
+    {
+        std::vector<char> dest(nPages, 0);
+        for (const auto& flags : threadFlags) {
+            std::transform(dest.begin(),
+                           dest.end(),
+                           flags.begin(),
+                           dest.begin(),
+                           std::logical_or<char>());
+        }
+
+        return dest.size();
+    };
+
+    BENCHMARK("Merge bitset")
+    {
+        DirtyPages dest;
+        mergeManyDirtyPages(dest, threadPages);
+        return dest.size();
+    };
+
+    DirtyPages merged;
+    mergeManyDirtyPages(merged, threadPages);
+    std::vector<char> mergedFlags = merged.toFlags();
 
-    REQUIRE(dest == expected);
+    BENCHMARK("Scan one byte per page")
+    {
+        size_t nDirty = 0;
+        for (size_t p = 0; p < nPages; p++) {
+            if (mergedFlags[p] != 0) {
+                nDirty++;
+            }
+        }
+
+        return nDirty;
+    };
+
+    BENCHMARK("Scan bitset")
+    {
+        size_t nDirty = 0;
+        for (size_t p = merged.nextDirty(0); p < nPages;
+             p = merged.nextDirty(p + 1)) {
+            nDirty++;
+        }
+
+        return nDirty;
+    };
 }
 }
@@ -0,0 +1,75 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/files.h>
+#include <faabric/util/memory_pressure.h>
+
+#include <filesystem>
+
+using namespace faabric::util;
+
+namespace tests {
+
+TEST_CASE("Test parsing memory pressure stalls", "[util][memory]")
+{
+    MemoryPressure pressure;
+
+    std::string psi = "some avg10=12.50 avg60=3.00 avg300=1.00 total=123\n"
+                      "full avg10=4.25 avg60=1.00 avg300=0.50 total=45\n";
+    parsePressureStall(psi, pressure);
+
+    REQUIRE(pressure.someStallPercent == 12.5);
+    REQUIRE(pressure.fullStallPercent == 4.25);
+
+    // Malformed lines are ignored
+    parsePressureStall("foo\nsome total=1\n", pressure);
+    REQUIRE(pressure.someStallPercent == 12.5);
+    REQUIRE(pressure.fullStallPercent == 4.25);
+}
+
+TEST_CASE("Test reading memory pressure from a cgroup", "[util][memory]")
+{
+    std::filesystem::path cgroupDir =
+      std::filesystem::temp_directory_path() / "faabric_test_cgroup";
+    std::filesystem::remove_all(cgroupDir);
+    std::filesystem::create_directories(cgroupDir);
+
+    std::string pressureFile = cgroupDir / "memory.pressure";
+    std::string currentFile = cgroupDir / "memory.current";
+    std::string maxFile = cgroupDir / "memory.max";
+
+    std::string psi = "some avg10=30.00 avg60=0 avg300=0 total=0\n"
+                      "full avg10=10.00 avg60=0 avg300=0 total=0\n";
+    writeBytesToFile(pressureFile, std::vector<uint8_t>(psi.begin(), psi.end()));
+
+    std::string current = "1000\n";
+    writeBytesToFile(currentFile,
+                     std::vector<uint8_t>(current.begin(), current.end()));
+
+    SECTION("With a limit")
+    {
+        std::string max = "4000\n";
+        writeBytesToFile(maxFile, std::vector<uint8_t>(max.begin(), max.end()));
+
+        MemoryPressure pressure = readMemoryPressure(cgroupDir);
+        REQUIRE(pressure.someStallPercent == 30);
+        REQUIRE(pressure.fullStallPercent == 10);
+        REQUIRE(pressure.usageBytes == 1000);
+        REQUIRE(pressure.limitBytes == 4000);
+    }
+
+    SECTION("Without a limit")
+    {
+        std::string max = "max\n";
+        writeBytesToFile(maxFile, std::vector<uint8_t>(max.begin(), max.end()));
+
+        // Usage and limit come from the host
+        MemoryPressure pressure = readMemoryPressure(cgroupDir);
+        REQUIRE(pressure.someStallPercent == 30);
+        REQUIRE(pressure.limitBytes > 0);
+        REQUIRE(pressure.usageBytes > 0);
+        REQUIRE(pressure.usageBytes <= pressure.limitBytes);
+    }
+
+    std::filesystem::remove_all(cgroupDir);
+}
+}
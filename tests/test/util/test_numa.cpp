@@ -0,0 +1,126 @@
+#include <catch2/catch.hpp>
+
+#include <faabric/util/files.h>
+#include <faabric/util/memory.h>
+#include <faabric/util/numa.h>
+
+#include <filesystem>
+#include <sched.h>
+#include <thread>
+
+using namespace faabric::util;
+
+namespace tests {
+
+TEST_CASE("Test parsing CPU lists", "[util][numa]")
+{
+    REQUIRE(parseCpuList("") == std::vector<int>());
+    REQUIRE(parseCpuList("3") == std::vector<int>({ 3 }));
+    REQUIRE(parseCpuList("0-3") == std::vector<int>({ 0, 1, 2, 3 }));
+    REQUIRE(parseCpuList("0-1,4,6-7\n") ==
+            std::vector<int>({ 0, 1, 4, 6, 7 }));
+
+    // Malformed ranges are ignored
+    REQUIRE(parseCpuList("foo,2") == std::vector<int>({ 2 }));
+}
+
+TEST_CASE("Test reading the CPU topology", "[util][numa]")
+{
+    std::filesystem::path nodesDir =
+      std::filesystem::temp_directory_path() / "faabric_test_numa";
+    std::filesystem::remove_all(nodesDir);
+
+    auto writeNode = [&nodesDir](const std::string& name,
+                                 const std::string& cpuList) {
+        std::filesystem::create_directories(nodesDir / name);
+        writeBytesToFile(nodesDir / name / "cpulist",
+                         std::vector<uint8_t>(cpuList.begin(), cpuList.end()));
+    };
+
+    std::vector<int> allCpus = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+    SECTION("No NUMA information")
+    {
+        CpuTopology topology = readCpuTopology(nodesDir, allCpus);
+        REQUIRE(topology.nodes.size() == 1);
+        REQUIRE(topology.nodes.at(0).id == 0);
+        REQUIRE(topology.nodes.at(0).cpus == allCpus);
+    }
+
+    SECTION("Two nodes")
+    {
+        writeNode("node1", "4-7\n");
+        writeNode("node0", "0-3\n");
+        writeNode("nodefoo", "8\n");
+        std::filesystem::create_directories(nodesDir / "power");
+
+        SECTION("All CPUs usable")
+        {
+            CpuTopology topology = readCpuTopology(nodesDir, allCpus);
+            REQUIRE(topology.nodes.size() == 2);
+            REQUIRE(topology.nodes.at(0).id == 0);
+            REQUIRE(topology.nodes.at(0).cpus ==
+                    std::vector<int>({ 0, 1, 2, 3 }));
+            REQUIRE(topology.nodes.at(1).id == 1);
+            REQUIRE(topology.nodes.at(1).cpus ==
+                    std::vector<int>({ 4, 5, 6, 7 }));
+
+            REQUIRE(topology.getNode(1) == &topology.nodes.at(1));
+            REQUIRE(topology.getNode(2) == nullptr);
+            REQUIRE(topology.getCpus() == allCpus);
+        }
+
+        SECTION("Some CPUs usable")
+        {
+            // Nodes without usable CPUs are left out
+            CpuTopology topology = readCpuTopology(nodesDir, { 1, 2 });
+            REQUIRE(topology.nodes.size() == 1);
+            REQUIRE(topology.nodes.at(0).id == 0);
+            REQUIRE(topology.nodes.at(0).cpus == std::vector<int>({ 1, 2 }));
+        }
+    }
+
+    std::filesystem::remove_all(nodesDir);
+}
+
+TEST_CASE("Test pinning threads to CPUs", "[util][numa]")
+{
+    const CpuTopology& topology = getCpuTopology();
+    REQUIRE(!topology.nodes.empty());
+    REQUIRE(topology.getCpus() == getAffinityCpus());
+
+    int cpu = topology.getCpus().back();
+    int actualCpu = -1;
+    std::thread t([cpu, &actualCpu] {
+        pinThreadToCpus({ cpu });
+        actualCpu = ::sched_getcpu();
+    });
+    t.join();
+
+    REQUIRE(actualCpu == cpu);
+}
+
+TEST_CASE("Test binding memory to NUMA nodes", "[util][numa]")
+{
+    int nodeId = getCpuTopology().nodes.at(0).id;
+
+    size_t memSize = 4 * HOST_PAGE_SIZE;
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+    std::fill(memView.begin(), memView.end(), 1);
+
+    // Binding is best-effort, so just check it leaves the memory intact,
+    // including partial pages
+    bindToNumaNode(memView, nodeId);
+    bindToNumaNode(memView.subspan(10, HOST_PAGE_SIZE), nodeId);
+
+    std::thread t([nodeId, &memView] {
+        setThreadNumaNode(nodeId);
+        memView[0] = 2;
+    });
+    t.join();
+
+    REQUIRE(memView[0] == 2);
+    REQUIRE(memView[memSize - 1] == 1);
+}
+}
@@ -58,4 +58,26 @@ TEST_CASE("Test periodic background operation", "[util]")
     // Check the count again
     REQUIRE(t.getWorkCount() == 2);
 }
+
+TEST_CASE("Test waking up periodic background thread", "[util]")
+{
+    // Long enough for the test to time out if the wake-up is missed
+    int intervalSeconds = 60;
+
+    auto b = Barrier::create(2);
+
+    DummyPeriodicThread t(b);
+    t.start(intervalSeconds);
+
+    // Give the thread time to start waiting
+    SLEEP_MS(100);
+    REQUIRE(t.getWorkCount() == 0);
+
+    t.wakeUp();
+    b->wait();
+    REQUIRE(t.getWorkCount() == 1);
+
+    t.stop();
+    REQUIRE(t.getWorkCount() == 1);
+}
 }
@@ -130,6 +130,18 @@ TEST_CASE("Test converting point-to-point mappings to scheduling decisions",
     REQUIRE(actual.groupIdxs == expectedGroupIdxs);
     REQUIRE(actual.messageIds == expectedMessageIds);
     REQUIRE(actual.hosts == expectedHosts);
+
+    // Check converting back gives the same mappings
+    faabric::PointToPointMappings roundTrip = actual.toPointToPointMappings();
+    REQUIRE(roundTrip.appid() == appId);
+    REQUIRE(roundTrip.groupid() == groupId);
+    REQUIRE(roundTrip.mappings_size() == 2);
+    for (int i = 0; i < 2; i++) {
+        REQUIRE(roundTrip.mappings(i).host() == expectedHosts.at(i));
+        REQUIRE(roundTrip.mappings(i).messageid() == expectedMessageIds.at(i));
+        REQUIRE(roundTrip.mappings(i).appidx() == expectedAppIdxs.at(i));
+        REQUIRE(roundTrip.mappings(i).groupidx() == expectedGroupIdxs.at(i));
+    }
 }
 
 TEST_CASE_METHOD(CachedDecisionTestFixture,
@@ -6,11 +6,16 @@
 #include <faabric/snapshot/SnapshotRegistry.h>
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
+#include <faabric/util/delta.h>
 #include <faabric/util/dirty.h>
+#include <faabric/util/environment.h>
 #include <faabric/util/macros.h>
 #include <faabric/util/memory.h>
 #include <faabric/util/snapshot.h>
 
+#include <mutex>
+#include <random>
+
 using namespace faabric::util;
 
 namespace tests {
@@ -162,12 +167,61 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     REQUIRE(actualSharedMemAfter == actualSnapMem);
 }
 
+TEST_CASE_METHOD(SnapshotMergeTestFixture,
+                 "Test restoring snapshots into huge TLB memory",
+                 "[snapshot][util]")
+{
+    conf.hugePagesMode = "explicit";
+    setTrackingMode("segfault");
+
+    // Uses host pages if no huge pages are reserved
+    size_t hugePageSize = getHugePageSize();
+    size_t memSize = 2 * hugePageSize;
+    auto snap = std::make_shared<SnapshotData>(memSize);
+
+    std::vector<uint8_t> data(300, 4);
+    snap->copyInData(data, hugePageSize + 2);
+    std::vector<uint8_t> expected = snap->getDataCopy();
+
+    MemoryRegion mem = allocatePrivateMemory(memSize);
+    std::span<uint8_t> memView(mem.get(), memSize);
+
+    snap->mapToMemory(memView);
+    REQUIRE(std::vector<uint8_t>(memView.begin(), memView.end()) == expected);
+
+    // Writes are tracked, and don't change the snapshot
+    auto tracker = getDirtyTracker();
+    tracker->clearAll();
+    tracker->startTracking(memView);
+    tracker->startThreadLocalTracking(memView);
+    memView[10] = 9;
+    tracker->stopTracking(memView);
+    tracker->stopThreadLocalTracking(memView);
+
+    REQUIRE(tracker->getBothDirtyPages(memView).isDirty(0));
+    REQUIRE(snap->getDataPtr(10)[0] == 0);
+
+    // Restoring again undoes the writes
+    snap->mapToMemory(memView);
+    REQUIRE(std::vector<uint8_t>(memView.begin(), memView.end()) == expected);
+}
+
 TEST_CASE_METHOD(SnapshotMergeTestFixture,
                  "Test mapping editing and remapping memory",
                  "[snapshot][util]")
 {
     SECTION("Soft PTEs") { setTrackingMode("softpte"); }
 
+    SECTION("Pagemap scan")
+    {
+        if (!PagemapScanDirtyTracker::isSupported()) {
+            WARN("PAGEMAP_SCAN unsupported, needs Linux 6.7 or later");
+            return;
+        }
+
+        setTrackingMode("pagemap-scan");
+    }
+
     SECTION("Segfaults") { setTrackingMode("segfault"); }
 
     int snapPages = 4;
@@ -478,7 +532,7 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     tracker->stopThreadLocalTracking(memView);
 
     auto dirtyRegions = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyRegions == expectedDirtyPages);
+    REQUIRE(dirtyRegions == DirtyPages(expectedDirtyPages));
 
     std::vector<SnapshotDiff> actualDiffs =
       snap->diffWithDirtyRegions(memView, dirtyRegions);
@@ -851,7 +905,7 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     tracker->stopThreadLocalTracking(memView);
 
     auto dirtyRegions = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyRegions == expectedDirtyPages);
+    REQUIRE(dirtyRegions == DirtyPages(expectedDirtyPages));
 
     std::vector<SnapshotDiff> actualDiffs =
       snap->diffWithDirtyRegions(memView, dirtyRegions);
@@ -1063,7 +1117,7 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     tracker->stopThreadLocalTracking(memView);
 
     auto dirtyRegions = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyRegions == expectedDirtyPages);
+    REQUIRE(dirtyRegions == DirtyPages(expectedDirtyPages));
 
     std::vector<SnapshotDiff> actualDiffs =
       snap->diffWithDirtyRegions(memView, dirtyRegions);
@@ -1354,7 +1408,7 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     tracker->stopThreadLocalTracking(memView);
 
     auto dirtyRegions = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyRegions == expectedDirtyPages);
+    REQUIRE(dirtyRegions == DirtyPages(expectedDirtyPages));
 
     std::vector<SnapshotDiff> actualDiffs =
       snap->diffWithDirtyRegions(memView, dirtyRegions);
@@ -1513,6 +1567,733 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
     checkDiffs(actualDiffs, expectedDiffs);
 }
 
+TEST_CASE_METHOD(SnapshotMergeTestFixture,
+                 "Test diffing typed array merge regions",
+                 "[snapshot][util]")
+{
+    // Large arrays spanning many pages, not aligned to a page boundary
+    int snapPages = 2 * DIFF_PARALLEL_MIN_DIRTY_PAGES;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+    uint32_t intOffset = 100;
+    size_t nInts = (100 * HOST_PAGE_SIZE) / sizeof(int);
+    uint32_t doubleOffset = 150 * HOST_PAGE_SIZE + 4;
+    size_t nDoubles = (300 * HOST_PAGE_SIZE) / sizeof(double);
+
+    std::vector<uint8_t> originalData(snapSize, 0);
+    std::vector<int> ints(nInts);
+    std::vector<double> doubles(nDoubles);
+    for (int i = 0; i < nInts; i++) {
+        ints.at(i) = i;
+    }
+    for (int i = 0; i < nDoubles; i++) {
+        doubles.at(i) = i * 0.5;
+    }
+    std::memcpy(originalData.data() + intOffset, ints.data(), nInts * 4);
+    std::memcpy(
+      originalData.data() + doubleOffset, doubles.data(), nDoubles * 8);
+
+    auto snap = std::make_shared<SnapshotData>(originalData);
+    snap->addMergeRegion(intOffset,
+                         nInts * sizeof(int),
+                         SnapshotDataType::Int,
+                         SnapshotMergeOperation::Sum);
+    snap->addMergeRegion(doubleOffset,
+                         nDoubles * sizeof(double),
+                         SnapshotDataType::Double,
+                         SnapshotMergeOperation::Max);
+
+    int nThreads = 1;
+    SECTION("Single thread") { nThreads = 1; }
+
+    SECTION("Multiple threads") { nThreads = 4; }
+
+    conf.diffThreads = nThreads;
+
+    // Change some runs of values, including ones straddling page boundaries
+    std::vector<int> updatedInts = ints;
+    std::vector<std::pair<size_t, size_t>> intRuns = {
+        { 0, 3 },
+        { HOST_PAGE_SIZE / sizeof(int) - 26, 4 },
+        { 5000, 1 },
+        { 5002, 100 },
+        { nInts - 1, 1 },
+    };
+    for (auto [start, count] : intRuns) {
+        for (size_t i = start; i < start + count; i++) {
+            updatedInts.at(i) += 7;
+        }
+    }
+
+    std::vector<double> updatedDoubles = doubles;
+    for (int i = 0; i < nDoubles; i += 500) {
+        updatedDoubles.at(i) += 1.5;
+    }
+
+    std::vector<uint8_t> updated = originalData;
+    std::memcpy(updated.data() + intOffset, updatedInts.data(), nInts * 4);
+    std::memcpy(
+      updated.data() + doubleOffset, updatedDoubles.data(), nDoubles * 8);
+
+    DirtyPages dirtyRegions(snapPages);
+    for (int p = 0; p < snapPages; p++) {
+        if (std::memcmp(originalData.data() + p * HOST_PAGE_SIZE,
+                        updated.data() + p * HOST_PAGE_SIZE,
+                        HOST_PAGE_SIZE) != 0) {
+            dirtyRegions.markDirty(p);
+        }
+    }
+
+    std::vector<SnapshotDiff> actualDiffs =
+      snap->diffWithDirtyRegions(updated, dirtyRegions);
+
+    // Expect one diff per run of changed values
+    std::vector<SnapshotDiff> expectedDiffs;
+    std::vector<std::vector<int>> expectedIntDiffs;
+    for (auto [start, count] : intRuns) {
+        expectedIntDiffs.emplace_back(count, 7);
+        expectedDiffs.emplace_back(
+          SnapshotDataType::Int,
+          SnapshotMergeOperation::Sum,
+          intOffset + start * sizeof(int),
+          std::span<const uint8_t>(BYTES(expectedIntDiffs.back().data()),
+                                   count * sizeof(int)));
+    }
+
+    for (int i = 0; i < nDoubles; i += 500) {
+        expectedDiffs.emplace_back(
+          SnapshotDataType::Double,
+          SnapshotMergeOperation::Max,
+          doubleOffset + i * sizeof(double),
+          std::span<const uint8_t>(BYTES(&updatedDoubles.at(i)),
+                                   sizeof(double)));
+    }
+
+    checkDiffs(actualDiffs, expectedDiffs);
+
+    // Apply the diffs to a snapshot with its own changes
+    std::vector<uint8_t> masterData = originalData;
+    int masterInt = 50;
+    std::memcpy(masterData.data() + intOffset + 5010 * sizeof(int),
+                &masterInt,
+                sizeof(int));
+    SnapshotData master(masterData);
+    master.queueDiffs(actualDiffs);
+    master.writeQueuedDiffs();
+
+    std::vector<uint8_t> masterAfter = master.getDataCopy();
+    std::vector<int> actualInts(nInts);
+    std::memcpy(actualInts.data(), masterAfter.data() + intOffset, nInts * 4);
+
+    std::vector<int> expectedInts = updatedInts;
+    expectedInts.at(5010) = masterInt + 7;
+    REQUIRE(actualInts == expectedInts);
+
+    std::vector<double> actualDoubles(nDoubles);
+    std::memcpy(
+      actualDoubles.data(), masterAfter.data() + doubleOffset, nDoubles * 8);
+    REQUIRE(actualDoubles == updatedDoubles);
+}
+
+TEST_CASE_METHOD(SnapshotMergeTestFixture,
+                 "Test diffing dirty regions in parallel",
+                 "[snapshot][util]")
+{
+    // Enough dirty pages to use multiple threads
+    int snapPages = 4 * DIFF_PARALLEL_MIN_DIRTY_PAGES;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+
+    SECTION("Bytewise") { conf.diffingMode = "bytewise"; }
+
+    SECTION("XOR") { conf.diffingMode = "xor"; }
+
+    std::vector<uint8_t> originalData(snapSize, 1);
+    auto snap = std::make_shared<SnapshotData>(originalData);
+
+    // Mix in some regions that aren't bytewise or XOR
+    uint32_t intOffset = (3 * HOST_PAGE_SIZE) + 8;
+    uint32_t doubleOffset = (100 * HOST_PAGE_SIZE) + 16;
+    snap->addMergeRegion(intOffset,
+                         sizeof(int),
+                         SnapshotDataType::Int,
+                         SnapshotMergeOperation::Sum);
+    snap->addMergeRegion(doubleOffset,
+                         sizeof(double),
+                         SnapshotDataType::Double,
+                         SnapshotMergeOperation::Max);
+    snap->fillGapsWithBytewiseRegions();
+
+    // Make random changes to most pages, as XOR diffs modify the updated data
+    // in place we need a fresh copy every time
+    DirtyPages dirtyRegions(snapPages);
+    auto doDiff = [&](int nThreads) {
+        conf.diffThreads = nThreads;
+
+        std::vector<uint8_t> updated = originalData;
+        std::mt19937 gen(1234);
+        for (int p = 0; p < snapPages; p++) {
+            if (gen() % 4 == 0) {
+                continue;
+            }
+
+            dirtyRegions.markDirty(p);
+            int nChanges = gen() % 20;
+            for (int i = 0; i < nChanges; i++) {
+                updated.at((p * HOST_PAGE_SIZE) + (gen() % HOST_PAGE_SIZE)) =
+                  2 + (gen() % 100);
+            }
+        }
+
+        int intValue = 5;
+        double doubleValue = 5.5;
+        std::memcpy(updated.data() + intOffset, &intValue, sizeof(int));
+        std::memcpy(
+          updated.data() + doubleOffset, &doubleValue, sizeof(double));
+
+        // Take a copy of the diffs, as they point into the updated data
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> diffs;
+        std::vector<SnapshotDiff> actual =
+          snap->diffWithDirtyRegions(updated, dirtyRegions);
+        for (const auto& diff : actual) {
+            diffs.emplace_back(diff.getOffset(), diff.getDataCopy());
+        }
+
+        return diffs;
+    };
+
+    auto expected = doDiff(1);
+    REQUIRE(!expected.empty());
+
+    // Diffs must be in offset order
+    for (int i = 1; i < expected.size(); i++) {
+        REQUIRE(expected.at(i - 1).first < expected.at(i).first);
+    }
+
+    for (int nThreads : { 2, 3, 8 }) {
+        REQUIRE(doDiff(nThreads) == expected);
+    }
+}
+
+TEST_CASE_METHOD(SnapshotMergeTestFixture,
+                 "Benchmark diffing dirty regions in parallel",
+                 "[.][benchmark]")
+{
+    // Diffs snapshots with changes on every other page, run with:
+    // faabric_tests "Benchmark diffing dirty regions in parallel"
+    // Small snapshots show the cost of handing out the work to threads
+    std::vector<int> threadCounts = { 1, 2, 4, 8 };
+    int nCores = getUsableCores();
+    if (nCores > 8) {
+        threadCounts.push_back(nCores);
+    }
+
+    // Bytewise diffing leaves the updated data as it is, so we can repeat it
+    conf.diffingMode = "bytewise";
+
+    for (size_t snapSizeMiB : { 4UL, 1024UL }) {
+        size_t snapSize = snapSizeMiB * 1024 * 1024;
+        int snapPages = snapSize / HOST_PAGE_SIZE;
+
+        auto snap = std::make_shared<SnapshotData>(snapSize);
+        snap->fillGapsWithBytewiseRegions();
+
+        MemoryRegion mem = allocatePrivateMemory(snapSize);
+        std::span<uint8_t> memView(mem.get(), snapSize);
+        snap->mapToMemory(memView);
+
+        DirtyPages dirtyRegions(snapPages);
+        for (int p = 0; p < snapPages; p += 2) {
+            mem.get()[(p * HOST_PAGE_SIZE) + 100] = 1;
+            dirtyRegions.markDirty(p);
+        }
+
+        for (int nThreads : threadCounts) {
+            conf.diffThreads = nThreads;
+            BENCHMARK(
+              fmt::format("{}MiB, {} threads", snapSizeMiB, nThreads))
+            {
+                return snap->diffWithDirtyRegions(memView, dirtyRegions)
+                  .size();
+            };
+        }
+    }
+}
+
+TEST_CASE_METHOD(SnapshotMergeTestFixture,
+                 "Test writing queued diffs",
+                 "[snapshot][util]")
+{
+    int snapPages = 512;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+
+    int nThreads = 1;
+    SECTION("Single thread") { nThreads = 1; }
+
+    SECTION("Multiple threads") { nThreads = 4; }
+
+    conf.diffThreads = nThreads;
+
+    // Generate lots of random, often overlapping, diffs of each kind. Bytes
+    // are kept small so that typed operations don't overflow.
+    std::mt19937 gen(4321);
+    std::vector<std::vector<uint8_t>> diffData;
+    std::vector<SnapshotDiff> diffs;
+    int nDiffs = 2 * WRITE_DIFFS_PARALLEL_MIN_DIFFS;
+    diffData.reserve(nDiffs);
+    for (int i = 0; i < nDiffs; i++) {
+        uint32_t offset = gen() % (snapSize - 512);
+        SnapshotDataType dataType = SnapshotDataType::Raw;
+        SnapshotMergeOperation op = SnapshotMergeOperation::Bytewise;
+        size_t length = 1 + (gen() % 300);
+
+        switch (gen() % 6) {
+            case 0: {
+                op = SnapshotMergeOperation::XOR;
+                break;
+            }
+            case 1: {
+                dataType = SnapshotDataType::Int;
+                op = SnapshotMergeOperation::Sum;
+                offset &= ~(sizeof(int32_t) - 1);
+                length = sizeof(int32_t);
+                break;
+            }
+            case 2: {
+                dataType = SnapshotDataType::Long;
+                op = SnapshotMergeOperation::Min;
+                offset &= ~(sizeof(long) - 1);
+                length = sizeof(long);
+                break;
+            }
+            case 3: {
+                // Runs of consecutive typed diffs
+                offset &= ~(sizeof(int32_t) - 1);
+                for (int j = 0; j < 8; j++) {
+                    diffData.emplace_back(sizeof(int32_t), gen() % 4);
+                    diffs.emplace_back(SnapshotDataType::Int,
+                                       SnapshotMergeOperation::Max,
+                                       offset + j * sizeof(int32_t),
+                                       diffData.back());
+                }
+                continue;
+            }
+            case 4: {
+                // Runs of bytewise diffs cut from one buffer, as received
+                // from another host
+                std::vector<uint8_t>& buffer = diffData.emplace_back(8 * 16);
+                for (auto& b : buffer) {
+                    b = gen() % 4;
+                }
+
+                for (int j = 0; j < 8; j++) {
+                    diffs.emplace_back(
+                      SnapshotDataType::Raw,
+                      SnapshotMergeOperation::Bytewise,
+                      offset + j * 16,
+                      std::span<const uint8_t>(buffer).subspan(j * 16, 16));
+                }
+                continue;
+            }
+            default: {
+                break;
+            }
+        }
+
+        diffData.emplace_back(length);
+        for (auto& b : diffData.back()) {
+            b = gen() % 4;
+        }
+        diffs.emplace_back(dataType, op, offset, diffData.back());
+    }
+
+    // Ignored diffs leave the data as it is
+    std::vector<uint8_t> ignoredData(100, 9);
+    diffs.emplace_back(SnapshotDataType::Raw,
+                       SnapshotMergeOperation::Ignore,
+                       0,
+                       ignoredData);
+
+    // Apply them one at a time to get the expected result
+    std::vector<uint8_t> originalData(snapSize, 1);
+    SnapshotData expectedSnap(originalData);
+    for (const auto& diff : diffs) {
+        expectedSnap.applyDiff(diff);
+    }
+    std::vector<uint8_t> expected = expectedSnap.getDataCopy();
+
+    SnapshotData snap(originalData);
+    snap.clearTrackedChanges();
+    snap.queueDiffs(diffs);
+    REQUIRE(snap.getQueuedDiffsCount() == diffs.size());
+    REQUIRE(snap.writeQueuedDiffs() == diffs.size());
+    REQUIRE(snap.getQueuedDiffsCount() == 0);
+
+    std::vector<uint8_t> actual = snap.getDataCopy();
+    REQUIRE(actual == expected);
+
+    // Tracked changes must cover every modified byte without overlapping
+    std::vector<SnapshotDiff> changes = snap.getTrackedChanges();
+    std::vector<uint8_t> tracked = originalData;
+    uint32_t lastEnd = 0;
+    for (const auto& change : changes) {
+        REQUIRE(change.getOffset() >= lastEnd);
+        lastEnd = change.getOffset() + change.getData().size();
+        std::copy(change.getData().begin(),
+                  change.getData().end(),
+                  tracked.begin() + change.getOffset());
+    }
+    REQUIRE(tracked == expected);
+}
+
+TEST_CASE("Test snapshot page hashes", "[snapshot][util]")
+{
+    // Three pages, the last partial, the first and second the same
+    size_t snapSize = (2 * HOST_PAGE_SIZE) + 100;
+    std::vector<uint8_t> data(snapSize, 1);
+    SnapshotData snap(data);
+
+    std::vector<SnapshotPageHash> hashes = snap.getPageHashes();
+    REQUIRE(hashes.size() == 3);
+    REQUIRE(hashes.at(0) == hashes.at(1));
+    REQUIRE(hashes.at(0) ==
+            hashSnapshotPage({ data.data(), (size_t)HOST_PAGE_SIZE }));
+    REQUIRE(hashes.at(2) ==
+            hashSnapshotPage({ data.data() + 2 * HOST_PAGE_SIZE, 100 }));
+    REQUIRE(hashes.at(2) != hashes.at(0));
+
+    // Hashes are updated when the snapshot changes
+    std::vector<uint8_t> update(10, 2);
+    snap.copyInData(update, HOST_PAGE_SIZE + 5);
+
+    std::vector<SnapshotPageHash> updatedHashes = snap.getPageHashes();
+    REQUIRE(updatedHashes.at(0) == hashes.at(0));
+    REQUIRE(updatedHashes.at(1) != hashes.at(1));
+    REQUIRE(updatedHashes.at(2) == hashes.at(2));
+}
+
+TEST_CASE("Test snapshot versions", "[snapshot][util]")
+{
+    std::vector<uint8_t> data(5 * HOST_PAGE_SIZE, 1);
+    SnapshotData snap(data);
+
+    // Initial data makes up the first version
+    REQUIRE(snap.getVersion() == 0);
+    REQUIRE(snap.commitVersion() == 1);
+    REQUIRE(snap.getTrackedChanges().empty());
+    REQUIRE(snap.getChangesSinceVersion(1).empty());
+
+    // Nothing to commit
+    REQUIRE(snap.commitVersion() == 1);
+
+    std::vector<uint8_t> dataA(10, 2);
+    std::vector<uint8_t> dataB(20, 3);
+    std::vector<uint8_t> dataC(HOST_PAGE_SIZE, 4);
+    snap.copyInData(dataA, 100);
+    snap.copyInData(dataB, 105);
+    REQUIRE(snap.commitVersion() == 2);
+
+    snap.copyInData(dataC, 2 * HOST_PAGE_SIZE);
+    REQUIRE(snap.commitVersion() == 3);
+    REQUIRE(snap.getVersion() == 3);
+
+    auto checkChanges = [&snap](uint64_t sinceVersion,
+                                std::vector<std::pair<uint32_t, size_t>>
+                                  expected) {
+        std::vector<SnapshotDiff> changes =
+          snap.getChangesSinceVersion(sinceVersion);
+        REQUIRE(changes.size() == expected.size());
+
+        for (int i = 0; i < changes.size(); i++) {
+            REQUIRE(changes.at(i).getOffset() == expected.at(i).first);
+            REQUIRE(changes.at(i).getData().size() == expected.at(i).second);
+            REQUIRE(changes.at(i).getDataCopy() ==
+                    snap.getDataCopy(expected.at(i).first,
+                                     expected.at(i).second));
+        }
+    };
+
+    // Overlapping changes are merged
+    checkChanges(1, { { 100, 25 }, { 2 * HOST_PAGE_SIZE, HOST_PAGE_SIZE } });
+    checkChanges(2, { { 2 * HOST_PAGE_SIZE, HOST_PAGE_SIZE } });
+    checkChanges(3, {});
+
+    // Changes across all versions
+    checkChanges(0, { { 0, 5 * HOST_PAGE_SIZE } });
+
+    // Pruned versions can no longer be synced from
+    snap.pruneVersions(2);
+    REQUIRE_THROWS(snap.getChangesSinceVersion(1));
+    checkChanges(2, { { 2 * HOST_PAGE_SIZE, HOST_PAGE_SIZE } });
+
+    // Uncommitted changes aren't included
+    snap.copyInData(dataA, 0);
+    checkChanges(3, {});
+    REQUIRE(snap.getTrackedChanges().size() == 1);
+}
+
+TEST_CASE("Test reading committed snapshot versions", "[snapshot][util]")
+{
+    std::vector<uint8_t> dataV1(4 * HOST_PAGE_SIZE, 1);
+    SnapshotData snap(dataV1);
+    REQUIRE(snap.commitVersion() == 1);
+
+    // Change spanning the first two pages
+    std::vector<uint8_t> update(HOST_PAGE_SIZE, 2);
+    snap.copyInData(update, HOST_PAGE_SIZE / 2);
+    REQUIRE(snap.commitVersion() == 2);
+    std::vector<uint8_t> dataV2 = snap.getDataCopy();
+
+    // Start building the next version over the same pages and another one
+    std::vector<uint8_t> pending(100, 3);
+    snap.copyInData(pending, HOST_PAGE_SIZE - 50);
+    snap.copyInData(pending, 3 * HOST_PAGE_SIZE);
+    std::vector<uint8_t> dataV3 = snap.getDataCopy();
+
+    // Committed versions are unaffected
+    REQUIRE(snap.getVersionDataCopy(1) == dataV1);
+    REQUIRE(snap.getVersionDataCopy(2) == dataV2);
+    REQUIRE(dataV3 != dataV2);
+
+    // Syncing a host holding the first version gets it to the second
+    std::vector<uint8_t> synced = dataV1;
+    for (const auto& diff : snap.getChangesSinceVersion(1)) {
+        std::copy(diff.getData().begin(),
+                  diff.getData().end(),
+                  synced.begin() + diff.getOffset());
+    }
+    REQUIRE(synced == dataV2);
+
+    // Versions can be restored
+    MemoryRegion mem = allocatePrivateMemory(dataV1.size());
+    std::span<uint8_t> memView(mem.get(), dataV1.size());
+    snap.mapVersionToMemory(memView, 1);
+    REQUIRE(std::vector<uint8_t>(memView.begin(), memView.end()) == dataV1);
+
+    snap.mapCommittedToMemory(memView);
+    REQUIRE(std::vector<uint8_t>(memView.begin(), memView.end()) == dataV2);
+
+    // Once committed, the new version is readable too
+    REQUIRE_THROWS(snap.getVersionDataCopy(3));
+    REQUIRE(snap.commitVersion() == 3);
+    REQUIRE(snap.getVersionDataCopy(3) == dataV3);
+    REQUIRE(snap.getVersionDataCopy(1) == dataV1);
+
+    // Pruning keeps the given version
+    snap.pruneVersions(2);
+    REQUIRE_THROWS(snap.getVersionDataCopy(1));
+    REQUIRE(snap.getVersionDataCopy(2) == dataV2);
+    REQUIRE(snap.getVersionDataCopy(3) == dataV3);
+}
+
+TEST_CASE("Test copying compressed data into snapshot", "[snapshot][util]")
+{
+    int snapPages = 6;
+    SnapshotData snap(snapPages * HOST_PAGE_SIZE);
+
+    // Two separate regions, compressed as one frame
+    std::vector<uint8_t> dataA(HOST_PAGE_SIZE, 5);
+    std::vector<uint8_t> dataB(100, 6);
+    dataA.at(10) = 1;
+
+    std::vector<std::span<const uint8_t>> srcs = { dataA, dataB };
+    std::vector<uint8_t> compressed(
+      zstdCompressBound(dataA.size() + dataB.size()));
+    compressed.resize(zstdCompress(srcs, compressed, 1));
+
+    uint32_t offsetA = 3 * HOST_PAGE_SIZE;
+    uint32_t offsetB = HOST_PAGE_SIZE + 20;
+
+    SECTION("Valid regions")
+    {
+        snap.copyInCompressedData(
+          compressed, { { offsetA, dataA.size() }, { offsetB, dataB.size() } });
+
+        std::vector<uint8_t> expected(snapPages * HOST_PAGE_SIZE, 0);
+        std::copy(dataA.begin(), dataA.end(), expected.begin() + offsetA);
+        std::copy(dataB.begin(), dataB.end(), expected.begin() + offsetB);
+        REQUIRE(snap.getDataCopy() == expected);
+
+        // Changes are tracked as if the data had been copied in
+        std::vector<SnapshotDiff> changes = snap.getTrackedChanges();
+        REQUIRE(changes.size() == 2);
+        REQUIRE(changes.at(0).getOffset() == offsetA);
+        REQUIRE(changes.at(0).getData().size() == dataA.size());
+        REQUIRE(changes.at(1).getOffset() == offsetB);
+        REQUIRE(changes.at(1).getData().size() == dataB.size());
+    }
+
+    SECTION("Regions don't match data")
+    {
+        REQUIRE_THROWS(
+          snap.copyInCompressedData(compressed, { { offsetA, dataA.size() } }));
+    }
+
+    SECTION("Region past end of snapshot")
+    {
+        uint32_t pastEnd = (snapPages * HOST_PAGE_SIZE) - 10;
+        REQUIRE_THROWS(snap.copyInCompressedData(
+          compressed,
+          { { offsetA, dataA.size() }, { pastEnd, dataB.size() } }));
+    }
+}
+
+TEST_CASE("Test fetching missing pages of lazy snapshot", "[snapshot][util]")
+{
+    size_t snapSize = (6 * HOST_PAGE_SIZE) + 100;
+    std::vector<uint8_t> expected(snapSize);
+    for (size_t i = 0; i < snapSize; i++) {
+        expected.at(i) = (i / HOST_PAGE_SIZE) + 1;
+    }
+
+    std::vector<std::pair<uint32_t, size_t>> fetches;
+    SnapshotData snap(snapSize);
+    snap.setLazyPageFetcher([&](uint32_t offset, std::span<uint8_t> buffer) {
+        fetches.emplace_back(offset, buffer.size());
+        std::copy_n(expected.begin() + offset, buffer.size(), buffer.begin());
+    });
+    REQUIRE(snap.getMissingPageCount() == 7);
+
+    // Reads fetch only the pages they touch
+    std::vector<uint8_t> actualChunk = snap.getDataCopy(2 * HOST_PAGE_SIZE, 10);
+    REQUIRE(actualChunk == std::vector<uint8_t>(10, 3));
+    REQUIRE(snap.getMissingPageCount() == 6);
+
+    // Writes fetch the page before changing part of it
+    std::vector<uint8_t> update(10, 9);
+    uint32_t updateOffset = (4 * HOST_PAGE_SIZE) + 20;
+    snap.copyInData(update, updateOffset);
+    std::copy(update.begin(), update.end(), expected.begin() + updateOffset);
+
+    // As do diffs with merge operations
+    int sumValue = 5;
+    uint32_t sumOffset = 5 * HOST_PAGE_SIZE;
+    snap.applyDiff(SnapshotDiff(SnapshotDataType::Int,
+                                SnapshotMergeOperation::Sum,
+                                sumOffset,
+                                { BYTES(&sumValue), sizeof(int) }));
+    int expectedSum = unalignedRead<int>(expected.data() + sumOffset) + 5;
+    unalignedWrite<int>(expectedSum, expected.data() + sumOffset);
+    REQUIRE(snap.getMissingPageCount() == 4);
+
+    // Runs of missing pages are fetched together, up to the end
+    REQUIRE(snap.getDataCopy() == expected);
+    REQUIRE(snap.getMissingPageCount() == 0);
+
+    std::vector<std::pair<uint32_t, size_t>> expectedFetches = {
+        { 2 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+        { 4 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+        { 5 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+        { 0, 2 * HOST_PAGE_SIZE },
+        { 3 * HOST_PAGE_SIZE, HOST_PAGE_SIZE },
+        { 6 * HOST_PAGE_SIZE, 100 },
+    };
+    REQUIRE(fetches == expectedFetches);
+
+    // Nothing more to fetch
+    snap.getPageHashes();
+    REQUIRE(fetches.size() == expectedFetches.size());
+}
+
+TEST_CASE("Test mapping lazy snapshot to memory", "[snapshot][util]")
+{
+    int snapPages = 8;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+    std::vector<uint8_t> expected(snapSize);
+    for (size_t i = 0; i < snapSize; i++) {
+        expected.at(i) = (i / HOST_PAGE_SIZE) + 1;
+    }
+
+    // Faults are handled on another thread
+    std::mutex fetchesMx;
+    std::vector<std::pair<uint32_t, size_t>> fetches;
+    auto fetcher = [&](uint32_t offset, std::span<uint8_t> buffer) {
+        std::lock_guard<std::mutex> lock(fetchesMx);
+        fetches.emplace_back(offset, buffer.size());
+        std::copy_n(expected.begin() + offset, buffer.size(), buffer.begin());
+    };
+
+    MemoryRegion mem = allocatePrivateMemory(snapSize);
+    size_t regionsBefore = getLazyPageHandler().getRegionCount();
+
+    {
+        auto snap = std::make_shared<SnapshotData>(snapSize);
+        snap->setLazyPageFetcher(fetcher);
+
+        snap->mapToMemoryLazily({ mem.get(), snapSize }, 1);
+        REQUIRE(fetches.empty());
+
+        // Accessing memory fetches the page and the one after it
+        REQUIRE(mem.get()[(2 * HOST_PAGE_SIZE) + 3] == 3);
+        mem.get()[6 * HOST_PAGE_SIZE] = 20;
+
+        std::vector<std::pair<uint32_t, size_t>> expectedFetches = {
+            { 2 * HOST_PAGE_SIZE, 2 * HOST_PAGE_SIZE },
+            { 6 * HOST_PAGE_SIZE, 2 * HOST_PAGE_SIZE },
+        };
+        REQUIRE(fetches == expectedFetches);
+        REQUIRE(snap->getMissingPageCount() == 4);
+
+        // Writes to the memory don't change the snapshot
+        REQUIRE(snap->getDataCopy(6 * HOST_PAGE_SIZE, 1).at(0) == 7);
+
+        // Pages already in the snapshot aren't fetched again
+        REQUIRE(snap->getDataCopy() == expected);
+        REQUIRE(fetches.size() == 4);
+        REQUIRE(mem.get()[5 * HOST_PAGE_SIZE] == 6);
+        REQUIRE(fetches.size() == 4);
+
+        expected.at(6 * HOST_PAGE_SIZE) = 20;
+        std::vector<uint8_t> actual(mem.get(), mem.get() + snapSize);
+        REQUIRE(actual == expected);
+    }
+
+    // Removing the snapshot stops it being used for the memory
+    REQUIRE(getLazyPageHandler().getRegionCount() == regionsBefore);
+}
+
+TEST_CASE("Test lazily mapping committed snapshot version", "[snapshot][util]")
+{
+    int snapPages = 4;
+    size_t snapSize = snapPages * HOST_PAGE_SIZE;
+    std::vector<uint8_t> original(snapSize);
+    for (size_t i = 0; i < snapSize; i++) {
+        original.at(i) = (i / HOST_PAGE_SIZE) + 1;
+    }
+
+    auto snap = std::make_shared<SnapshotData>(snapSize);
+    snap->setLazyPageFetcher([&](uint32_t offset, std::span<uint8_t> buffer) {
+        std::copy_n(original.begin() + offset, buffer.size(), buffer.begin());
+    });
+
+    // Commit a change to one page
+    std::vector<uint8_t> committed = original;
+    std::vector<uint8_t> dataA(100, 9);
+    snap->copyInData(dataA, HOST_PAGE_SIZE + 10);
+    std::copy(
+      dataA.begin(), dataA.end(), committed.begin() + HOST_PAGE_SIZE + 10);
+    REQUIRE(snap->commitVersion() == 1);
+
+    // Write diffs over that page and a missing one after the commit
+    std::vector<uint8_t> dataB(HOST_PAGE_SIZE, 7);
+    std::vector<uint8_t> latest = committed;
+    snap->queueDiffs({ SnapshotDiff(SnapshotDataType::Raw,
+                                    SnapshotMergeOperation::Bytewise,
+                                    HOST_PAGE_SIZE + 50,
+                                    dataB) });
+    snap->writeQueuedDiffs();
+    std::copy(dataB.begin(), dataB.end(), latest.begin() + HOST_PAGE_SIZE + 50);
+    REQUIRE(snap->getMissingPageCount() > 0);
+
+    MemoryRegion memA = allocatePrivateMemory(snapSize);
+    MemoryRegion memB = allocatePrivateMemory(snapSize);
+    snap->mapToMemoryLazily({ memA.get(), snapSize }, 0, true);
+    snap->mapToMemoryLazily({ memB.get(), snapSize }, 0);
+
+    // Only the committed version is seen when asked for
+    REQUIRE(std::vector<uint8_t>(memA.get(), memA.get() + snapSize) ==
+            committed);
+    REQUIRE(std::vector<uint8_t>(memB.get(), memB.get() + snapSize) == latest);
+}
+
 TEST_CASE("Test snapshot data constructors", "[snapshot][util]")
 {
     std::vector<uint8_t> data(2 * HOST_PAGE_SIZE, 3);
@@ -1846,6 +2627,156 @@ TEST_CASE("Test diffing byte array regions", "[util][snapshot]")
     }
 }
 
+TEST_CASE("Test diffing byte array regions with merge gap", "[util][snapshot]")
+{
+    size_t arraySize = 4 * ARRAY_COMP_CHUNK_SIZE;
+    std::vector<uint8_t> a(arraySize, 1);
+    std::vector<uint8_t> b(arraySize, 1);
+
+    // Three changes, the first two close together, the third further away
+    b[10] = 2;
+    b[11] = 2;
+    b[20] = 2;
+    b[200] = 2;
+
+    uint32_t mergeGap = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> expected;
+
+    SECTION("No merging")
+    {
+        mergeGap = 0;
+        expected = { { 10, 2 }, { 20, 1 }, { 200, 1 } };
+    }
+
+    SECTION("Gap too small")
+    {
+        mergeGap = 7;
+        expected = { { 10, 2 }, { 20, 1 }, { 200, 1 } };
+    }
+
+    SECTION("Merge nearby")
+    {
+        mergeGap = 8;
+        expected = { { 10, 11 }, { 200, 1 } };
+    }
+
+    SECTION("Merge all")
+    {
+        mergeGap = 1000;
+        expected = { { 10, 191 } };
+    }
+
+    std::vector<SnapshotDiff> actual;
+    diffArrayRegions(actual, 0, arraySize, a, b, mergeGap);
+
+    REQUIRE(actual.size() == expected.size());
+    for (int i = 0; i < actual.size(); i++) {
+        REQUIRE(actual.at(i).getOffset() == expected.at(i).first);
+        REQUIRE(actual.at(i).getData().size() == expected.at(i).second);
+
+        // Merged diffs carry the updated data, gaps included
+        std::vector<uint8_t> expectedData(
+          b.begin() + expected.at(i).first,
+          b.begin() + expected.at(i).first + expected.at(i).second);
+        REQUIRE(actual.at(i).getDataCopy() == expectedData);
+    }
+}
+
+TEST_CASE("Test diffing byte array regions against bytewise comparison",
+          "[util][snapshot]")
+{
+    // Random changes over arrays and ranges of awkward sizes, to exercise the
+    // edges of the chunks and blocks
+    std::mt19937 gen(1234);
+    for (int t = 0; t < 200; t++) {
+        size_t arraySize = 1 + (gen() % (10 * ARRAY_COMP_CHUNK_SIZE));
+        std::vector<uint8_t> a(arraySize, 0);
+        std::vector<uint8_t> b(arraySize, 0);
+        for (size_t i = 0; i < arraySize; i++) {
+            if (gen() % 20 == 0) {
+                b[i] = 1;
+            }
+        }
+
+        uint32_t startOffset = gen() % arraySize;
+        uint32_t endOffset =
+          startOffset + (gen() % (arraySize - startOffset + 1));
+
+        std::vector<std::pair<uint32_t, uint32_t>> expected;
+        bool inRun = false;
+        for (uint32_t i = startOffset; i < endOffset; i++) {
+            if (a[i] != b[i] && !inRun) {
+                inRun = true;
+                expected.emplace_back(i, 0);
+            } else if (a[i] == b[i] && inRun) {
+                inRun = false;
+                expected.back().second = i - expected.back().first;
+            }
+        }
+        if (inRun) {
+            expected.back().second = endOffset - expected.back().first;
+        }
+
+        std::vector<SnapshotDiff> actual;
+        diffArrayRegions(actual, startOffset, endOffset, a, b);
+
+        REQUIRE(actual.size() == expected.size());
+        for (int i = 0; i < actual.size(); i++) {
+            REQUIRE(actual.at(i).getOffset() == expected.at(i).first);
+            REQUIRE(actual.at(i).getData().size() == expected.at(i).second);
+        }
+    }
+}
+
+TEST_CASE("Benchmark diffing byte array regions", "[.][benchmark]")
+{
+    // Diffs a 64MiB array with different patterns of changes, run with:
+    // faabric_tests "[benchmark]"
+    size_t arraySize = 64 * 1024 * 1024;
+    std::vector<uint8_t> a(arraySize, 0);
+    std::vector<uint8_t> b(arraySize, 0);
+
+    std::mt19937 gen(1234);
+
+    std::string pattern;
+    SECTION("Sparse")
+    {
+        // One changed byte every few pages
+        pattern = "sparse";
+        for (size_t i = 0; i < arraySize; i += 3 * HOST_PAGE_SIZE) {
+            b[i + (gen() % HOST_PAGE_SIZE)] = 1;
+        }
+    }
+
+    SECTION("Clustered")
+    {
+        // Runs of 64 bytes in a quarter of pages
+        pattern = "clustered";
+        for (size_t p = 0; p < arraySize; p += 4 * HOST_PAGE_SIZE) {
+            size_t offset = p + (gen() % (HOST_PAGE_SIZE - 64));
+            std::fill_n(b.begin() + offset, 64, 1);
+        }
+    }
+
+    SECTION("Dense")
+    {
+        // Every fourth byte changed, e.g. an updated array of ints
+        pattern = "dense";
+        for (size_t i = 0; i < arraySize; i += 4) {
+            b[i] = 1;
+        }
+    }
+
+    for (uint32_t mergeGap : { 0, 16 }) {
+        BENCHMARK(fmt::format("{} (64MiB, gap {})", pattern, mergeGap))
+        {
+            std::vector<SnapshotDiff> diffs;
+            diffArrayRegions(diffs, 0, arraySize, a, b, mergeGap);
+            return diffs.size();
+        };
+    }
+}
+
 TEST_CASE("Test snapshot merge region equality", "[snapshot][util]")
 {
     SECTION("Equal")
@@ -1947,8 +2878,8 @@ TEST_CASE_METHOD(SnapshotMergeTestFixture,
 
     // Get diffs
     std::vector<char> expectedDirtyPages(snapPages, 1);
-    std::vector<char> dirtyPages = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyPages == expectedDirtyPages);
+    DirtyPages dirtyPages = tracker->getBothDirtyPages(memView);
+    REQUIRE(dirtyPages == DirtyPages(expectedDirtyPages));
 
     // Diff with snapshot
     snap->fillGapsWithBytewiseRegions();
@@ -2058,8 +2989,8 @@ TEST_CASE_METHOD(DirtyTrackingTestFixture, "Test XOR diffs", "[util][snapshot]")
     tracker->stopThreadLocalTracking(memView);
 
     // Get diffs
-    std::vector<char> dirtyPages = tracker->getBothDirtyPages(memView);
-    REQUIRE(dirtyPages == expectedDirtyPages);
+    DirtyPages dirtyPages = tracker->getBothDirtyPages(memView);
+    REQUIRE(dirtyPages == DirtyPages(expectedDirtyPages));
 
     // Diff with snapshot
     std::vector<faabric::util::SnapshotDiff> actual =
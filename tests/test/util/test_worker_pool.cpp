@@ -0,0 +1,109 @@
+#include <catch2/catch.hpp>
+
+#include "faabric_utils.h"
+
+#include <faabric/util/WorkerPool.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+using namespace faabric::util;
+
+namespace tests {
+
+TEST_CASE("Test running work on a worker pool", "[util]")
+{
+    WorkerPool pool;
+    REQUIRE(pool.getThreadCount() == 0);
+
+    int nTasks = 1000;
+    std::vector<int> done(nTasks, 0);
+    std::atomic<int> nextTask = 0;
+
+    std::mutex threadsMx;
+    std::set<std::thread::id> threads;
+
+    auto work = [&]() {
+        for (int t = nextTask++; t < nTasks; t = nextTask++) {
+            done.at(t)++;
+
+            std::unique_lock<std::mutex> lock(threadsMx);
+            threads.insert(std::this_thread::get_id());
+        }
+    };
+
+    SECTION("Caller only")
+    {
+        pool.run(1, work);
+        REQUIRE(pool.getThreadCount() == 0);
+        REQUIRE(threads.size() == 1);
+        REQUIRE(threads.count(std::this_thread::get_id()) == 1);
+    }
+
+    SECTION("With workers")
+    {
+        pool.run(4, work);
+        REQUIRE(pool.getThreadCount() == 3);
+
+        // Workers are kept and reused
+        nextTask = 0;
+        std::fill(done.begin(), done.end(), 0);
+        pool.run(3, work);
+        REQUIRE(pool.getThreadCount() == 3);
+    }
+
+    // Every task is done exactly once
+    REQUIRE(std::all_of(done.begin(), done.end(), [](int d) { return d == 1; }));
+}
+
+TEST_CASE("Test worker pool runs concurrent callers", "[util]")
+{
+    WorkerPool pool;
+
+    int nCallers = 4;
+    int nTasks = 200;
+    std::vector<std::atomic<int>> nDone(nCallers);
+
+    std::vector<std::jthread> callers;
+    for (int c = 0; c < nCallers; c++) {
+        callers.emplace_back([&pool, &nDone, c, nTasks] {
+            std::atomic<int> nextTask = 0;
+            pool.run(3, [&] {
+                while (nextTask++ < nTasks) {
+                    nDone.at(c)++;
+                }
+            });
+        });
+    }
+
+    for (auto& t : callers) {
+        t.join();
+    }
+
+    for (auto& n : nDone) {
+        REQUIRE(n == nTasks);
+    }
+
+    REQUIRE(pool.getThreadCount() == 2);
+}
+
+TEST_CASE("Test worker pool rethrows errors", "[util]")
+{
+    WorkerPool pool;
+
+    std::atomic<int> nCalls = 0;
+    auto work = [&nCalls]() {
+        nCalls++;
+        throw std::runtime_error("Work failed");
+    };
+
+    REQUIRE_THROWS_AS(pool.run(2, work), std::runtime_error);
+    REQUIRE(nCalls >= 1);
+
+    // The pool is still usable afterwards
+    std::atomic<int> nRuns = 0;
+    pool.run(2, [&nRuns] { nRuns++; });
+    REQUIRE(nRuns >= 1);
+}
+}
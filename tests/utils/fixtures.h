@@ -404,6 +404,8 @@ class TestExecutor final : public faabric::scheduler::Executor
 
     size_t getMaxMemorySize() override;
 
+    std::string getZygoteVersion() override;
+
     int32_t executeTask(
       int threadPoolIdx,
       int msgIdx,